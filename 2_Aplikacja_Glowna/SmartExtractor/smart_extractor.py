@@ -1,7 +1,7 @@
 import re
 import logging
 from datetime import datetime
-from typing import Any, Dict
+from typing import Any, Dict, Optional
 
 try:
     import spacy
@@ -121,9 +121,10 @@ class SmartExtractor:
             re.compile(r"(?:subject|regarding|re)[:\s]+([^\n\.]{5,100})", re.IGNORECASE),
         ]
         
-    def _find_document_type(self, text: str) -> str:
-        """Return document type based on keywords."""
-        text_lower = text.lower()
+    def _find_document_type(self, text: str, text_lower: Optional[str] = None) -> str:
+        """Return document type based on keywords."""
+        if text_lower is None:
+            text_lower = text.lower()
         # Sprawdź pierwsze 500 znaków (nagłówek dokumentu)
         header = text_lower[:500] if len(text_lower) > 500 else text_lower
         
@@ -204,8 +205,13 @@ class SmartExtractor:
         
         return ""
     
-    def _extract_subject(self, text: str) -> str:
-        """Extract the subject of the document."""
+    def _extract_subject(self, text: str, doc_type: Optional[str] = None) -> str:
+        """Extract the subject of the document.
+
+        Args:
+            text: Document text.
+            doc_type: Already detected document type; detected here when ``None``.
+        """
         for pattern in self.subject_patterns:
             match = pattern.search(text)
             if match:
@@ -213,8 +219,10 @@ class SmartExtractor:
                 return subject[:100]  # Ogranicz długość
         
         # Jeśli nie znaleziono tematu, spróbuj znaleźć treść po tytule dokumentu
-        if self._find_document_type(text):
-            doc_type = self._find_document_type(text).lower()
+        if doc_type is None:
+            doc_type = self._find_document_type(text)
+        if doc_type:
+            doc_type = doc_type.lower()
             pattern = rf'{doc_type}[:\s]+([^\n\.]{10,100})'
             match = re.search(pattern, text, re.IGNORECASE)
             if match:
@@ -222,11 +230,13 @@ class SmartExtractor:
                 
         return ""
     
-    def extract_info(self, text: str) -> Dict[str, str]:
+    def extract_info(self, text: str, analysis: Any = None) -> Dict[str, str]:
         """Extract all relevant metadata from ``text``.
 
         Args:
             text: Document text to analyse.
+            analysis: Optional ``DocumentAnalysis`` of ``text``; its lowercased
+                text and NER entities are reused instead of being recomputed.
 
         Returns:
             Dictionary with extracted information.
@@ -246,7 +256,9 @@ class SmartExtractor:
             date = self._extract_date(text)
 
             # Znajdź typ dokumentu
-            doc_type = self._find_document_type(text)
+            doc_type = self._find_document_type(
+                text, analysis.lower if analysis is not None else None
+            )
 
             # Znajdź numer dokumentu
             doc_number = self._extract_document_number(text)
@@ -255,15 +267,20 @@ class SmartExtractor:
             sender_recipient = self._extract_sender_recipient(text)
 
             # Znajdź temat (w sprawie)
-            subject = self._extract_subject(text)
+            subject = self._extract_subject(text, doc_type)
 
             # Fallback do modelu NER jeśli pewne pola są puste
-            if self.nlp:
+            entities = None
+            if analysis is not None and analysis.nlp_model is not None:
+                # Dokument spaCy policzony już na etapie NER
+                entities = analysis.entities
+            elif self.nlp:
                 doc = self.nlp(text)
                 entities = {ent.label_.upper(): [] for ent in doc.ents}
                 for ent in doc.ents:
                     entities[ent.label_.upper()].append(ent.text.replace("\n", " ").strip())
 
+            if entities is not None:
                 if not date:
                     date = " ".join(entities.get("DATA", []))
                 if not sender_recipient:
@@ -1,3 +1,5 @@
+import multiprocessing
+
 from logging_config import setup_logging
 from gui.pdf_processor_app import PdfProcessorApp
 from gui.qt_safe import QtWidgets, QT_AVAILABLE
@@ -5,6 +7,8 @@ from config import load_settings
 from app_session_manager import SessionManager
 
 if __name__ == "__main__":
+    # Wymagane przez procesy robocze NER (nlp.pipe) w wersji .exe
+    multiprocessing.freeze_support()
     setup_logging()
     if not QT_AVAILABLE:
         raise RuntimeError(
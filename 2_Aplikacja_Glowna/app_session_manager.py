@@ -4,7 +4,10 @@ import base64
 import hashlib
 import datetime
 import getpass
-from typing import Any, Dict, List, Optional, Tuple
+import itertools
+import logging
+import struct
+from typing import Any, Dict, Iterator, List, Optional, Tuple
 
 try:  # pragma: no cover - allow running as package or module
     from .gui.qt_safe import QtWidgets, QtCore
@@ -13,10 +16,27 @@ except Exception:  # pragma: no cover - fallback for top-level imports
     from gui.qt_safe import QtWidgets, QtCore
     from gui.constants import DOC_TYPE_LABELS
 
-from cryptography.fernet import Fernet
+from cryptography.fernet import Fernet, InvalidToken
 import uuid
 import sys
 
+logger = logging.getLogger(__name__)
+
+# Nagłówki plików sesji: V1 to jeden zaszyfrowany blob JSON, V2 to ciąg
+# rekordów [długość: 4 bajty big-endian][token Fernet] z danymi JSON:
+#   {"t": "meta", ...}          ustawienia sesji (ostatni rekord wygrywa)
+#   {"t": "row", "row": i, ...} zawartość wiersza i
+#   {"t": "rows", "count": n}   obcięcie tabeli do n wierszy
+SESSION_HEADER_V1 = b'ARCHIWIZATOR_SESSION_V1'
+SESSION_HEADER_V2 = b'ARCHIWIZATOR_SESSION_V2'
+# Kompakcja, gdy nadmiarowych rekordów jest więcej niż wierszy (min. tyle)
+COMPACT_MIN_RECORDS = 256
+
+
+class _WrongKey(Exception):
+    """Raised when session records cannot be decrypted with the given key."""
+
+
 class SessionManager:
     """Klasa obsługująca zapisywanie i wczytywanie sesji pracy z aplikacją."""
     
@@ -43,6 +63,12 @@ class SessionManager:
         self.counters: dict[str, int] = {}
         # osobny licznik dla dokumentów SA
         self.sa_counters: dict[str, int] = {}
+        # Stan ostatniego zapisu/odczytu, na podstawie którego dopisywane są zmiany
+        self._session_cipher: Optional[Fernet] = None
+        self._saved_rows: Optional[List[Tuple[str, Tuple[str, ...]]]] = None
+        self._saved_meta: Optional[Dict[str, Any]] = None
+        self._log_records = 0
+        self._valid_end = 0
         
         # Klucz szyfrowania generowany na podstawie identyfikatora maszyny i użytkownika
         self._generate_encryption_key()
@@ -63,41 +89,37 @@ class SessionManager:
         self.key = base64.urlsafe_b64encode(key_hash)
         self.cipher = Fernet(self.key)
     
-    def save_session(self, path: Optional[str] = None, password: Optional[str] = None) -> str:
-        """Persist the current session to disk.
-
-        Args:
-            path: Optional path for the session file. Generated automatically
-                when omitted.
-            password: Optional password for additional encryption.
+    def _cipher_for(self, password: Optional[str]) -> Fernet:
+        """Return the cipher for ``password`` or the machine key."""
+        if not password:
+            return self.cipher
+        password_hash = hashlib.sha256(password.encode()).digest()[:16]
+        extra_key = base64.urlsafe_b64encode(password_hash + password_hash)
+        return Fernet(extra_key)
 
-        Returns:
-            Path to the saved session file.
-        """
-        if not path:
-            # Automatyczna generacja nazwy pliku z datą i ID sesji
-            timestamp = datetime.datetime.now().strftime("%Y%m%d_%H%M%S")
-            filename = f"archiwizator_sesja_{timestamp}.arch"
-            path = os.path.join(self.session_folder, filename)
-        
-        # Przygotowanie danych sesji
-        session_data = {
+    def _session_meta(self) -> Dict[str, Any]:
+        """Session-level state stored in the ``meta`` record."""
+        meta = {
             'session_id': self.session_id,
-            'timestamp': datetime.datetime.now().isoformat(),
             'user': getpass.getuser(),
             'work_mode': self.app.work_mode,
             'input_dir': self.app.input_dir,
             'output_dir': self.app.output_dir,
             'case_signature': self.app.case_signature,
-            'files_data': [],
             'current_row': -1,
             'pdf_path': getattr(self.app, '_current_pdf_path', ''),
-            'counters': self.counters,
-            'sa_counters': self.sa_counters,
+            'counters': dict(self.counters),
+            'sa_counters': dict(self.sa_counters),
         }
+        try:
+            meta['current_row'] = self.app.tree.currentRow()
+        except Exception:
+            pass
+        return meta
 
-        # Zapisz dane tabeli z QTableWidget
-        row_count = 0
+    def _snapshot_rows(self, input_dir: str) -> List[Tuple[str, Tuple[str, ...]]]:
+        """Return ``(original_path, values)`` for every table row."""
+        rows: List[Tuple[str, Tuple[str, ...]]] = []
         try:
             row_count = self.app.tree.rowCount()
         except Exception:
@@ -121,157 +143,345 @@ class SessionManager:
                     if os.path.isabs(str(data)):
                         original_path = str(data)
                     else:
-                        original_path = os.path.join(session_data['input_dir'], str(data))
+                        original_path = os.path.join(input_dir, str(data))
                 else:
-                    original_path = os.path.join(session_data['input_dir'], name_item.text())
+                    original_path = os.path.join(input_dir, name_item.text())
+            rows.append((original_path, tuple(row_values)))
+        return rows
 
-            session_data['files_data'].append(
-                {
-                    'original_path': original_path,
-                    'values': row_values,
-                }
-            )
+    @staticmethod
+    def _encode_record(cipher: Fernet, record: Dict[str, Any]) -> bytes:
+        token = cipher.encrypt(json.dumps(record, ensure_ascii=False).encode())
+        return struct.pack('>I', len(token)) + token
+
+    @staticmethod
+    def _row_record(row: int, entry: Tuple[str, Tuple[str, ...]]) -> Dict[str, Any]:
+        return {'t': 'row', 'row': row, 'original_path': entry[0], 'values': list(entry[1])}
 
+    def _can_append(self, path: str, cipher: Fernet) -> bool:
+        """Whether ``path`` is the V2 file last written or read by this manager."""
+        if (
+            self._saved_rows is None
+            or path != self.current_session_path
+            or cipher is not self._session_cipher
+        ):
+            return False
         try:
-            session_data['current_row'] = self.app.tree.currentRow()
-        except Exception:
-            pass
-        
-        # Szyfrowanie danych
-        session_json = json.dumps(session_data, indent=2)
-        
-        # Dodatkowe zabezpieczenie hasłem jeśli podane
+            return os.path.getsize(path) >= self._valid_end
+        except OSError:
+            return False
+
+    def save_session(self, path: Optional[str] = None, password: Optional[str] = None) -> str:
+        """Persist the current session to disk.
+
+        Sessions are stored as a log of individually encrypted,
+        length-prefixed records (see :data:`SESSION_HEADER_V2`).  Saving
+        again to the current session file appends only the rows that changed
+        since the last save; the file is rewritten in compacted form when it
+        is new or the appended records outnumber the live rows.
+
+        Args:
+            path: Optional path for the session file. Generated automatically
+                when omitted.
+            password: Optional password for additional encryption. When
+                omitted for the current session file, its existing key is
+                kept.
+
+        Returns:
+            Path to the saved session file.
+        """
+        if not path:
+            # Automatyczna generacja nazwy pliku z datą i ID sesji
+            timestamp = datetime.datetime.now().strftime("%Y%m%d_%H%M%S")
+            filename = f"archiwizator_sesja_{timestamp}.arch"
+            path = os.path.join(self.session_folder, filename)
+
         if password:
-            password_hash = hashlib.sha256(password.encode()).digest()[:16]
-            extra_key = base64.urlsafe_b64encode(password_hash + password_hash)
-            extra_cipher = Fernet(extra_key)
-            encrypted_data = extra_cipher.encrypt(session_json.encode())
+            cipher = self._cipher_for(password)
+        elif path == self.current_session_path and self._session_cipher is not None:
+            cipher = self._session_cipher
         else:
-            encrypted_data = self.cipher.encrypt(session_json.encode())
-            
-        # Dodanie nagłówka identyfikującego plik
-        header = b'ARCHIWIZATOR_SESSION_V1'
-        
-        with open(path, 'wb') as f:
-            f.write(header + b'\n')
-            f.write(encrypted_data)
-            
+            cipher = self.cipher
+
+        meta = self._session_meta()
+        rows = self._snapshot_rows(meta['input_dir'])
+
+        appended = 0
+        if self._can_append(path, cipher):
+            saved = self._saved_rows
+            records = [
+                self._row_record(row, entry)
+                for row, entry in enumerate(rows)
+                if row >= len(saved) or saved[row] != entry
+            ]
+            if len(rows) < len(saved):
+                records.append({'t': 'rows', 'count': len(rows)})
+            if meta != self._saved_meta:
+                records.append(dict(meta, t='meta', timestamp=datetime.datetime.now().isoformat()))
+            appended = self._log_records + len(records)
+            if appended - len(rows) - 1 <= max(COMPACT_MIN_RECORDS, len(rows)):
+                if records:
+                    with open(path, 'r+b') as f:
+                        # Odcięcie ewentualnie niedokończonego rekordu
+                        f.seek(self._valid_end)
+                        f.truncate()
+                        f.write(b''.join(self._encode_record(cipher, r) for r in records))
+                        self._valid_end = f.tell()
+                self._log_records = appended
+                self._saved_rows = rows
+                self._saved_meta = meta
+                return path
+
+        # Pełny zapis (kompakcja): nagłówek, meta i wszystkie wiersze
+        tmp_path = path + '.tmp'
+        with open(tmp_path, 'wb') as f:
+            f.write(SESSION_HEADER_V2 + b'\n')
+            f.write(self._encode_record(
+                cipher, dict(meta, t='meta', timestamp=datetime.datetime.now().isoformat())
+            ))
+            for row, entry in enumerate(rows):
+                f.write(self._encode_record(cipher, self._row_record(row, entry)))
+            self._valid_end = f.tell()
+        os.replace(tmp_path, path)
+
         self.current_session_path = path
+        self._session_cipher = cipher
+        self._log_records = len(rows) + 1
+        self._saved_rows = rows
+        self._saved_meta = meta
         return path
-    
-    def load_session(self, path: str, password: Optional[str] = None) -> Tuple[bool, str]:
-        """Load a previously saved session file.
 
-        Args:
-            path: Path to the encrypted session file.
-            password: Optional password if the session was additionally
-                encrypted.
+    def _restore_meta(self, session_data: Dict[str, Any]) -> None:
+        """Apply session-level settings to the application."""
+        self.session_id = session_data['session_id']
+        self.counters = session_data.get('counters', {})
+        self.sa_counters = session_data.get('sa_counters', {})
+
+        # Aktualizacja podstawowych ustawień
+        self.app.work_mode = session_data.get('work_mode', 'KP')
+        self.app.input_dir = session_data.get('input_dir', '')
+        self.app.output_dir = session_data.get('output_dir', '')
+        self.app.case_signature = session_data.get('case_signature', '')
 
-        Returns:
-            Tuple of success flag and message.
-        """
         try:
-            with open(path, 'rb') as f:
-                # Weryfikacja nagłówka
-                header = f.readline().strip()
-                if header != b'ARCHIWIZATOR_SESSION_V1':
-                    return False, "To nie jest prawidłowy plik sesji Archiwizatora."
-                
-                # Odczyt zaszyfrowanych danych
-                encrypted_data = f.read()
-            
-            # Próba odszyfrowania
+            self.app.mode_combo.setCurrentText(
+                DOC_TYPE_LABELS.get(self.app.work_mode, self.app.work_mode)
+            )
+            self.app.input_edit.setText(self.app.input_dir)
+            self.app.output_edit.setText(self.app.output_dir)
+            self.app.case_edit.setText(self.app.case_signature)
             try:
-                if password:
-                    # Próba odszyfrowania z hasłem
-                    password_hash = hashlib.sha256(password.encode()).digest()[:16]
-                    extra_key = base64.urlsafe_b64encode(password_hash + password_hash)
-                    extra_cipher = Fernet(extra_key)
-                    session_json = extra_cipher.decrypt(encrypted_data).decode()
-                else:
-                    # Próba standardowego odszyfrowania
-                    session_json = self.cipher.decrypt(encrypted_data).decode()
-                    
-                session_data = json.loads(session_json)
+                self.app._sync_number_edit()
             except Exception:
-                # Jeśli standardowe odszyfrowanie nie zadziałało, może być zaszyfrowane hasłem
-                if not password:
-                    return False, "Ten plik sesji jest zabezpieczony hasłem. Proszę podać hasło."
-                else:
-                    return False, "Nieprawidłowe hasło lub uszkodzony plik sesji."
-            
-            # Przywrócenie stanu aplikacji
-            self.session_id = session_data['session_id']
-            self.counters = session_data.get('counters', {})
-            self.sa_counters = session_data.get('sa_counters', {})
+                pass
+        except Exception:
+            pass
 
-            # Aktualizacja podstawowych ustawień
-            self.app.work_mode = session_data.get('work_mode', 'KP')
-            self.app.input_dir = session_data.get('input_dir', '')
-            self.app.output_dir = session_data.get('output_dir', '')
-            self.app.case_signature = session_data.get('case_signature', '')
+        try:
+            self.app.update_ui_for_mode()
+        except Exception:
+            pass
 
-            try:
-                self.app.mode_combo.setCurrentText(
-                    DOC_TYPE_LABELS.get(self.app.work_mode, self.app.work_mode)
-                )
-                self.app.input_edit.setText(self.app.input_dir)
-                self.app.output_edit.setText(self.app.output_dir)
-                self.app.case_edit.setText(self.app.case_signature)
+    def _set_row(self, row: int, file_entry: Dict[str, Any]) -> bool:
+        """Fill table ``row`` (appending it when needed) from a stored entry."""
+        values = file_entry.get('values', [])
+        try:
+            if row >= self.app.tree.rowCount():
+                self.app.tree.insertRow(row)
+        except Exception:
+            return False
+
+        for col, value in enumerate(values):
+            item = QtWidgets.QTableWidgetItem(value)
+            if col == 0:
                 try:
-                    self.app._sync_number_edit()
+                    original_path = file_entry.get('original_path', value)
+                    name = os.path.basename(original_path)
+                    item.setText(name)
+                    item.setData(QtCore.Qt.UserRole, original_path)
                 except Exception:
                     pass
-            except Exception:
-                pass
+            self.app.tree.setItem(row, col, item)
+        return True
 
+    def _restore_position(self, session_data: Dict[str, Any]) -> None:
+        try:
+            current_row = session_data.get('current_row', -1)
+            if current_row >= 0 and self.app.tree.rowCount() > current_row:
+                self.app.tree.setCurrentCell(current_row, 0)
+            pdf_path = session_data.get('pdf_path', '')
+            if pdf_path:
+                self.app._current_pdf_path = pdf_path
+                self.app._load_pdf(pdf_path)
+        except Exception:
+            pass
+
+    def _clear_table(self) -> None:
+        try:
+            self.app.tree.setRowCount(0)
+        except Exception:
+            pass
+
+    @staticmethod
+    def _read_records(f, cipher: Fernet) -> Iterator[Tuple[Optional[Dict[str, Any]], int]]:
+        """Yield ``(record, end_offset)`` from a V2 session file.
+
+        A record that cannot be decrypted or parsed is yielded as ``None``;
+        the length prefix still locates the next one.  Reading stops at a
+        truncated record, e.g. after an interrupted save.
+        """
+        while True:
+            prefix = f.read(4)
+            if len(prefix) < 4:
+                return
+            (length,) = struct.unpack('>I', prefix)
+            token = f.read(length)
+            if len(token) < length:
+                return
             try:
-                self.app.update_ui_for_mode()
-            except Exception:
-                pass
+                record = json.loads(cipher.decrypt(token).decode())
+            except (InvalidToken, ValueError):
+                record = None
+            yield (record if isinstance(record, dict) else None), f.tell()
+
+    def _load_v2(self, f, path: str, cipher: Fernet) -> Tuple[bool, str]:
+        """Stream records of a V2 file into the table as they are decrypted."""
+        records = self._read_records(f, cipher)
+        try:
+            first, end = next(records)
+        except StopIteration:
+            return False, "Plik sesji jest pusty lub uszkodzony."
+        if first is None:
+            raise _WrongKey()
+        if first.get('t') != 'meta':
+            return False, "Plik sesji jest pusty lub uszkodzony."
 
-            # Czyszczenie obecnych danych w tabeli
+        self._restore_meta(first)
+        meta = first
+        self._clear_table()
+        rows: List[Tuple[str, Tuple[str, ...]]] = []
+        count = 0
+        skipped = 0
+        try:
+            self.app.tree.setUpdatesEnabled(False)
+        except Exception:
+            pass
+        try:
+            for record, end in itertools.chain([(first, end)], records):
+                count += 1
+                self._valid_end = end
+                kind = record.get('t') if record is not None else None
+                if not self._is_valid_record(record):
+                    # Uszkodzony rekord w środku pliku: pozostałe wiersze są nadal wczytywane
+                    skipped += 1
+                    logger.warning("Pominięto uszkodzony rekord sesji %d w %s", count, path)
+                    continue
+                if kind == 'row':
+                    row = record['row']
+                    while len(rows) < row and self._set_row(len(rows), {}):
+                        # Wiersz z pominiętego rekordu zostaje pusty, kolejne na swoich miejscach
+                        rows.append(('', ()))
+                    if self._set_row(row, record):
+                        entry = (record.get('original_path', ''), tuple(record.get('values', [])))
+                        if row < len(rows):
+                            rows[row] = entry
+                        else:
+                            rows.append(entry)
+                elif kind == 'rows':
+                    del rows[record['count']:]
+                    try:
+                        self.app.tree.setRowCount(record['count'])
+                    except Exception:
+                        pass
+                elif kind == 'meta' and record is not first:
+                    meta = record
+        finally:
             try:
-                self.app.tree.setRowCount(0)
+                self.app.tree.setUpdatesEnabled(True)
             except Exception:
                 pass
 
-            # Wczytanie plików
-            files_loaded = 0
-            for row, file_entry in enumerate(session_data.get('files_data', [])):
-                values = file_entry.get('values', [])
-                try:
-                    self.app.tree.insertRow(row)
-                except Exception:
-                    continue
+        if meta is not first:
+            self._restore_meta(meta)
+        self._restore_position(meta)
+
+        self.current_session_path = path
+        self._session_cipher = cipher
+        self._log_records = count
+        self._saved_rows = rows
+        self._saved_meta = {k: v for k, v in meta.items() if k not in ('t', 'timestamp')}
+        message = f"Wczytano sesję: {len(rows)} plików załadowanych."
+        if skipped:
+            message += f" Pominięto uszkodzone rekordy: {skipped}."
+        return True, message
+
+    @staticmethod
+    def _is_valid_record(record: Optional[Dict[str, Any]]) -> bool:
+        """Return whether ``record`` is a complete V2 record of a known kind."""
+        if record is None:
+            return False
+        kind = record.get('t')
+        if kind == 'row':
+            row = record.get('row')
+            return (
+                isinstance(row, int)
+                and row >= 0
+                and isinstance(record.get('values', []), list)
+            )
+        if kind == 'rows':
+            count = record.get('count')
+            return isinstance(count, int) and count >= 0
+        return kind == 'meta'
 
-                for col, value in enumerate(values):
-                    item = QtWidgets.QTableWidgetItem(value)
-                    if col == 0:
-                        try:
-                            original_path = file_entry.get('original_path', value)
-                            name = os.path.basename(original_path)
-                            item.setText(name)
-                            item.setData(QtCore.Qt.UserRole, original_path)
-                        except Exception:
-                            pass
-                    self.app.tree.setItem(row, col, item)
+    def _load_v1(self, f, path: str, cipher: Fernet) -> Tuple[bool, str]:
+        """Load the original single-blob format."""
+        try:
+            session_data = json.loads(cipher.decrypt(f.read()).decode())
+        except Exception as exc:
+            raise _WrongKey() from exc
+
+        self._restore_meta(session_data)
+        self._clear_table()
+        files_loaded = 0
+        for row, file_entry in enumerate(session_data.get('files_data', [])):
+            if self._set_row(row, file_entry):
                 files_loaded += 1
+        self._restore_position(session_data)
 
-            try:
-                current_row = session_data.get('current_row', -1)
-                if current_row >= 0 and self.app.tree.rowCount() > current_row:
-                    self.app.tree.setCurrentCell(current_row, 0)
-                pdf_path = session_data.get('pdf_path', '')
-                if pdf_path:
-                    self.app._current_pdf_path = pdf_path
-                    self.app._load_pdf(pdf_path)
-            except Exception:
-                pass
+        self.current_session_path = path
+        # Następny zapis przepisze plik w formacie V2
+        self._session_cipher = cipher
+        self._saved_rows = None
+        return True, f"Wczytano sesję: {files_loaded} plików załadowanych."
+
+    def load_session(self, path: str, password: Optional[str] = None) -> Tuple[bool, str]:
+        """Load a previously saved session file.
+
+        Args:
+            path: Path to the encrypted session file.
+            password: Optional password if the session was additionally
+                encrypted.
+
+        Returns:
+            Tuple of success flag and message.
+        """
+        try:
+            cipher = self._cipher_for(password)
+            with open(path, 'rb') as f:
+                # Weryfikacja nagłówka
+                header = f.readline().strip()
+                try:
+                    if header == SESSION_HEADER_V2:
+                        return self._load_v2(f, path, cipher)
+                    if header == SESSION_HEADER_V1:
+                        return self._load_v1(f, path, cipher)
+                except _WrongKey:
+                    # Jeśli standardowe odszyfrowanie nie zadziałało, może być zaszyfrowane hasłem
+                    if not password:
+                        return False, "Ten plik sesji jest zabezpieczony hasłem. Proszę podać hasło."
+                    return False, "Nieprawidłowe hasło lub uszkodzony plik sesji."
+            return False, "To nie jest prawidłowy plik sesji Archiwizatora."
 
-            self.current_session_path = path
-            return True, f"Wczytano sesję: {files_loaded} plików załadowanych."
-            
         except Exception as e:
             import traceback
             traceback.print_exc()
@@ -0,0 +1,401 @@
+"""Barcodes and QR codes on the first page (``native/barcode.c``).
+
+Incoming mail gets a registry sticker with a Code 128 or Code 39 barcode,
+and arbitration court (SA) documents often carry a QR code with the case
+data.  :func:`read_codes` finds them on a rasterized page: 1D barcodes are
+decoded along every few rows and columns by the native scanline decoder
+(or its Python port), QR codes with OpenCV's ``QRCodeDetector``.
+
+:func:`routing_fields` turns the codes into document metadata: the
+registry barcode gives the document number and the QR payload (JSON,
+``key=value`` pairs or a bare signature) the case signature and other
+fields.  A document routed this way does not need OCR to be named.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import json
+import logging
+import re
+import unicodedata
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Sequence
+from urllib.parse import parse_qsl, urlsplit
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Co ile wierszy i kolumn (w pikselach przy 300 dpi) czytana jest linia skanu
+SCAN_STEP = 8
+_WINDOW = 24
+_MIN_STDDEV = 20
+_MAX_VALUE = 128
+_MAX_CODES = 32
+
+_C128 = (
+    "212222 222122 222221 121223 121322 131222 122213 122312 132212 221213 "
+    "221312 231212 112232 122132 122231 113222 123122 123221 223211 221132 "
+    "221231 213212 223112 312131 311222 321122 321221 312212 322112 322211 "
+    "212123 212321 232121 111323 131123 131321 112313 132113 132311 211313 "
+    "231113 231311 112133 112331 132131 113123 113321 133121 313121 211331 "
+    "231131 213113 213311 213131 311123 311321 331121 312113 312311 332111 "
+    "314111 221411 431111 111224 111422 121124 121421 141122 141221 112214 "
+    "112412 122114 122411 142112 142211 241211 221114 413111 241112 134111 "
+    "111242 121142 121241 114212 124112 124211 411212 421112 421211 212141 "
+    "214121 412121 111143 111341 131141 114113 114311 411113 411311 113141 "
+    "114131 311141 411131 211412 211214 211232"
+).split()
+_C128_VALUES = {pattern: value for value, pattern in enumerate(_C128)}
+_C128_STOP = "2331112"
+_C39_CHARS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. *$/+%"
+_C39 = (
+    "nnnwwnwnn wnnwnnnnw nnwwnnnnw wnwwnnnnn nnnwwnnnw wnnwwnnnn nnwwwnnnn "
+    "nnnwnnwnw wnnwnnwnn nnwwnnwnn wnnnnwnnw nnwnnwnnw wnwnnwnnn nnnnwwnnw "
+    "wnnnwwnnn nnwnwwnnn nnnnnwwnw wnnnnwwnn nnwnnwwnn nnnnwwwnn wnnnnnnww "
+    "nnwnnnnww wnwnnnnwn nnnnwnnww wnnnwnnwn nnwnwnnwn nnnnnnwww wnnnnnwwn "
+    "nnwnnnwwn nnnnwnwwn wwnnnnnnw nwwnnnnnw wwwnnnnnn nwnnwnnnw wwnnwnnnn "
+    "nwwnwnnnn nwnnnnwnw wwnnnnwnn nwwnnnwnn nwnnwnwnn nwnwnwnnn nwnwnnnwn "
+    "nwnnnwnwn nnnwnwnwn"
+).split()
+_C39_VALUES = {pattern: _C39_CHARS[i] for i, pattern in enumerate(_C39)}
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.barcode_scan.argtypes = [
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_char_p,
+        ctypes.c_int,
+    ]
+    lib.barcode_scan.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("barcode", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native barcode decoder can be used."""
+    return _library.is_available()
+
+
+@dataclass(frozen=True)
+class Code:
+    """A decoded barcode or QR code."""
+
+    symbology: str
+    value: str
+
+
+# --- Dekoder linii skanu w Pythonie (odpowiednik native/barcode.c) ---
+
+
+def _to_modules(runs: Sequence[int], modules: int) -> Optional[str]:
+    total = sum(runs)
+    if total < modules:
+        return None
+    out = []
+    for run in runs:
+        m = (2 * run * modules + total) // (2 * total)
+        if not 1 <= m <= 4:
+            return None
+        out.append(str(m))
+    return "".join(out)
+
+
+def _c128_value(runs: Sequence[int]) -> int:
+    pattern = _to_modules(runs, 11)
+    return _C128_VALUES.get(pattern, -1) if pattern else -1
+
+
+def _c128_text(values: Sequence[int]) -> str:
+    code_set = values[0] - 103
+    out = []
+    i = 1
+    while i < len(values):
+        v = values[i]
+        cur = code_set
+        if v == 98 and code_set != 2 and i + 1 < len(values):
+            cur = 1 if code_set == 0 else 0
+            i += 1
+            v = values[i]
+        i += 1
+        if cur == 2:
+            if v < 100:
+                out.append(f"{v:02d}")
+            elif v == 100:
+                code_set = 1
+            elif v == 101:
+                code_set = 0
+            continue
+        if v == 99:
+            code_set = 2
+        elif v == 100 and cur == 0:
+            code_set = 1
+        elif v == 101 and cur == 1:
+            code_set = 0
+        elif v < 96:
+            out.append(chr(v - 64 if cur == 0 and v >= 64 else v + 32))
+    text = "".join(out)
+    return text if len(text) <= _MAX_VALUE else ""
+
+
+def _add(found: Dict[tuple, int], key: tuple) -> None:
+    if key in found or len(found) < _MAX_CODES:
+        found[key] = found.get(key, 0) + 1
+
+
+def _c128_at(runs: Sequence[int], i: int, found: Dict[tuple, int]) -> None:
+    start = _c128_value(runs[i:i + 6])
+    if start < 103:
+        return
+    if i > 0 and runs[i - 1] * 11 < 5 * sum(runs[i:i + 6]):
+        return
+    values = [start]
+    j = i + 6
+    while j + 7 <= len(runs):
+        if _to_modules(runs[j:j + 7], 13) == _C128_STOP:
+            if len(values) < 3:
+                return
+            check = values[0] + sum(k * v for k, v in enumerate(values[1:-1], 1))
+            if check % 103 != values[-1]:
+                return
+            text = _c128_text(values[:-1])
+            if text:
+                _add(found, ("CODE128", text))
+            return
+        v = _c128_value(runs[j:j + 6])
+        if not 0 <= v <= 102 or len(values) == _MAX_VALUE + 1:
+            return
+        values.append(v)
+        j += 6
+
+
+def _c39_char(runs: Sequence[int]) -> Optional[str]:
+    order = list(range(9))
+    # Ta sama kolejność wyboru co w C, aby remisy rozstrzygały się identycznie
+    for a in range(3):
+        for b in range(a + 1, 9):
+            if runs[order[b]] > runs[order[a]]:
+                order[a], order[b] = order[b], order[a]
+    narrow_max = max(runs[k] for k in order[3:])
+    if 2 * runs[order[2]] < 3 * narrow_max:
+        return None
+    pattern = ["n"] * 9
+    for k in order[:3]:
+        pattern[k] = "w"
+    return _C39_VALUES.get("".join(pattern))
+
+
+def _c39_at(runs: Sequence[int], i: int, found: Dict[tuple, int]) -> None:
+    if _c39_char(runs[i:i + 9]) != "*":
+        return
+    if i > 0 and runs[i - 1] < sum(runs[i:i + 9]) // 2:
+        return
+    text = []
+    j = i + 10
+    while j + 9 <= len(runs):
+        ch = _c39_char(runs[j:j + 9])
+        if ch is None:
+            return
+        if ch == "*":
+            if text:
+                _add(found, ("CODE39", "".join(text)))
+            return
+        if len(text) == _MAX_VALUE:
+            return
+        text.append(ch)
+        j += 10
+
+
+def _decode_runs(runs: Sequence[int], found: Dict[tuple, int]) -> None:
+    for i in range(0, len(runs) - 5, 2):
+        _c128_at(runs, i, found)
+        if i + 9 <= len(runs):
+            _c39_at(runs, i, found)
+
+
+def _scan_line(line: Sequence[int], found: Dict[tuple, int]) -> None:
+    n = len(line)
+    sums = [0] * (n + 1)
+    squares = [0] * (n + 1)
+    for k, v in enumerate(line):
+        sums[k + 1] = sums[k] + v
+        squares[k + 1] = squares[k] + v * v
+    runs: List[int] = []
+    prev_dark = False
+    min_var = _MIN_STDDEV * _MIN_STDDEV
+    for k in range(n):
+        lo, hi = max(0, k - _WINDOW), min(n, k + _WINDOW + 1)
+        w, s = hi - lo, sums[hi] - sums[lo]
+        var_w2 = (squares[hi] - squares[lo]) * w - s * s
+        dark = var_w2 >= min_var * w * w and line[k] * w < s
+        if not runs and not dark:
+            continue
+        if not runs or dark != prev_dark:
+            runs.append(0)
+        runs[-1] += 1
+        prev_dark = dark
+    if runs and not prev_dark:
+        runs.pop()
+    _decode_runs(runs, found)
+    _decode_runs(runs[::-1], found)
+
+
+def _scan_python(data: bytes, width: int, height: int, step: int) -> List[Code]:
+    found: Dict[tuple, int] = {}
+    for y in range(step // 2, height, step):
+        _scan_line(data[y * width:(y + 1) * width], found)
+    for x in range(step // 2, width, step):
+        _scan_line(data[x::width][:height], found)
+    return [
+        Code(symbology, value)
+        for (symbology, value), hits in found.items()
+        if symbology != "CODE39" or hits >= 2
+    ]
+
+
+def scan_barcodes(data: bytes, width: int, height: int, step: int = SCAN_STEP) -> List[Code]:
+    """Decode Code 128 and Code 39 barcodes of an 8-bit grayscale page."""
+    if width <= 0 or height <= 0 or len(data) < width * height:
+        return []
+    lib = _library.load()
+    if lib is None:
+        return _scan_python(data, width, height, step)
+    out = ctypes.create_string_buffer(8192)
+    count = lib.barcode_scan(data, width, height, width, step, out, len(out))
+    if count < 0:
+        raise MemoryError("barcode_scan")
+    codes = []
+    for line in out.value.decode("latin-1").splitlines():
+        symbology, _, value = line.partition("\t")
+        codes.append(Code(symbology, value))
+    return codes
+
+
+def scan_qr_codes(gray) -> List[Code]:
+    """Decode QR codes with OpenCV; returns nothing when it is unavailable."""
+    try:
+        import cv2
+        import numpy as np
+    except Exception:  # pragma: no cover - brak OpenCV
+        return []
+    detector_cls = getattr(cv2, "QRCodeDetector", None)
+    if detector_cls is None:
+        return []
+    image = np.asarray(gray)
+    try:
+        ok, values, _, _ = detector_cls().detectAndDecodeMulti(image)
+    except Exception as exc:
+        logger.debug("Błąd dekodowania kodu QR: %s", exc)
+        return []
+    return [Code("QR", value) for value in (values if ok else ()) if value]
+
+
+def read_codes(image, step: int = SCAN_STEP) -> List[Code]:
+    """Return barcodes and QR codes found on a rasterized PIL page."""
+    gray = image.convert("L")
+    width, height = gray.size
+    codes = scan_barcodes(gray.tobytes(), width, height, step)
+    codes.extend(scan_qr_codes(gray))
+    return codes
+
+
+# --- Metadane z zawartości kodów ---
+
+_SIGNATURE = re.compile(
+    r"^(?:[IVXLC]+\s+)?[A-Za-z]{1,5}\.?\s+\d{1,6}\s*/\s*\d{2,4}$|^SA\s*\d+\s*/\s*\d{2,4}$",
+    re.IGNORECASE,
+)
+# Numer z naklejki dziennika podawczego, np. "KW/2024/00123" lub "RPW-15-24";
+# kody EAN produktów czy numery przesyłek kurierskich go nie spełniają
+_REGISTRY_NUMBER = re.compile(r"^[A-Z]{1,6}(?:\s*[/-]\s*\d{1,8}){2,3}$")
+# Klucze w treści kodów QR i odpowiadające im pola metadanych
+_QR_KEYS = {
+    "sygnatura": "sygnatura_sprawy",
+    "sygnatura_sprawy": "sygnatura_sprawy",
+    "sygn": "sygnatura_sprawy",
+    "sprawa": "sygnatura_sprawy",
+    "case": "sygnatura_sprawy",
+    "nr": "numer_dokumentu",
+    "numer": "numer_dokumentu",
+    "numer_dokumentu": "numer_dokumentu",
+    "nr_rej": "numer_dokumentu",
+    "rejestr": "numer_dokumentu",
+    "data": "data",
+    "date": "data",
+    "nadawca": "nadawca_odbiorca",
+    "nadawca_odbiorca": "nadawca_odbiorca",
+    "typ": "typ_dokumentu",
+    "typ_dokumentu": "typ_dokumentu",
+    "w_sprawie": "w_sprawie",
+}
+
+
+def _normalize_key(key: str) -> str:
+    key = unicodedata.normalize("NFKD", key.strip().lower())
+    key = "".join(ch for ch in key if not unicodedata.combining(ch)).replace("ł", "l")
+    return re.sub(r"[^a-z0-9]+", "_", key).strip("_")
+
+
+def _qr_pairs(payload: str) -> List[tuple]:
+    payload = payload.strip()
+    try:
+        data = json.loads(payload)
+    except ValueError:
+        data = None
+    if isinstance(data, dict):
+        return [(str(k), str(v)) for k, v in data.items() if v not in (None, "")]
+    if "://" in payload:
+        return parse_qsl(urlsplit(payload).query)
+    pairs = []
+    for part in re.split(r"[\n;&|]+", payload):
+        key, sep, value = part.partition("=") if "=" in part else part.partition(":")
+        if sep and value.strip():
+            pairs.append((key, value.strip()))
+    return pairs
+
+
+def is_registry_number(value: str, prefixes: Sequence[str] = ()) -> bool:
+    """Return whether a 1D barcode ``value`` looks like a registry number.
+
+    A value matches when it has the registry format (letters followed by
+    two or three numbers, e.g. ``KW/2024/00123``) or starts with one of
+    ``prefixes`` (compared case-insensitively).
+    """
+    value = value.strip()
+    if _REGISTRY_NUMBER.match(value.upper()):
+        return True
+    return any(p and value.upper().startswith(p.strip().upper()) for p in prefixes)
+
+
+def routing_fields(codes: Sequence[Code], registry_prefixes: Sequence[str] = ()) -> Dict[str, str]:
+    """Return metadata fields carried by ``codes``.
+
+    QR codes fill the fields named in their payload; a payload that is just
+    a case signature fills ``sygnatura_sprawy``.  A 1D barcode that is a
+    registry number (see :func:`is_registry_number`) fills
+    ``numer_dokumentu`` unless a QR code already did; other 1D codes, such
+    as product EANs or parcel numbers on an enclosure, are ignored.
+    """
+    fields: Dict[str, str] = {}
+    for code in codes:
+        if code.symbology != "QR":
+            continue
+        pairs = _qr_pairs(code.value)
+        for key, value in pairs:
+            field = _QR_KEYS.get(_normalize_key(key))
+            if field and not fields.get(field):
+                fields[field] = " ".join(value.split())
+        if not pairs and _SIGNATURE.match(code.value.strip()):
+            fields.setdefault("sygnatura_sprawy", " ".join(code.value.split()))
+    for code in codes:
+        if code.symbology == "QR" or fields.get("numer_dokumentu"):
+            continue
+        if is_registry_number(code.value, registry_prefixes):
+            fields["numer_dokumentu"] = code.value.strip()
+    return fields
@@ -0,0 +1,422 @@
+"""Bilevel recompression of archived scans (``native/bilevel.c``).
+
+Most archived documents are black-and-white letters scanned at 300 dpi in
+colour or greyscale, so their PDFs are many times larger than the content
+needs.  The OCR pipeline already binarizes every page; with
+``archive_bilevel`` the binarized pages are encoded with CCITT Group 4
+(ITU-T T.6) in the OCR worker threads and, once :class:`FilePlacer` has
+placed the archive copy, :class:`Recompressor` replaces it with a PDF of
+the G4 pages when that is smaller.
+
+Pages with colour content (stamps, signatures in blue ink, photos) would
+lose it, so documents with such a page keep the original file.  So do PDFs
+that are more than page images -- with a text layer, form fields,
+annotations or signatures -- and documents whose OCR did not encode every
+page.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import logging
+import os
+import re
+import zlib
+from concurrent.futures import Future, ThreadPoolExecutor
+from dataclasses import dataclass
+from typing import List, Optional, Sequence, Tuple
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Metody FilePlacer dające kopię odrębną od źródła; twardy link też, bo
+# podmiana przez os.replace rozłącza go, nie ruszając oryginału.  Przy
+# "same" kopia jest samym źródłem i rekompresja zniszczyłaby jedyny oryginał.
+_SEPARATE_COPIES = frozenset({"reflink", "copy_file_range", "copy", "hardlink"})
+
+# Różnica kanałów RGB, od której piksel uznaje się za kolorowy
+MIN_CHROMA = 48
+# Co który wiersz i kolumna są sprawdzane przy wykrywaniu koloru
+_COLOUR_STEP = 4
+
+# Kody długości serii T.4: końcowe 0..63, uzupełniające 64..1728 oraz
+# wspólne dla obu kolorów 1792..2560
+_WHITE_TERM = (
+    "00110101 000111 0111 1000 1011 1100 1110 1111 "
+    "10011 10100 00111 01000 001000 000011 110100 110101 "
+    "101010 101011 0100111 0001100 0001000 0010111 0000011 0000100 "
+    "0101000 0101011 0010011 0100100 0011000 00000010 00000011 00011010 "
+    "00011011 00010010 00010011 00010100 00010101 00010110 00010111 00101000 "
+    "00101001 00101010 00101011 00101100 00101101 00000100 00000101 00001010 "
+    "00001011 01010010 01010011 01010100 01010101 00100100 00100101 01011000 "
+    "01011001 01011010 01011011 01001010 01001011 00110010 00110011 00110100"
+).split()
+_WHITE_MAKEUP = (
+    "11011 10010 010111 0110111 00110110 00110111 01100100 01100101 "
+    "01101000 01100111 011001100 011001101 011010010 011010011 011010100 011010101 "
+    "011010110 011010111 011011000 011011001 011011010 011011011 010011000 010011001 "
+    "010011010 011000 010011011"
+).split()
+_BLACK_TERM = (
+    "0000110111 010 11 10 011 0011 0010 00011 "
+    "000101 000100 0000100 0000101 0000111 00000100 00000111 000011000 "
+    "0000010111 0000011000 0000001000 00001100111 00001101000 00001101100 00000110111 00000101000 "
+    "00000010111 00000011000 000011001010 000011001011 000011001100 000011001101 000001101000 000001101001 "
+    "000001101010 000001101011 000011010010 000011010011 000011010100 000011010101 000011010110 000011010111 "
+    "000001101100 000001101101 000011011010 000011011011 000001010100 000001010101 000001010110 000001010111 "
+    "000001100100 000001100101 000001010010 000001010011 000000100100 000000110111 000000111000 000000100111 "
+    "000000101000 000001011000 000001011001 000000101011 000000101100 000001011010 000001100110 000001100111"
+).split()
+_BLACK_MAKEUP = (
+    "0000001111 000011001000 000011001001 000001011011 000000110011 000000110100 000000110101 0000001101100 "
+    "0000001101101 0000001001010 0000001001011 0000001001100 0000001001101 0000001110010 0000001110011 0000001110100 "
+    "0000001110101 0000001110110 0000001110111 0000001010010 0000001010011 0000001010100 0000001010101 0000001011010 "
+    "0000001011011 0000001100100 0000001100101"
+).split()
+_EXT_MAKEUP = (
+    "00000001000 00000001100 00000001101 000000010010 000000010011 000000010100 000000010101 000000010110 "
+    "000000010111 000000011100 000000011101 000000011110 000000011111"
+).split()
+_PASS = "0001"
+_HORIZONTAL = "001"
+_VERTICAL = ("0000011", "000011", "011", "1", "010", "000010", "0000010")
+_EOL = "000000000001"
+# Piksel ciemniejszy niż 128 jest czarny
+_BLACK = bytes(1 if v < 128 else 0 for v in range(256))
+
+# Zawartość PDF, którą zastąpienie obrazami G4 by utraciło
+_NOT_IMAGE_ONLY = re.compile(
+    rb"/(?:Font|AcroForm|Annots|ByteRange|Encrypt|EmbeddedFiles|JavaScript)\b"
+)
+_PAGE = re.compile(rb"/Type\s*/Page(?![A-Za-z])")
+_OBJECT_STREAM = re.compile(rb"/Type\s*/ObjStm\b")
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.g4_encode.argtypes = [
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_char_p,
+        ctypes.c_long,
+    ]
+    lib.g4_encode.restype = ctypes.c_long
+    lib.colour_pixels.argtypes = [
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+    ]
+    lib.colour_pixels.restype = ctypes.c_long
+
+
+_library = native_lib.NativeLibrary("bilevel", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native bilevel library can be used."""
+    return _library.is_available()
+
+
+class _Bits:
+    def __init__(self) -> None:
+        self.parts: List[str] = []
+
+    def span(self, span: int, term: Sequence[str], makeup: Sequence[str]) -> None:
+        while span >= 2624:
+            self.parts.append(_EXT_MAKEUP[12])
+            span -= 2560
+        if span >= 64:
+            m = span // 64
+            self.parts.append(makeup[m - 1] if m <= 27 else _EXT_MAKEUP[m - 28])
+            span -= m * 64
+        self.parts.append(term[span])
+
+    def tobytes(self) -> bytes:
+        bits = "".join(self.parts)
+        bits += "0" * (-len(bits) % 8)
+        return int(bits, 2).to_bytes(len(bits) // 8, "big") if bits else b""
+
+
+def _find_diff(line: bytes, start: int, width: int, color: int) -> int:
+    pos = line.find(b"\x00" if color else b"\x01", start)
+    return width if pos < 0 else pos
+
+
+def _encode_row(bits: _Bits, cur: bytes, ref: bytes, width: int) -> None:
+    a0 = 0
+    a1 = 0 if cur[0] else _find_diff(cur, 0, width, 0)
+    b1 = 0 if ref[0] else _find_diff(ref, 0, width, 0)
+    while True:
+        b2 = _find_diff(ref, b1, width, ref[b1]) if b1 < width else width
+        if b2 >= a1:
+            d = b1 - a1
+            if not -3 <= d <= 3:
+                a2 = _find_diff(cur, a1, width, cur[a1]) if a1 < width else width
+                bits.parts.append(_HORIZONTAL)
+                if a0 + a1 == 0 or cur[a0] == 0:
+                    bits.span(a1 - a0, _WHITE_TERM, _WHITE_MAKEUP)
+                    bits.span(a2 - a1, _BLACK_TERM, _BLACK_MAKEUP)
+                else:
+                    bits.span(a1 - a0, _BLACK_TERM, _BLACK_MAKEUP)
+                    bits.span(a2 - a1, _WHITE_TERM, _WHITE_MAKEUP)
+                a0 = a2
+            else:
+                bits.parts.append(_VERTICAL[d + 3])
+                a0 = a1
+        else:
+            bits.parts.append(_PASS)
+            a0 = b2
+        if a0 >= width:
+            return
+        color = cur[a0]
+        a1 = _find_diff(cur, a0, width, color)
+        b1 = _find_diff(ref, a0, width, not color)
+        b1 = _find_diff(ref, b1, width, color)
+
+
+def encode_g4(gray: bytes, width: int, height: int) -> bytes:
+    """Encode an 8-bit grayscale page (rows without padding) with CCITT G4."""
+    if width <= 0 or height <= 0 or len(gray) < width * height:
+        raise ValueError("Nieprawidłowe wymiary strony")
+    lib = _library.load()
+    if lib is not None:
+        # Typowa strona tekstu kompresuje się ponad 20-krotnie
+        cap = width * height // 20 + 1024
+        while True:
+            out = ctypes.create_string_buffer(cap)
+            n = lib.g4_encode(gray, width, height, width, out, cap)
+            if n < 0:
+                raise MemoryError("g4_encode")
+            if n <= cap:
+                return out.raw[:n]
+            cap = n
+    bits = _Bits()
+    ref = bytes(width)
+    for y in range(height):
+        cur = gray[y * width:(y + 1) * width].translate(_BLACK)
+        _encode_row(bits, cur, ref, width)
+        ref = cur
+    bits.parts += [_EOL, _EOL]
+    return bits.tobytes()
+
+
+def colour_fraction(rgb: bytes, width: int, height: int, min_chroma: int = MIN_CHROMA) -> float:
+    """Return the share of sampled RGB pixels whose channels differ by ``min_chroma``."""
+    samples = ((height + _COLOUR_STEP - 1) // _COLOUR_STEP) * (
+        (width + _COLOUR_STEP - 1) // _COLOUR_STEP
+    )
+    if not samples or len(rgb) < 3 * width * height:
+        return 0.0
+    lib = _library.load()
+    if lib is not None:
+        count = lib.colour_pixels(rgb, width, height, 3 * width, min_chroma)
+    else:
+        count = 0
+        for y in range(0, height, _COLOUR_STEP):
+            row = rgb[3 * y * width:3 * (y + 1) * width]
+            r, g, b = row[0::3 * _COLOUR_STEP], row[1::3 * _COLOUR_STEP], row[2::3 * _COLOUR_STEP]
+            count += sum(
+                max(p) - min(p) >= min_chroma for p in zip(r, g, b)
+            )
+    return count / samples
+
+
+@dataclass
+class BilevelPage:
+    """One page encoded with CCITT G4."""
+
+    width: int
+    height: int
+    dpi: int
+    data: bytes
+
+
+def is_colour(image, max_fraction: float) -> bool:
+    """Return ``True`` when more than ``max_fraction`` of a PIL page is colour."""
+    if getattr(image, "mode", "RGB") in ("1", "L"):
+        return False
+    rgb = image.convert("RGB")
+    width, height = rgb.size
+    return colour_fraction(rgb.tobytes(), width, height) > max_fraction
+
+
+def encode_page(binary, dpi: int) -> BilevelPage:
+    """Encode a binarized page (2D ``uint8`` array, 0 = black) for archiving."""
+    height, width = binary.shape[:2]
+    return BilevelPage(width, height, dpi, encode_g4(binary.tobytes(), width, height))
+
+
+def write_pdf(path: str, pages: Sequence[BilevelPage]) -> None:
+    """Write ``pages`` as a PDF of CCITT G4 images sized by their DPI."""
+    offsets: List[int] = []
+    with open(path, "wb") as f:
+
+        def obj(body: bytes, stream: bytes = b"") -> None:
+            offsets.append(f.tell())
+            f.write(b"%d 0 obj\n" % len(offsets) + body)
+            if stream:
+                f.write(b"\nstream\n" + stream + b"\nendstream")
+            f.write(b"\nendobj\n")
+
+        f.write(b"%PDF-1.4\n%\xe2\xe3\xcf\xd3\n")
+        kids = b" ".join(b"%d 0 R" % (3 + 3 * i) for i in range(len(pages)))
+        obj(b"<< /Type /Catalog /Pages 2 0 R >>")
+        obj(b"<< /Type /Pages /Kids [%s] /Count %d >>" % (kids, len(pages)))
+        for i, page in enumerate(pages):
+            image, content = 4 + 3 * i, 5 + 3 * i
+            w = page.width * 72 / page.dpi
+            h = page.height * 72 / page.dpi
+            obj(
+                b"<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %.2f %.2f] "
+                b"/Resources << /XObject << /Im0 %d 0 R >> >> /Contents %d 0 R >>"
+                % (w, h, image, content)
+            )
+            obj(
+                b"<< /Type /XObject /Subtype /Image /Width %d /Height %d "
+                b"/ColorSpace /DeviceGray /BitsPerComponent 1 /Filter /CCITTFaxDecode "
+                b"/DecodeParms << /K -1 /Columns %d /Rows %d >> /Length %d >>"
+                % (page.width, page.height, page.width, page.height, len(page.data)),
+                page.data,
+            )
+            draw = b"q %.2f 0 0 %.2f 0 0 cm /Im0 Do Q" % (w, h)
+            obj(b"<< /Length %d >>" % len(draw), draw)
+        xref = f.tell()
+        f.write(b"xref\n0 %d\n0000000000 65535 f \n" % (len(offsets) + 1))
+        for offset in offsets:
+            f.write(b"%010d 00000 n \n" % offset)
+        f.write(
+            b"trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%d\n%%%%EOF\n"
+            % (len(offsets) + 1, xref)
+        )
+
+
+def _object_streams(data: bytes) -> List[bytes]:
+    # Obiekty PDF 1.5 mogą być ukryte w skompresowanych strumieniach obiektów
+    bodies = []
+    for match in _OBJECT_STREAM.finditer(data):
+        start = data.find(b"stream", match.end())
+        if start < 0:
+            raise ValueError("Brak strumienia obiektów")
+        start += len(b"stream")
+        start += 2 if data[start:start + 2] == b"\r\n" else 1
+        bodies.append(zlib.decompressobj().decompress(data[start:]))
+    return bodies
+
+
+def scanned_page_count(path: str) -> Optional[int]:
+    """Return the page count of a PDF that consists of page images only.
+
+    Returns ``None`` for PDFs with a text layer, form fields, annotations,
+    signatures, attachments or encryption, and for files that cannot be
+    inspected; replacing those with G4 images would lose content.
+    """
+    try:
+        with open(path, "rb") as f:
+            data = f.read()
+        parts = [data] + _object_streams(data)
+    except (OSError, ValueError, zlib.error) as exc:
+        logger.warning("Nie można sprawdzić zawartości %s: %s", path, exc)
+        return None
+    if any(_NOT_IMAGE_ONLY.search(part) for part in parts):
+        return None
+    return sum(len(_PAGE.findall(part)) for part in parts)
+
+
+@dataclass
+class RecompressResult:
+    """Outcome of recompressing one archived file."""
+
+    path: str
+    original_size: int = 0
+    size: int = 0
+    replaced: bool = False
+    reason: str = ""
+
+
+class Recompressor:
+    """Replace archived copies with G4 PDFs once they have been placed."""
+
+    def __init__(self, max_workers: int = 0) -> None:
+        self._pool = ThreadPoolExecutor(max_workers=max_workers or os.cpu_count() or 1)
+        self._futures: List[Future] = []
+
+    def submit(
+        self, placement: "Future", pages: Sequence[Optional[BilevelPage]]
+    ) -> "Future[RecompressResult]":
+        """Recompress the file of ``placement`` (a ``PlacementResult`` future).
+
+        ``pages`` holds the encoded pages of the document; a ``None`` page
+        has colour content and keeps the original.  The file is replaced
+        only when it holds exactly ``len(pages)`` page images and nothing
+        else (see :func:`scanned_page_count`), and only when it is a copy
+        separate from the source -- never when the placement method is
+        ``same``, i.e. the archive file is the input file itself.
+        """
+        future = self._pool.submit(self._recompress, placement, list(pages))
+        self._futures.append(future)
+        return future
+
+    @staticmethod
+    def _recompress(placement: "Future", pages: List[Optional[BilevelPage]]) -> RecompressResult:
+        placed = placement.result()
+        result = RecompressResult(placed.dst)
+        if not placed.ok:
+            result.reason = "błąd kopiowania"
+            return result
+        if placed.method not in _SEPARATE_COPIES:
+            result.reason = "brak odrębnej kopii"
+            return result
+        if not pages or any(page is None for page in pages):
+            result.reason = "kolor"
+            return result
+        page_count = scanned_page_count(placed.dst)
+        if page_count is None:
+            # Warstwa tekstowa, formularze lub podpisy zostałyby utracone
+            result.reason = "nie tylko obrazy"
+            return result
+        if page_count != len(pages):
+            # OCR przerwany lub nieudany: brak części stron
+            result.reason = "niepełny dokument"
+            return result
+        tmp = placed.dst + ".g4.tmp"
+        try:
+            result.original_size = os.path.getsize(placed.dst)
+            write_pdf(tmp, pages)
+            result.size = os.path.getsize(tmp)
+            if result.size >= result.original_size:
+                # Plik cyfrowy lub już skompresowany: zostaje oryginał
+                result.reason = "bez zysku"
+                os.remove(tmp)
+                return result
+            with open(tmp, "rb+") as f:
+                os.fsync(f.fileno())
+            os.replace(tmp, placed.dst)
+            result.replaced = True
+        except OSError as exc:
+            result.reason = str(exc)
+            logger.error("Błąd rekompresji %s: %s", placed.dst, exc)
+            try:
+                os.remove(tmp)
+            except OSError:
+                pass
+        return result
+
+    def close(self) -> List[RecompressResult]:
+        """Wait for all files and return their results in submission order."""
+        results = [f.result() for f in self._futures]
+        self._pool.shutdown(wait=True)
+        return results
+
+
+def savings(results: Sequence[RecompressResult]) -> Tuple[int, int, int]:
+    """Return ``(replaced files, bytes before, bytes after)`` of ``results``."""
+    replaced = [r for r in results if r.replaced]
+    return (
+        len(replaced),
+        sum(r.original_size for r in replaced),
+        sum(r.size for r in replaced),
+    )
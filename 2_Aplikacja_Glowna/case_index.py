@@ -0,0 +1,309 @@
+"""Snapping OCR'd case signatures to known cases (``native/case_index.c``).
+
+OCR often confuses look-alike characters in case signatures (``O``/``0``,
+``I``/``1``, ``S``/``5``) and splits or merges their parts, so the extracted
+signature names a case that does not exist and the document gets a wrong
+file name.  :class:`CaseIndex` holds the signatures of known cases and
+returns the one closest to an extracted signature.
+
+Signatures are compared in a folded form: upper case, without whitespace,
+with diacritics removed and look-alike characters merged, so the usual OCR
+confusions cost nothing and every other difference is one edit.  The Roman
+numeral of the court division (``I``, ``II`` in ``II C 105/24``) is kept as
+letters, and a signature is never snapped to a case of another division.  The folded
+keys are kept in a compressed trie searched with a bit-parallel bounded
+Levenshtein distance, which answers in microseconds for tens of thousands
+of cases.
+
+Known cases are read from a text file with one signature per line (see
+:func:`default_signatures_path`); lines starting with ``#`` are comments.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import logging
+import os
+import re
+import sys
+import threading
+import unicodedata
+from array import array
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Sequence, Tuple
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Znaki mylone przez OCR sprowadzane do jednej postaci
+_CONFUSIONS = str.maketrans({
+    "O": "0", "Q": "0",
+    "I": "1", "L": "1", "|": "1", "!": "1",
+    "S": "5",
+    "B": "8",
+    "Z": "2",
+    "\\": "/",
+    ",": ".",
+    "_": "-",
+    "–": "-", "—": "-",
+})
+# Numer wydziału na początku sygnatury: cyfry rzymskie (lub mylone z nimi
+# znaki) przed spacją i symbolem repertorium
+_DIVISION = re.compile(r"^\s*([IVXLCivxlc1|!]+)\s+(?=[^\W\d_])")
+_DIVISION_CONFUSIONS = str.maketrans({"1": "I", "|": "I", "!": "I", "L": "I"})
+# Najdłuższa sygnatura obsługiwana przez wyszukiwanie bitowo-równoległe
+_MAX_NATIVE_LEN = 64
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.caseidx_build.argtypes = [
+        ctypes.c_char_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int
+    ]
+    lib.caseidx_build.restype = ctypes.c_void_p
+    lib.caseidx_free.argtypes = [ctypes.c_void_p]
+    lib.caseidx_free.restype = None
+    lib.caseidx_nodes.argtypes = [ctypes.c_void_p]
+    lib.caseidx_nodes.restype = ctypes.c_int
+    lib.caseidx_search.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_int),
+        ctypes.POINTER(ctypes.c_int),
+        ctypes.c_int,
+    ]
+    lib.caseidx_search.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("case_index", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native case index library can be used."""
+    return _library.is_available()
+
+
+def _fold_division(signature: str) -> Tuple[str, str]:
+    """Split ``signature`` into its folded division numeral and the rest."""
+    match = _DIVISION.match(signature)
+    if match is None:
+        return "", signature
+    return match.group(1).upper().translate(_DIVISION_CONFUSIONS), signature[match.end():]
+
+
+def fold_signature(signature: str) -> str:
+    """Return the comparison form of ``signature``.
+
+    >>> fold_signature("I C 1O5/24") == fold_signature("1 c 105/24")
+    True
+    >>> fold_signature("I C 105/24") == fold_signature("II C 105/24")
+    False
+    """
+    division, rest = _fold_division(signature)
+    text = unicodedata.normalize("NFKD", rest.upper())
+    text = "".join(ch for ch in text if not unicodedata.combining(ch) and not ch.isspace())
+    return division + text.translate(_CONFUSIONS).encode("ascii", "ignore").decode("ascii")
+
+
+def _levenshtein_row(key: str, query: str, max_distance: int) -> Optional[int]:
+    prev = list(range(len(query) + 1))
+    for i, ch in enumerate(key, 1):
+        cur = [i]
+        for j, qch in enumerate(query, 1):
+            cur.append(min(prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + (ch != qch)))
+        if min(cur) > max_distance:
+            return None
+        prev = cur
+    return prev[-1] if prev[-1] <= max_distance else None
+
+
+@dataclass
+class CaseMatch:
+    """A known case close to the extracted signature."""
+
+    signature: str
+    distance: int
+
+
+class _PyTrie:
+    """Python trie with row-by-row Levenshtein search, used without the library."""
+
+    def __init__(self, keys: Sequence[str]) -> None:
+        self.root: dict = {}
+        for i, key in enumerate(keys):
+            node = self.root
+            for ch in key:
+                node = node.setdefault(ch, {})
+            node[None] = i
+
+    def search(self, query: str, max_distance: int) -> Dict[int, int]:
+        found: Dict[int, int] = {}
+        stack = [(self.root, list(range(len(query) + 1)))]
+        while stack:
+            node, row = stack.pop()
+            if None in node and row[-1] <= max_distance:
+                found[node[None]] = row[-1]
+            for ch, child in node.items():
+                if ch is None:
+                    continue
+                cur = [row[0] + 1]
+                for j, qch in enumerate(query, 1):
+                    cur.append(min(row[j] + 1, cur[j - 1] + 1, row[j - 1] + (ch != qch)))
+                if min(cur) <= max_distance:
+                    stack.append((child, cur))
+        return found
+
+
+class CaseIndex:
+    """Known case signatures searchable with OCR-tolerant edit distance."""
+
+    def __init__(self, signatures: Sequence[str], max_distance: int = 2) -> None:
+        """Build the index.
+
+        Args:
+            signatures: Known case signatures in their proper spelling.
+            max_distance: Largest number of edits, after folding, between an
+                extracted signature and the case it is snapped to.  Short
+                signatures allow fewer edits (see :meth:`snap`).
+        """
+        self.max_distance = max_distance
+        by_key: Dict[str, List[str]] = {}
+        for signature in signatures:
+            signature = " ".join(signature.split())
+            key = fold_signature(signature)
+            if key and signature not in by_key.setdefault(key, []):
+                by_key[key].append(signature)
+        self.keys = sorted(by_key, key=lambda k: k.encode("ascii"))
+        self.signatures = [by_key[key] for key in self.keys]
+        self._lib = _library.load()
+        self._native = None
+        self._trie = None
+        if self._lib is not None:
+            data = "".join(self.keys).encode("ascii")
+            offsets = array("i", [0])
+            for key in self.keys:
+                offsets.append(offsets[-1] + len(key))
+            address, _ = offsets.buffer_info()
+            self._native = self._lib.caseidx_build(
+                data, ctypes.cast(address, ctypes.POINTER(ctypes.c_int)), len(self.keys)
+            )
+            if not self._native:
+                raise MemoryError("caseidx_build")
+        else:
+            self._trie = _PyTrie(self.keys)
+
+    def __len__(self) -> int:
+        return len(self.keys)
+
+    def __del__(self) -> None:
+        if getattr(self, "_native", None):
+            self._lib.caseidx_free(self._native)
+            self._native = None
+
+    def search(self, signature: str, max_distance: Optional[int] = None) -> List[CaseMatch]:
+        """Return known cases within ``max_distance`` edits, closest first."""
+        if max_distance is None:
+            max_distance = self.max_distance
+        query = fold_signature(signature)
+        if not query:
+            return []
+        found = self._search_folded(query, max_distance)
+        matches = [
+            CaseMatch(sig, dist)
+            for idx, dist in found.items()
+            for sig in self.signatures[idx]
+        ]
+        matches.sort(key=lambda m: (m.distance, m.signature))
+        return matches
+
+    def _search_folded(self, query: str, max_distance: int) -> Dict[int, int]:
+        if self._native is not None and len(query) <= _MAX_NATIVE_LEN:
+            cap = 16
+            while True:
+                ids = (ctypes.c_int * cap)()
+                dists = (ctypes.c_int * cap)()
+                found = self._lib.caseidx_search(
+                    self._native, query.encode("ascii"), len(query), max_distance,
+                    ids, dists, cap,
+                )
+                if found <= cap:
+                    return dict(zip(ids[:found], dists[:found]))
+                cap = found
+        if self._trie is not None:
+            return self._trie.search(query, max_distance)
+        # Sygnatura dłuższa niż słowo maszynowe: porównanie z każdym kluczem
+        found = {}
+        for idx, key in enumerate(self.keys):
+            if abs(len(key) - len(query)) <= max_distance:
+                dist = _levenshtein_row(key, query, max_distance)
+                if dist is not None:
+                    found[idx] = dist
+        return found
+
+    def snap(self, signature: str) -> Optional[CaseMatch]:
+        """Return the single known case closest to ``signature``.
+
+        The allowed distance is ``max_distance`` but short signatures get
+        fewer edits: up to seven folded characters only look-alike
+        confusions are corrected, so ``I C 1/24`` never turns into
+        ``I C 7/24``, and every further four characters allow one more
+        edit.  A signature with a division numeral only snaps to cases of
+        the same division, so ``I C 105/24`` never becomes ``II C 105/24``.
+        ``None`` is returned when nothing is close enough or two different
+        cases are equally close.
+        """
+        limit = min(self.max_distance, max(0, (len(fold_signature(signature)) - 4) // 4))
+        matches = self.search(signature, limit)
+        division = _fold_division(signature)[0]
+        if division:
+            matches = [m for m in matches if _fold_division(m.signature)[0] == division]
+        if not matches:
+            return None
+        if len(matches) > 1 and matches[1].distance == matches[0].distance:
+            return None
+        return matches[0]
+
+
+def default_signatures_path() -> str:
+    """Return ``sygnatury.txt`` next to the application."""
+    if getattr(sys, "frozen", False):
+        base = os.path.dirname(sys.executable)
+    else:
+        base = os.path.dirname(os.path.abspath(__file__))
+    return os.path.join(base, "sygnatury.txt")
+
+
+def read_signatures(path: str) -> List[str]:
+    """Read known signatures from ``path``, one per line."""
+    with open(path, encoding="utf-8-sig") as f:
+        return [
+            line.strip() for line in f if line.strip() and not line.lstrip().startswith("#")
+        ]
+
+
+_shared: Optional[Tuple[Tuple[str, float, int], CaseIndex]] = None
+_shared_lock = threading.Lock()
+
+
+def load_case_index(settings=None) -> Optional[CaseIndex]:
+    """Return the index of known cases shared by all workers.
+
+    The file is read again when it changes.  Returns ``None`` when there is
+    no list of known cases.
+    """
+    global _shared
+    path = getattr(settings, "case_signatures_file", "") or default_signatures_path()
+    max_distance = getattr(settings, "case_signature_max_distance", 2)
+    try:
+        mtime = os.path.getmtime(path)
+    except OSError:
+        return None
+    key = (os.path.abspath(path), mtime, max_distance)
+    with _shared_lock:
+        if _shared is None or _shared[0] != key:
+            index = CaseIndex(read_signatures(path), max_distance)
+            logger.info("Wczytano %d sygnatur spraw z %s", len(index), path)
+            _shared = (key, index)
+        return _shared[1]
@@ -95,10 +95,65 @@ class AppSettings(BaseModel):
     ocr_dpi: int = 300
     # Maximum number of threads used for OCR; 0 means auto-detect
     ocr_workers: int = 0
+    # Threads extracting metadata while OCR continues; 0 means min(4, cores)
+    extraction_workers: int = 0
+    # OCR-finished documents waiting for extraction before OCR is throttled
+    pipeline_queue_size: int = 8
+    # spaCy NER worker processes fed by nlp.pipe; 0 means all cores
+    ner_processes: int = 1
+    # Documents per nlp.pipe batch; small values keep the pipeline streaming
+    ner_batch_size: int = 4
+    # Concurrent file copies into the archive; 0 means min(8, 2 * cores)
+    copy_workers: int = 0
+    # Flush archived files to disk every N files; 0 leaves it to the OS
+    copy_fsync_batch: int = 64
+    # Compare the SHA-256 of every archived copy with its source
+    verify_copies: bool = False
+    # Hard-link instead of copying when input and archive share a filesystem
+    copy_hardlinks: bool = False
+    # Index the OCR text of archived documents for full-text search
+    fulltext_index: bool = True
+    # Full-text index directory; empty means "indeks" next to the application
+    fulltext_index_dir: str = ""
+    # Documents buffered in memory before a new index segment is written
+    fulltext_flush_docs: int = 256
+    # Number of index segments that triggers a background merge
+    fulltext_merge_factor: int = 8
+    # Flag incoming documents whose OCR text nearly matches an archived one
+    duplicate_detection: bool = True
+    # SimHash bits (0-7) two documents may differ by to count as duplicates
+    duplicate_max_distance: int = 3
+    # Reuse the OCR text of pages identical to recognised ones (after binarization)
+    ocr_page_cache: bool = False
+    # dHash/pHash bits (0-8) a page may differ by to reuse its cached text
+    ocr_page_cache_max_distance: int = 0
+    # Known case signatures, one per line; empty means "sygnatury.txt" next to the application
+    case_signatures_file: str = ""
+    # Edits allowed when snapping an OCR'd signature to a known case
+    case_signature_max_distance: int = 2
+    # Read registry barcodes and QR codes of the first page into the metadata
+    barcode_routing: bool = True
+    # Comma-separated prefixes of registry barcodes outside the "KW/2024/00123" format
+    barcode_registry_prefixes: str = ""
+    # Skip OCR of documents whose QR code carries the case signature
+    barcode_skip_ocr: bool = False
+    # Replace archived scans with CCITT G4 (black-and-white) PDFs when smaller
+    archive_bilevel: bool = False
+    # Share of sampled pixels that may be colour before a page keeps its original
+    archive_bilevel_max_colour: float = 0.001
     blur_kernel_size: int = 3
     adaptive_threshold_block_size: int = 11
     adaptive_threshold_c: int = 2
 
+    # LLM assistant backend: "auto", "torch" or "gguf" (native llama.cpp)
+    llm_backend: str = "auto"
+    # CPU threads for the native LLM backend; 0 means all cores
+    llm_threads: int = 0
+    # Persist the KV cache of the constant prompt prefix next to the GGUF model
+    llm_prompt_cache: bool = True
+    # Documents decoded together in one batch by the native LLM backend
+    llm_parallel: int = 4
+
     @validator("blur_kernel_size", pre=True, always=True, allow_reuse=True)
     def _ensure_blur_kernel_odd(cls, value):
         """Coerce blur kernel size to a valid odd number."""
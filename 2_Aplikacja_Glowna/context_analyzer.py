@@ -1,45 +1,21 @@
 import os
 import json
 import re
+import string
 from datetime import datetime
 from typing import Any, Dict, List, Optional
 
 import logging
 import random
 
-try:
-    # Prefer szybkie i dokładne porównanie z biblioteki rapidfuzz
-    from rapidfuzz.distance import JaroWinkler
+from document_analysis import DocumentAnalysis, ensure_analysis
+import string_similarity
+
 
-    def fuzzy_similarity(a: str, b: str) -> float:
-        """Calculate normalized similarity using Jaro-Winkler from rapidfuzz."""
-        return JaroWinkler.normalized_similarity(a, b)
-except Exception:
-    try:  # Fallback do biblioteki python-Levenshtein
-        import Levenshtein
+def fuzzy_similarity(a: str, b: str) -> float:
+    """Jaro-Winkler similarity from the native kernels in ``string_similarity``."""
+    return string_similarity.jaro_winkler(a, b)
 
-        def fuzzy_similarity(a: str, b: str) -> float:
-            return Levenshtein.ratio(a, b)
-    except Exception:  # Ostateczny prosty fallback
-        def fuzzy_similarity(a: str, b: str) -> float:
-            if a == b:
-                return 1.0
-            if not a or not b:
-                return 0.0
-            m, n = len(a), len(b)
-            dp = list(range(n + 1))
-            for i in range(1, m + 1):
-                prev = i - 1
-                dp[0] = i
-                for j in range(1, n + 1):
-                    cur = dp[j]
-                    if a[i - 1] == b[j - 1]:
-                        dp[j] = prev
-                    else:
-                        dp[j] = 1 + min(prev, dp[j], dp[j - 1])
-                    prev = cur
-            distance = dp[n]
-            return 1 - distance / max(m, n)
 
 try:
     from sentence_transformers import SentenceTransformer
@@ -63,13 +39,19 @@ except Exception:  # pragma: no cover - fallback stub
 
 # Opcjonalna szybka implementacja podobieństwa kosinusowego
 try:
-    from fast_similarity import cosine_similarity as fast_cosine
+    from native_kernels import cosine_similarity as fast_cosine
 except Exception:  # pragma: no cover - pure Python fallback
     def fast_cosine(a, b):
         dot = sum(x * y for x, y in zip(a, b))
         na = sum(x * x for x in a) ** 0.5
         nb = sum(y * y for y in b) ** 0.5
         return 0.0 if na == 0.0 or nb == 0.0 else dot / (na * nb)
+
+# Opcjonalny natywny silnik embeddingów int8 (native/minilm.c)
+try:
+    import native_embedder
+except Exception:  # pragma: no cover - optional native backend
+    native_embedder = None
 
 # Konfiguracja logowania
 logger = logging.getLogger(__name__)
@@ -87,8 +69,7 @@ class ContextAwareDocumentAnalyzer:
         "2. DATA dokumentu (w formacie YYYY-MM-DD kiedy został wystawiony lub podpisany, jeśli jest podana w różnych formatach, wybierz najbardziej prawdopodobną)\n"
         "3. NADAWCA/ODBIORCA (nazwa firmy lub instytucji lub osoby fizycznej, która wystawia lub otrzymuje dokument)\n"
         "4. TEMAT dokumentu (krótki opis czego dotyczy)\n"
-        "5. NUMER DOKUMENTU (np. nr umowy, nr faktury, sygnatura) jeśli występuje"
-        "{similar_examples}\n\n"
+        "5. NUMER DOKUMENTU (np. nr umowy, nr faktury, sygnatura) jeśli występuje\n\n"
         "Zwróć wyniki WYŁĄCZNIE w formacie JSON, nic poza tym. Format:\n"
         "{{\n"
         "  \"typ_dokumentu\": \"OKREŚLONY_TYP\",\n"
@@ -104,7 +85,8 @@ class ContextAwareDocumentAnalyzer:
         "- Znajdź datę w różnych formatach i przekształć ją do formatu YYYY-MM-DD\n"
         "- Określ typ dokumentu na podstawie jego struktury i treści\n"
         "- Jeśli dokument zawiera wiele dat, wybierz tę, która najprawdopodobniej jest datą dokumentu\n\n"
-        "Jeśli jakaś informacja nie występuje w tekście, użyj pustego ciągu \"\" dla danego pola.\n"
+        "Jeśli jakaś informacja nie występuje w tekście, użyj pustego ciągu \"\" dla danego pola."
+        "{similar_examples}\n"
         "<|user|>\n"
         "{document_text}\n"
         "<|assistant|>"
@@ -122,6 +104,8 @@ class ContextAwareDocumentAnalyzer:
             memory_file: Optional path to a JSON file with stored context.
             prompts: Optional mapping with custom prompt templates.
             embedding_model: Optional preloaded SentenceTransformer instance.
+                Defaults to the native int8 encoder when it is built and
+                its model file exists, otherwise to SentenceTransformer.
         """
         if memory_file is None:
             # Domyślnie zapisujemy w tym samym katalogu co aplikację
@@ -134,14 +118,22 @@ class ContextAwareDocumentAnalyzer:
 
         self.document_memory = []  # Przechowuje analizowane dokumenty
         self.corrections_memory = []  # Przechowuje poprawki użytkownika
+        self._embedding_cache: Dict[str, List[float]] = {}  # fragment -> wektor
         # Model embeddingów do porównywania dokumentów
-        self.embedding_model = embedding_model or SentenceTransformer(
-            'sentence-transformers/all-MiniLM-L6-v2'
-        )
+        self.embedding_model = embedding_model or self._default_embedding_model()
 
         # Załaduj istniejącą pamięć, jeśli istnieje
         self.load_memory()
         
+    @staticmethod
+    def _default_embedding_model():
+        if native_embedder is not None and native_embedder.is_available():
+            try:
+                return native_embedder.NativeSentenceEncoder()
+            except Exception as e:
+                logger.warning(f"Nie udało się załadować natywnego modelu embeddingów: {e}")
+        return SentenceTransformer('sentence-transformers/all-MiniLM-L6-v2')
+
     def load_memory(self) -> None:
         """Load stored contextual data from ``memory_file``."""
         if os.path.exists(self.memory_file):
@@ -227,36 +219,54 @@ class ContextAwareDocumentAnalyzer:
             return True
         return False
     
-    def find_similar_documents(self, text: str, top_n: int = 3) -> List[Dict[str, Any]]:
-        """Find documents in memory similar to the provided text."""
+    def _memory_embeddings(self) -> List[List[float]]:
+        """Return embeddings of the memory fragments, encoding only new ones."""
+        missing = list(dict.fromkeys(
+            doc['text_fragment'] for doc in self.document_memory
+            if doc['text_fragment'] not in self._embedding_cache
+        ))
+        if missing:
+            if len(self._embedding_cache) > 2 * len(self.document_memory):
+                self._embedding_cache = {}
+                return self._memory_embeddings()
+            for fragment, vector in zip(missing, self.embedding_model.encode(missing)):
+                self._embedding_cache[fragment] = list(vector)
+        return [self._embedding_cache[doc['text_fragment']] for doc in self.document_memory]
+
+    def find_similar_documents(
+        self, text: str, top_n: int = 3, analysis: Optional[DocumentAnalysis] = None
+    ) -> List[Dict[str, Any]]:
+        """Find documents in memory similar to the provided text.
+
+        Args:
+            text: Text of the analysed document.
+            top_n: Maximum number of documents to return.
+            analysis: Optional shared analysis of ``text`` whose cached
+                embedding is reused.
+        """
         if not self.document_memory or len(self.document_memory) < 2:
             return []
             
-        # Przygotuj wektor dla nowego tekstu
         try:
-            all_texts = [doc['text_fragment'] for doc in self.document_memory]
-            all_texts.append(text[:2000])  # Dodaj nowy tekst
+            # Wektor nowego tekstu liczony raz na dokument, wektory pamięci z cache
+            analysis = ensure_analysis(text, analysis)
+            query = analysis.embedding(self.embedding_model)
+            vectors = self._memory_embeddings()
+
+            if native_embedder is not None:
+                ranked = native_embedder.top_k_vectors(query, vectors, top_n)
+            else:
+                similarities = [fast_cosine(query, vec) for vec in vectors]
+                ranked = sorted(
+                    enumerate(similarities), key=lambda item: item[1], reverse=True
+                )[:top_n]
 
-            # Oblicz embeddingi dla wszystkich tekstów
-            embeddings = self.embedding_model.encode(all_texts)
-
-            new_doc_vector = embeddings[-1]
-            existing_docs_vectors = embeddings[:-1]
-
-            similarities = [
-                fast_cosine(new_doc_vector, vec) for vec in existing_docs_vectors
-            ]
-
-            similar_indices = sorted(
-                range(len(similarities)), key=lambda i: similarities[i], reverse=True
-            )[:top_n]
-            
             similar_docs = []
-            for idx in similar_indices:
-                if similarities[idx] > 0.2:  # Minimalny próg podobieństwa
+            for idx, score in ranked:
+                if score > 0.2:  # Minimalny próg podobieństwa
                     similar_docs.append({
                         'document': self.document_memory[idx],
-                        'similarity': float(similarities[idx])
+                        'similarity': float(score)
                     })
             
             return similar_docs
@@ -278,11 +288,14 @@ class ContextAwareDocumentAnalyzer:
             return None
             
         # Znajdź najbardziej podobną poprawkę na podstawie fuzzy match
+        # Jedno wywołanie dla wszystkich poprawek: maski tekstu liczone raz
+        scores = string_similarity.batch(
+            text, [correction['text_fragment'] for correction in relevant_corrections]
+        )
         max_similarity = -1.0
         most_similar_correction = None
 
-        for correction in relevant_corrections:
-            similarity = fuzzy_similarity(correction['text_fragment'], text)
+        for correction, similarity in zip(relevant_corrections, scores):
             if similarity > max_similarity:
                 max_similarity = similarity
                 most_similar_correction = correction
@@ -292,9 +305,14 @@ class ContextAwareDocumentAnalyzer:
 
         return None
     
-    def generate_enhanced_prompt(self, text: str, original_filename: str = "") -> str:
+    def generate_enhanced_prompt(
+        self,
+        text: str,
+        original_filename: str = "",
+        analysis: Optional[DocumentAnalysis] = None,
+    ) -> str:
         """Generate a prompt for the LLM enriched with contextual examples."""
-        similar_docs = self.find_similar_documents(text)
+        similar_docs = self.find_similar_documents(text, analysis=analysis)
 
         similar_section = ""
         if similar_docs:
@@ -314,6 +332,20 @@ class ContextAwareDocumentAnalyzer:
         template = self.prompts.get("metadata_prompt", self.DEFAULT_METADATA_PROMPT)
         prompt = template.format(similar_examples=similar_section, document_text=text[:1500])
         return prompt
+
+    def static_prompt_prefix(self) -> str:
+        """Return the part of the metadata prompt shared by every document.
+
+        This is the literal text of the template up to its first placeholder,
+        so its KV cache can be computed once by the LLM backend and reused.
+        """
+        template = self.prompts.get("metadata_prompt", self.DEFAULT_METADATA_PROMPT)
+        prefix = []
+        for literal, field, _, _ in string.Formatter().parse(template):
+            prefix.append(literal)
+            if field is not None:
+                break
+        return "".join(prefix)
     
     def apply_contextual_corrections(self, extracted_info: Dict[str, str], text: str) -> Dict[str, str]:
         """Apply corrections based on previously stored user adjustments."""
@@ -0,0 +1,512 @@
+"""Distributed OCR: a coordinator shards PDFs, stateless workers pull pages.
+
+:class:`Coordinator` splits every document into page ranges of
+``pages_per_task`` pages and serves them over TCP.  Workers started with
+:func:`run_worker` -- on other machines or as extra local processes --
+lease one range at a time, send heartbeats while recognizing it and stream
+the text back.  The protocol is one JSON object per line:
+
+* ``{"op": "hello", "worker": id, "token": t}`` -- introduces the worker;
+  every other operation is refused until the shared token matches,
+* ``{"op": "lease"}`` -- answered with ``{"task": {...}}``, ``{"wait": s}``
+  while other leases may still come back, or ``{"done": true}``,
+* ``{"op": "heartbeat", "task": id}`` -- extends the lease,
+* ``{"op": "result", "task": id, "text": "...", "error": "..."}`` --
+  accepted only from the worker currently holding the lease,
+* ``{"op": "release", "task": id, "error": "..."}`` -- gives the lease back
+  after a failure of the node itself, such as a missing engine or input.
+
+A lease that is not renewed within ``lease_seconds``, whose connection
+drops or that is given back goes back to the queue; after ``max_attempts``
+leases the range is reported as failed.  Errors reported by the OCR itself
+are final.  A worker that gives a lease back stops, so one misconfigured
+node does not fail the ranges of the whole job.  Only the
+first result of a range is kept, so a late answer from a worker presumed
+lost is harmless.  Workers read input from a shared path, or with
+``ship_input`` the coordinator sends each file once per worker, with the
+first lease of that document.
+
+Workers keep no state between tasks apart from shipped files, so nodes can
+be added or removed while a job runs and throughput grows with their number.
+"""
+
+from __future__ import annotations
+
+import base64
+import collections
+import hmac
+import json
+import logging
+import os
+import queue
+import secrets
+import socket
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import uuid
+from dataclasses import dataclass, field
+from typing import Callable, Dict, Iterator, List, Optional, Sequence, Tuple
+
+logger = logging.getLogger(__name__)
+
+if getattr(sys, "frozen", False):
+    _BASE_PATH = sys._MEIPASS
+else:
+    _BASE_PATH = os.path.dirname(os.path.abspath(__file__))
+
+# Przerwa, po której pracownik ponownie prosi o zadanie, gdy kolejka jest
+# pusta, a część dzierżaw może jeszcze wrócić
+_WAIT_SECONDS = 0.2
+
+
+@dataclass
+class DocumentResult:
+    """OCR result of one document, assembled from its page ranges."""
+
+    index: int
+    path: str
+    text: str
+    error: str = ""
+
+
+@dataclass
+class _Task:
+    id: int
+    doc: int
+    part: int
+    first: int
+    last: int
+    attempts: int = 0
+    owner: Optional[str] = None
+    deadline: float = 0.0
+    done: bool = False
+
+
+@dataclass
+class _Document:
+    path: str
+    parts: List[Optional[str]]
+    errors: List[str] = field(default_factory=list)
+    remaining: int = 0
+
+
+def _count_pages(path: str) -> int:
+    """Return the page count of ``path`` or 0 when it cannot be read."""
+    try:
+        from pdf2image import pdfinfo_from_path
+
+        info = pdfinfo_from_path(path, poppler_path=os.environ.get("POPPLER_PATH"))
+        return int(info.get("Pages", 0))
+    except Exception as exc:
+        logger.warning("Nie można odczytać liczby stron %s: %s", path, exc)
+        return 0
+
+
+def _shards(pages: int, pages_per_task: int) -> List[Tuple[int, int]]:
+    # Nieznana liczba stron: cały dokument jako jedno zadanie (last = 0)
+    if pages <= 0:
+        return [(1, 0)]
+    return [
+        (first, min(pages, first + pages_per_task - 1))
+        for first in range(1, pages + 1, pages_per_task)
+    ]
+
+
+class _Handler(socketserver.StreamRequestHandler):
+    def handle(self) -> None:
+        coordinator: Coordinator = self.server.coordinator
+        worker = f"{self.client_address[0]}:{self.client_address[1]}"
+        authenticated = False
+        # Dokumenty już przesłane temu pracownikowi (ship_input)
+        shipped: set = set()
+        try:
+            for line in self.rfile:
+                if not line.strip():
+                    continue
+                message = json.loads(line)
+                op = message.get("op")
+                if op == "hello":
+                    token = str(message.get("token", ""))
+                    if not hmac.compare_digest(token.encode(), coordinator.token.encode()):
+                        logger.warning("Odrzucono pracownika %s: błędny token", worker)
+                        reply = {"error": "błędny token"}
+                        self.wfile.write(json.dumps(reply).encode("utf-8") + b"\n")
+                        return
+                    authenticated = True
+                    worker = f"{message.get('worker', worker)}@{worker}"
+                    reply = {"ok": True}
+                elif not authenticated:
+                    logger.warning("Odrzucono %s: operacja %s przed hello", worker, op)
+                    return
+                elif op == "lease":
+                    reply = coordinator._lease(worker, shipped)
+                elif op == "heartbeat":
+                    reply = {"ok": coordinator._renew(message["task"], worker)}
+                elif op == "release":
+                    reply = {
+                        "ok": coordinator._give_back(
+                            message["task"], worker, message.get("error", "")
+                        )
+                    }
+                elif op == "result":
+                    reply = {
+                        "ok": coordinator._complete(
+                            message["task"],
+                            worker,
+                            message.get("text", ""),
+                            message.get("error", ""),
+                        )
+                    }
+                else:
+                    reply = {"error": f"nieznana operacja: {op}"}
+                self.wfile.write(json.dumps(reply).encode("utf-8") + b"\n")
+        except (OSError, ValueError, KeyError) as exc:
+            logger.warning("Połączenie z %s przerwane: %s", worker, exc)
+        finally:
+            coordinator._release(worker)
+
+
+class _Server(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+class Coordinator:
+    """Shard PDFs into page ranges and hand them out to TCP workers.
+
+    Args:
+        pdf_paths: documents to recognize.
+        pages_per_task: pages per leased range.
+        lease_seconds: time a lease stays valid without a heartbeat.
+        max_attempts: leases of one range before it is reported as failed.
+        ship_input: send file contents with the lease instead of relying on
+            a path shared by all nodes.
+        host, port: listening address; port 0 picks a free port.
+        token: secret the workers must present in ``hello``; a random one
+            is generated when empty (see :attr:`token`).
+        count_pages: page counter, ``pdfinfo`` by default.
+    """
+
+    def __init__(
+        self,
+        pdf_paths: Sequence[str],
+        pages_per_task: int = 16,
+        lease_seconds: float = 60.0,
+        max_attempts: int = 3,
+        ship_input: bool = False,
+        host: str = "127.0.0.1",
+        port: int = 0,
+        count_pages: Optional[Callable[[str], int]] = None,
+        token: str = "",
+    ) -> None:
+        count_pages = count_pages or _count_pages
+        self.token = token or secrets.token_urlsafe(16)
+        self.lease_seconds = lease_seconds
+        self.max_attempts = max_attempts
+        self.ship_input = ship_input
+        self._cond = threading.Condition()
+        self._documents: List[_Document] = []
+        self._tasks: Dict[int, _Task] = {}
+        self._pending: collections.deque = collections.deque()
+        self._results: "queue.Queue[DocumentResult]" = queue.Queue()
+        self._unfinished = len(pdf_paths)
+        for doc, path in enumerate(pdf_paths):
+            ranges = _shards(count_pages(path), max(1, pages_per_task))
+            self._documents.append(
+                _Document(path, [None] * len(ranges), remaining=len(ranges))
+            )
+            for part, (first, last) in enumerate(ranges):
+                task = _Task(len(self._tasks), doc, part, first, last)
+                self._tasks[task.id] = task
+                self._pending.append(task.id)
+        self._server = _Server((host, port), _Handler)
+        self._server.coordinator = self
+        self._threads: List[threading.Thread] = []
+        self._stop = threading.Event()
+
+    @property
+    def address(self) -> Tuple[str, int]:
+        """``(host, port)`` the workers should connect to."""
+        return self._server.server_address[:2]
+
+    def start(self) -> "Coordinator":
+        """Start serving leases in background threads."""
+        for target in (self._server.serve_forever, self._reap):
+            thread = threading.Thread(target=target, daemon=True)
+            thread.start()
+            self._threads.append(thread)
+        return self
+
+    def results(self) -> Iterator[DocumentResult]:
+        """Yield documents in order of completion until all are done."""
+        for _ in range(len(self._documents)):
+            yield self._results.get()
+
+    def close(self) -> None:
+        """Stop serving; connected workers see the connection close."""
+        self._stop.set()
+        self._server.shutdown()
+        self._server.server_close()
+        for thread in self._threads:
+            thread.join()
+
+    def __enter__(self) -> "Coordinator":
+        return self.start()
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    # --- Obsługa protokołu (wywoływana z wątków połączeń) ---
+
+    def _lease(self, worker: str, shipped: set) -> dict:
+        with self._cond:
+            while self._pending:
+                task = self._tasks[self._pending.popleft()]
+                if task.done:
+                    continue
+                task.attempts += 1
+                task.owner = worker
+                task.deadline = time.monotonic() + self.lease_seconds
+                path = self._documents[task.doc].path
+                message = {
+                    "id": task.id,
+                    "doc": task.doc,
+                    "path": path,
+                    "first": task.first,
+                    "last": task.last,
+                }
+                break
+            else:
+                if self._unfinished == 0:
+                    return {"done": True}
+                return {"wait": _WAIT_SECONDS}
+        if self.ship_input and task.doc not in shipped:
+            # Pracownik zachowuje plik do końca pracy, kolejne zakresy tego
+            # dokumentu wysyłane są bez danych
+            try:
+                with open(path, "rb") as fh:
+                    message["data"] = base64.b64encode(fh.read()).decode("ascii")
+            except OSError as exc:
+                self._complete(task.id, worker, "", f"Błąd odczytu pliku: {exc}")
+                return self._lease(worker, shipped)
+            shipped.add(task.doc)
+        return {"task": message}
+
+    def _renew(self, task_id: int, worker: str) -> bool:
+        with self._cond:
+            task = self._tasks.get(task_id)
+            if task is None or task.done or task.owner != worker:
+                return False
+            task.deadline = time.monotonic() + self.lease_seconds
+            return True
+
+    def _complete(self, task_id: int, worker: str, text: str, error: str) -> bool:
+        with self._cond:
+            task = self._tasks.get(task_id)
+            if task is None or task.done or task.owner != worker:
+                # Spóźniony wynik po utracie dzierżawy albo wynik zadania,
+                # którego pracownik nie dzierżawi: obowiązuje dzierżawca
+                return False
+            self._finish(task, text, error)
+            return True
+
+    def _give_back(self, task_id: int, worker: str, error: str) -> bool:
+        with self._cond:
+            task = self._tasks.get(task_id)
+            if task is None or task.done or task.owner != worker:
+                return False
+            logger.warning("Pracownik %s oddał zadanie %d: %s", worker, task_id, error)
+            self._requeue(task, f"błąd węzła: {error}")
+            return True
+
+    def _release(self, worker: str) -> None:
+        with self._cond:
+            for task in self._tasks.values():
+                if task.owner == worker and not task.done:
+                    self._requeue(task, "utracono połączenie z pracownikiem")
+
+    def _reap(self) -> None:
+        interval = max(0.05, min(1.0, self.lease_seconds / 4))
+        while not self._stop.wait(interval):
+            now = time.monotonic()
+            with self._cond:
+                for task in self._tasks.values():
+                    if task.owner is not None and not task.done and task.deadline < now:
+                        logger.warning("Wygasła dzierżawa zadania %d (%s)", task.id, task.owner)
+                        self._requeue(task, "wygasła dzierżawa")
+
+    def _requeue(self, task: _Task, reason: str) -> None:
+        task.owner = None
+        if task.attempts >= self.max_attempts:
+            self._finish(task, "", f"{reason} ({task.attempts} prób)")
+        else:
+            self._pending.appendleft(task.id)
+
+    def _finish(self, task: _Task, text: str, error: str) -> None:
+        task.done = True
+        task.owner = None
+        document = self._documents[task.doc]
+        document.parts[task.part] = text
+        if error:
+            pages = f"strony {task.first}-{task.last}" if task.last else "dokument"
+            document.errors.append(f"{pages}: {error}")
+        document.remaining -= 1
+        if document.remaining == 0:
+            self._unfinished -= 1
+            self._results.put(
+                DocumentResult(
+                    task.doc,
+                    document.path,
+                    "".join(document.parts),
+                    "; ".join(document.errors),
+                )
+            )
+
+
+def ocr_pages(path: str, first: int, last: int) -> str:
+    """Recognize pages ``first``..``last`` of ``path`` with ``training_ocr``.
+
+    ``last`` equal to 0 means the whole document.  Raises ``RuntimeError``
+    with the engine's message when the pages cannot be recognized.
+    """
+    args = [os.path.join(_BASE_PATH, "training_ocr"), "--stream"]
+    if last:
+        args += ["--pages", f"{first}-{last}"]
+    proc = subprocess.run(
+        [*args, path],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.DEVNULL,
+        text=True,
+        encoding="utf-8",
+        creationflags=subprocess.CREATE_NO_WINDOW if os.name == "nt" else 0,
+    )
+    for line in proc.stdout.splitlines():
+        if line.strip():
+            item = json.loads(line)
+            if item.get("error"):
+                raise RuntimeError(item["error"])
+            return item.get("text", "")
+    raise RuntimeError(f"training_ocr zakończył się kodem {proc.returncode}")
+
+
+def run_worker(
+    address: Tuple[str, int],
+    token: str,
+    ocr: Optional[Callable[[str, int, int], str]] = None,
+    heartbeat: float = 5.0,
+) -> int:
+    """Process leases from the coordinator at ``address`` until it is done.
+
+    Args:
+        address: ``(host, port)`` of the coordinator.
+        token: shared secret of the coordinator (:attr:`Coordinator.token`).
+        ocr: ``ocr(path, first, last) -> text``, :func:`ocr_pages` by default.
+        heartbeat: seconds between lease renewals while a task runs.
+
+    An ``OSError`` while preparing or recognizing a range -- the engine
+    cannot be started, the input is missing or the shipped file cannot be
+    written -- is a failure of this node, not of the document: the lease
+    is given back and the worker stops.  Other exceptions are reported as
+    the OCR error of the range.
+
+    Returns:
+        Number of page ranges processed.
+    """
+    ocr = ocr or ocr_pages
+    lock = threading.Lock()
+    processed = 0
+    # Pliki przesłane przez koordynatora: indeks dokumentu -> plik tymczasowy
+    shipped: Dict[int, str] = {}
+    try:
+        sock = socket.create_connection(address)
+    except OSError as exc:
+        logger.error("Nie można połączyć z koordynatorem %s:%s: %s", *address, exc)
+        return 0
+    reader = sock.makefile("rb")
+
+    def call(message: dict) -> dict:
+        with lock:
+            sock.sendall(json.dumps(message).encode("utf-8") + b"\n")
+            line = reader.readline()
+        if not line:
+            raise ConnectionError("koordynator zamknął połączenie")
+        return json.loads(line)
+
+    try:
+        reply = call(
+            {
+                "op": "hello",
+                "worker": f"{socket.gethostname()}-{uuid.uuid4().hex[:8]}",
+                "token": token,
+            }
+        )
+        if not reply.get("ok"):
+            logger.error("Koordynator odrzucił pracownika: %s", reply.get("error"))
+            return 0
+        while True:
+            reply = call({"op": "lease"})
+            if reply.get("done"):
+                break
+            if "wait" in reply:
+                time.sleep(reply["wait"])
+                continue
+            task = reply["task"]
+            busy = threading.Event()
+
+            def beat(task_id=task["id"], busy=busy):
+                while not busy.wait(heartbeat):
+                    try:
+                        call({"op": "heartbeat", "task": task_id})
+                    except (OSError, ValueError):
+                        return
+
+            beater = threading.Thread(target=beat, daemon=True)
+            beater.start()
+            text, error, failure = "", "", ""
+            try:
+                path = task["path"]
+                if "data" in task:
+                    # Plik przesłany w dzierżawie: pracownik nie ma wspólnego dysku
+                    fd, tmp_path = tempfile.mkstemp(suffix=".pdf")
+                    shipped[task["doc"]] = tmp_path
+                    with os.fdopen(fd, "wb") as fh:
+                        fh.write(base64.b64decode(task["data"]))
+                path = shipped.get(task.get("doc"), path)
+                if not os.path.exists(path):
+                    raise FileNotFoundError(f"brak pliku wejściowego: {path}")
+                text = ocr(path, task["first"], task["last"])
+            except OSError as exc:
+                # Awaria węzła (brak silnika, pliku, miejsca na dysku)
+                failure = str(exc) or type(exc).__name__
+            except Exception as exc:
+                error = str(exc) or type(exc).__name__
+            finally:
+                busy.set()
+                beater.join()
+            if failure:
+                logger.error("Pracownik oddaje zadanie %d i kończy pracę: %s", task["id"], failure)
+                call({"op": "release", "task": task["id"], "error": failure})
+                break
+            call({"op": "result", "task": task["id"], "text": text, "error": error})
+            processed += 1
+    except (OSError, ValueError) as exc:
+        logger.warning("Przerwano pracę z koordynatorem %s:%s: %s", *address, exc)
+    finally:
+        reader.close()
+        sock.close()
+        for tmp_path in shipped.values():
+            try:
+                os.remove(tmp_path)
+            except OSError:
+                pass
+    return processed
+
+
+def parse_address(value: str) -> Tuple[str, int]:
+    """Parse ``host:port`` (or just ``port``) into an address tuple."""
+    host, _, port = value.rpartition(":")
+    return host or "127.0.0.1", int(port)
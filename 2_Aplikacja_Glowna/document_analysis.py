@@ -0,0 +1,103 @@
+"""Per-document analysis context shared by the extraction stages.
+
+``extract_info_from_text`` runs NER, the rule-based ``SmartExtractor``, the
+regular-expression fallbacks and the LLM assistant on the same OCR text.
+:class:`DocumentAnalysis` computes the expensive views of that text once --
+the spaCy ``Doc``, the lowercased text, word spans, the header and the
+sentence embedding -- and only when a stage first asks for them.
+"""
+
+from __future__ import annotations
+
+import re
+from functools import cached_property
+from typing import Any, Dict, List, Optional, Tuple
+
+from processing.ner import entities_from_doc
+
+# Liczba znaków traktowana jako nagłówek dokumentu
+HEADER_CHARS = 500
+# Fragment tekstu używany do embeddingu (jak w pamięci kontekstowej)
+EMBEDDING_CHARS = 2000
+
+_WORD_RE = re.compile(r"\w+")
+
+
+class DocumentAnalysis:
+    """Lazily computed views of one document's text."""
+
+    def __init__(self, text: str, nlp_model: Any = None, filename: str = "") -> None:
+        """Wrap ``text`` without computing anything yet.
+
+        Args:
+            text: OCR text of the document.
+            nlp_model: Optional spaCy pipeline used for :attr:`doc`.
+            filename: Original filename, kept for the LLM stage.
+        """
+        self.text = text or ""
+        self.nlp_model = nlp_model
+        self.filename = filename
+        self._embeddings: Dict[int, List[float]] = {}
+
+    @cached_property
+    def doc(self) -> Any:
+        """spaCy ``Doc`` of the full text, or ``None`` without a model.
+
+        May be assigned beforehand with a ``Doc`` produced by batched
+        ``nlp.pipe`` NER (see :mod:`processing.ner`).
+        """
+        if self.nlp_model is None:
+            return None
+        return self.nlp_model(self.text)
+
+    @cached_property
+    def entities(self) -> Dict[str, List[str]]:
+        """Entity texts grouped by upper-cased label."""
+        return entities_from_doc(self.doc) if self.doc is not None else {}
+
+    @cached_property
+    def lower(self) -> str:
+        return self.text.lower()
+
+    @cached_property
+    def normalized(self) -> str:
+        """Lowercased text with whitespace runs collapsed to single spaces."""
+        return " ".join(self.lower.split())
+
+    @cached_property
+    def header(self) -> str:
+        return self.text[:HEADER_CHARS]
+
+    @cached_property
+    def header_lower(self) -> str:
+        return self.lower[:HEADER_CHARS]
+
+    @cached_property
+    def token_spans(self) -> List[Tuple[int, int]]:
+        """Character ``(start, end)`` spans of the words in the text."""
+        return [m.span() for m in _WORD_RE.finditer(self.text)]
+
+    def embedding(self, model: Any) -> List[float]:
+        """Return the sentence embedding of the text computed with ``model``.
+
+        The vector is cached per model, so the context analyzer and the LLM
+        stage share one encoder call per document.
+        """
+        key = id(model)
+        if key not in self._embeddings:
+            vector = model.encode([self.text[:EMBEDDING_CHARS]])[0]
+            self._embeddings[key] = list(vector)
+        return self._embeddings[key]
+
+    def entity_text(self, label: str) -> str:
+        """Return all entities with ``label`` joined by spaces."""
+        return " ".join(self.entities.get(label, []))
+
+
+def ensure_analysis(
+    text: str, analysis: Optional[DocumentAnalysis] = None, nlp_model: Any = None
+) -> DocumentAnalysis:
+    """Return ``analysis`` when it wraps ``text``, otherwise a new context."""
+    if analysis is not None and analysis.text == (text or ""):
+        return analysis
+    return DocumentAnalysis(text, nlp_model)
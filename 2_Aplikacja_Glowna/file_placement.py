@@ -0,0 +1,260 @@
+"""Parallel placement of archived documents (``native/file_place.c``).
+
+:class:`FilePlacer` copies files to the archive from a bounded thread pool.
+Each file is placed with the cheapest method the filesystem supports --
+reflink clone, ``copy_file_range`` or, when explicitly allowed, a hard link --
+falling back to a plain copy with a 1 MiB buffer.  Destinations are flushed
+with ``fsync`` in batches, an optional SHA-256 comparison verifies the copy
+and every file gets its own :class:`PlacementResult`.
+
+A file is written under a temporary name next to its destination and
+renamed over it when complete, so a failed copy leaves an existing
+destination intact.  A destination that already is the source -- the
+output folder equals the input folder -- is left untouched.
+
+Without the compiled library the same pool uses ``shutil.copy2``, which
+already copies in the kernel where Python supports it.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import hashlib
+import logging
+import os
+import shutil
+import threading
+from concurrent.futures import Future, ThreadPoolExecutor, wait
+from dataclasses import dataclass
+from typing import Dict, List, Optional
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Kody metod zwracane przez place_file()
+METHODS = {1: "reflink", 2: "copy_file_range", 3: "hardlink", 4: "copy", 5: "same"}
+_ALLOW_HARDLINK = 1
+
+# Próby znalezienia wolnej nazwy pliku tymczasowego, jak w file_place.c
+_TEMP_ATTEMPTS = 1000
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.place_file.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
+    lib.place_file.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("file_place", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native placement library can be used."""
+    return _library.is_available()
+
+
+@dataclass
+class PlacementResult:
+    """Outcome of placing one file."""
+
+    src: str
+    dst: str
+    ok: bool = False
+    method: str = ""
+    error: str = ""
+    checksum: str = ""
+
+
+def file_checksum(path: str) -> str:
+    """Return the SHA-256 hex digest of ``path``."""
+    with open(path, "rb") as f:
+        return hashlib.file_digest(f, "sha256").hexdigest()
+
+
+def place_file(src: str, dst: str, allow_hardlink: bool = False) -> str:
+    """Place ``src`` at ``dst`` and return the method used.
+
+    Raises:
+        OSError: When the file could not be placed.
+    """
+    lib = _library.load()
+    if lib is None:
+        return _place_file_python(src, dst, allow_hardlink)
+    flags = _ALLOW_HARDLINK if allow_hardlink else 0
+    code = lib.place_file(os.fsencode(src), os.fsencode(dst), flags)
+    if code < 0:
+        if os.name == "nt":
+            raise ctypes.WinError(-code)
+        raise OSError(-code, os.strerror(-code), src)
+    return METHODS.get(code, "copy")
+
+
+def _place_file_python(src: str, dst: str, allow_hardlink: bool) -> str:
+    if os.path.exists(dst) and os.path.samefile(src, dst):
+        return "same"
+    for n in range(_TEMP_ATTEMPTS):
+        tmp = f"{dst}.{os.getpid()}.{threading.get_ident()}.{n}.tmp"
+        method = ""
+        if allow_hardlink:
+            try:
+                os.link(src, tmp)
+                method = "hardlink"
+            except FileExistsError:
+                continue
+            except OSError:
+                pass
+        if not method:
+            try:
+                os.close(os.open(tmp, os.O_WRONLY | os.O_CREAT | os.O_EXCL))
+            except FileExistsError:
+                continue
+            method = "copy"
+        try:
+            if method == "copy":
+                shutil.copy2(src, tmp)
+            # Podmiana dopiero gotowego pliku: nieudana kopia nie niszczy dst
+            os.replace(tmp, dst)
+        except BaseException:
+            try:
+                os.unlink(tmp)
+            except OSError:
+                pass
+            raise
+        return method
+    raise FileExistsError(f"Brak wolnej nazwy tymczasowej dla {dst}")
+
+
+def _fsync(path: str) -> None:
+    # Windows (FlushFileBuffers) wymaga uchwytu z prawem zapisu
+    fd = os.open(path, os.O_RDWR | os.O_BINARY if os.name == "nt" else os.O_RDONLY)
+    try:
+        os.fsync(fd)
+    finally:
+        os.close(fd)
+
+
+class FilePlacer:
+    """Place files concurrently and collect per-file outcomes."""
+
+    def __init__(
+        self,
+        max_workers: int = 0,
+        fsync_batch: int = 64,
+        verify: bool = False,
+        allow_hardlink: bool = False,
+    ) -> None:
+        """Create the placer.
+
+        Args:
+            max_workers: Concurrent I/O operations; ``0`` picks
+                ``min(8, 2 * cpu_count)``.
+            fsync_batch: Flush destinations to disk after this many files;
+                ``0`` leaves flushing to the operating system.
+            verify: Compare SHA-256 of source and destination.
+            allow_hardlink: Link instead of copying on the same filesystem.
+                The archive then shares the file with the input folder.
+        """
+        self.max_workers = max_workers or min(8, 2 * (os.cpu_count() or 1))
+        self.fsync_batch = fsync_batch
+        self.verify = verify
+        self.allow_hardlink = allow_hardlink
+        self._pool = ThreadPoolExecutor(max_workers=self.max_workers)
+        # Ogranicza liczbę zleconych, a jeszcze niewykonanych operacji
+        self._slots = threading.BoundedSemaphore(self.max_workers * 4)
+        self._lock = threading.Lock()
+        self._by_dst: Dict[str, Future] = {}
+        self._futures: List[Future] = []
+        self._unsynced: List[str] = []
+
+    def submit(self, src: str, dst: str) -> "Future[PlacementResult]":
+        """Queue ``src`` to be placed at ``dst``.
+
+        Blocks while the queue is full.  Files sent to the same destination
+        are placed in submission order, so the last one wins as with
+        sequential copies.
+        """
+        self._slots.acquire()
+        key = os.path.normcase(os.path.abspath(dst))
+        with self._lock:
+            previous = self._by_dst.get(key)
+            future = self._pool.submit(self._place, src, dst, previous)
+            self._by_dst[key] = future
+            self._futures.append(future)
+        return future
+
+    def _place(self, src: str, dst: str, previous: Optional[Future]) -> PlacementResult:
+        result = PlacementResult(src, dst)
+        try:
+            if previous is not None:
+                wait([previous])
+            result.method = place_file(src, dst, self.allow_hardlink)
+            if self.verify:
+                result.checksum = file_checksum(dst)
+                if result.method != "hardlink" and file_checksum(src) != result.checksum:
+                    raise OSError(f"Suma kontrolna kopii różni się od oryginału: {dst}")
+            result.ok = True
+        except Exception as exc:
+            result.error = str(exc)
+            logger.error("Błąd kopiowania pliku %s: %s", src, exc)
+        finally:
+            self._slots.release()
+        if result.ok and self.fsync_batch:
+            self._queue_sync(dst)
+        return result
+
+    def _queue_sync(self, dst: str) -> None:
+        with self._lock:
+            self._unsynced.append(dst)
+            if len(self._unsynced) < self.fsync_batch:
+                return
+            batch, self._unsynced = self._unsynced, []
+        self._sync(batch)
+
+    def _sync(self, paths: List[str]) -> None:
+        """Flush a batch of destinations and their directories."""
+        for path in paths:
+            try:
+                _fsync(path)
+            except OSError as exc:
+                logger.warning("fsync %s: %s", path, exc)
+        if os.name != "nt":
+            for directory in {os.path.dirname(os.path.abspath(p)) for p in paths}:
+                try:
+                    fd = os.open(directory, os.O_RDONLY)
+                    try:
+                        os.fsync(fd)
+                    finally:
+                        os.close(fd)
+                except OSError:
+                    pass
+
+    def close(self) -> List[PlacementResult]:
+        """Wait for all placements and the final flush.
+
+        Returns:
+            Results in submission order.
+        """
+        results = [f.result() for f in self._futures]
+        self._pool.shutdown(wait=True)
+        with self._lock:
+            batch, self._unsynced = self._unsynced, []
+        if batch:
+            self._sync(batch)
+        return results
+
+    def __enter__(self) -> "FilePlacer":
+        return self
+
+    def __exit__(self, exc_type, exc, tb) -> None:
+        self.close()
+
+
+def place_files(
+    pairs, max_workers: int = 0, fsync_batch: int = 64, verify: bool = False,
+    allow_hardlink: bool = False,
+) -> List[PlacementResult]:
+    """Place ``(src, dst)`` pairs concurrently and return their outcomes."""
+    placer = FilePlacer(max_workers, fsync_batch, verify, allow_hardlink)
+    for src, dst in pairs:
+        placer.submit(src, dst)
+    return placer.close()
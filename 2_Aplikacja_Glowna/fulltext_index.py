@@ -0,0 +1,948 @@
+"""Archive-wide full-text index over OCR output (``native/fulltext_index.c``).
+
+Documents are added with the text OCR already produced for them and become
+searchable after :meth:`FullTextIndex.commit`.  The index is a directory of
+immutable segment files listed in ``manifest.json``:
+
+* text is tokenized with Polish-aware normalization -- words split by OCR at
+  a line-end hyphen are joined, diacritics are folded (OCR often loses them)
+  and common inflectional suffixes are stripped, so "sprawie", "sprawy" and
+  "sprawę" are one term;
+* every term has a posting list of varint-encoded doc id deltas and term
+  frequencies plus, separately, the in-document positions used by phrase
+  queries;
+* segments are memory-mapped and only the posting lists of the query terms
+  are read; small segments are merged in a background thread, dropping
+  documents that were replaced or removed;
+* queries rank documents with BM25; text in double quotes is a phrase that
+  documents must contain.
+
+Python scores may differ from the native ones in float rounding.  One
+process at a time may write to an index directory, enforced by an
+exclusive lock on ``write.lock``; any number may search it.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import heapq
+import itertools
+import json
+import logging
+import math
+import mmap
+import os
+import re
+import struct
+import sys
+import tempfile
+import threading
+import unicodedata
+from array import array
+from dataclasses import dataclass
+from functools import lru_cache
+from typing import Dict, Iterator, List, Optional, Sequence, Tuple
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+MANIFEST = "manifest.json"
+WRITE_LOCK = "write.lock"
+_SEGMENT_NAME = re.compile(r"seg_(\d+)")
+SEGMENT_MAGIC = b"ATXI"
+SEGMENT_VERSION = 1
+# Zmiana analizatora wymaga przebudowy indeksu
+ANALYZER_VERSION = 1
+
+BM25_K1 = 1.2
+BM25_B = 0.75
+
+
+
+class IndexLockedError(RuntimeError):
+    """Another process holds the writer lock of the index directory."""
+
+
+def _lock_writer(directory: str) -> int:
+    """Take the exclusive writer lock of ``directory``; returns its descriptor.
+
+    The lock belongs to the open file, so the operating system releases it
+    when the process ends and a crashed writer never blocks the index.
+    """
+    path = os.path.join(directory, WRITE_LOCK)
+    fd = os.open(path, os.O_RDWR | os.O_CREAT, 0o644)
+    try:
+        if os.name == "nt":
+            import msvcrt
+
+            msvcrt.locking(fd, msvcrt.LK_NBLCK, 1)
+        else:
+            import fcntl
+
+            fcntl.flock(fd, fcntl.LOCK_EX | fcntl.LOCK_NB)
+    except OSError as exc:
+        os.close(fd)
+        raise IndexLockedError(f"Indeks {directory} jest zapisywany przez inny proces") from exc
+    return fd
+
+
+def _unlock_writer(fd: int) -> None:
+    if os.name == "nt":
+        import msvcrt
+
+        try:
+            os.lseek(fd, 0, os.SEEK_SET)
+            msvcrt.locking(fd, msvcrt.LK_UNLCK, 1)
+        except OSError:
+            pass
+    os.close(fd)
+
+
+# Nagłówek segmentu: magia, wersja, liczba dokumentów i termów, suma długości
+# dokumentów oraz przesunięcia sekcji (długości, ścieżki, termy, nazwy, dane)
+_HEADER = struct.Struct("<4sIIIQQQQQQ")
+# Wpis termu: przesunięcie i długość nazwy, df, przesunięcie i rozmiar
+# listy dokumentów, przesunięcie i rozmiar listy pozycji
+_TERM = struct.Struct("<IIIQIQI")
+
+_UIntPtr = ctypes.POINTER(ctypes.c_uint32)
+_FloatPtr = ctypes.POINTER(ctypes.c_float)
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.fts_encode.argtypes = [_UIntPtr, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+    lib.fts_encode.restype = ctypes.c_int
+    lib.fts_decode.argtypes = [
+        ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, _UIntPtr
+    ]
+    lib.fts_decode.restype = ctypes.c_int
+    lib.fts_bm25.argtypes = [
+        ctypes.POINTER(ctypes.c_void_p),
+        ctypes.POINTER(ctypes.c_int),
+        ctypes.POINTER(ctypes.c_int),
+        _FloatPtr,
+        ctypes.c_int,
+        ctypes.c_void_p,
+        ctypes.c_int,
+        ctypes.c_char_p,
+        ctypes.c_float,
+        ctypes.c_float,
+        ctypes.c_float,
+        ctypes.c_int,
+        _UIntPtr,
+        _FloatPtr,
+    ]
+    lib.fts_bm25.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("fulltext_index", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native postings library can be used."""
+    return _library.is_available()
+
+
+# ---------------------------------------------------------------------------
+# Analiza tekstu
+
+# Słowo przeniesione przez OCR do następnej linii: "doku-\nment"
+_HYPHENATION = re.compile(r"(\w)-[ \t]*\r?\n[ \t]*(\w)")
+_TOKEN = re.compile(r"\w+")
+_PHRASE = re.compile(r'"([^"]*)"')
+_POLISH = str.maketrans("ąćęłńóśźż", "acelnoszz")
+# Końcówki fleksyjne (po usunięciu znaków diakrytycznych), najdłuższe najpierw
+_SUFFIXES = sorted(
+    [
+        "owania", "owanie", "owie", "ami", "ach", "ego", "emu", "ich", "ych",
+        "ymi", "imi", "iej", "owi", "ow", "om", "em", "ie", "a", "e", "i", "o",
+        "u", "y",
+    ],
+    key=len,
+    reverse=True,
+)
+MIN_STEM = 4
+MAX_TOKEN = 64
+
+
+@lru_cache(maxsize=1 << 16)
+def normalize_token(token: str) -> str:
+    """Return the index term for a single word."""
+    term = token.lower().translate(_POLISH)
+    if not term.isascii():
+        term = "".join(
+            c for c in unicodedata.normalize("NFKD", term) if not unicodedata.combining(c)
+        )
+    if term.isalpha():
+        for suffix in _SUFFIXES:
+            if term.endswith(suffix) and len(term) - len(suffix) >= MIN_STEM:
+                return term[: -len(suffix)]
+    return term
+
+
+def analyze(text: str) -> List[str]:
+    """Split OCR ``text`` into index terms in reading order."""
+    text = _HYPHENATION.sub(r"\1\2", text)
+    return [normalize_token(t) for t in _TOKEN.findall(text) if len(t) <= MAX_TOKEN]
+
+
+def parse_query(query: str) -> Tuple[List[List[str]], List[str]]:
+    """Split ``query`` into quoted phrases and the remaining terms."""
+    phrases = [terms for terms in map(analyze, _PHRASE.findall(query)) if terms]
+    return phrases, analyze(_PHRASE.sub(" ", query))
+
+
+# ---------------------------------------------------------------------------
+# Kodowanie list
+
+
+def _pointer(buf: array, ctype):
+    address, _ = buf.buffer_info()
+    return ctypes.cast(address, ctypes.POINTER(ctype))
+
+
+def encode_varints(values: array, delta: bool = False) -> bytes:
+    """Encode unsigned ``values`` (``array('I')``) as LEB128 varints."""
+    if not values:
+        return b""
+    lib = _library.load()
+    if lib is not None:
+        out = ctypes.create_string_buffer(5 * len(values))
+        size = lib.fts_encode(_pointer(values, ctypes.c_uint32), len(values), int(delta), out)
+        return out.raw[:size]
+    out = bytearray()
+    prev = 0
+    for value in values:
+        v = value - prev if delta else value
+        prev = value
+        while v >= 0x80:
+            out.append((v & 0x7F) | 0x80)
+            v >>= 7
+        out.append(v)
+    return bytes(out)
+
+
+def _decode_py(data, offset: int, count: int, delta: bool) -> Tuple[array, int]:
+    out = array("I", bytes(4 * count))
+    pos = offset
+    acc = 0
+    for i in range(count):
+        v = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            v |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                break
+            shift += 7
+        acc = acc + v if delta else v
+        out[i] = acc
+    return out, pos - offset
+
+
+# ---------------------------------------------------------------------------
+# Segmenty
+
+
+class _SegmentWriter:
+    """Write one immutable segment; terms must be added in byte order."""
+
+    def __init__(self, path: str, doc_lens: array, paths: Sequence[str]) -> None:
+        self.path = path
+        self.doc_lens = doc_lens
+        self.paths = paths
+        self._data = tempfile.TemporaryFile()
+        self._data_size = 0
+        self._entries = bytearray()
+        self._names = bytearray()
+        self._n_terms = 0
+
+    def add_term(self, term: bytes, docs: array, tfs: array, positions: array) -> None:
+        """Add the postings of ``term``; ``positions`` are in-document deltas."""
+        postings = encode_varints(docs, delta=True) + encode_varints(tfs)
+        deltas = encode_varints(positions)
+        self._entries += _TERM.pack(
+            len(self._names),
+            len(term),
+            len(docs),
+            self._data_size,
+            len(postings),
+            self._data_size + len(postings),
+            len(deltas),
+        )
+        self._names += term
+        self._data.write(postings)
+        self._data.write(deltas)
+        self._data_size += len(postings) + len(deltas)
+        self._n_terms += 1
+
+    def finish(self) -> None:
+        """Assemble the segment file and atomically move it into place."""
+        paths = b"".join(p.encode("utf-8") + b"\0" for p in self.paths)
+        doclens_off = _HEADER.size
+        paths_off = doclens_off + 4 * len(self.doc_lens)
+        terms_off = paths_off + len(paths)
+        names_off = terms_off + len(self._entries)
+        data_off = names_off + len(self._names)
+        header = _HEADER.pack(
+            SEGMENT_MAGIC,
+            SEGMENT_VERSION,
+            len(self.doc_lens),
+            self._n_terms,
+            sum(self.doc_lens),
+            doclens_off,
+            paths_off,
+            terms_off,
+            names_off,
+            data_off,
+        )
+        lens = self.doc_lens
+        if sys.byteorder != "little":
+            lens = array("I", lens)
+            lens.byteswap()
+        tmp = self.path + ".tmp"
+        with open(tmp, "wb") as f:
+            f.write(header)
+            f.write(lens.tobytes())
+            f.write(paths)
+            f.write(self._entries)
+            f.write(self._names)
+            self._data.seek(0)
+            while True:
+                chunk = self._data.read(1 << 20)
+                if not chunk:
+                    break
+                f.write(chunk)
+            f.flush()
+            os.fsync(f.fileno())
+        self._data.close()
+        os.replace(tmp, self.path)
+
+
+class _Segment:
+    """Memory-mapped, read-only view of one segment file."""
+
+    def __init__(self, path: str, deleted=()) -> None:
+        self.path = path
+        self.name = os.path.basename(path)
+        with open(path, "rb") as f:
+            # ACCESS_COPY daje bufor zapisywalny, którego adres przyjmuje ctypes;
+            # strony nie są kopiowane, dopóki nic do nich nie jest zapisywane
+            self._mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_COPY)
+        (
+            magic,
+            version,
+            self.n_docs,
+            self.n_terms,
+            self.total_tokens,
+            self._doclens_off,
+            paths_off,
+            self._terms_off,
+            self._names_off,
+            self._data_off,
+        ) = _HEADER.unpack_from(self._mm, 0)
+        if magic != SEGMENT_MAGIC or version != SEGMENT_VERSION:
+            self._mm.close()
+            raise ValueError(f"Nieprawidłowy segment indeksu: {path}")
+        self.paths = [
+            p.decode("utf-8")
+            for p in self._mm[paths_off:self._terms_off].split(b"\0")[: self.n_docs]
+        ]
+        self._view = memoryview(self._mm)
+        self.doc_lens = self._view[
+            self._doclens_off:self._doclens_off + 4 * self.n_docs
+        ].cast("I")
+        self._base = ctypes.c_char.from_buffer(self._mm)
+        self.address = ctypes.addressof(self._base)
+        self.deleted = set(deleted)
+        # Referencja listy segmentów indeksu oraz trwających wyszukiwań i scaleń
+        self.refs = 1
+        self.retired = False
+
+    @property
+    def live(self) -> int:
+        return self.n_docs - len(self.deleted)
+
+    def lookup(self, term: bytes) -> Optional[tuple]:
+        """Return the dictionary entry of ``term`` or ``None``."""
+        lo, hi = 0, self.n_terms
+        while lo < hi:
+            mid = (lo + hi) // 2
+            entry = _TERM.unpack_from(self._mm, self._terms_off + mid * _TERM.size)
+            start = self._names_off + entry[0]
+            key = self._mm[start:start + entry[1]]
+            if key < term:
+                lo = mid + 1
+            elif key > term:
+                hi = mid
+            else:
+                return entry
+        return None
+
+    def iter_terms(self) -> Iterator[Tuple[bytes, tuple]]:
+        """Yield ``(term, entry)`` pairs in byte order."""
+        for i in range(self.n_terms):
+            entry = _TERM.unpack_from(self._mm, self._terms_off + i * _TERM.size)
+            start = self._names_off + entry[0]
+            yield self._mm[start:start + entry[1]], entry
+
+    def _decode(self, offset: int, size: int, count: int, delta: bool) -> Tuple[array, int]:
+        offset += self._data_off
+        lib = _library.load()
+        if lib is None:
+            return _decode_py(self._mm, offset, count, delta)
+        out = array("I", bytes(4 * count))
+        used = lib.fts_decode(
+            self.address + offset, size, count, int(delta), _pointer(out, ctypes.c_uint32)
+        )
+        if used < 0:
+            raise ValueError(f"Uszkodzona lista w segmencie {self.name}")
+        return out, used
+
+    def postings(self, entry: tuple) -> Tuple[array, array]:
+        """Return doc ids and term frequencies of a dictionary entry."""
+        _, _, df, offset, size, _, _ = entry
+        docs, used = self._decode(offset, size, df, True)
+        tfs, _ = self._decode(offset + used, size - used, df, False)
+        return docs, tfs
+
+    def positions(self, entry: tuple, count: int) -> array:
+        """Return the in-document position deltas of a dictionary entry."""
+        return self._decode(entry[5], entry[6], count, False)[0]
+
+    def bm25(self, entries, weights, mask, avg_len: float, k: int) -> List[Tuple[int, float]]:
+        """Return up to ``k`` best ``(doc, score)`` pairs of this segment."""
+        lib = _library.load()
+        if lib is None:
+            return self._bm25_py(entries, weights, mask, avg_len, k)
+        n = len(entries)
+        postings = (ctypes.c_void_p * n)(
+            *(self.address + self._data_off + e[3] for e in entries)
+        )
+        lengths = (ctypes.c_int * n)(*(e[4] for e in entries))
+        dfs = (ctypes.c_int * n)(*(e[2] for e in entries))
+        w = (ctypes.c_float * n)(*weights)
+        out_docs = array("I", bytes(4 * k))
+        out_scores = array("f", bytes(4 * k))
+        found = lib.fts_bm25(
+            postings,
+            lengths,
+            dfs,
+            w,
+            n,
+            self.address + self._doclens_off,
+            self.n_docs,
+            bytes(mask) if mask is not None else None,
+            avg_len,
+            BM25_K1,
+            BM25_B,
+            k,
+            _pointer(out_docs, ctypes.c_uint32),
+            _pointer(out_scores, ctypes.c_float),
+        )
+        if found < 0:
+            raise ValueError(f"Uszkodzona lista w segmencie {self.name}")
+        return list(zip(out_docs[:found], out_scores[:found]))
+
+    def _bm25_py(self, entries, weights, mask, avg_len, k):
+        scores: Dict[int, float] = {}
+        for entry, weight in zip(entries, weights):
+            docs, tfs = self.postings(entry)
+            for doc, tf in zip(docs, tfs):
+                if mask is not None and not mask[doc]:
+                    continue
+                norm = BM25_K1 * (1 - BM25_B + BM25_B * self.doc_lens[doc] / avg_len)
+                scores[doc] = scores.get(doc, 0.0) + weight * tf * (BM25_K1 + 1) / (tf + norm)
+        return heapq.nlargest(k, scores.items(), key=lambda item: (item[1], -item[0]))
+
+    def phrase_docs(self, entries: Sequence[tuple]) -> set:
+        """Return local doc ids containing the terms of ``entries`` in sequence."""
+        decoded = [self.postings(e) for e in entries]
+        candidates = set(decoded[0][0])
+        for docs, _ in decoded[1:]:
+            candidates.intersection_update(docs)
+        if not candidates or len(entries) == 1:
+            return candidates
+        starts: Dict[int, set] = {}
+        for j, (entry, (docs, tfs)) in enumerate(zip(entries, decoded)):
+            deltas = self.positions(entry, sum(tfs))
+            offset = 0
+            for doc, tf in zip(docs, tfs):
+                if doc in candidates:
+                    shifted = {p - j for p in itertools.accumulate(deltas[offset:offset + tf])}
+                    if j == 0:
+                        starts[doc] = shifted
+                    else:
+                        starts[doc] &= shifted
+                offset += tf
+        return {doc for doc, s in starts.items() if s}
+
+    def close(self) -> None:
+        self.doc_lens.release()
+        self._view.release()
+        del self._base
+        self._mm.close()
+
+
+# ---------------------------------------------------------------------------
+# Indeks
+
+
+@dataclass
+class SearchHit:
+    """One ranked search result."""
+
+    path: str
+    score: float
+
+
+class FullTextIndex:
+    """Segmented inverted index stored in ``directory``."""
+
+    def __init__(
+        self,
+        directory: str,
+        flush_docs: int = 256,
+        merge_factor: int = 8,
+        background_merge: bool = True,
+        readonly: bool = False,
+    ) -> None:
+        """Open or create the index.
+
+        Args:
+            directory: Index directory, created when missing.
+            flush_docs: Buffered documents written as a new segment.
+            merge_factor: Number of segments that triggers merging the
+                smallest of them into one.
+            background_merge: Merge in a background thread instead of the
+                thread that flushed.
+            readonly: Open for searching only; no files are modified.
+
+        Raises:
+            IndexLockedError: another process has the index open for writing.
+        """
+        self.directory = directory
+        self.flush_docs = max(1, flush_docs)
+        self.merge_factor = max(2, merge_factor)
+        self.background_merge = background_merge
+        self.readonly = readonly
+        self._lock = threading.RLock()
+        self._segments: List[_Segment] = []
+        self._doc_ids: Dict[str, Tuple[_Segment, int]] = {}
+        self._generation = 0
+        self._dirty = False
+        self._merge_thread: Optional[threading.Thread] = None
+        self._closed = False
+        self._lock_fd: Optional[int] = None
+        self._reset_buffer()
+        if not readonly:
+            os.makedirs(directory, exist_ok=True)
+            self._lock_fd = _lock_writer(directory)
+        try:
+            self._load()
+        except BaseException:
+            if self._lock_fd is not None:
+                _unlock_writer(self._lock_fd)
+                self._lock_fd = None
+            raise
+
+    # -- stan na dysku -----------------------------------------------------
+
+    def _load(self) -> None:
+        manifest = os.path.join(self.directory, MANIFEST)
+        data = {"segments": []}
+        if os.path.exists(manifest):
+            with open(manifest, encoding="utf-8") as f:
+                data = json.load(f)
+            if data.get("analyzer") != ANALYZER_VERSION:
+                logger.warning(
+                    "Indeks %s zbudowano innym analizatorem, zalecana przebudowa",
+                    self.directory,
+                )
+        self._generation = data.get("generation", 0)
+        for item in data["segments"]:
+            segment = _Segment(os.path.join(self.directory, item["name"]), item["deleted"])
+            self._segments.append(segment)
+            for local, path in enumerate(segment.paths):
+                if local not in segment.deleted:
+                    self._doc_ids[path] = (segment, local)
+        if self.readonly:
+            return
+        # Pozostałości po przerwanym zapisie lub scaleniu.  Segment nowszy niż
+        # manifest nie jest usuwany (mógł go zapisać inny proces), a numeracja
+        # nowych segmentów zaczyna się za nim, aby go nie nadpisać.
+        listed = {s.name for s in self._segments}
+        newest = self._generation
+        for name in os.listdir(self.directory):
+            match = _SEGMENT_NAME.match(name)
+            if match is None or name in listed:
+                continue
+            generation = int(match.group(1))
+            if generation > self._generation:
+                logger.warning("Pominięto segment %s nowszy niż manifest", name)
+                newest = max(newest, generation)
+                continue
+            try:
+                os.remove(os.path.join(self.directory, name))
+            except OSError:
+                pass
+        self._generation = newest
+
+    def _write_manifest_locked(self) -> None:
+        data = {
+            "version": 1,
+            "analyzer": ANALYZER_VERSION,
+            "generation": self._generation,
+            "segments": [
+                {"name": s.name, "deleted": sorted(s.deleted)} for s in self._segments
+            ],
+        }
+        path = os.path.join(self.directory, MANIFEST)
+        tmp = path + ".tmp"
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump(data, f)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, path)
+        self._dirty = False
+
+    def _next_segment_path(self) -> str:
+        self._generation += 1
+        return os.path.join(self.directory, f"seg_{self._generation:06d}.fts")
+
+    def _release_locked(self, segment: _Segment) -> None:
+        segment.refs -= 1
+        if segment.refs == 0:
+            segment.close()
+            if segment.retired:
+                try:
+                    os.remove(segment.path)
+                except OSError:
+                    # Windows: plik wciąż otwarty w innym procesie, usuwany przy otwarciu
+                    pass
+
+    # -- zapis -------------------------------------------------------------
+
+    def _reset_buffer(self) -> None:
+        self._pending_paths: List[str] = []
+        self._pending_lens = array("I")
+        self._pending_ids: Dict[str, int] = {}
+        self._pending_deleted: set = set()
+        self._pending: Dict[str, Tuple[array, array, array]] = {}
+
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._doc_ids) + len(self._pending_ids)
+
+    def add_document(self, path: str, text: str) -> None:
+        """Index ``text`` under ``path``, replacing an earlier version."""
+        if self.readonly:
+            raise PermissionError("Indeks otwarty tylko do odczytu")
+        path = os.path.abspath(path)
+        positions: Dict[str, List[int]] = {}
+        tokens = analyze(text)
+        for pos, term in enumerate(tokens):
+            positions.setdefault(term, []).append(pos)
+        with self._lock:
+            self._delete_locked(path)
+            local = len(self._pending_paths)
+            self._pending_paths.append(path)
+            self._pending_lens.append(len(tokens))
+            self._pending_ids[path] = local
+            for term, plist in positions.items():
+                entry = self._pending.get(term)
+                if entry is None:
+                    entry = self._pending[term] = (array("I"), array("I"), array("I"))
+                entry[0].append(local)
+                entry[1].append(len(plist))
+                entry[2].extend(b - a for a, b in zip([0] + plist, plist))
+            if len(self._pending_paths) >= self.flush_docs:
+                self._flush_locked()
+                self._write_manifest_locked()
+                self._maybe_merge_locked()
+
+    def delete_document(self, path: str) -> bool:
+        """Remove ``path`` from the index; returns ``False`` when absent."""
+        with self._lock:
+            return self._delete_locked(os.path.abspath(path))
+
+    def _delete_locked(self, path: str) -> bool:
+        local = self._pending_ids.pop(path, None)
+        if local is not None:
+            self._pending_deleted.add(local)
+            return True
+        found = self._doc_ids.pop(path, None)
+        if found is None:
+            return False
+        segment, local = found
+        segment.deleted.add(local)
+        self._dirty = True
+        return True
+
+    def _flush_locked(self) -> None:
+        if not self._pending_paths:
+            return
+        path = self._next_segment_path()
+        writer = _SegmentWriter(path, self._pending_lens, self._pending_paths)
+        for term in sorted(self._pending, key=lambda t: t.encode("utf-8")):
+            writer.add_term(term.encode("utf-8"), *self._pending[term])
+        writer.finish()
+        segment = _Segment(path, self._pending_deleted)
+        self._segments.append(segment)
+        for doc_path, local in self._pending_ids.items():
+            self._doc_ids[doc_path] = (segment, local)
+        self._reset_buffer()
+
+    def commit(self) -> None:
+        """Write buffered documents to disk and make them searchable."""
+        if self.readonly:
+            return
+        with self._lock:
+            if self._pending_paths or self._dirty:
+                self._flush_locked()
+                self._write_manifest_locked()
+                self._maybe_merge_locked()
+
+    # -- scalanie ----------------------------------------------------------
+
+    def _maybe_merge_locked(self) -> None:
+        if self._closed or len(self._segments) < self.merge_factor:
+            return
+        if self._merge_thread is not None and self._merge_thread.is_alive():
+            return
+        smallest = sorted(self._segments, key=lambda s: s.n_docs)[: self.merge_factor]
+        # Kolejność segmentów zachowuje kolejność dokumentów
+        merging = [s for s in self._segments if s in smallest]
+        for segment in merging:
+            segment.refs += 1
+        snapshot = [set(s.deleted) for s in merging]
+        path = self._next_segment_path()
+        if self.background_merge:
+            self._merge_thread = threading.Thread(
+                target=self._merge, args=(merging, snapshot, path), daemon=True
+            )
+            self._merge_thread.start()
+        else:
+            self._merge(merging, snapshot, path)
+
+    def _merge(self, merging: List[_Segment], snapshot: List[set], path: str) -> None:
+        try:
+            remap = []
+            paths: List[str] = []
+            lens = array("I")
+            for segment, deleted in zip(merging, snapshot):
+                ids = array("i")
+                for local in range(segment.n_docs):
+                    if local in deleted:
+                        ids.append(-1)
+                    else:
+                        ids.append(len(paths))
+                        paths.append(segment.paths[local])
+                        lens.append(segment.doc_lens[local])
+                remap.append(ids)
+            writer = _SegmentWriter(path, lens, paths)
+            streams = [
+                zip(segment.iter_terms(), itertools.repeat(i)) for i, segment in enumerate(merging)
+            ]
+            merged_terms = heapq.merge(*streams, key=lambda x: (x[0][0], x[1]))
+            for term, group in itertools.groupby(merged_terms, key=lambda x: x[0][0]):
+                docs, tfs, positions = array("I"), array("I"), array("I")
+                for (_, entry), i in group:
+                    segment, ids = merging[i], remap[i]
+                    seg_docs, seg_tfs = segment.postings(entry)
+                    deltas = segment.positions(entry, sum(seg_tfs))
+                    offset = 0
+                    for doc, tf in zip(seg_docs, seg_tfs):
+                        new = ids[doc]
+                        if new >= 0:
+                            docs.append(new)
+                            tfs.append(tf)
+                            positions.extend(deltas[offset:offset + tf])
+                        offset += tf
+                if docs:
+                    writer.add_term(term, docs, tfs, positions)
+            writer.finish()
+            merged = _Segment(path)
+        except Exception as exc:
+            logger.error("Błąd scalania segmentów indeksu: %s", exc)
+            with self._lock:
+                for segment in merging:
+                    self._release_locked(segment)
+            return
+
+        with self._lock:
+            if self._closed:
+                merged.close()
+                for segment in merging:
+                    self._release_locked(segment)
+                return
+            # Dokumenty usunięte lub zastąpione w trakcie scalania
+            for segment, deleted, ids in zip(merging, snapshot, remap):
+                for local in segment.deleted - deleted:
+                    if ids[local] >= 0:
+                        merged.deleted.add(ids[local])
+            for local, doc_path in enumerate(merged.paths):
+                if local not in merged.deleted:
+                    self._doc_ids[doc_path] = (merged, local)
+            position = self._segments.index(merging[0])
+            self._segments = [s for s in self._segments if s not in merging]
+            self._segments.insert(position, merged)
+            self._write_manifest_locked()
+            for segment in merging:
+                segment.retired = True
+                self._release_locked(segment)  # referencja scalania
+                self._release_locked(segment)  # referencja listy segmentów
+            logger.info("Scalono %d segmentów indeksu (%d dok.)", len(merging), len(paths))
+            self._merge_thread = None
+            self._maybe_merge_locked()
+
+    def wait_for_merges(self) -> None:
+        """Block until background merges finish."""
+        while True:
+            with self._lock:
+                thread = self._merge_thread
+            if thread is None or not thread.is_alive() or thread is threading.current_thread():
+                return
+            thread.join()
+
+    # -- wyszukiwanie ------------------------------------------------------
+
+    def search(self, query: str, limit: int = 20) -> List[SearchHit]:
+        """Return documents best matching ``query``, best first.
+
+        Words are ranked with BM25; text in double quotes is a phrase that a
+        document must contain.  Documents added since the last
+        :meth:`commit` are not searched.
+        """
+        phrases, words = parse_query(query)
+        terms = list(dict.fromkeys(words + [t for phrase in phrases for t in phrase]))
+        if not terms or limit <= 0:
+            return []
+        with self._lock:
+            segments = list(self._segments)
+            for segment in segments:
+                segment.refs += 1
+        try:
+            return self._search(segments, phrases, terms, limit)
+        finally:
+            with self._lock:
+                for segment in segments:
+                    self._release_locked(segment)
+
+    def _search(self, segments, phrases, terms, limit) -> List[SearchHit]:
+        n_docs = sum(s.live for s in segments)
+        if not n_docs:
+            return []
+        avg_len = sum(s.total_tokens for s in segments) / sum(s.n_docs for s in segments)
+        avg_len = avg_len or 1.0
+        keys = [t.encode("utf-8") for t in terms]
+        entries = [[s.lookup(k) for k in keys] for s in segments]
+        idf = []
+        for j in range(len(keys)):
+            df = sum(e[j][2] for e in entries if e[j] is not None)
+            idf.append(math.log(1 + (n_docs - df + 0.5) / (df + 0.5)))
+
+        best: List[Tuple[float, str]] = []
+        for segment, seg_entries in zip(segments, entries):
+            present = [(e, w) for e, w in zip(seg_entries, idf) if e is not None]
+            if not present:
+                continue
+            mask = None
+            if phrases:
+                allowed = None
+                for phrase in phrases:
+                    phrase_entries = [seg_entries[terms.index(t)] for t in phrase]
+                    if any(e is None for e in phrase_entries):
+                        allowed = set()
+                        break
+                    docs = segment.phrase_docs(phrase_entries)
+                    allowed = docs if allowed is None else allowed & docs
+                    if not allowed:
+                        break
+                allowed -= segment.deleted
+                if not allowed:
+                    continue
+                mask = bytearray(segment.n_docs)
+                for doc in allowed:
+                    mask[doc] = 1
+            elif segment.deleted:
+                mask = bytearray(b"\1") * segment.n_docs
+                for doc in segment.deleted:
+                    mask[doc] = 0
+            hits = segment.bm25(
+                [e for e, _ in present], [w for _, w in present], mask, avg_len, limit
+            )
+            for doc, score in hits:
+                item = (float(score), segment.paths[doc])
+                if len(best) < limit:
+                    heapq.heappush(best, item)
+                else:
+                    heapq.heappushpop(best, item)
+        return [SearchHit(path, score) for score, path in sorted(best, reverse=True)]
+
+    # -- zamykanie ---------------------------------------------------------
+
+    def close(self) -> None:
+        """Commit pending documents, finish merges, unmap segments and unlock."""
+        self.commit()
+        self.wait_for_merges()
+        with self._lock:
+            if self._closed:
+                return
+            self._closed = True
+            for segment in self._segments:
+                self._release_locked(segment)
+            self._segments = []
+            self._doc_ids = {}
+            if self._lock_fd is not None:
+                _unlock_writer(self._lock_fd)
+                self._lock_fd = None
+
+    def __enter__(self) -> "FullTextIndex":
+        return self
+
+    def __exit__(self, exc_type, exc, tb) -> None:
+        self.close()
+
+
+def default_index_dir() -> str:
+    """Return the index directory used when none is configured."""
+    if getattr(sys, "frozen", False):
+        base_dir = os.path.dirname(sys.executable)
+    else:
+        base_dir = os.path.dirname(os.path.abspath(__file__))
+    return os.path.join(base_dir, "indeks")
+
+
+_shared: Dict[str, FullTextIndex] = {}
+_shared_lock = threading.Lock()
+
+
+def open_index(settings=None) -> FullTextIndex:
+    """Return the writable index shared by the whole application.
+
+    The processing pipeline and the search window use the same instance,
+    so documents committed by one are immediately visible to the other.
+    """
+    directory = getattr(settings, "fulltext_index_dir", "") or default_index_dir()
+    directory = os.path.abspath(directory)
+    with _shared_lock:
+        index = _shared.get(directory)
+        if index is None or index._closed:
+            index = FullTextIndex(
+                directory,
+                flush_docs=getattr(settings, "fulltext_flush_docs", 256),
+                merge_factor=getattr(settings, "fulltext_merge_factor", 8),
+            )
+            _shared[directory] = index
+        return index
+
+
+def close_shared() -> None:
+    """Close the indexes opened with :func:`open_index`."""
+    with _shared_lock:
+        indexes = list(_shared.values())
+        _shared.clear()
+    for index in indexes:
+        index.close()
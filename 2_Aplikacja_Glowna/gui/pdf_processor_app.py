@@ -29,21 +29,23 @@ from __future__ import annotations
 import logging
 import os
 import re
-import shutil
 from pathlib import Path
 import inspect
-import pandas as pd
 from datetime import datetime
 import getpass
 
 from .qt_safe import QtWidgets, QtCore, QtGui
 from . import processing_worker, style
-from .processing_worker import ProcessingWorker
+from .processing_worker import ProcessingWorker, ReocrWorker
 from .training_window import TrainingWindow
+from .search_window import SearchWindow
 from .session_manager_ui import SessionManagerUI
 from .constants import DOC_TYPE_LABELS, LABEL_TO_CODE
 from config import AppSettings, load_settings, save_settings
 from app_session_manager import SessionManager
+from xlsx_writer import CellStyle, XlsxWriter
+import file_placement
+import fulltext_index
 
 # Load bundled fonts so they are available across platforms
 try:  # pragma: no cover - run only when Qt is available
@@ -180,15 +182,12 @@ class ConfigDialog(QtWidgets.QDialog):
 DISALLOWED_CHARS = re.compile(r"[<>:\"/\\|?*\x00-\x1F]")
 
 
-def handle_file_copy(src_path: str, dest_dir: str, filename: str) -> str | None:
-    r"""Copy ``src_path`` to ``dest_dir`` ensuring the filename is safe.
+def sanitize_filename(src_path: str, filename: str) -> str | None:
+    r"""Return a safe version of ``filename`` for the archive.
 
-    ``filename`` is sanitised by replacing any character outside the ASCII
-    ``[\w.-]`` range with an underscore.  The resulting name is returned when
-    the copy succeeds; ``None`` indicates that the file was skipped or an
-    error occurred.
+    Any character outside the ASCII ``[\w.-]`` range is replaced with an
+    underscore; ``None`` means the file must be skipped.
     """
-
     safe_name = Path(filename).name
     safe_name = re.sub(r"[^\w.-]", "_", safe_name, flags=re.ASCII)
 
@@ -199,15 +198,30 @@ def handle_file_copy(src_path: str, dest_dir: str, filename: str) -> str | None:
             safe_name,
         )
         return None
+    if safe_name != filename:
+        logger.info(
+            "Nazwa pliku '%s' została zmieniona na '%s'", filename, safe_name
+        )
+    return safe_name
+
+
+def handle_file_copy(src_path: str, dest_dir: str, filename: str) -> str | None:
+    r"""Copy ``src_path`` to ``dest_dir`` ensuring the filename is safe.
+
+    ``filename`` is sanitised by replacing any character outside the ASCII
+    ``[\w.-]`` range with an underscore.  The resulting name is returned when
+    the copy succeeds; ``None`` indicates that the file was skipped or an
+    error occurred.  Batches are placed concurrently with
+    :class:`file_placement.FilePlacer` instead.
+    """
+
+    safe_name = sanitize_filename(src_path, filename)
+    if safe_name is None:
+        return None
 
     destination = Path(dest_dir) / safe_name
     try:
-        shutil.copy2(src_path, destination)
-        if safe_name != filename:
-            logger.info(
-                "Nazwa pliku '%s' została zmieniona na '%s'", filename, safe_name
-            )
-
+        file_placement.place_file(src_path, str(destination))
         return safe_name
     except Exception as e:  # pragma: no cover - logujemy błąd
         logger.error("Błąd kopiowania pliku %s: %s", src_path, e)
@@ -236,6 +250,8 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
         self._llm_warning_shown: bool = False
 
         self._worker: ProcessingWorker | None = None
+        self._reocr_worker: ReocrWorker | None = None
+        self._search_window: SearchWindow | None = None
         self._training_window: TrainingWindow | None = None
         self._highlighted_rows: set[int] = set()
         self.pdf_doc = None
@@ -393,6 +409,10 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
         self.validate_btn.clicked.connect(self._validate_current_row)
         panel_layout.addWidget(self.validate_btn)
 
+        self.reocr_btn = QtWidgets.QPushButton("Ponów OCR wiersza")
+        self.reocr_btn.clicked.connect(self.reocr_current_row)
+        panel_layout.addWidget(self.reocr_btn)
+
         panel_layout.addStretch(1)
 
         self.main_splitter.addWidget(self.side_panel)
@@ -416,6 +436,9 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
 
         export_action = tools_menu.addAction("Eksportuj do XLSX")
         export_action.triggered.connect(self.export_to_xlsx)
+
+        search_action = tools_menu.addAction("Szukaj w archiwum")
+        search_action.triggered.connect(self.open_search_window)
         about_action = menu.addAction("O programie")
         about_action.triggered.connect(self.show_about_dialog)
 
@@ -461,6 +484,7 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
         load_action.setShortcut(QtGui.QKeySequence("Ctrl+Shift+O"))
         save_action.setShortcut(QtGui.QKeySequence("Ctrl+S"))
         export_action.setShortcut(QtGui.QKeySequence("Ctrl+E"))
+        search_action.setShortcut(QtGui.QKeySequence("Ctrl+F"))
 
         # --- Progress bar in the status bar ---
         self.progress_bar = QtWidgets.QProgressBar()
@@ -507,6 +531,14 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
             self._training_window.raise_()
             self._training_window.activateWindow()
 
+    def open_search_window(self) -> None:
+        """Show the full-text search dialog over the archive."""
+        if self._search_window is None:
+            self._search_window = SearchWindow(self.settings, self)
+        self._search_window.show()
+        self._search_window.raise_()
+        self._search_window.activateWindow()
+
     def edit_settings(self) -> None:
         """Open configuration dialog and persist changes."""
         dlg = ConfigDialog(self.settings, self.session_manager, self)
@@ -858,25 +890,75 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
         target.setText(new_name)
         self.tree.blockSignals(False)
 
-    def _validate_current_row(self) -> None:
-        """Re-run analysis for the currently selected row."""
+    def _current_row_path(self) -> tuple[int, str | None]:
+        """Return the selected row and the path of its PDF file."""
         if not hasattr(self.tree, "currentRow"):
-            return
+            return -1, None
         row = self.tree.currentRow()
         if row < 0:
-            return
+            return row, None
         name_item = self.tree.item(row, 0)
         if name_item is None:
-            return
+            return row, None
         path = name_item.data(QtCore.Qt.UserRole)
         if not path:
             path = os.path.join(self.input_dir, name_item.text())
+        return row, path
+
+    def _validate_current_row(self) -> None:
+        """Re-run analysis for the currently selected row."""
+        row, path = self._current_row_path()
+        if path is None:
+            return
 
         try:
             text = Path(path).read_text("utf-8", errors="ignore")
         except Exception:
             text = ""
+        self._analyze_row(row, text)
 
+    def reocr_current_row(self) -> None:
+        """Recognize the selected document again ahead of a running batch.
+
+        The OCR runs in a :class:`ReocrWorker` with interactive priority, so
+        it gets the next free OCR engine even while a directory is being
+        processed; the row is analysed again once the text is ready.
+        """
+        row, path = self._current_row_path()
+        if path is None or (self._reocr_worker and self._reocr_worker.isRunning()):
+            return
+        self.reocr_btn.setEnabled(False)
+        try:
+            self.statusBar().showMessage(f"OCR: {os.path.basename(path)}")
+        except Exception:
+            pass
+        self._reocr_worker = ReocrWorker(path, row, self.settings)
+        self._reocr_worker.finished.connect(self._on_reocr_finished)
+        self._reocr_worker.error.connect(self._on_reocr_error)
+        self._reocr_worker.start()
+
+    def _on_reocr_finished(self, row: int, text: str, status: str) -> None:
+        self.reocr_btn.setEnabled(True)
+        item = self.tree.item(row, 0) if row < self.tree.rowCount() else None
+        if item is None or item.data(QtCore.Qt.UserRole) != self._reocr_worker.path:
+            # Wiersz usunięty lub przesunięty w czasie OCR
+            return
+        if status != "Sukces":
+            self._on_processing_error(f"OCR nie powiódł się: {text or status}")
+            return
+        try:
+            self.statusBar().showMessage("OCR zakończony", 3000)
+        except Exception:
+            pass
+        self._analyze_row(row, text)
+
+    def _on_reocr_error(self, message: str) -> None:
+        self.reocr_btn.setEnabled(True)
+        self._on_processing_error(message)
+
+    def _analyze_row(self, row: int, text: str) -> None:
+        """Extract metadata from ``text`` and show it in ``row``."""
+        name_item = self.tree.item(row, 0)
         llm = self.init_llm_processor() if self.use_llm else None
         info = processing_worker.extract_info_from_text(
             text, name_item.text(), self.work_mode, self.case_signature, llm
@@ -1034,87 +1116,44 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
             path += ".xlsx"
 
         headers = ["Lp.", "Nowa nazwa", *[label for _, label in INFO_FIELDS]]
-        data: list[list[str]] = []
-        colors: list[list[str]] = []
-        for row in range(self.tree.rowCount()):
-            row_values: list[str] = []
-            row_colors: list[str] = []
-            for col in range(1, self.tree.columnCount()):
-                item = self.tree.item(row, col)
-                row_values.append(item.text() if item else "")
-                if item:
-                    try:
-                        qc = item.background().color().name().upper()
-                    except Exception:
-                        qc = ""
-                    hex_color = qc.lstrip("#")
-                    if hex_color in {"00000000", "FFFFFF", "FFFFC8"}:
-                        hex_color = ""
-                else:
-                    hex_color = ""
-                row_colors.append(hex_color)
-            data.append(row_values)
-            colors.append(row_colors)
+        status_col = headers.index("Status")
+        status_fills = {
+            "OK": "C6EFCE",
+            "BŁĄD": "F8CBAD",
+            "DO UZUPEŁNIENIA": "FFF3CD",
+            "DUPLIKAT": "DDEBF7",
+        }
+        header_style = CellStyle(bold=True, fill="D9D9D9", border=True)
+        alt_colors = ["FFFFFF", "F0F0F0"]
 
-        col_widths = [len(h) for h in headers]
-        for row_values in data:
-            for idx, value in enumerate(row_values):
-                col_widths[idx] = max(col_widths[idx], len(str(value)))
+        def cell_color(item) -> str:
+            try:
+                qc = item.background().color().name().upper()
+            except Exception:
+                qc = ""
+            hex_color = qc.lstrip("#")
+            if hex_color in {"00000000", "FFFFFF", "FFFFC8"}:
+                hex_color = ""
+            return hex_color
 
-        df = pd.DataFrame(data, columns=headers)
         try:
-            df.to_excel(path, index=False)
-            from openpyxl import load_workbook
-            from openpyxl.styles import Font, Alignment, PatternFill, Border, Side
-            from openpyxl.utils import get_column_letter
-
-            wb = load_workbook(path)
-            ws = wb.active
-            ws.freeze_panes = "A2"
-            ws.auto_filter.ref = ws.dimensions
-
-            bold = Font(bold=True)
-            header_fill = PatternFill(
-                start_color="D9D9D9", end_color="D9D9D9", fill_type="solid"
-            )
-            thin = Side(style="thin", color="000000")
-            border = Border(left=thin, right=thin, top=thin, bottom=thin)
-            for cell in ws[1]:
-                cell.font = bold
-                cell.fill = header_fill
-                cell.border = border
-            for idx, width in enumerate(col_widths, start=1):
-                ws.column_dimensions[get_column_letter(idx)].width = width + 2
-            alt_colors = ["FFFFFF", "F0F0F0"]
-            for r_idx, color_row in enumerate(colors, start=2):
-                row_fill = alt_colors[(r_idx - 2) % 2]
-                for c_idx, hex_color in enumerate(color_row, start=1):
-                    cell = ws.cell(row=r_idx, column=c_idx)
-                    cell.alignment = Alignment(wrap_text=True, vertical="top")
-                    cell.border = border
-                    fill_color = hex_color or row_fill
-                    cell.fill = PatternFill(
-                        start_color=fill_color,
-                        end_color=fill_color,
-                        fill_type="solid",
-                    )
-
-            status_col = headers.index("Status") + 1
-            status_fills = {
-                "OK": "C6EFCE",
-                "BŁĄD": "F8CBAD",
-                "DO UZUPEŁNIENIA": "FFF3CD",
-            }
-            for r_idx, row in enumerate(data, start=2):
-                status = row[status_col - 1]
-                color = status_fills.get(status)
-                if color:
-                    cell = ws.cell(row=r_idx, column=status_col)
-                    cell.fill = PatternFill(
-                        start_color=color, end_color=color, fill_type="solid"
-                    )
-
-            wb.save(path)
+            # Wiersze trafiają z tabeli prosto do pliku, bez DataFrame i openpyxl
+            with XlsxWriter(path, freeze_header=True, auto_filter=True) as xlsx:
+                xlsx.write_row(headers, header_style)
+                for row in range(self.tree.rowCount()):
+                    row_fill = alt_colors[row % 2]
+                    values: list[str] = []
+                    styles: list[CellStyle] = []
+                    for col in range(1, self.tree.columnCount()):
+                        item = self.tree.item(row, col)
+                        values.append(item.text() if item else "")
+                        fill = (cell_color(item) if item else "") or row_fill
+                        styles.append(CellStyle(fill=fill, border=True, wrap=True))
+                    if status_col < len(values) and values[status_col] in status_fills:
+                        styles[status_col] = styles[status_col]._replace(
+                            fill=status_fills[values[status_col]]
+                        )
+                    xlsx.write_row(values, styles)
             QtWidgets.QMessageBox.information(
                 self, "Eksport", f"Zapisano dane do pliku:\n{path}"
             )
@@ -1160,12 +1199,17 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
 
     # ------------------------------------------------------------------
     def closeEvent(self, event):  # pragma: no cover - simple shutdown logic
-        if self._worker and self._worker.isRunning():
-            try:
-                self._worker.stop()
-                self._worker.wait()
-            except Exception:
-                pass
+        for worker in (self._worker, self._reocr_worker):
+            if worker and worker.isRunning():
+                try:
+                    worker.stop()
+                    worker.wait()
+                except Exception:
+                    pass
+        try:
+            fulltext_index.close_shared()
+        except Exception as exc:
+            logger.warning("Błąd zamykania indeksu pełnotekstowego: %s", exc)
         super().closeEvent(event)
 
     def init_llm_processor(self):
@@ -1188,7 +1232,12 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
                 pass
             return None
         try:
-            processor = DocumentLLMProcessor()
+            processor = DocumentLLMProcessor(
+                backend=self.settings.llm_backend,
+                n_threads=self.settings.llm_threads,
+                prompt_cache=self.settings.llm_prompt_cache,
+                n_parallel=self.settings.llm_parallel,
+            )
             if hasattr(processor, "load_model") and not processor.load_model():
                 raise RuntimeError("model not loaded")
             self.llm_processor = processor
@@ -1229,4 +1278,4 @@ class PdfProcessorApp(QtWidgets.QMainWindow, SessionManagerUI):
         )
 
 
-__all__ = ["PdfProcessorApp", "ProcessingWorker", "handle_file_copy"]
+__all__ = ["PdfProcessorApp", "ProcessingWorker", "handle_file_copy", "sanitize_filename"]
@@ -7,6 +7,7 @@ from datetime import datetime
 import logging
 from functools import lru_cache
 import threading
+from concurrent.futures import ThreadPoolExecutor, wait
 from queue import Queue, Empty
 
 try:  # pragma: no cover - prefer real PySide6 when available
@@ -56,6 +57,10 @@ try:  # pragma: no cover - when processing package not available
     from processing import ocr
 except Exception:  # pragma: no cover - minimal stub
     ocr = types.SimpleNamespace()
+try:  # pragma: no cover - when processing package not available
+    from processing import ner
+except Exception:  # pragma: no cover - minimal stub
+    ner = types.SimpleNamespace()
 
 logger = logging.getLogger(__name__)
 
@@ -72,6 +77,15 @@ else:
 if base_path not in sys.path:
     sys.path.insert(0, base_path)
 
+from document_analysis import DocumentAnalysis, ensure_analysis
+from file_placement import FilePlacer
+import barcodes
+import bilevel
+import case_index
+import fulltext_index
+import near_duplicates
+import ocr_scheduler
+
 @lru_cache(maxsize=1)
 def get_smart_extractor():
     """Zwraca instancję SmartExtractor lub obiekt zastępczy."""
@@ -79,12 +93,13 @@ def get_smart_extractor():
         from SmartExtractor import SmartExtractor
 
         logger.info("Moduł SmartExtractor znaleziony.")
-        return SmartExtractor()
+        # Wspólny model NER zamiast osobnego ładowania pl_core_news_sm
+        return SmartExtractor(nlp_model=get_nlp_model())
     except ImportError:
         logger.warning("Moduł SmartExtractor niedostępny.")
 
         class DummyExtractor:
-            def extract_info(self, text):
+            def extract_info(self, text, analysis=None):
                 return {
                     "data": "",
                     "nadawca_odbiorca": "",
@@ -170,9 +185,70 @@ def get_nlp_model():
     return load_spacy_model()
 
 
+def submit_llm_requests(llm_processor, analyses):
+    """Queue LLM metadata extraction for all documents up front.
+
+    ``analyses`` is a list of :class:`DocumentAnalysis` objects.  Returns one
+    future per document (``None`` when the processor cannot batch), so the
+    native backend decodes many documents together while the rest of the
+    extraction consumes the results in order.
+    """
+    submit = getattr(llm_processor, "submit_smart_metadata", None)
+    if submit is None:
+        return [None] * len(analyses)
+    return [submit(a.text, a.filename, analysis=a) for a in analyses]
+
+
+def cancel_llm_requests(llm_processor) -> None:
+    """Drop LLM requests queued by :func:`submit_llm_requests` and not yet done.
+
+    Their futures resolve with ``None``, so a stopped run neither waits for
+    nor keeps decoding documents that will never be committed.
+    """
+    cancel = getattr(llm_processor, "cancel_pending", None)
+    if cancel is not None:
+        cancel()
+
+
+def snap_case_signature(signature: str, settings=None) -> str:
+    """Return the known case signature closest to ``signature``.
+
+    The signature is returned unchanged when there is no list of known cases
+    or no single case is close enough (see ``case_index.py``).
+    """
+    settings = settings or config.SETTINGS
+    try:
+        index = case_index.load_case_index(settings)
+    except Exception as exc:
+        logger.warning("Lista znanych spraw niedostępna: %s", exc)
+        return signature
+    match = index.snap(signature) if index is not None else None
+    if match is None:
+        return signature
+    if match.signature != signature:
+        logger.info(
+            "Sygnatura '%s' dopasowana do znanej sprawy '%s' (odległość %d)",
+            signature,
+            match.signature,
+            match.distance,
+        )
+    return match.signature
+
+
 def extract_info_from_text(
-    text, original_filename, mode, case_signature_override="", llm_processor=None
+    text,
+    original_filename,
+    mode,
+    case_signature_override="",
+    llm_processor=None,
+    llm_future=None,
+    analysis=None,
 ):
+    """Extract metadata from ``text`` using NER, rules, regexes and the LLM.
+
+    ``analysis`` is an optional :class:`DocumentAnalysis` of ``text`` shared
+    by all stages, so the spaCy parse and the embedding are computed once.
+    """
     info = {
         "data": "",
         "nadawca_odbiorca": "",
@@ -185,12 +261,11 @@ def extract_info_from_text(
 
     # Krok 1: Analiza za pomocą modelu NER (spaCy)
     nlp_model = get_nlp_model()
+    analysis = ensure_analysis(text, analysis)
+    if analysis.nlp_model is None:
+        analysis.nlp_model = nlp_model
     if nlp_model:
-        doc = nlp_model(text)
-        entities = {ent.label_.upper(): [] for ent in doc.ents}
-        for ent in doc.ents:
-            entities[ent.label_.upper()].append(ent.text.replace("\n", " ").strip())
-
+        entities = analysis.entities
         info["data"] = " ".join(entities.get("DATA", []))
         info["nadawca_odbiorca"] = " ".join(entities.get("ORGANIZACJA", []))
         info["w_sprawie"] = " ".join(entities.get("TYTUL_PISMA", []))
@@ -205,7 +280,7 @@ def extract_info_from_text(
         info["status"] = "BŁĄD"
 
     # Krok 2: Użycie SmartExtractor dla pól, które są puste
-    smart_results = get_smart_extractor().extract_info(text)
+    smart_results = get_smart_extractor().extract_info(text, analysis)
 
     if not info["data"]:
         info["data"] = smart_results.get("data", "")
@@ -261,21 +336,25 @@ def extract_info_from_text(
             info["numer_dokumentu"] = num_match.group(1).strip()
 
     if not info["sygnatura_sprawy"]:
-        sig_match = re.search(
-            r"(?:sygn\.?\s*akt|sygnatura)\s*[:\s-]*([A-Z0-9./\- ]+)",
-            text,
-            flags=re.IGNORECASE,
-        )
-        if sig_match:
-            info["sygnatura_sprawy"] = sig_match.group(1).strip()
+        info["sygnatura_sprawy"] = text_case_signature(text)
+
+    # Odczytana sygnatura jest poprawiana do najbliższej znanej sprawy
+    signature_snapped = False
+    if info["sygnatura_sprawy"] and not case_signature_override:
+        snapped = snap_case_signature(info["sygnatura_sprawy"])
+        signature_snapped = snapped != info["sygnatura_sprawy"]
+        info["sygnatura_sprawy"] = snapped
 
     # Krok 4: Użycie asystenta LLM tylko jeśli jest dostępny i użytkownik go włączył
-    if llm_processor:
+    if llm_processor or llm_future is not None:
         logger.info("Używanie asystenta Phi-3 Mini do wzbogacenia analizy...")
         try:
-            llm_results = llm_processor.extract_smart_metadata(
-                text, original_filename
-            )
+            if llm_future is not None:
+                llm_results = llm_future.result()
+            else:
+                llm_results = llm_processor.extract_smart_metadata(
+                    text, original_filename, analysis=analysis
+                )
 
             if llm_results:
                 if not info["typ_dokumentu"] and llm_results.get("typ_dokumentu"):
@@ -301,6 +380,9 @@ def extract_info_from_text(
         if key != "status" and not value:
             colors[key] = "yellow"
 
+    if signature_snapped:
+        colors["sygnatura_sprawy"] = "orange"
+    # Poprawioną sygnaturę użytkownik ma potwierdzić przed archiwizacją
     if colors:
         info["status"] = "DO UZUPEŁNIENIA"
     info["colors"] = colors
@@ -349,6 +431,267 @@ def generate_new_filename(info, doc_type, counters):
     return f"{name}.pdf"
 
 
+def make_file_placer(settings=None) -> FilePlacer:
+    """Create a :class:`FilePlacer` configured from ``settings``."""
+    settings = settings or config.SETTINGS
+    return FilePlacer(
+        max_workers=getattr(settings, "copy_workers", 0),
+        fsync_batch=getattr(settings, "copy_fsync_batch", 64),
+        verify=getattr(settings, "verify_copies", False),
+        allow_hardlink=getattr(settings, "copy_hardlinks", False),
+    )
+
+
+def submit_file_copy(placer: FilePlacer, src, target_dir, new_name: str):
+    """Queue the archive copy of ``src`` under a sanitised ``new_name``.
+
+    Returns:
+        ``(safe_name, future)`` or ``(None, None)`` when the name is rejected.
+    """
+    from .pdf_processor_app import sanitize_filename  # lazy import
+
+    safe_name = sanitize_filename(str(src), new_name)
+    if safe_name is None:
+        return None, None
+    return safe_name, placer.submit(str(src), str(Path(target_dir) / safe_name))
+
+
+def finish_file_copies(placer: FilePlacer, results: list, placements: list) -> None:
+    """Wait for queued copies; rows whose copy failed get the proposed name.
+
+    ``placements`` holds ``(row, new_name, future)`` for every queued copy.
+    """
+    placer.close()
+    for row, new_name, future in placements:
+        if not future.result().ok:
+            name, idx, _, info = results[row]
+            results[row] = (name, idx, new_name, info)
+
+
+def make_recompressor(settings=None):
+    """Return a :class:`bilevel.Recompressor` or ``None`` when it is disabled."""
+    settings = settings or config.SETTINGS
+    if not getattr(settings, "archive_bilevel", False):
+        return None
+    return bilevel.Recompressor()
+
+
+def finish_recompression(recompressor) -> None:
+    """Wait for recompressed archive copies and log the space saved."""
+    if recompressor is None:
+        return
+    results = recompressor.close()
+    files, before, after = bilevel.savings(results)
+    kept = len(results) - files
+    if files:
+        logger.info(
+            "Rekompresja G4: %d plików, %.1f MB -> %.1f MB (%.0f%% mniej), bez zmian: %d",
+            files,
+            before / 2**20,
+            after / 2**20,
+            100 * (1 - after / before) if before else 0,
+            kept,
+        )
+    elif results:
+        logger.info("Rekompresja G4: brak zysku dla %d plików", kept)
+
+
+def make_text_index(settings=None):
+    """Return the shared full-text index or ``None`` when it is disabled."""
+    settings = settings or config.SETTINGS
+    if not getattr(settings, "fulltext_index", False):
+        return None
+    try:
+        return fulltext_index.open_index(settings)
+    except Exception as exc:
+        logger.warning("Indeks pełnotekstowy niedostępny: %s", exc)
+        return None
+
+
+def index_document(index, path, text: str) -> None:
+    """Add the OCR ``text`` of an archived document to ``index``."""
+    if index is None or not text or text.startswith("BŁĄD TECHNICZNY OCR"):
+        return
+    try:
+        index.add_document(str(path), text)
+    except Exception as exc:
+        logger.warning("Błąd indeksowania %s: %s", path, exc)
+
+
+def finish_text_index(index, placements: list) -> None:
+    """Drop documents whose copy failed and make the rest searchable."""
+    if index is None:
+        return
+    try:
+        for _, _, future in placements:
+            result = future.result()
+            if not result.ok:
+                index.delete_document(result.dst)
+        index.commit()
+    except Exception as exc:
+        logger.warning("Błąd zapisu indeksu pełnotekstowego: %s", exc)
+
+
+def make_duplicate_index(settings=None):
+    """Return the shared fingerprint store or ``None`` when detection is off."""
+    settings = settings or config.SETTINGS
+    if not getattr(settings, "duplicate_detection", False):
+        return None
+    try:
+        return near_duplicates.open_duplicate_index(settings)
+    except Exception as exc:
+        logger.warning("Wykrywanie duplikatów niedostępne: %s", exc)
+        return None
+
+
+# Sygnatura odczytana z tekstu oryginału, zapisywana razem z odciskiem
+TEXT_SIGNATURE = "sygnatura_w_tekscie"
+
+
+def check_duplicate(dup_index, text: str, path):
+    """Look ``text`` up among archived and earlier documents of the batch.
+
+    Returns:
+        ``(match, reserved_id)``: the :class:`near_duplicates.DuplicateMatch`
+        of a near-duplicate, or ``None`` and the id under which the new
+        document was reserved (``None`` when it cannot be fingerprinted).
+    """
+    if dup_index is None or not text or text.startswith("BŁĄD TECHNICZNY OCR"):
+        return None, None
+    try:
+        fp = near_duplicates.fingerprint(text)
+        if fp is None:
+            return None, None
+        match = dup_index.find(fp)
+        if match is not None:
+            return match, None
+        return None, dup_index.reserve(fp, str(path))
+    except Exception as exc:
+        logger.warning("Błąd wykrywania duplikatu %s: %s", path, exc)
+        return None, None
+
+
+def store_fingerprint(dup_index, reserved_id: int, path, info: dict, future=None) -> None:
+    """Persist a reserved fingerprint under the archived ``path``.
+
+    With the ``future`` of the archive copy the fingerprint is stored once
+    the copy succeeds and the reservation is dropped when it fails, so no
+    record points at a file that was never archived.
+    """
+    if future is not None:
+        def _done(done) -> None:
+            try:
+                ok = done.result().ok
+            except Exception:
+                ok = False
+            if ok:
+                store_fingerprint(dup_index, reserved_id, path, info)
+            else:
+                release_fingerprint(dup_index, reserved_id)
+
+        future.add_done_callback(_done)
+        return
+    try:
+        dup_index.store(
+            reserved_id, str(path), {k: v for k, v in info.items() if k != "colors"}
+        )
+    except Exception as exc:
+        logger.warning("Błąd zapisu odcisku %s: %s", path, exc)
+
+
+def release_fingerprint(dup_index, reserved_id: int) -> None:
+    """Drop the reservation of a document that was not archived."""
+    try:
+        dup_index.release(reserved_id)
+    except Exception as exc:
+        logger.warning("Błąd zwalniania odcisku %d: %s", reserved_id, exc)
+
+
+def text_case_signature(text: str) -> str:
+    """Case signature following ``sygn. akt`` or ``sygnatura`` in ``text``."""
+    sig_match = re.search(
+        r"(?:sygn\.?\s*akt|sygnatura)\s*[:\s-]*([A-Z0-9./\- ]+)",
+        text,
+        flags=re.IGNORECASE,
+    )
+    return sig_match.group(1).strip() if sig_match else ""
+
+
+def signatures_agree(text: str, original_info: dict) -> bool:
+    """Whether ``text`` carries the same case signature as its original.
+
+    Letters filled in from one template differ only in a few words, so a
+    near-duplicate may belong to another case. The signature read from the
+    text is compared with the one read from the original's text, or with
+    its extracted signature for records stored without it.
+    """
+    def norm(value: str) -> str:
+        return re.sub(r"\s+", "", value).casefold()
+
+    theirs = original_info.get(
+        TEXT_SIGNATURE, original_info.get("sygnatura_sprawy", "")
+    )
+    return norm(text_case_signature(text)) == norm(theirs)
+
+
+def fingerprint_info(info: dict, text: str) -> dict:
+    """``info`` stored with a fingerprint, with the signature read from ``text``."""
+    return {**info, TEXT_SIGNATURE: text_case_signature(text)}
+
+
+def duplicate_info(match, case_signature_override: str = "") -> dict:
+    """Metadata of a near-duplicate, copied from the matching document.
+
+    NER, rules and the LLM are skipped; the row is marked ``DUPLIKAT`` and
+    the ``duplikat`` column names the archived original. Callers check
+    :func:`signatures_agree` first; a duplicate of another case keeps its
+    own extraction and is only passed to :func:`mark_duplicate`.
+    """
+    info = {key: "" for key in (
+        "data", "nadawca_odbiorca", "w_sprawie", "numer_dokumentu",
+        "sygnatura_sprawy", "typ_dokumentu",
+    )}
+    info.update({
+        k: v for k, v in match.info.items()
+        if k not in ("colors", "status", TEXT_SIGNATURE)
+    })
+    if case_signature_override:
+        info["sygnatura_sprawy"] = case_signature_override
+    info["colors"] = {}
+    return mark_duplicate(info, match.path)
+
+
+def mark_duplicate(info: dict, original) -> dict:
+    """Set status ``DUPLIKAT`` and the ``duplikat`` column of ``info``.
+
+    Used alone for a document that precedes its original in the batch: it
+    keeps its own metadata, since the original was not archived before it.
+    """
+    info["status"] = "DUPLIKAT"
+    info["duplikat"] = str(original)
+    info.setdefault("colors", {})["duplikat"] = "lightblue"
+    return info
+
+
+def apply_routing_fields(info: dict, fields: dict, case_signature_override: str = "") -> dict:
+    """Overwrite extracted metadata with the fields read from barcodes.
+
+    Codes printed on the document are authoritative, so their fields replace
+    whatever NER, rules or the LLM found and are marked ``lightcyan``.  A
+    case signature given by the user still wins over the QR code.
+    """
+    colors = info.setdefault("colors", {})
+    for key, value in fields.items():
+        if key not in info or (key == "sygnatura_sprawy" and case_signature_override):
+            continue
+        info[key] = value
+        colors[key] = "lightcyan"
+    unresolved = {"yellow", "orange"} & set(colors.values())
+    if info.get("status") == "DO UZUPEŁNIENIA" and not unresolved:
+        info["status"] = "OK"
+    return info
+
+
 def process_files(
     input_dir: str,
     output_dir: str = "",
@@ -376,29 +719,107 @@ def process_files(
     target_dir.mkdir(exist_ok=True)
     if counters is None:
         counters = {}
-    for idx, path in enumerate(pdf_paths, 1):
-        if stop_cb and stop_cb():
-            break
+    texts = []
+    for path in pdf_paths:
         try:
-            text = path.read_text("utf-8", errors="ignore")
+            texts.append(path.read_text("utf-8", errors="ignore"))
         except Exception:
-            text = ""
-        info = extract_info_from_text(
-            text, path.name, work_mode, case_signature, llm_processor
-        )
-        try:
-            new_name = generate_new_filename(info, work_mode, counters)
-        except ValueError:
-            new_name = f"dokument_do_weryfikacji_{idx}.pdf"
-        from .pdf_processor_app import handle_file_copy  # lazy import
-
-        safe_name = handle_file_copy(str(path), str(target_dir), new_name)
-        results.append((path.name, idx, safe_name or new_name, info))
-        if progress_cb:
-            progress_cb(idx, total)
+            texts.append("")
+    analyses = [
+        DocumentAnalysis(text, filename=path.name) for path, text in zip(pdf_paths, texts)
+    ]
+    llm_futures = (
+        submit_llm_requests(llm_processor, analyses) if llm_processor else [None] * total
+    )
+    placer = make_file_placer()
+    placements = []
+    try:
+        for idx, (path, analysis, llm_future) in enumerate(
+            zip(pdf_paths, analyses, llm_futures), 1
+        ):
+            if stop_cb and stop_cb():
+                break
+            info = extract_info_from_text(
+                analysis.text,
+                path.name,
+                work_mode,
+                case_signature,
+                llm_processor,
+                llm_future=llm_future,
+                analysis=analysis,
+            )
+            try:
+                new_name = generate_new_filename(info, work_mode, counters)
+            except ValueError:
+                new_name = f"dokument_do_weryfikacji_{idx}.pdf"
+            # Kopia trafia do puli, a ekstrakcja przechodzi do kolejnego pliku
+            safe_name, future = submit_file_copy(placer, path, target_dir, new_name)
+            if future is not None:
+                placements.append((len(results), new_name, future))
+            results.append((path.name, idx, safe_name or new_name, info))
+            if progress_cb:
+                progress_cb(idx, total)
+    finally:
+        if llm_processor:
+            cancel_llm_requests(llm_processor)
+        finish_file_copies(placer, results, placements)
     return results
 
 
+def process_stream(documents, extract, commit, workers=0, poll=None, max_pending=0):
+    """Run ``extract`` concurrently on a stream and ``commit`` results in order.
+
+    ``documents`` is a :class:`queue.Queue` receiving ``(index, payload)``
+    items with 0-based indices in any order and ``None`` as the end marker.
+    ``extract(index, payload)`` runs in a pool of ``workers`` threads (``0``
+    picks ``min(4, cpu_count)``) as soon as an item arrives, while
+    ``commit(index, result)`` is called on the calling thread strictly in
+    index order.  ``poll()`` is invoked roughly every 100 ms; returning
+    ``False`` stops the pipeline after the results committed so far.
+
+    With ``max_pending`` set, no further items are taken from ``documents``
+    while that many are extracted or awaiting their commit and the next one
+    to commit is among them; the producer then blocks on the full queue.
+    Items are still taken while the next document has not arrived, since
+    only it can unblock the commits.
+    """
+    workers = workers or min(4, os.cpu_count() or 1)
+    pending = {}
+    next_index = 0
+    finished = False
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        try:
+            while True:
+                if poll is not None and poll() is False:
+                    return
+                if max_pending and len(pending) >= max_pending and next_index in pending:
+                    # Limit buforowanych wyników: czekaj na zatwierdzenie
+                    wait([pending[next_index]], timeout=0.1)
+                elif not finished:
+                    try:
+                        item = documents.get(timeout=0.1)
+                    except Empty:
+                        item = False
+                    if item is None:
+                        finished = True
+                    elif item is not False:
+                        index, payload = item
+                        pending[index] = pool.submit(extract, index, payload)
+                elif next_index not in pending:
+                    break
+                # Zatwierdzanie w kolejności dokumentów (numeracja plików)
+                while next_index in pending and pending[next_index].done():
+                    commit(next_index, pending.pop(next_index).result())
+                    next_index += 1
+                    if poll is not None and poll() is False:
+                        return
+                if finished and next_index in pending:
+                    wait([pending[next_index]], timeout=0.1)
+        finally:
+            for future in pending.values():
+                future.cancel()
+
+
 class ProcessingWorker(QtCore.QThread):
     """Background thread processing PDF files and emitting Qt signals."""
 
@@ -466,59 +887,239 @@ class ProcessingWorker(QtCore.QThread):
 
             total_pages = sum(_count_pages(p) for p in pdf_paths)
             pages_done = 0
-            results_holder: dict[str, list] = {}
-
-            def ocr_task() -> None:
-                res, _ = ocr.extract_texts_with_ocr_parallel(
+            target_dir = Path(self.output_dir or self.input_dir)
+            target_dir.mkdir(exist_ok=True)
+            # Wczytaj modele przed startem puli, aby wątki ich nie dublowały
+            nlp_model = None
+            try:
+                nlp_model = get_nlp_model()
+                get_smart_extractor()
+            except Exception as exc:
+                logger.warning(f"Nie udało się wstępnie załadować modeli: {exc}")
+
+            # Etap 1: OCR wrzuca gotowe dokumenty do ograniczonej kolejki;
+            # prawie identyczne z już widzianymi są oznaczane przed NER i LLM
+            queue_size = self.settings.pipeline_queue_size
+            documents: Queue = Queue(maxsize=queue_size)
+            dup_index = make_duplicate_index(self.settings)
+            reserved: dict[int, int] = {}
+            # Duplikaty dokumentów z tej samej partii, jeszcze niezarchiwizowanych:
+            # rozstrzygane przy zatwierdzaniu, gdy oryginał ma już nazwę i metadane
+            in_batch: dict[int, object] = {}
+            originals: dict[int, tuple] = {}
+            preceding: dict[int, list[int]] = {}
+            # Duplikaty z archiwum o innej sygnaturze: własne metadane, tylko oznaczenie
+            other_case: dict[int, str] = {}
+            # Pola odczytane z kodów kreskowych i QR pierwszej strony
+            routed: dict[int, dict] = {}
+            read_codes = getattr(self.settings, "barcode_routing", False)
+            registry_prefixes = [
+                p.strip()
+                for p in getattr(self.settings, "barcode_registry_prefixes", "").split(",")
+                if p.strip()
+            ]
+            # Strony zakodowane G4 czekające na skopiowanie pliku do archiwum
+            encode_bilevel = getattr(self.settings, "archive_bilevel", False)
+            bilevel_pages: dict[int, list] = {}
+
+            def ocr_documents():
+                for idx, res in ocr.iter_texts_with_ocr(
                     [str(p) for p in pdf_paths],
                     cancel_event,
                     progress_queue,
                     language=self.settings.ocr_language,
                     psm=self.settings.ocr_psm,
                     oem=self.settings.ocr_oem,
-                )
-                results_holder["res"] = res
+                    max_pending=queue_size,
+                    read_codes=read_codes,
+                    skip_routed=read_codes and self.settings.barcode_skip_ocr,
+                    encode_bilevel=encode_bilevel,
+                ):
+                    if res[1] == "Anulowano":
+                        # Niepełny tekst po zatrzymaniu nie jest zatwierdzany
+                        continue
+                    analysis = DocumentAnalysis(
+                        res[0] if res else "", filename=pdf_paths[idx].name
+                    )
+                    extras = res[2] if len(res) > 2 else None
+                    # Tylko kompletny OCR: po błędzie lub anulowaniu brak części stron
+                    if extras is not None and extras.bilevel_pages and res[1] == "Sukces":
+                        bilevel_pages[idx] = extras.bilevel_pages
+                    fields = (
+                        barcodes.routing_fields(extras.codes, registry_prefixes) if extras else {}
+                    )
+                    if fields:
+                        routed[idx] = fields
+                    if not analysis.text and fields.get("sygnatura_sprawy"):
+                        # OCR pominięty: metadane pochodzą wyłącznie z kodów
+                        documents.put((idx, (analysis, None, None)))
+                        continue
+                    duplicate, reserved_id = check_duplicate(
+                        dup_index, analysis.text, pdf_paths[idx]
+                    )
+                    if duplicate is not None and duplicate.reserved:
+                        in_batch[idx] = duplicate
+                    elif duplicate is not None and signatures_agree(
+                        analysis.text, duplicate.info
+                    ):
+                        # Duplikat omija NER i LLM, trafia od razu do ekstrakcji
+                        documents.put((idx, (analysis, None, duplicate)))
+                        continue
+                    elif duplicate is not None:
+                        # Ten sam wzór pisma w innej sprawie: własna ekstrakcja
+                        other_case[idx] = duplicate.path
+                    if reserved_id is not None:
+                        reserved[idx] = reserved_id
+                    # Żądanie LLM trafia do batcha, zanim dokument czeka na ekstrakcję
+                    llm_future = (
+                        submit_llm_requests(self.llm_processor, [analysis])[0]
+                        if self.llm_processor
+                        else None
+                    )
+                    yield analysis.text, (idx, analysis, llm_future)
 
-            thread = threading.Thread(target=ocr_task)
-            thread.start()
-            if self.progress:
-                self.progress.emit(0, total_pages)
-            while thread.is_alive() or not progress_queue.empty():
+            def ocr_task() -> None:
                 try:
-                    msg, inc = progress_queue.get(timeout=0.1)
-                    if msg == "page_done":
-                        pages_done += inc
-                        if self.progress:
-                            self.progress.emit(pages_done, total_pages)
-                except Empty:
-                    pass
-                if not self._running:
-                    cancel_event.set()
-            thread.join()
-            ocr_results = results_holder.get("res", [])
-            target_dir = Path(self.output_dir or self.input_dir)
-            target_dir.mkdir(exist_ok=True)
-
-            results: list[tuple[str, int, str, dict]] = []
-            for idx, (path, ocr_result) in enumerate(zip(pdf_paths, ocr_results), 1):
-                text = ocr_result[0] if ocr_result else ""
+                    if nlp_model:
+                        # NER partiami (nlp.pipe) wprost ze strumienia OCR
+                        stream = ner.pipe_documents(
+                            nlp_model,
+                            ocr_documents(),
+                            n_process=self.settings.ner_processes,
+                            batch_size=self.settings.ner_batch_size,
+                        )
+                    else:
+                        stream = ((None, item) for _, item in ocr_documents())
+                    for doc, (idx, analysis, llm_future) in stream:
+                        if doc is not None:
+                            analysis.nlp_model = nlp_model
+                            analysis.doc = doc
+                        documents.put((idx, (analysis, llm_future, None)))
+                except Exception as exc:
+                    logger.error(f"Błąd etapu OCR: {exc}")
+                finally:
+                    documents.put(None)
+
+            # Etap 2: ekstrakcja metadanych równolegle z OCR
+            def extract(idx: int, payload) -> tuple[dict, str]:
+                analysis, llm_future, duplicate = payload
+                if duplicate is not None:
+                    return duplicate_info(duplicate, self.case_signature), analysis.text
                 info = extract_info_from_text(
-                    text,
-                    path.name,
+                    analysis.text,
+                    pdf_paths[idx].name,
                     self.work_mode,
                     self.case_signature,
                     self.llm_processor,
+                    llm_future=llm_future,
+                    analysis=analysis,
                 )
+                if idx in routed:
+                    apply_routing_fields(info, routed[idx], self.case_signature)
+                if idx in other_case:
+                    mark_duplicate(info, other_case.pop(idx))
+                return info, analysis.text
+
+            # Etap 3: nazwy w kolejności plików, kopiowanie w puli FilePlacer,
+            # tekst OCR trafia do indeksu pełnotekstowego pod nazwą w archiwum
+            results: list[tuple[str, int, str, dict]] = []
+            placer = make_file_placer(self.settings)
+            placements = []
+            text_index = make_text_index(self.settings)
+            recompressor = make_recompressor(self.settings)
+
+            def commit(idx: int, extracted: tuple[dict, str]) -> None:
+                info, text = extracted
+                path = pdf_paths[idx]
+                duplicate = in_batch.pop(idx, None)
+                if duplicate is not None:
+                    if duplicate.id in originals:
+                        original, original_info = originals[duplicate.id]
+                        if not signatures_agree(text, original_info):
+                            info = mark_duplicate(info, original)
+                        else:
+                            info = duplicate_info(
+                                near_duplicates.DuplicateMatch(
+                                    original, duplicate.distance, original_info
+                                ),
+                                self.case_signature,
+                            )
+                    else:
+                        # Oryginał jest dalej na liście: oznaczany przy jego zapisie
+                        preceding.setdefault(duplicate.id, []).append(len(results))
                 try:
                     new_name = generate_new_filename(
                         info, self.work_mode, self.counters
                     )
                 except ValueError:
-                    new_name = f"dokument_do_weryfikacji_{idx}.pdf"
-                from .pdf_processor_app import handle_file_copy  # lazy import
+                    new_name = f"dokument_do_weryfikacji_{idx + 1}.pdf"
+                safe_name, future = submit_file_copy(placer, path, target_dir, new_name)
+                pages = bilevel_pages.pop(idx, None)
+                if future is not None:
+                    placements.append((len(results), new_name, future))
+                    index_document(text_index, target_dir / safe_name, text)
+                    if recompressor is not None and pages:
+                        recompressor.submit(future, pages)
+                    if idx in reserved:
+                        reserved_id = reserved.pop(idx)
+                        original = target_dir / safe_name
+                        stored = fingerprint_info(info, text)
+                        originals[reserved_id] = (str(original), stored)
+                        for row in preceding.pop(reserved_id, []):
+                            mark_duplicate(results[row][3], original)
+                        store_fingerprint(dup_index, reserved_id, original, stored, future)
+                if idx in reserved:
+                    release_fingerprint(dup_index, reserved.pop(idx))
+                results.append((path.name, idx + 1, safe_name or new_name, info))
+
+            def poll() -> bool:
+                nonlocal pages_done
+                while True:
+                    try:
+                        msg, inc = progress_queue.get_nowait()
+                    except Empty:
+                        break
+                    if msg == "page_done":
+                        pages_done += inc
+                        if self.progress:
+                            self.progress.emit(pages_done, total_pages)
+                if not self._running and not cancel_event.is_set():
+                    cancel_event.set()
+                    if self.llm_processor:
+                        cancel_llm_requests(self.llm_processor)
+                return self._running
 
-                safe_name = handle_file_copy(str(path), str(target_dir), new_name)
-                results.append((path.name, idx, safe_name or new_name, info))
+            thread = threading.Thread(target=ocr_task, daemon=True)
+            thread.start()
+            if self.progress:
+                self.progress.emit(0, total_pages)
+            try:
+                process_stream(
+                    documents,
+                    extract,
+                    commit,
+                    workers=self.settings.extraction_workers,
+                    poll=poll,
+                    max_pending=queue_size,
+                )
+            finally:
+                cancel_event.set()
+                if self.llm_processor:
+                    cancel_llm_requests(self.llm_processor)
+                # Odblokuj wątek OCR czekający na miejsce w kolejce
+                while thread.is_alive():
+                    try:
+                        documents.get(timeout=0.1)
+                    except Empty:
+                        pass
+                thread.join()
+                finish_file_copies(placer, results, placements)
+                finish_recompression(recompressor)
+                finish_text_index(text_index, placements)
+                # Dokumenty niezatwierdzone po zatrzymaniu nie trafiły do archiwum
+                for reserved_id in reserved.values():
+                    release_fingerprint(dup_index, reserved_id)
+            poll()
             self.finished.emit(results)
         except Exception as exc:  # pragma: no cover - defensive
             self.error.emit(str(exc))
@@ -527,6 +1128,59 @@ class ProcessingWorker(QtCore.QThread):
         """Request the thread to terminate after the current file."""
         self._running = False
 
+def recognize_interactive(path, settings=None, cancel_event=None) -> tuple:
+    """Recognize one document a user waits for, ahead of running batches.
+
+    The pages take the ``INTERACTIVE`` lane of the shared OCR engines (see
+    ``ocr_scheduler.py``), so the document is served before batch pages
+    still waiting for an engine.  The page cache is bypassed, so every page
+    is really recognised again, and the new text replaces the cached one.
+
+    Returns:
+        A tuple ``(text, status)`` as from ``ocr.extract_text_with_ocr``.
+    """
+    settings = settings or config.SETTINGS
+    return ocr.extract_text_with_ocr(
+        str(path),
+        language=settings.ocr_language,
+        psm=settings.ocr_psm,
+        oem=settings.ocr_oem,
+        priority=ocr_scheduler.INTERACTIVE,
+        cancel_event=cancel_event,
+        use_page_cache=False,
+    )
+
+
+class ReocrWorker(QtCore.QThread):
+    """Background thread recognizing one table row with interactive priority."""
+
+    try:  # pragma: no cover - executed only when PySide6 is available
+        finished = QtCore.Signal(int, str, str)
+        error = QtCore.Signal(str)
+    except Exception:  # pragma: no cover - fallback for tests
+        finished = _DummySignal()
+        error = _DummySignal()
+
+    def __init__(self, path, row: int, settings: AppSettings | None = None, parent=None) -> None:
+        super().__init__(parent)
+        self.path = path
+        self.row = row
+        self.settings = settings or config.SETTINGS
+        self.cancel_event = threading.Event()
+
+    def run(self) -> None:
+        try:
+            ocr._configure_pytesseract()
+            text, status = recognize_interactive(self.path, self.settings, self.cancel_event)
+            self.finished.emit(self.row, text, status)
+        except Exception as exc:  # pragma: no cover - defensive
+            self.error.emit(str(exc))
+
+    def stop(self) -> None:
+        """Skip the pages not yet recognized."""
+        self.cancel_event.set()
+
+
 def open_pdf_file(filepath):
     """Otwiera plik PDF przy użyciu domyślnej aplikacji systemu."""
     try:
@@ -552,6 +1206,7 @@ __all__ = [
     "extract_info_from_text",
     "generate_new_filename",
     "process_files",
+    "process_stream",
     "ProcessingWorker",
     "open_pdf_file",
     "load_spacy_model",
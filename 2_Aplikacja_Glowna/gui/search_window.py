@@ -0,0 +1,84 @@
+"""Qt dialog searching the archive by document content.
+
+Queries go to the full-text index fed by the processing pipeline (see
+``fulltext_index.py``).  Words are ranked with BM25 and text in double
+quotes must appear as a phrase; double-clicking a result opens the PDF.
+"""
+
+from __future__ import annotations
+
+import os
+import time
+
+from . import processing_worker
+from .qt_safe import QtWidgets, QtCore
+
+# Liczba wyników pokazywanych dla jednego zapytania
+RESULT_LIMIT = 200
+
+
+class SearchWindow(QtWidgets.QDialog):
+    """Dialog with a query field and a ranked list of archived documents."""
+
+    def __init__(self, settings, parent=None) -> None:
+        super().__init__(parent)
+        self.settings = settings
+        self.setWindowTitle("Szukaj w archiwum")
+        self.resize(800, 500)
+        layout = QtWidgets.QVBoxLayout(self)
+
+        query_layout = QtWidgets.QHBoxLayout()
+        self.query_edit = QtWidgets.QLineEdit()
+        self.query_edit.setPlaceholderText('np. umowa najmu "Gdańsk ul. Długa"')
+        self.query_edit.returnPressed.connect(self.run_search)
+        query_layout.addWidget(self.query_edit)
+        search_btn = QtWidgets.QPushButton("Szukaj")
+        search_btn.clicked.connect(self.run_search)
+        query_layout.addWidget(search_btn)
+        layout.addLayout(query_layout)
+
+        self.results = QtWidgets.QTreeWidget()
+        self.results.setColumnCount(3)
+        self.results.setHeaderLabels(["Plik", "Trafność", "Folder"])
+        self.results.setRootIsDecorated(False)
+        self.results.itemDoubleClicked.connect(self._open_result)
+        layout.addWidget(self.results)
+
+        self.status_label = QtWidgets.QLabel("")
+        layout.addWidget(self.status_label)
+
+    def run_search(self) -> None:
+        """Search the index for the current query and list the hits."""
+        query = self.query_edit.text().strip()
+        self.results.clear()
+        if not query:
+            return
+        index = processing_worker.make_text_index(self.settings)
+        if index is None:
+            self.status_label.setText("Indeks pełnotekstowy jest wyłączony w konfiguracji.")
+            return
+        start = time.perf_counter()
+        try:
+            hits = index.search(query, RESULT_LIMIT)
+        except Exception as exc:
+            QtWidgets.QMessageBox.critical(self, "Błąd", f"Błąd wyszukiwania:\n{exc}")
+            return
+        elapsed = (time.perf_counter() - start) * 1000
+        for hit in hits:
+            item = QtWidgets.QTreeWidgetItem(
+                [os.path.basename(hit.path), f"{hit.score:.2f}", os.path.dirname(hit.path)]
+            )
+            item.setData(0, QtCore.Qt.UserRole, hit.path)
+            self.results.addTopLevelItem(item)
+        self.status_label.setText(
+            f"Znaleziono: {len(hits)} (przeszukano {len(index)} dok. w {elapsed:.1f} ms)"
+        )
+
+    def _open_result(self, item, column) -> None:
+        path = item.data(0, QtCore.Qt.UserRole)
+        if not os.path.exists(path):
+            QtWidgets.QMessageBox.warning(
+                self, "Brak pliku", f"Plik nie istnieje w archiwum:\n{path}"
+            )
+            return
+        processing_worker.open_pdf_file(path)
@@ -4,7 +4,10 @@ This module replaces the previous Tkinter implementation with a
 :class:`QtWidgets.QDialog` version.  The window allows selecting a folder
 with training data and displays log output from a background process that
 invokes ``training_worker.py``.  The subprocess is executed within a
-``QThread`` and progress is reported using Qt signals.
+``QThread`` and progress is reported using Qt signals.  Stopping sends
+``cancel`` on the subprocess' stdin, which interrupts OCR of the training
+data at once; a process still busy after ``STOP_GRACE_SECONDS`` (spaCy
+training itself) is killed.
 """
 
 from __future__ import annotations
@@ -13,10 +16,14 @@ import os
 import shutil
 import subprocess
 import sys
+import threading
 
 from .processing_worker import base_path, app_dir
 from .qt_safe import QtWidgets, QtCore
 
+# Czas na przerwanie OCR przed zabiciem procesu treningu
+STOP_GRACE_SECONDS = 10.0
+
 
 class _DummySignal:
     """Fallback signal used when PySide6 is unavailable."""
@@ -45,18 +52,24 @@ class TrainingWorker(QtCore.QObject):
     def __init__(self, cmd: list[str]) -> None:
         super().__init__()
         self.cmd = cmd
+        self._process: subprocess.Popen | None = None
+        self.stop_requested = False
 
     def run(self) -> None:
         """Run the external training script and emit progress lines."""
         try:
             process = subprocess.Popen(
                 self.cmd,
+                stdin=subprocess.PIPE,
                 stdout=subprocess.PIPE,
                 stderr=subprocess.STDOUT,
                 text=True,
                 bufsize=1,
                 creationflags=getattr(subprocess, "CREATE_NO_WINDOW", 0),
             )
+            self._process = process
+            if self.stop_requested:
+                self.stop()
             assert process.stdout
             for line in process.stdout:
                 self.progress.emit(line.rstrip())
@@ -67,6 +80,26 @@ class TrainingWorker(QtCore.QObject):
             self.progress.emit(f"Błąd uruchamiania treningu: {exc}")
             self.finished.emit(False)
 
+    def stop(self) -> None:
+        """Ask the training process to stop; kill it if it does not exit."""
+        self.stop_requested = True
+        process = self._process
+        if process is None or process.poll() is not None:
+            return
+        try:
+            process.stdin.write("cancel\n")
+            process.stdin.flush()
+        except (OSError, ValueError):
+            pass
+
+        def _kill() -> None:
+            if process.poll() is None:
+                process.kill()
+
+        timer = threading.Timer(STOP_GRACE_SECONDS, _kill)
+        timer.daemon = True
+        timer.start()
+
 
 class TrainingWindow(QtWidgets.QDialog):
     """Dialog providing UI for training a new model."""
@@ -105,6 +138,10 @@ class TrainingWindow(QtWidgets.QDialog):
         self.train_button = QtWidgets.QPushButton("2. Rozpocznij trening")
         self.train_button.clicked.connect(self.start_training_thread)
         layout.addWidget(self.train_button)
+        self.stop_button = QtWidgets.QPushButton("Przerwij trening")
+        self.stop_button.setEnabled(False)
+        self.stop_button.clicked.connect(self.stop_training)
+        layout.addWidget(self.stop_button)
 
         # --- Log output ---
         log_group = QtWidgets.QGroupBox("Log treningu")
@@ -141,6 +178,7 @@ class TrainingWindow(QtWidgets.QDialog):
             return
 
         self.train_button.setEnabled(False)
+        self.stop_button.setEnabled(True)
         self.log_text.clear()
 
         self.output_model_dir = os.path.join(app_dir, "temp_model_output")
@@ -162,8 +200,21 @@ class TrainingWindow(QtWidgets.QDialog):
         self._thread.finished.connect(self._thread.deleteLater)
         self._thread.start()
 
+    def stop_training(self) -> None:
+        if self._worker is None:
+            return
+        self.stop_button.setEnabled(False)
+        self.log_message("Przerywanie treningu...")
+        self._worker.stop()
+
     def _on_training_complete(self, success: bool) -> None:
-        if success:
+        stopped = self._worker is not None and self._worker.stop_requested
+        self.stop_button.setEnabled(False)
+        self._worker = None
+        if stopped and not success:
+            shutil.rmtree(self.output_model_dir, ignore_errors=True)
+            self.log_message("\n>>> Trening przerwany.")
+        elif success:
             final_model_path = os.path.join(app_dir, "custom_ner_model")
             if os.path.exists(final_model_path):
                 shutil.rmtree(final_model_path)
@@ -7,7 +7,10 @@ except Exception:  # pragma: no cover - torch not available in tests
     torch = None  # type: ignore
 import logging
 import gc
-from typing import Any, Dict, List, Optional, Union
+import hashlib
+import threading
+from concurrent.futures import Future, InvalidStateError, ThreadPoolExecutor
+from typing import Any, Dict, List, Optional, Set, Union
 
 # bitsandbytes i konfiguracja kwantyzacji są opcjonalne
 try:
@@ -33,6 +36,12 @@ except Exception:  # pragma: no cover - transformers unavailable
 # Import analizatora kontekstowego
 from context_analyzer import ContextAwareDocumentAnalyzer
 
+# Natywny backend llama.cpp (GGUF) jest opcjonalny
+try:
+    import native_llm
+except Exception:  # pragma: no cover - module missing in stripped builds
+    native_llm = None  # type: ignore
+
 # Konfiguracja logowania
 logger = logging.getLogger(__name__)
 
@@ -76,6 +85,26 @@ DEFAULT_CORRECTION_PROMPT = (
     "<|assistant|>"
 )
 
+# Gramatyka GBNF odpowiedzi z metadanymi dla backendu natywnego: pięć pól
+# w stałej kolejności, data pusta lub YYYY-MM-DD, bez nawiasów klamrowych
+# w wartościach, więc pierwsze "}" kończy odpowiedź.
+METADATA_GRAMMAR = r"""
+root ::= "{" ws "\"typ_dokumentu\":" ws str "," ws "\"data\":" ws date "," ws "\"nadawca_odbiorca\":" ws str "," ws "\"temat\":" ws str "," ws "\"numer_dokumentu\":" ws str ws "}"
+str  ::= "\"" chr* "\""
+chr  ::= [^"\\{}\x00-\x1f] | "\\" ["\\/nt]
+date ::= "\"" ( [0-9] [0-9] [0-9] [0-9] "-" ( "0" [1-9] | "1" [0-2] ) "-" ( "0" [1-9] | [12] [0-9] | "3" [01] ) )? "\""
+ws   ::= [ \t\n]{0,8}
+"""
+
+
+def _settle(future: Future, value: Any) -> None:
+    """Resolve ``future`` unless :meth:`DocumentLLMProcessor.cancel_pending` did."""
+    try:
+        future.set_result(value)
+    except InvalidStateError:
+        pass
+
+
 class DocumentLLMProcessor:
     """Klasa do inteligentnego przetwarzania treści dokumentów przy użyciu małych LLM"""
     
@@ -100,13 +129,38 @@ class DocumentLLMProcessor:
         }
     }
     
-    def __init__(self, selected_model: str = "phi-2", use_quantization: Union[bool, str] = "auto") -> None:
+    BACKENDS = ("auto", "torch", "gguf")
+
+    # Parametry generowania metadanych (wspólne dla trybu pojedynczego i batcha)
+    METADATA_GENERATION = {
+        "max_new_tokens": 500,
+        "temperature": 0.2,  # Niska temperatura dla bardziej deterministycznych odpowiedzi
+        "top_p": 0.95,
+        "do_sample": True,
+    }
+
+    def __init__(
+        self,
+        selected_model: str = "phi-2",
+        use_quantization: Union[bool, str] = "auto",
+        backend: str = "auto",
+        n_threads: int = 0,
+        prompt_cache: bool = True,
+        n_parallel: int = 4,
+    ) -> None:
         """Initialize the processor with a chosen LLM model.
 
         Args:
             selected_model: Key of the model to load.
             use_quantization: Whether to use 4-bit quantization (``True``/``False``)
                 or ``"auto"`` to decide based on environment.
+            backend: ``"torch"`` for transformers, ``"gguf"`` for the native
+                llama.cpp backend or ``"auto"`` to prefer a local ``.gguf``
+                file when the native library is built.
+            n_threads: CPU threads for the native backend; ``0`` uses all cores.
+            prompt_cache: Persist the KV cache of the static prompt prefix
+                next to the GGUF model so later runs skip its evaluation.
+            n_parallel: Documents decoded together by the native backend.
         """
         self.selected_model = selected_model if selected_model in self.AVAILABLE_MODELS else "phi-2"
         self.model_info = self.AVAILABLE_MODELS[self.selected_model]
@@ -131,6 +185,18 @@ class DocumentLLMProcessor:
             self.device = "cpu"
         # czy używać kwantyzacji: True/False/"auto"
         self.use_quantization = use_quantization
+        self.backend = backend if backend in self.BACKENDS else "auto"
+        self.n_threads = n_threads
+        self.prompt_cache = prompt_cache
+        self.n_parallel = max(1, n_parallel)
+        # Chroni pamięć kontekstową, którą aktualizują też wywołania z batcha
+        self._context_lock = threading.Lock()
+        # Wątek zgłaszający żądania z submit_smart_metadata() i ich anulowanie
+        self._submit_lock = threading.Lock()
+        self._submitter: Optional[ThreadPoolExecutor] = None
+        self._queued: Set[Future] = set()
+        self._generation = 0
+        self.native_model = None
         self.loaded = False
 
         # Załaduj konfigurację promptów
@@ -146,19 +212,85 @@ class DocumentLLMProcessor:
 
         logger.info(f"Inicjalizacja asystenta LLM - model: {self.model_info['name']} (urządzenie: {self.device})")
     
+    def find_gguf_model(self) -> Optional[str]:
+        """Return path of the first ``.gguf`` file in ``model_dir`` if present."""
+        if not os.path.isdir(self.model_dir):
+            return None
+        candidates = sorted(
+            f for f in os.listdir(self.model_dir) if f.lower().endswith(".gguf")
+        )
+        return os.path.join(self.model_dir, candidates[0]) if candidates else None
+
+    def resolve_backend(self) -> str:
+        """Return the backend actually used: ``"gguf"`` or ``"torch"``."""
+        if self.backend != "auto":
+            return self.backend
+        if native_llm is not None and native_llm.is_available() and self.find_gguf_model():
+            return "gguf"
+        return "torch"
+
     def is_model_downloaded(self) -> bool:
         """Check whether model files are present on disk."""
+        if self.resolve_backend() == "gguf":
+            return self.find_gguf_model() is not None
         required_files = ["config.json", "tokenizer.json", "tokenizer_config.json"]
         return os.path.exists(self.model_dir) and all(os.path.exists(os.path.join(self.model_dir, f)) for f in required_files)
-        
+
+    def _load_native_model(self) -> bool:
+        """Load the quantized GGUF model with the native CPU backend."""
+        model_path = self.find_gguf_model()
+        if native_llm is None or model_path is None:
+            logger.warning(f"Brak pliku .gguf dla modelu {self.model_info['name']} w {self.model_dir}")
+            return False
+        cache_key = f"gguf_{model_path}"
+        if cache_key not in MODEL_CACHE:
+            logger.info(f"Ładowanie modelu GGUF {os.path.basename(model_path)} (backend natywny)...")
+            MODEL_CACHE[cache_key] = native_llm.NativeLLM(
+                model_path,
+                n_ctx=self._native_kv_size(),
+                n_threads=self.n_threads,
+                n_parallel=self.n_parallel,
+            )
+            self._prime_prompt_prefix(MODEL_CACHE[cache_key], model_path)
+        self.native_model = MODEL_CACHE[cache_key]
+        self.loaded = True
+        logger.info(f"Model {self.model_info['name']} załadowany (GGUF, CPU)")
+        return True
+
+    def _native_kv_size(self) -> int:
+        """KV cache size shared by the parallel sequences of the native backend.
+
+        One full context window plus half a window per extra sequence; the
+        static prompt prefix is stored once and shared by all of them.
+        """
+        window = min(self.model_info["context_length"], 4096)
+        return window + (self.n_parallel - 1) * (window // 2)
+
+    def _prime_prompt_prefix(self, model, model_path: str) -> None:
+        """Evaluate the constant system part of the metadata prompt once."""
+        prefix = self.context_analyzer.static_prompt_prefix()
+        if not prefix:
+            return
+        cache_path = None
+        if self.prompt_cache:
+            digest = hashlib.sha1(prefix.encode("utf-8")).hexdigest()[:12]
+            cache_path = f"{os.path.splitext(model_path)[0]}.prompt-{digest}.bin"
+        try:
+            n_tokens = model.set_prompt_prefix(prefix, cache_path)
+            logger.info(f"Prefiks promptu ({n_tokens} tokenów) zapisany w pamięci KV")
+        except Exception as e:
+            logger.warning(f"Nie udało się przygotować prefiksu promptu: {e}")
+
     def load_model(self) -> bool:
         """Load the LLM into memory with CPU/GPU optimisations."""
         try:
+            if self.loaded:
+                return True
+            if self.resolve_backend() == "gguf":
+                return self._load_native_model()
             if torch is None:
                 logger.warning("Torch not available; skipping model loading")
                 return False
-            if self.loaded:
-                return True
 
             cache_key = f"{self.model_id}_{self.device}_{self.use_quantization}"
             if cache_key in MODEL_CACHE and cache_key in TOKENIZER_CACHE:
@@ -236,12 +368,64 @@ class DocumentLLMProcessor:
             logger.error(f"Błąd ładowania modelu {self.model_info['name']}: {e}")
             return False
     
-    def extract_smart_metadata(self, text: str, filename: str = "") -> Optional[Dict[str, str]]:
+    def _generate(
+        self,
+        prompt: str,
+        max_new_tokens: int,
+        temperature: float,
+        top_p: float,
+        do_sample: bool,
+        grammar: Optional[str] = None,
+    ) -> str:
+        """Run the loaded backend and return only the assistant's reply.
+
+        ``grammar`` constrains the native backend to a JSON object and stops
+        generation at its closing brace; the torch path ignores it.
+        """
+        if self.native_model is not None:
+            return self.native_model.generate(
+                prompt,
+                max_tokens=max_new_tokens,
+                temperature=temperature if do_sample else 0.0,
+                top_p=top_p,
+                grammar=grammar,
+                stop="}" if grammar else None,
+            ).strip()
+
+        inputs = self.tokenizer(prompt, return_tensors="pt").to(self.device)
+        with torch.no_grad():
+            outputs = self.model.generate(
+                inputs["input_ids"],
+                max_new_tokens=max_new_tokens,
+                temperature=temperature,
+                top_p=top_p,
+                do_sample=do_sample
+            )
+        response = self.tokenizer.decode(outputs[0], skip_special_tokens=True)
+        # Wyodrębnij część odpowiedzi asystenta (po <|assistant|>)
+        return response.split("<|assistant|>")[-1].strip()
+
+    def _parse_json_response(self, response: str) -> Any:
+        """Decode the JSON object returned by :meth:`_generate`."""
+        if self.native_model is not None:
+            # Odpowiedź ograniczona gramatyką jest dokładnie jednym obiektem JSON
+            return json.loads(response)
+        json_pattern = re.search(r'(\{.*\})', response, re.DOTALL)
+        if not json_pattern:
+            return json.loads(response)
+        json_text = re.sub(r'\\(?!["\\/bfnrt]|u[0-9a-fA-F]{4})', r'', json_pattern.group(1))
+        return json.loads(json_text)
+
+    def extract_smart_metadata(
+        self, text: str, filename: str = "", analysis: Any = None
+    ) -> Optional[Dict[str, str]]:
         """Use the LLM to extract document metadata.
 
         Args:
             text: OCR text of the document.
             filename: Optional original filename for context.
+            analysis: Optional ``DocumentAnalysis`` of ``text`` shared with the
+                other extraction stages (its embedding is reused).
 
         Returns:
             Dictionary with extracted metadata or ``None`` on failure.
@@ -251,63 +435,151 @@ class DocumentLLMProcessor:
             return None
         
         # Użyj analizatora kontekstowego do wygenerowania ulepszonego promptu
-        prompt = self.context_analyzer.generate_enhanced_prompt(text, filename)
+        with self._context_lock:
+            prompt = self.context_analyzer.generate_enhanced_prompt(
+                text, filename, analysis=analysis
+            )
 
         try:
-            # Przetwórz przez model LLM
-            inputs = self.tokenizer(prompt, return_tensors="pt").to(self.device)
-            
             # Generowanie odpowiedzi z kontrolą parametrów
-            with torch.no_grad():
-                outputs = self.model.generate(
-                    inputs["input_ids"],
-                    max_new_tokens=500,
-                    temperature=0.2,  # Niska temperatura dla bardziej deterministycznych odpowiedzi
-                    top_p=0.95,
-                    do_sample=True
-                )
-            response = self.tokenizer.decode(outputs[0], skip_special_tokens=True)
-            
-            # Wyodrębnij część odpowiedzi asystenta (po <|assistant|>)
-            assistant_response = response.split("<|assistant|>")[-1].strip()
-            logger.info(f"Model odpowiedział: {assistant_response[:100]}...")
-            
-            # Wyodrębnij JSON z odpowiedzi
-            try:
-                json_pattern = re.search(r'(\{.*\})', assistant_response, re.DOTALL)
-                if json_pattern:
-                    json_text = json_pattern.group(1)
-                    json_text = re.sub(r'\\(?!["\\/bfnrt]|u[0-9a-fA-F]{4})', r'', json_text)
-                    metadata = json.loads(json_text)
-                else:
-                    metadata = json.loads(assistant_response)
-
-                if isinstance(metadata, dict):
-                    if 'temat' in metadata and 'w_sprawie' not in metadata:
-                        metadata['w_sprawie'] = metadata.pop('temat')
-
-                    if not self.validate_metadata(metadata):
-                        logger.error("Walidacja metadanych nie powiodła się")
-                        return None
-
-                    logger.info("Pomyślnie wyodrębniono metadane z dokumentu")
-
-                    self.context_analyzer.add_document_to_memory(text, metadata)
-                    metadata = self.context_analyzer.apply_contextual_corrections(metadata, text)
-
-                    score = self.calculate_quality_score(metadata)
-                    logger.info(f"Wynik jakości ({self.model_info['name']}): {score:.2f}")
-                    return metadata
-                else:
-                    logger.error("Zwrócone dane nie są słownikiem")
-                    return None
-            except json.JSONDecodeError as je:
-                logger.error(f"Błąd parsowania JSON: {je}")
-                return None
+            assistant_response = self._generate(
+                prompt, grammar=METADATA_GRAMMAR, **self.METADATA_GENERATION
+            )
+        except Exception as e:
+            logger.error(f"Błąd podczas analizy LLM: {e}")
+            return None
+        return self._metadata_from_response(text, assistant_response)
+
+    def submit_smart_metadata(self, text: str, filename: str = "", analysis: Any = None) -> Future:
+        """Queue metadata extraction so many documents are decoded in one batch.
+
+        The call returns immediately.  Loading the model, building the prompt
+        and, for backends without batching, the generation itself run on the
+        processor's own submission thread; with the native backend the
+        request then joins the engine's continuous batch.  Requests not
+        finished yet are dropped by :meth:`cancel_pending`.
+
+        Returns:
+            Future resolved with the same value as :meth:`extract_smart_metadata`.
+        """
+        future: Future = Future()
+        with self._submit_lock:
+            if self._submitter is None:
+                self._submitter = ThreadPoolExecutor(
+                    max_workers=1, thread_name_prefix="llm-submit"
+                )
+            self._queued.add(future)
+            self._submitter.submit(
+                self._run_submission, future, self._generation, text, filename, analysis
+            )
+        return future
+
+    def _run_submission(
+        self, future: Future, generation: int, text: str, filename: str, analysis: Any
+    ) -> None:
+        with self._submit_lock:
+            if future not in self._queued:
+                return  # anulowane przed rozpoczęciem
+            self._queued.discard(future)
+        try:
+            if not self.loaded and not self.load_model():
+                logger.error("Nie można użyć asystenta LLM - model nie jest załadowany")
+                future.set_result(None)
+                return
+            if self.native_model is None or not hasattr(self.native_model, "submit"):
+                future.set_result(self.extract_smart_metadata(text, filename, analysis))
+                return
 
+            with self._context_lock:
+                prompt = self.context_analyzer.generate_enhanced_prompt(
+                    text, filename, analysis=analysis
+                )
+            params = self.METADATA_GENERATION
+            with self._submit_lock:
+                if generation != self._generation:
+                    future.set_result(None)
+                    return
+                pending = self.native_model.submit(
+                    prompt,
+                    max_tokens=params["max_new_tokens"],
+                    temperature=params["temperature"],
+                    top_p=params["top_p"],
+                    grammar=METADATA_GRAMMAR,
+                    stop="}",
+                )
+        except Exception as e:
+            logger.error(f"Błąd podczas analizy LLM: {e}")
+            if not future.done():
+                future.set_result(None)
+            return
+
+        def _resolve(done: Future) -> None:
+            # Wątek harmonogramu llama.cpp tylko przekazuje odpowiedź: parsowanie
+            # i pamięć kontekstu nie wstrzymują dekodowania innych sekwencji
+            self._submitter.submit(self._finish_submission, future, generation, text, done)
+
+        pending.add_done_callback(_resolve)
+
+    def _finish_submission(
+        self, future: Future, generation: int, text: str, done: Future
+    ) -> None:
+        if generation != self._generation:
+            _settle(future, None)  # anulowane w trakcie dekodowania
+            return
+        try:
+            response = done.result().strip()
+            metadata = self._metadata_from_response(text, response)
         except Exception as e:
             logger.error(f"Błąd podczas analizy LLM: {e}")
-            return None
+            metadata = None
+        _settle(future, metadata)
+
+    def cancel_pending(self) -> None:
+        """Resolve every unfinished :meth:`submit_smart_metadata` with ``None``.
+
+        Queued requests are dropped without running and the native engine
+        stops the sequences it is decoding.  A transformers generation
+        already in progress runs to completion.
+        """
+        with self._submit_lock:
+            self._generation += 1
+            queued, self._queued = self._queued, set()
+            cancel = getattr(self.native_model, "cancel_pending", None)
+            if cancel is not None:
+                cancel()
+        for future in queued:
+            _settle(future, None)
+
+    def _metadata_from_response(self, text: str, assistant_response: str) -> Optional[Dict[str, str]]:
+        """Parse and validate the model reply and update the context memory."""
+        logger.info(f"Model odpowiedział: {assistant_response[:100]}...")
+        # Wyodrębnij JSON z odpowiedzi
+        try:
+            metadata = self._parse_json_response(assistant_response)
+        except json.JSONDecodeError as je:
+            logger.error(f"Błąd parsowania JSON: {je}")
+            return None
+
+        if not isinstance(metadata, dict):
+            logger.error("Zwrócone dane nie są słownikiem")
+            return None
+        if 'temat' in metadata and 'w_sprawie' not in metadata:
+            metadata['w_sprawie'] = metadata.pop('temat')
+
+        if not self.validate_metadata(metadata):
+            logger.error("Walidacja metadanych nie powiodła się")
+            return None
+
+        logger.info("Pomyślnie wyodrębniono metadane z dokumentu")
+
+        # Odpowiedzi z batcha przychodzą z wątku backendu natywnego
+        with self._context_lock:
+            self.context_analyzer.add_document_to_memory(text, metadata)
+            metadata = self.context_analyzer.apply_contextual_corrections(metadata, text)
+
+        score = self.calculate_quality_score(metadata)
+        logger.info(f"Wynik jakości ({self.model_info['name']}): {score:.2f}")
+        return metadata
 
     def validate_metadata(self, metadata: Dict[str, str]) -> bool:
         """Validate structure and format of extracted metadata."""
@@ -347,25 +619,18 @@ class DocumentLLMProcessor:
         )
 
         try:
-            inputs = self.tokenizer(prompt, return_tensors="pt").to(self.device)
-            with torch.no_grad():
-                outputs = self.model.generate(
-                    inputs["input_ids"],
-                    max_new_tokens=500,
-                    temperature=0.1,
-                    top_p=0.9,
-                    do_sample=False
-                )
-            response = self.tokenizer.decode(outputs[0], skip_special_tokens=True)
-            assistant_response = response.split("<|assistant|>")[-1].strip()
-            
+            assistant_response = self._generate(
+                prompt,
+                max_new_tokens=500,
+                temperature=0.1,
+                top_p=0.9,
+                do_sample=False,
+                grammar=METADATA_GRAMMAR,
+            )
+
             # Parsuj odpowiedź JSON
-            json_pattern = re.search(r'(\{.*\})', assistant_response, re.DOTALL)
-            if json_pattern:
-                json_text = json_pattern.group(1)
-                json_text = re.sub(r'\\(?!["\\/bfnrt]|u[0-9a-fA-F]{4})', r'', json_text)
-                corrections = json.loads(json_text)
-                
+            corrections = self._parse_json_response(assistant_response)
+            if corrections:
                 # Przenieś poprawki do oryginalnego słownika
                 if isinstance(corrections, dict):
                     if corrections.get('typ_dokumentu'):
@@ -394,10 +659,13 @@ class DocumentLLMProcessor:
         base_dir = os.path.dirname(os.path.abspath(__file__))
         available: List[str] = []
         
-        # Sprawdź standardowe modele
+        # Sprawdź standardowe modele (transformers lub pojedynczy plik .gguf)
         for model_key in self.AVAILABLE_MODELS.keys():
             model_dir = os.path.join(base_dir, f"llm_model_{model_key}")
-            if os.path.exists(model_dir) and os.path.exists(os.path.join(model_dir, "config.json")):
+            if not os.path.isdir(model_dir):
+                continue
+            has_gguf = any(f.lower().endswith(".gguf") for f in os.listdir(model_dir))
+            if has_gguf or os.path.exists(os.path.join(model_dir, "config.json")):
                 available.append(model_key)
         
         # Sprawdź starą lokalizację
@@ -0,0 +1,336 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Code 128 and Code 39 decoding along scanlines of a grayscale page, used to
+// route documents by their registry sticker before OCR (barcodes.py).
+//
+// Every step-th row and column is read in both directions. A pixel is dark
+// when it is below the mean of the surrounding window and the window has
+// enough contrast, so stickers on grey or stamped paper binarize cleanly.
+// Runs of dark and light pixels are matched against the symbol tables with
+// module widths rounded from each symbol's total width. Code 128 symbols are
+// accepted only with a valid check character; Code 39 has none, so a value
+// must be read on two scanlines.
+
+#define WINDOW 24       // half-width of the thresholding window in pixels
+#define MIN_STDDEV 20   // flat areas (std. deviation below this) are light
+#define MAX_VALUE 128   // longest decoded value
+#define MAX_CODES 32
+
+// Module widths of Code 128 values 0..105 (bar, space, bar, space, ...).
+static const char *const C128[106] = {
+    "212222", "222122", "222221", "121223", "121322", "131222", "122213", "122312",
+    "132212", "221213", "221312", "231212", "112232", "122132", "122231", "113222",
+    "123122", "123221", "223211", "221132", "221231", "213212", "223112", "312131",
+    "311222", "321122", "321221", "312212", "322112", "322211", "212123", "212321",
+    "232121", "111323", "131123", "131321", "112313", "132113", "132311", "211313",
+    "231113", "231311", "112133", "112331", "132131", "113123", "113321", "133121",
+    "313121", "211331", "231131", "213113", "213311", "213131", "311123", "311321",
+    "331121", "312113", "312311", "332111", "314111", "221411", "431111", "111224",
+    "111422", "121124", "121421", "141122", "141221", "112214", "112412", "122114",
+    "122411", "142112", "142211", "241211", "221114", "413111", "241112", "134111",
+    "111242", "121142", "121241", "114212", "124112", "124211", "411212", "421112",
+    "421211", "212141", "214121", "412121", "111143", "111341", "131141", "114113",
+    "114311", "411113", "411311", "113141", "114131", "311141", "411131", "211412",
+    "211214", "211232",
+};
+static const char C128_STOP[] = "2331112";
+
+// Code 39 characters with their wide (w) and narrow (n) elements.
+static const char C39_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. *$/+%";
+static const char *const C39[44] = {
+    "nnnwwnwnn", "wnnwnnnnw", "nnwwnnnnw", "wnwwnnnnn", "nnnwwnnnw", "wnnwwnnnn",
+    "nnwwwnnnn", "nnnwnnwnw", "wnnwnnwnn", "nnwwnnwnn", "wnnnnwnnw", "nnwnnwnnw",
+    "wnwnnwnnn", "nnnnwwnnw", "wnnnwwnnn", "nnwnwwnnn", "nnnnnwwnw", "wnnnnwwnn",
+    "nnwnnwwnn", "nnnnwwwnn", "wnnnnnnww", "nnwnnnnww", "wnwnnnnwn", "nnnnwnnww",
+    "wnnnwnnwn", "nnwnwnnwn", "nnnnnnwww", "wnnnnnwwn", "nnwnnnwwn", "nnnnwnwwn",
+    "wwnnnnnnw", "nwwnnnnnw", "wwwnnnnnn", "nwnnwnnnw", "wwnnwnnnn", "nwwnwnnnn",
+    "nwnnnnwnw", "wwnnnnwnn", "nwwnnnwnn", "nwnnwnwnn", "nwnwnwnnn", "nwnwnnnwn",
+    "nwnnnwnwn", "nnnwnwnwn",
+};
+
+typedef struct {
+    char symbology[8];
+    char value[MAX_VALUE + 1];
+    int hits;
+} Code;
+
+typedef struct {
+    Code codes[MAX_CODES];
+    int n;
+} Found;
+
+static void add_code(Found *f, const char *symbology, const char *value) {
+    for (int i = 0; i < f->n; ++i)
+        if (!strcmp(f->codes[i].symbology, symbology) && !strcmp(f->codes[i].value, value)) {
+            f->codes[i].hits++;
+            return;
+        }
+    if (f->n == MAX_CODES)
+        return;
+    Code *c = &f->codes[f->n++];
+    strcpy(c->symbology, symbology);
+    strcpy(c->value, value);
+    c->hits = 1;
+}
+
+// Round runs to modules given that together they span `modules`; returns 0
+// when a run rounds to zero or more than four modules.
+static int to_modules(const int *runs, int n, int modules, char *out) {
+    int total = 0;
+    for (int k = 0; k < n; ++k)
+        total += runs[k];
+    if (total < modules)
+        return 0;
+    for (int k = 0; k < n; ++k) {
+        int m = (2 * runs[k] * modules + total) / (2 * total);
+        if (m < 1 || m > 4)
+            return 0;
+        out[k] = (char)('0' + m);
+    }
+    out[n] = 0;
+    return 1;
+}
+
+static int c128_value(const int *runs) {
+    char pattern[7];
+    if (!to_modules(runs, 6, 11, pattern))
+        return -1;
+    for (int v = 0; v < 106; ++v)
+        if (!memcmp(pattern, C128[v], 6))
+            return v;
+    return -1;
+}
+
+static int c128_stop(const int *runs) {
+    char pattern[8];
+    return to_modules(runs, 7, 13, pattern) && !memcmp(pattern, C128_STOP, 7);
+}
+
+// Translate symbol values (start code first, check character excluded) to
+// text following the code set switches.
+static int c128_text(const int *values, int n, char *out) {
+    int set = values[0] - 103;  // 0 = A, 1 = B, 2 = C
+    int len = 0;
+    for (int i = 1; i < n; ++i) {
+        int v = values[i];
+        int cur = set;
+        if (v == 98 && set != 2 && i + 1 < n) {
+            // Zmiana zestawu tylko dla następnego znaku (A <-> B)
+            cur = set == 0 ? 1 : 0;
+            v = values[++i];
+        }
+        if (cur == 2) {
+            if (v < 100) {
+                if (len + 2 > MAX_VALUE)
+                    return 0;
+                out[len++] = (char)('0' + v / 10);
+                out[len++] = (char)('0' + v % 10);
+            } else if (v == 100) {
+                set = 1;
+            } else if (v == 101) {
+                set = 0;
+            }
+            continue;
+        }
+        if (v == 99) {
+            set = 2;
+        } else if (v == 100 && cur == 0) {
+            set = 1;
+        } else if (v == 101 && cur == 1) {
+            set = 0;
+        } else if (v < 96) {
+            if (len + 1 > MAX_VALUE)
+                return 0;
+            out[len++] = (char)(cur == 0 && v >= 64 ? v - 64 : v + 32);
+        }
+        // FNC1-FNC4 nie niosą znaków
+    }
+    out[len] = 0;
+    return len > 0;
+}
+
+// Try to read a Code 128 symbol whose start code begins at dark run i.
+static void c128_at(const int *runs, int n, int i, Found *f) {
+    int values[MAX_VALUE + 2];
+    int start = c128_value(runs + i);
+    if (start < 103)
+        return;
+    // Przed kodem startu wymagana cisza szerokości co najmniej 5 modułów
+    int width = 0;
+    for (int k = 0; k < 6; ++k)
+        width += runs[i + k];
+    if (i > 0 && runs[i - 1] * 11 < 5 * width)
+        return;
+    values[0] = start;
+    int count = 1;
+    for (int j = i + 6; j + 7 <= n; j += 6) {
+        if (c128_stop(runs + j)) {
+            if (count < 3)
+                return;
+            int check = values[0];
+            for (int k = 1; k < count - 1; ++k)
+                check += k * values[k];
+            if (check % 103 != values[count - 1])
+                return;
+            char text[MAX_VALUE + 1];
+            if (c128_text(values, count - 1, text))
+                add_code(f, "CODE128", text);
+            return;
+        }
+        int v = c128_value(runs + j);
+        if (v < 0 || v > 102 || count == MAX_VALUE + 1)
+            return;
+        values[count++] = v;
+    }
+}
+
+static int c39_char(const int *runs) {
+    // Trzy najszersze elementy są szerokie
+    int order[9];
+    for (int k = 0; k < 9; ++k)
+        order[k] = k;
+    for (int a = 0; a < 3; ++a)
+        for (int b = a + 1; b < 9; ++b)
+            if (runs[order[b]] > runs[order[a]]) {
+                int t = order[a];
+                order[a] = order[b];
+                order[b] = t;
+            }
+    int narrow_max = 0;
+    for (int k = 3; k < 9; ++k)
+        if (runs[order[k]] > narrow_max)
+            narrow_max = runs[order[k]];
+    if (2 * runs[order[2]] < 3 * narrow_max)
+        return -1;
+    char pattern[10];
+    memset(pattern, 'n', 9);
+    pattern[9] = 0;
+    for (int a = 0; a < 3; ++a)
+        pattern[order[a]] = 'w';
+    for (int c = 0; c < 44; ++c)
+        if (!memcmp(pattern, C39[c], 9))
+            return c;
+    return -1;
+}
+
+// Try to read a Code 39 symbol whose start character begins at dark run i.
+static void c39_at(const int *runs, int n, int i, Found *f) {
+    const int star = 39;
+    if (c39_char(runs + i) != star)
+        return;
+    int width = 0;
+    for (int k = 0; k < 9; ++k)
+        width += runs[i + k];
+    if (i > 0 && runs[i - 1] < width / 2)
+        return;
+    char text[MAX_VALUE + 1];
+    int len = 0;
+    for (int j = i + 10; j + 9 <= n; j += 10) {
+        int c = c39_char(runs + j);
+        if (c < 0)
+            return;
+        if (c == star) {
+            if (len == 0)
+                return;
+            text[len] = 0;
+            add_code(f, "CODE39", text);
+            return;
+        }
+        if (len == MAX_VALUE)
+            return;
+        text[len++] = C39_CHARS[c];
+    }
+}
+
+static void decode_runs(const int *runs, int n, Found *f) {
+    // Parzyste indeksy to ciemne elementy
+    for (int i = 0; i + 6 <= n; i += 2) {
+        c128_at(runs, n, i, f);
+        if (i + 9 <= n)
+            c39_at(runs, n, i, f);
+    }
+}
+
+// Binarize one line of n pixels and decode it in both directions.
+static void scan_line(const uint8_t *px, int n, int pitch, int64_t *sums, int64_t *squares,
+                      int *runs, int *reversed, Found *f) {
+    sums[0] = squares[0] = 0;
+    for (int k = 0; k < n; ++k) {
+        int v = px[(size_t)k * pitch];
+        sums[k + 1] = sums[k] + v;
+        squares[k + 1] = squares[k] + v * v;
+    }
+    int n_runs = 0, prev_dark = 0;
+    for (int k = 0; k < n; ++k) {
+        int lo = k - WINDOW < 0 ? 0 : k - WINDOW;
+        int hi = k + WINDOW + 1 > n ? n : k + WINDOW + 1;
+        int64_t w = hi - lo, s = sums[hi] - sums[lo], s2 = squares[hi] - squares[lo];
+        int64_t var_w2 = s2 * w - s * s;  // wariancja * w^2
+        int dark = var_w2 >= (int64_t)MIN_STDDEV * MIN_STDDEV * w * w &&
+                   (int64_t)px[(size_t)k * pitch] * w < s;
+        if (n_runs == 0 && !dark)
+            continue;  // ciąg zaczyna się od pierwszego ciemnego elementu
+        if (n_runs == 0 || dark != prev_dark)
+            runs[n_runs++] = 0;
+        runs[n_runs - 1]++;
+        prev_dark = dark;
+    }
+    if (n_runs > 0 && !prev_dark)
+        n_runs--;  // jasne tło za ostatnim elementem
+    decode_runs(runs, n_runs, f);
+    for (int k = 0; k < n_runs; ++k)
+        reversed[k] = runs[n_runs - 1 - k];
+    decode_runs(reversed, n_runs, f);
+}
+
+// Scan every step-th row and column of a grayscale page whose rows start
+// stride bytes apart. Decoded codes are written to out as
+// "SYMBOLOGY\tvalue\n" lines (truncated to cap bytes including the NUL);
+// returns the number of codes or -1 on allocation failure.
+int barcode_scan(const uint8_t *gray, int width, int height, int stride, int step,
+                 char *out, int cap) {
+    int longest = width > height ? width : height;
+    int64_t *sums = (int64_t *)malloc(((size_t)longest + 1) * sizeof(int64_t));
+    int64_t *squares = (int64_t *)malloc(((size_t)longest + 1) * sizeof(int64_t));
+    int *runs = (int *)malloc((size_t)longest * sizeof(int));
+    int *reversed = (int *)malloc((size_t)longest * sizeof(int));
+    Found *f = (Found *)calloc(1, sizeof(Found));
+    if (!sums || !squares || !runs || !reversed || !f) {
+        free(sums);
+        free(squares);
+        free(runs);
+        free(reversed);
+        free(f);
+        return -1;
+    }
+    if (step < 1)
+        step = 1;
+    for (int y = step / 2; y < height; y += step)
+        scan_line(gray + (size_t)y * stride, width, 1, sums, squares, runs, reversed, f);
+    for (int x = step / 2; x < width; x += step)
+        scan_line(gray + x, height, stride, sums, squares, runs, reversed, f);
+
+    int written = 0, count = 0;
+    if (cap > 0)
+        out[0] = 0;
+    for (int i = 0; i < f->n; ++i) {
+        const Code *c = &f->codes[i];
+        // Code 39 nie ma znaku kontrolnego: wymagane dwa zgodne odczyty
+        if (!strcmp(c->symbology, "CODE39") && c->hits < 2)
+            continue;
+        int len = (int)(strlen(c->symbology) + strlen(c->value) + 2);
+        if (written + len + 1 > cap)
+            break;
+        written += sprintf(out + written, "%s\t%s\n", c->symbology, c->value);
+        ++count;
+    }
+    free(sums);
+    free(squares);
+    free(runs);
+    free(reversed);
+    free(f);
+    return count;
+}
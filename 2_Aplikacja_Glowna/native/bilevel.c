@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CCITT Group 4 (ITU-T T.6) encoding of binarized pages and colour detection
+// for recompressing archived scans (bilevel.py).
+//
+// Every row is coded against the previous one (an imaginary white row for the
+// first) with the pass, vertical and horizontal modes of T.6, following the
+// reference encoder of libtiff. A pixel is black when its grey value is below
+// 128. The stream ends with EOFB and is suitable for a PDF image with
+// /CCITTFaxDecode and /K -1.
+
+typedef struct {
+    uint16_t code;
+    uint8_t len;
+} Code;
+
+static const Code WHITE_TERM[64] = {
+    {0x0035, 8}, {0x0007, 6}, {0x0007, 4}, {0x0008, 4}, {0x000b, 4}, {0x000c, 4},
+    {0x000e, 4}, {0x000f, 4}, {0x0013, 5}, {0x0014, 5}, {0x0007, 5}, {0x0008, 5},
+    {0x0008, 6}, {0x0003, 6}, {0x0034, 6}, {0x0035, 6}, {0x002a, 6}, {0x002b, 6},
+    {0x0027, 7}, {0x000c, 7}, {0x0008, 7}, {0x0017, 7}, {0x0003, 7}, {0x0004, 7},
+    {0x0028, 7}, {0x002b, 7}, {0x0013, 7}, {0x0024, 7}, {0x0018, 7}, {0x0002, 8},
+    {0x0003, 8}, {0x001a, 8}, {0x001b, 8}, {0x0012, 8}, {0x0013, 8}, {0x0014, 8},
+    {0x0015, 8}, {0x0016, 8}, {0x0017, 8}, {0x0028, 8}, {0x0029, 8}, {0x002a, 8},
+    {0x002b, 8}, {0x002c, 8}, {0x002d, 8}, {0x0004, 8}, {0x0005, 8}, {0x000a, 8},
+    {0x000b, 8}, {0x0052, 8}, {0x0053, 8}, {0x0054, 8}, {0x0055, 8}, {0x0024, 8},
+    {0x0025, 8}, {0x0058, 8}, {0x0059, 8}, {0x005a, 8}, {0x005b, 8}, {0x004a, 8},
+    {0x004b, 8}, {0x0032, 8}, {0x0033, 8}, {0x0034, 8},
+};
+
+static const Code WHITE_MAKEUP[27] = {
+    {0x001b, 5}, {0x0012, 5}, {0x0017, 6}, {0x0037, 7}, {0x0036, 8}, {0x0037, 8},
+    {0x0064, 8}, {0x0065, 8}, {0x0068, 8}, {0x0067, 8}, {0x00cc, 9}, {0x00cd, 9},
+    {0x00d2, 9}, {0x00d3, 9}, {0x00d4, 9}, {0x00d5, 9}, {0x00d6, 9}, {0x00d7, 9},
+    {0x00d8, 9}, {0x00d9, 9}, {0x00da, 9}, {0x00db, 9}, {0x0098, 9}, {0x0099, 9},
+    {0x009a, 9}, {0x0018, 6}, {0x009b, 9},
+};
+
+static const Code BLACK_TERM[64] = {
+    {0x0037, 10}, {0x0002, 3}, {0x0003, 2}, {0x0002, 2}, {0x0003, 3}, {0x0003, 4},
+    {0x0002, 4}, {0x0003, 5}, {0x0005, 6}, {0x0004, 6}, {0x0004, 7}, {0x0005, 7},
+    {0x0007, 7}, {0x0004, 8}, {0x0007, 8}, {0x0018, 9}, {0x0017, 10}, {0x0018, 10},
+    {0x0008, 10}, {0x0067, 11}, {0x0068, 11}, {0x006c, 11}, {0x0037, 11}, {0x0028, 11},
+    {0x0017, 11}, {0x0018, 11}, {0x00ca, 12}, {0x00cb, 12}, {0x00cc, 12}, {0x00cd, 12},
+    {0x0068, 12}, {0x0069, 12}, {0x006a, 12}, {0x006b, 12}, {0x00d2, 12}, {0x00d3, 12},
+    {0x00d4, 12}, {0x00d5, 12}, {0x00d6, 12}, {0x00d7, 12}, {0x006c, 12}, {0x006d, 12},
+    {0x00da, 12}, {0x00db, 12}, {0x0054, 12}, {0x0055, 12}, {0x0056, 12}, {0x0057, 12},
+    {0x0064, 12}, {0x0065, 12}, {0x0052, 12}, {0x0053, 12}, {0x0024, 12}, {0x0037, 12},
+    {0x0038, 12}, {0x0027, 12}, {0x0028, 12}, {0x0058, 12}, {0x0059, 12}, {0x002b, 12},
+    {0x002c, 12}, {0x005a, 12}, {0x0066, 12}, {0x0067, 12},
+};
+
+static const Code BLACK_MAKEUP[27] = {
+    {0x000f, 10}, {0x00c8, 12}, {0x00c9, 12}, {0x005b, 12}, {0x0033, 12}, {0x0034, 12},
+    {0x0035, 12}, {0x006c, 13}, {0x006d, 13}, {0x004a, 13}, {0x004b, 13}, {0x004c, 13},
+    {0x004d, 13}, {0x0072, 13}, {0x0073, 13}, {0x0074, 13}, {0x0075, 13}, {0x0076, 13},
+    {0x0077, 13}, {0x0052, 13}, {0x0053, 13}, {0x0054, 13}, {0x0055, 13}, {0x005a, 13},
+    {0x005b, 13}, {0x0064, 13}, {0x0065, 13},
+};
+
+static const Code EXT_MAKEUP[13] = {
+    {0x0008, 11}, {0x000c, 11}, {0x000d, 11}, {0x0012, 12}, {0x0013, 12}, {0x0014, 12},
+    {0x0015, 12}, {0x0016, 12}, {0x0017, 12}, {0x001c, 12}, {0x001d, 12}, {0x001e, 12},
+    {0x001f, 12},
+};
+
+static const Code PASS = {0x1, 4};        // 0001
+static const Code HORIZONTAL = {0x1, 3};  // 001
+// Tryby pionowe dla b1 - a1 = -3..3 (VR3 ... VL3)
+static const Code VERTICAL[7] = {
+    {0x03, 7}, {0x03, 6}, {0x03, 3}, {0x1, 1}, {0x2, 3}, {0x02, 6}, {0x02, 7},
+};
+static const Code EOL = {0x001, 12};
+
+typedef struct {
+    uint8_t *out;
+    size_t cap;
+    size_t n;
+    uint32_t acc;
+    int bits;
+} Bits;
+
+static void put(Bits *b, Code c) {
+    b->acc = (b->acc << c.len) | c.code;
+    b->bits += c.len;
+    while (b->bits >= 8) {
+        b->bits -= 8;
+        if (b->n < b->cap)
+            b->out[b->n] = (uint8_t)(b->acc >> b->bits);
+        b->n++;
+    }
+}
+
+static void put_span(Bits *b, int span, const Code *term, const Code *makeup) {
+    while (span >= 2624) {
+        put(b, EXT_MAKEUP[12]);  // 2560
+        span -= 2560;
+    }
+    if (span >= 64) {
+        int m = span / 64;
+        put(b, m <= 27 ? makeup[m - 1] : EXT_MAKEUP[m - 28]);
+        span -= m * 64;
+    }
+    put(b, term[span]);
+}
+
+// First position >= bs whose pixel is not `color`, or be.
+static inline int find_diff(const uint8_t *line, int bs, int be, int color) {
+    while (bs < be && line[bs] == color)
+        ++bs;
+    return bs;
+}
+
+static inline int find_diff2(const uint8_t *line, int bs, int be, int color) {
+    return bs < be ? find_diff(line, bs, be, color) : be;
+}
+
+static void encode_row(Bits *b, const uint8_t *cur, const uint8_t *ref, int width) {
+    int a0 = 0;
+    int a1 = cur[0] ? 0 : find_diff(cur, 0, width, 0);
+    int b1 = ref[0] ? 0 : find_diff(ref, 0, width, 0);
+    for (;;) {
+        int b2 = find_diff2(ref, b1, width, b1 < width ? ref[b1] : 0);
+        if (b2 >= a1) {
+            int d = b1 - a1;
+            if (d < -3 || d > 3) {
+                int a2 = find_diff2(cur, a1, width, a1 < width ? cur[a1] : 0);
+                put(b, HORIZONTAL);
+                if (a0 + a1 == 0 || cur[a0] == 0) {
+                    put_span(b, a1 - a0, WHITE_TERM, WHITE_MAKEUP);
+                    put_span(b, a2 - a1, BLACK_TERM, BLACK_MAKEUP);
+                } else {
+                    put_span(b, a1 - a0, BLACK_TERM, BLACK_MAKEUP);
+                    put_span(b, a2 - a1, WHITE_TERM, WHITE_MAKEUP);
+                }
+                a0 = a2;
+            } else {
+                put(b, VERTICAL[d + 3]);
+                a0 = a1;
+            }
+        } else {
+            put(b, PASS);
+            a0 = b2;
+        }
+        if (a0 >= width)
+            break;
+        int color = cur[a0];
+        a1 = find_diff(cur, a0, width, color);
+        b1 = find_diff(ref, a0, width, !color);
+        b1 = find_diff(ref, b1, width, color);
+    }
+}
+
+// Encode a grayscale page whose rows start stride bytes apart. Writes at most
+// cap bytes to out and returns the full length of the stream (call again
+// with a larger buffer when it exceeds cap), or -1 on allocation failure.
+long g4_encode(const uint8_t *gray, int width, int height, int stride, uint8_t *out, long cap) {
+    uint8_t *lines = (uint8_t *)calloc(2 * (size_t)width, 1);
+    if (!lines)
+        return -1;
+    uint8_t *ref = lines, *cur = lines + width;
+    Bits b = {out, cap > 0 ? (size_t)cap : 0, 0, 0, 0};
+    for (int y = 0; y < height; ++y) {
+        const uint8_t *row = gray + (size_t)y * stride;
+        for (int x = 0; x < width; ++x)
+            cur[x] = row[x] < 128;
+        encode_row(&b, cur, ref, width);
+        uint8_t *t = ref;
+        ref = cur;
+        cur = t;
+    }
+    // EOFB i dopełnienie do pełnego bajtu
+    put(&b, EOL);
+    put(&b, EOL);
+    if (b.bits > 0)
+        put(&b, (Code){0, (uint8_t)(8 - b.bits)});
+    free(lines);
+    return (long)b.n;
+}
+
+// Count pixels on every fourth row and column of an RGB page whose largest
+// and smallest channel differ by at least min_chroma.
+long colour_pixels(const uint8_t *rgb, int width, int height, int stride, int min_chroma) {
+    long count = 0;
+    for (int y = 0; y < height; y += 4) {
+        const uint8_t *row = rgb + (size_t)y * stride;
+        for (int x = 0; x < width; x += 4) {
+            int r = row[3 * x], g = row[3 * x + 1], bl = row[3 * x + 2];
+            int hi = r > g ? r : g, lo = r < g ? r : g;
+            if (bl > hi)
+                hi = bl;
+            if (bl < lo)
+                lo = bl;
+            count += hi - lo >= min_chroma;
+        }
+    }
+    return count;
+}
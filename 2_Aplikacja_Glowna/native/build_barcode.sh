@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the Code 128 / Code 39 scanline decoder used for barcode routing.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/barcode.c" -o "$DIR/barcode.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/barcode.c" -o "$DIR/libbarcode.so"
+fi
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the CCITT G4 encoder used to recompress archived scans.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/bilevel.c" -o "$DIR/bilevel.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/bilevel.c" -o "$DIR/libbilevel.so"
+fi
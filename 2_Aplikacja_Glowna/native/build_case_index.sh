@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the case signature trie with bit-parallel fuzzy lookup.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/case_index.c" -o "$DIR/case_index.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/case_index.c" -o "$DIR/libcase_index.so"
+fi
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the native file placement library.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O2 -shared "$DIR/file_place.c" -o "$DIR/file_place.dll"
+else
+    gcc -O2 -fPIC -shared "$DIR/file_place.c" -o "$DIR/libfile_place.so"
+fi
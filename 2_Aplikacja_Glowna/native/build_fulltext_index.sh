@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the posting-list kernels of the full-text index.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/fulltext_index.c" -o "$DIR/fulltext_index.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/fulltext_index.c" -o "$DIR/libfulltext_index.so"
+fi
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Compile the native GGUF inference backend against llama.cpp.
+# LLAMA_CPP_DIR must point to a llama.cpp checkout built with CMake
+# (cmake -B build -DBUILD_SHARED_LIBS=ON && cmake --build build).
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ -z "$LLAMA_CPP_DIR" ]; then
+  echo "Ustaw zmienną LLAMA_CPP_DIR na katalog z llama.cpp" >&2
+  exit 1
+fi
+
+INCLUDES="-I$LLAMA_CPP_DIR/include -I$LLAMA_CPP_DIR/ggml/include"
+LIBDIR="$LLAMA_CPP_DIR/build/bin"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig c++ -O3 -std=c++17 -shared "$DIR/llm_backend.cpp" $INCLUDES -L"$LIBDIR" -lllama -o "$DIR/llm_backend.dll"
+else
+    g++ -O3 -std=c++17 -fPIC -shared "$DIR/llm_backend.cpp" $INCLUDES -L"$LIBDIR" -lllama -Wl,-rpath,'$ORIGIN' -o "$DIR/libllm_backend.so"
+fi
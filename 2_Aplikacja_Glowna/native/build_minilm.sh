@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the native int8 sentence-embedding encoder.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/minilm.c" -o "$DIR/minilm.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/minilm.c" -o "$DIR/libminilm.so" -fopenmp -lm
+fi
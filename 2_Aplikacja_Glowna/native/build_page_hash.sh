@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile perceptual page hashing used by the page-level OCR cache.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/page_hash.c" -o "$DIR/page_hash.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/page_hash.c" -o "$DIR/libpage_hash.so" -lm
+fi
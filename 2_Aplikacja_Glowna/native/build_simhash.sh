@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile SimHash fingerprinting and the multi-index Hamming table.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/simhash.c" -o "$DIR/simhash.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/simhash.c" -o "$DIR/libsimhash.so"
+fi
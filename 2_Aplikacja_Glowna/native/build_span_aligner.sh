@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compile the multi-pattern entity span aligner.
+set -e
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+if [ "$OS" = "Windows_NT" ]; then
+    zig cc -O3 -mcpu=native -shared "$DIR/span_aligner.c" -o "$DIR/span_aligner.dll"
+else
+    gcc -O3 -march=native -fPIC -shared "$DIR/span_aligner.c" -o "$DIR/libspan_aligner.so"
+fi
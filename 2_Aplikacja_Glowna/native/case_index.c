@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Index of known case signatures for snapping OCR'd signatures to the nearest
+// known case (case_index.py).
+//
+// Keys are signatures already folded by Python (upper case, no spaces, OCR
+// look-alikes such as O/0 and I/1 merged). They are stored in a compressed
+// trie whose edges carry whole substrings. A query walks the trie with the
+// bit-parallel Levenshtein algorithm of Myers/Hyyrö: one machine word holds a
+// column of the edit-distance matrix for queries of up to 64 characters, each
+// trie character updates it in a handful of instructions and a subtree is
+// abandoned as soon as every cell of the column exceeds the distance limit.
+
+typedef struct {
+    int32_t first_child;
+    int32_t next_sibling;
+    int32_t label;      // offset of the edge label in chars
+    int32_t label_len;
+    int32_t key;        // id of the key ending here, -1 for none
+} Node;
+
+typedef struct {
+    Node *nodes;
+    int32_t n_nodes;
+    int32_t cap_nodes;
+    char *chars;        // all keys concatenated
+} CaseIndex;
+
+typedef struct {
+    uint64_t peq[256];
+    uint64_t last;
+    int m;
+    int max_distance;
+    int *out_ids;
+    int *out_dists;
+    int cap;
+    int found;
+} Query;
+
+static int32_t new_node(CaseIndex *idx, int32_t label, int32_t label_len) {
+    if (idx->n_nodes == idx->cap_nodes) {
+        int32_t cap = idx->cap_nodes ? idx->cap_nodes * 2 : 1024;
+        Node *nodes = (Node *)realloc(idx->nodes, (size_t)cap * sizeof(Node));
+        if (!nodes)
+            return -1;
+        idx->nodes = nodes;
+        idx->cap_nodes = cap;
+    }
+    Node *n = &idx->nodes[idx->n_nodes];
+    n->first_child = n->next_sibling = -1;
+    n->label = label;
+    n->label_len = label_len;
+    n->key = -1;
+    return idx->n_nodes++;
+}
+
+// Build the subtree of keys [lo, hi), all sharing their first depth chars,
+// under parent. Keys are sorted, so the common prefix of the range is the
+// common prefix of its first and last key.
+static int build(CaseIndex *idx, const int *offsets, int lo, int hi, int depth, int32_t parent) {
+    int32_t prev = -1;
+    int i = lo;
+    while (i < hi) {
+        int start = offsets[i], len = offsets[i + 1] - start;
+        if (len == depth) {
+            idx->nodes[parent].key = i;
+            ++i;
+            continue;
+        }
+        char c = idx->chars[start + depth];
+        int j = i + 1;
+        while (j < hi && offsets[j + 1] - offsets[j] > depth && idx->chars[offsets[j] + depth] == c)
+            ++j;
+        // Wspólny prefiks grupy [i, j) wyznacza etykietę krawędzi
+        int end = len;
+        int last = offsets[j - 1], last_len = offsets[j] - last;
+        if (last_len < end)
+            end = last_len;
+        int lcp = depth + 1;
+        while (lcp < end && idx->chars[start + lcp] == idx->chars[last + lcp])
+            ++lcp;
+        int32_t child = new_node(idx, start + depth, lcp - depth);
+        if (child < 0)
+            return -1;
+        if (prev < 0)
+            idx->nodes[parent].first_child = child;
+        else
+            idx->nodes[prev].next_sibling = child;
+        prev = child;
+        if (build(idx, offsets, i, j, lcp, child) < 0)
+            return -1;
+        i = j;
+    }
+    return 0;
+}
+
+void caseidx_free(CaseIndex *idx) {
+    if (!idx)
+        return;
+    free(idx->nodes);
+    free(idx->chars);
+    free(idx);
+}
+
+// Build an index of n keys stored back to back in chars; key i occupies
+// [offsets[i], offsets[i + 1]). Keys must be sorted bytewise and unique.
+CaseIndex *caseidx_build(const char *chars, const int *offsets, int n) {
+    CaseIndex *idx = (CaseIndex *)calloc(1, sizeof(CaseIndex));
+    if (!idx)
+        return NULL;
+    size_t total = n > 0 ? (size_t)offsets[n] : 0;
+    idx->chars = (char *)malloc(total + 1);
+    if (!idx->chars || new_node(idx, 0, 0) < 0) {
+        caseidx_free(idx);
+        return NULL;
+    }
+    memcpy(idx->chars, chars, total);
+    if (n > 0 && build(idx, offsets, 0, n, 0, 0) < 0) {
+        caseidx_free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+int caseidx_nodes(const CaseIndex *idx) { return idx->n_nodes; }
+
+// Column state of the edit-distance matrix between the query and the trie
+// path so far: bit i of vp/vn is set when D[i+1][j] - D[i][j] is +1/-1.
+typedef struct {
+    uint64_t vp, vn;
+    int score;  // D[m][j]
+    int j;      // characters consumed
+} Column;
+
+static inline void step(const Query *q, Column *col, unsigned char c) {
+    uint64_t eq = q->peq[c];
+    uint64_t xv = eq | col->vn;
+    uint64_t xh = (((eq & col->vp) + col->vp) ^ col->vp) | eq;
+    uint64_t hp = col->vn | ~(xh | col->vp);
+    uint64_t hn = col->vp & xh;
+    if (hp & q->last)
+        ++col->score;
+    else if (hn & q->last)
+        --col->score;
+    // Górny wiersz D[0][j] = j rośnie o jeden z każdym znakiem
+    hp = (hp << 1) | 1;
+    hn <<= 1;
+    col->vp = hn | ~(xv | hp);
+    col->vn = hp & xv;
+    col->j++;
+}
+
+// Smallest value in the column, a lower bound for every key below the node.
+static int column_min(const Query *q, const Column *col) {
+    int cur = col->j, best = cur;
+    for (int i = 0; i < q->m; ++i) {
+        cur += (int)((col->vp >> i) & 1) - (int)((col->vn >> i) & 1);
+        if (cur < best)
+            best = cur;
+    }
+    return best;
+}
+
+static void walk(const CaseIndex *idx, Query *q, int32_t node, Column col) {
+    const Node *n = &idx->nodes[node];
+    for (int k = 0; k < n->label_len; ++k) {
+        step(q, &col, (unsigned char)idx->chars[n->label + k]);
+        if (column_min(q, &col) > q->max_distance)
+            return;
+    }
+    if (n->key >= 0 && col.score <= q->max_distance) {
+        if (q->found < q->cap) {
+            q->out_ids[q->found] = n->key;
+            q->out_dists[q->found] = col.score;
+        }
+        q->found++;
+    }
+    for (int32_t c = n->first_child; c >= 0; c = idx->nodes[c].next_sibling)
+        walk(idx, q, c, col);
+}
+
+// Find keys within max_distance edits of query (1 to 64 chars). Writes up to
+// cap (id, distance) pairs and returns the total found, or -1 for a query of
+// unsupported length.
+int caseidx_search(const CaseIndex *idx, const char *query, int len, int max_distance,
+                   int *out_ids, int *out_dists, int cap) {
+    if (len < 1 || len > 64)
+        return -1;
+    Query q;
+    memset(q.peq, 0, sizeof(q.peq));
+    for (int i = 0; i < len; ++i)
+        q.peq[(unsigned char)query[i]] |= (uint64_t)1 << i;
+    q.m = len;
+    q.last = (uint64_t)1 << (len - 1);
+    q.max_distance = max_distance;
+    q.out_ids = out_ids;
+    q.out_dists = out_dists;
+    q.cap = cap;
+    q.found = 0;
+    Column col;
+    col.vp = len == 64 ? ~(uint64_t)0 : (((uint64_t)1 << len) - 1);
+    col.vn = 0;
+    col.score = len;
+    col.j = 0;
+    walk(idx, &q, 0, col);
+    return q.found;
+}
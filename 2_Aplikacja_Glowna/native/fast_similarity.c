@@ -1,5 +1,6 @@
 ﻿#include <math.h>
 #include <stddef.h>
+#include <stdlib.h>
 #ifdef USE_BLAS
 #include <cblas.h>
 #endif
@@ -44,3 +45,50 @@ float cosine_similarityf(const float * restrict a, const float * restrict b, int
     }
     return dot / (sqrtf(na) * sqrtf(nb));
 }
+
+// Cosine similarity of ``query`` against each row of the row-major
+// ``matrix`` [rows x n]; results go to ``out`` [rows].
+void cosine_batchf(const float * restrict query, const float * restrict matrix,
+                   int rows, int n, float * restrict out) {
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows; ++r) {
+        out[r] = cosine_similarityf(query, matrix + (size_t)r * n, n);
+    }
+}
+
+// Select the ``k`` rows of ``matrix`` most similar to ``query``.
+// Writes row indices and scores in descending order of similarity and
+// returns the number of results (min(k, rows)), or -1 on allocation failure.
+int cosine_top_kf(const float * restrict query, const float * restrict matrix,
+                  int rows, int n, int k, int * restrict indices,
+                  float * restrict scores) {
+    if (k > rows) {
+        k = rows;
+    }
+    if (k <= 0) {
+        return 0;
+    }
+    float *all = (float *)malloc(sizeof(float) * (size_t)rows);
+    if (!all) {
+        return -1;
+    }
+    cosine_batchf(query, matrix, rows, n, all);
+    // Insertion into a small sorted buffer; k is tiny compared to rows.
+    int count = 0;
+    for (int r = 0; r < rows; ++r) {
+        float s = all[r];
+        if (count == k && s <= scores[k - 1]) {
+            continue;
+        }
+        int pos = count < k ? count++ : k - 1;
+        while (pos > 0 && scores[pos - 1] < s) {
+            scores[pos] = scores[pos - 1];
+            indices[pos] = indices[pos - 1];
+            --pos;
+        }
+        scores[pos] = s;
+        indices[pos] = r;
+    }
+    free(all);
+    return count;
+}
@@ -0,0 +1,265 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Place one archived document at its destination with the cheapest method
+// the filesystem offers: a hard link (only when allowed by the caller), a
+// reflink clone, an in-kernel copy_file_range, or a plain copy with a large
+// buffer. Permissions and timestamps are preserved like shutil.copy2.
+//
+// The file is written under a temporary name in the destination directory
+// and renamed over ``dst`` only when complete, so a failed copy never
+// destroys an existing destination. When ``dst`` already is ``src`` (the
+// output folder is the input folder) nothing is touched.
+//
+// Many files are placed concurrently from the thread pool in
+// file_placement.py; ctypes releases the GIL for the whole call.
+
+#define PLACE_REFLINK 1
+#define PLACE_COPY_RANGE 2
+#define PLACE_HARDLINK 3
+#define PLACE_COPY 4
+#define PLACE_SAME 5
+
+#define PLACE_ALLOW_HARDLINK 1
+
+#define COPY_BUFFER (1 << 20)
+
+// Próby znalezienia wolnej nazwy pliku tymczasowego
+#define TEMP_ATTEMPTS 1000
+
+#ifdef _WIN32
+#include <windows.h>
+
+static wchar_t *widen(const char *s) {
+    int n = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
+    if (n <= 0)
+        return NULL;
+    wchar_t *w = (wchar_t *)malloc((size_t)n * sizeof(wchar_t));
+    if (w)
+        MultiByteToWideChar(CP_UTF8, 0, s, -1, w, n);
+    return w;
+}
+
+static int same_file(const wchar_t *a, const wchar_t *b) {
+    HANDLE ha = CreateFileW(a, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (ha == INVALID_HANDLE_VALUE)
+        return 0;
+    HANDLE hb = CreateFileW(b, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    int same = 0;
+    if (hb != INVALID_HANDLE_VALUE) {
+        BY_HANDLE_FILE_INFORMATION ia, ib;
+        if (GetFileInformationByHandle(ha, &ia) && GetFileInformationByHandle(hb, &ib))
+            same = ia.dwVolumeSerialNumber == ib.dwVolumeSerialNumber &&
+                   ia.nFileIndexHigh == ib.nFileIndexHigh &&
+                   ia.nFileIndexLow == ib.nFileIndexLow;
+        CloseHandle(hb);
+    }
+    CloseHandle(ha);
+    return same;
+}
+
+// Returns the PLACE_* method used or -GetLastError() on failure.
+__declspec(dllexport) int place_file(const char *src, const char *dst, int flags) {
+    wchar_t *wsrc = widen(src), *wdst = widen(dst), *wtmp = NULL;
+    int result;
+    if (!wsrc || !wdst) {
+        result = -(int)ERROR_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+    if (same_file(wsrc, wdst)) {
+        result = PLACE_SAME;
+        goto done;
+    }
+    size_t len = wcslen(wdst);
+    wtmp = (wchar_t *)malloc((len + 32) * sizeof(wchar_t));
+    if (!wtmp) {
+        result = -(int)ERROR_NOT_ENOUGH_MEMORY;
+        goto done;
+    }
+    for (unsigned n = 0; n < TEMP_ATTEMPTS; ++n) {
+        _snwprintf(wtmp, len + 32, L"%ls.%lu.%u.tmp", wdst, GetCurrentThreadId(), n);
+        wtmp[len + 31] = L'\0';
+        result = 0;
+        if (flags & PLACE_ALLOW_HARDLINK) {
+            if (CreateHardLinkW(wtmp, wsrc, NULL))
+                result = PLACE_HARDLINK;
+            else if (GetLastError() == ERROR_ALREADY_EXISTS)
+                continue;
+        }
+        // CopyFileW korzysta z klonowania bloków na ReFS i kopiowania po
+        // stronie serwera na udziałach SMB
+        if (!result && CopyFileW(wsrc, wtmp, TRUE))
+            result = PLACE_COPY;
+        if (!result) {
+            DWORD err = GetLastError();
+            if (err == ERROR_FILE_EXISTS || err == ERROR_ALREADY_EXISTS)
+                continue;
+            result = -(int)err;
+            goto done;
+        }
+        if (!MoveFileExW(wtmp, wdst, MOVEFILE_REPLACE_EXISTING)) {
+            result = -(int)GetLastError();
+            DeleteFileW(wtmp);
+        }
+        goto done;
+    }
+    result = -(int)ERROR_FILE_EXISTS;
+done:
+    free(wsrc);
+    free(wdst);
+    free(wtmp);
+    return result;
+}
+
+#else
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
+static int copy_buffered(int in, int out) {
+    char *buf = (char *)malloc(COPY_BUFFER);
+    if (!buf)
+        return -ENOMEM;
+    int result = 0;
+    for (;;) {
+        ssize_t n = read(in, buf, COPY_BUFFER);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            result = -errno;
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                result = -errno;
+                goto done;
+            }
+            off += w;
+        }
+    }
+done:
+    free(buf);
+    return result;
+}
+
+// Copies the open ``in`` into the empty ``out`` and closes ``out``.
+// Returns the PLACE_* method used or -errno on failure.
+static int copy_contents(int in, int out, const struct stat *st) {
+    int method = 0;
+#ifdef __linux__
+    if (ioctl(out, FICLONE, in) == 0)
+        method = PLACE_REFLINK;
+    if (!method) {
+        off_t left = st->st_size;
+        int failed = 0;
+        while (left > 0) {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t)left, 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                failed = 1;
+                break;
+            }
+            left -= n;
+        }
+        if (!failed) {
+            method = PLACE_COPY_RANGE;
+        } else if (left != st->st_size) {
+            // Częściowa kopia: dokończenie od początku zwykłym kopiowaniem
+            if (lseek(in, 0, SEEK_SET) < 0 || lseek(out, 0, SEEK_SET) < 0 ||
+                ftruncate(out, 0) != 0)
+                method = -errno;
+        }
+    }
+#endif
+    if (!method) {
+        int err = copy_buffered(in, out);
+        method = err < 0 ? err : PLACE_COPY;
+    }
+
+    if (method > 0) {
+        struct timespec times[2] = {st->st_atim, st->st_mtim};
+        fchmod(out, st->st_mode & 07777);
+        futimens(out, times);
+    }
+    if (close(out) != 0 && method > 0)
+        method = -errno;
+    return method;
+}
+
+// Returns the PLACE_* method used or -errno on failure.
+int place_file(const char *src, const char *dst, int flags) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return -errno;
+    struct stat st, dst_st;
+    if (fstat(in, &st) != 0) {
+        int err = -errno;
+        close(in);
+        return err;
+    }
+    // Folder wyjściowy równy wejściowemu: plik już jest na miejscu
+    if (stat(dst, &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        close(in);
+        return PLACE_SAME;
+    }
+
+    size_t size = strlen(dst) + 48;
+    char *tmp = (char *)malloc(size);
+    if (!tmp) {
+        close(in);
+        return -ENOMEM;
+    }
+    int method = -EEXIST, out = -1, created = 0;
+    for (unsigned n = 0; n < TEMP_ATTEMPTS; ++n) {
+        snprintf(tmp, size, "%s.%ld.%u.tmp", dst, (long)getpid(), n);
+        if (flags & PLACE_ALLOW_HARDLINK) {
+            if (link(src, tmp) == 0) {
+                method = PLACE_HARDLINK;
+                created = 1;
+                break;
+            }
+            if (errno == EEXIST)
+                continue;
+        }
+        out = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (out >= 0) {
+            created = 1;
+            method = copy_contents(in, out, &st);
+            break;
+        }
+        if (errno != EEXIST) {
+            method = -errno;
+            break;
+        }
+    }
+    close(in);
+
+    // Podmiana dopiero gotowego pliku: nieudana kopia nie niszczy dst
+    if (method > 0 && rename(tmp, dst) != 0)
+        method = -errno;
+    if (method < 0 && created)
+        unlink(tmp);
+    free(tmp);
+    return method;
+}
+#endif
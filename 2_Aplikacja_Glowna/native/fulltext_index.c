@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Posting-list kernels for the archive full-text index (fulltext_index.py).
+//
+// Postings are stored as LEB128 varints: a block of doc id deltas followed
+// by a block of term frequencies, and separately the in-document position
+// deltas. Segments are memory-mapped by Python and these functions read the
+// mapped bytes in place; ctypes releases the GIL for every call, so several
+// segments can be searched or merged concurrently.
+
+static inline int read_varint(const uint8_t *buf, int len, int *pos, uint32_t *value) {
+    uint32_t v = 0;
+    int shift = 0;
+    while (*pos < len && shift < 35) {
+        uint8_t byte = buf[(*pos)++];
+        v |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = v;
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+// Encode count values as varints; with delta set, values must be
+// non-decreasing and their differences are stored. out needs room for
+// 5 * count bytes. Returns the number of bytes written.
+int fts_encode(const uint32_t *values, int count, int delta, uint8_t *out) {
+    int pos = 0;
+    uint32_t prev = 0;
+    for (int i = 0; i < count; ++i) {
+        uint32_t v = delta ? values[i] - prev : values[i];
+        prev = values[i];
+        while (v >= 0x80) {
+            out[pos++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        out[pos++] = (uint8_t)v;
+    }
+    return pos;
+}
+
+// Decode count varints from buf into out, summing them when delta is set.
+// Returns the number of bytes consumed or -1 for truncated input.
+int fts_decode(const uint8_t *buf, int len, int count, int delta, uint32_t *out) {
+    int pos = 0;
+    uint32_t acc = 0;
+    for (int i = 0; i < count; ++i) {
+        uint32_t v;
+        if (read_varint(buf, len, &pos, &v) < 0)
+            return -1;
+        acc = delta ? acc + v : v;
+        out[i] = acc;
+    }
+    return pos;
+}
+
+typedef struct {
+    float score;
+    uint32_t doc;
+} Hit;
+
+// Min-heap on score (ties: higher doc id is "smaller" so lower ids win)
+static inline int hit_less(Hit a, Hit b) {
+    return a.score < b.score || (a.score == b.score && a.doc > b.doc);
+}
+
+static void sift_down(Hit *heap, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && hit_less(heap[l], heap[m]))
+            m = l;
+        if (r < n && hit_less(heap[r], heap[m]))
+            m = r;
+        if (m == i)
+            return;
+        Hit tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+// Rank the documents of one segment with BM25.
+//   postings/lengths/dfs: posting block of every query term (doc id deltas,
+//                         then term frequencies), its size and document count
+//   weights:              idf of every term (computed from global statistics)
+//   doc_lens:             token count of every document of the segment
+//   mask:                 optional, only documents with mask[d] != 0 count
+// Writes at most k best documents, best first, to out_docs/out_scores and
+// returns how many were written, or -1 on allocation failure or corrupt
+// postings.
+int fts_bm25(const uint8_t *const *postings, const int *lengths, const int *dfs,
+             const float *weights, int n_terms, const uint32_t *doc_lens, int n_docs,
+             const uint8_t *mask, float avg_len, float k1, float b, int k, uint32_t *out_docs,
+             float *out_scores) {
+    if (k <= 0 || n_docs <= 0)
+        return 0;
+    float *scores = (float *)calloc((size_t)n_docs, sizeof(float));
+    if (!scores)
+        return -1;
+    // Normalizacja długości liczona raz na dokument, nie na wystąpienie
+    float *norm = (float *)malloc((size_t)n_docs * sizeof(float));
+    if (!norm) {
+        free(scores);
+        return -1;
+    }
+    float inv_avg = avg_len > 0 ? 1.0f / avg_len : 0.0f;
+    for (int d = 0; d < n_docs; ++d)
+        norm[d] = k1 * (1.0f - b + b * (float)doc_lens[d] * inv_avg);
+
+    int result = -1;
+    for (int t = 0; t < n_terms; ++t) {
+        const uint8_t *buf = postings[t];
+        int len = lengths[t], df = dfs[t];
+        int doc_pos = 0, tf_pos = 0;
+        // Pozycja bloku częstości: za wszystkimi przyrostami identyfikatorów
+        for (int i = 0; i < df; ++i) {
+            uint32_t skip;
+            if (read_varint(buf, len, &tf_pos, &skip) < 0)
+                goto done;
+        }
+        uint32_t doc = 0;
+        float w = weights[t];
+        for (int i = 0; i < df; ++i) {
+            uint32_t delta, tf;
+            if (read_varint(buf, len, &doc_pos, &delta) < 0 ||
+                read_varint(buf, len, &tf_pos, &tf) < 0)
+                goto done;
+            doc += delta;
+            if (doc >= (uint32_t)n_docs)
+                goto done;
+            if (mask && !mask[doc])
+                continue;
+            float f = (float)tf;
+            scores[doc] += w * f * (k1 + 1.0f) / (f + norm[doc]);
+        }
+    }
+
+    Hit *heap = (Hit *)malloc((size_t)k * sizeof(Hit));
+    if (!heap)
+        goto done;
+    int n = 0;
+    for (int d = 0; d < n_docs; ++d) {
+        if (scores[d] <= 0.0f)
+            continue;
+        Hit h = {scores[d], (uint32_t)d};
+        if (n < k) {
+            heap[n++] = h;
+            if (n == k)
+                for (int i = k / 2 - 1; i >= 0; --i)
+                    sift_down(heap, n, i);
+        } else if (hit_less(heap[0], h)) {
+            heap[0] = h;
+            sift_down(heap, n, 0);
+        }
+    }
+    if (n < k)
+        for (int i = n / 2 - 1; i >= 0; --i)
+            sift_down(heap, n, i);
+    // Zdejmowanie z kopca daje wyniki od najgorszego
+    for (int i = n - 1; i >= 0; --i) {
+        out_docs[i] = heap[0].doc;
+        out_scores[i] = heap[0].score;
+        heap[0] = heap[i];
+        sift_down(heap, i, 0);
+    }
+    free(heap);
+    result = n;
+
+done:
+    free(norm);
+    free(scores);
+    return result;
+}
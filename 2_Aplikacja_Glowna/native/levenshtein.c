@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -38,3 +39,275 @@ int levenshtein_distance(const char *a, const char *b) {
     free(curr);
     return result;
 }
+
+// Levenshtein distance over UTF-32 code points, so multi-byte characters
+// count as one edit. Returns -1 on allocation failure.
+long levenshtein_distance_utf32(const uint32_t *a, size_t la, const uint32_t *b, size_t lb) {
+    long *prev = (long *)malloc((lb + 1) * sizeof(long));
+    long *curr = (long *)malloc((lb + 1) * sizeof(long));
+    if (!prev || !curr) {
+        free(prev);
+        free(curr);
+        return -1;
+    }
+    for (size_t j = 0; j <= lb; ++j)
+        prev[j] = (long)j;
+    for (size_t i = 1; i <= la; ++i) {
+        curr[0] = (long)i;
+        for (size_t j = 1; j <= lb; ++j) {
+            long best = prev[j - 1] + (a[i - 1] != b[j - 1]);
+            if (prev[j] + 1 < best)
+                best = prev[j] + 1;
+            if (curr[j - 1] + 1 < best)
+                best = curr[j - 1] + 1;
+            curr[j] = best;
+        }
+        long *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+    long result = prev[lb];
+    free(prev);
+    free(curr);
+    return result;
+}
+
+// Jaro-Winkler similarity and normalized Levenshtein (InDel) ratio over UTF-32
+// code points, so results match Python str comparisons character for
+// character. Both use bit-parallel pattern masks: one 64-bit word when the
+// first string has at most 64 characters, blocks of words for longer ones.
+// similarity_batch() builds the masks of the query once and scores it
+// against many strings in parallel. See string_similarity.py for the wrapper.
+
+#define METRIC_JARO_WINKLER 0
+#define METRIC_LEVENSHTEIN_RATIO 1
+
+typedef struct {
+    size_t words;     // 64-bitowych słów na maskę
+    uint64_t *latin;  // maski znaków < 256, po words słów
+    uint32_t *keys;   // tablica haszująca pozostałych znaków (znak + 1, 0 = wolne)
+    uint64_t *masks;  // maski znaków z keys
+    size_t capacity;
+} PatternMasks;
+
+static void pm_free(PatternMasks *pm) {
+    free(pm->latin);
+    free(pm->keys);
+    free(pm->masks);
+}
+
+static uint64_t *pm_find(const PatternMasks *pm, uint32_t c, int insert) {
+    if (c < 256)
+        return pm->latin + (size_t)c * pm->words;
+    size_t h = (size_t)(c * 2654435761u) & (pm->capacity - 1);
+    while (pm->keys[h]) {
+        if (pm->keys[h] == c + 1)
+            return pm->masks + h * pm->words;
+        h = (h + 1) & (pm->capacity - 1);
+    }
+    if (!insert)
+        return NULL;
+    pm->keys[h] = c + 1;
+    return pm->masks + h * pm->words;
+}
+
+static int pm_init(PatternMasks *pm, const uint32_t *s, size_t len) {
+    pm->words = len ? (len + 63) / 64 : 1;
+    pm->capacity = 16;
+    while (pm->capacity < 2 * len)
+        pm->capacity <<= 1;
+    pm->latin = (uint64_t *)calloc(256 * pm->words, sizeof(uint64_t));
+    pm->keys = (uint32_t *)calloc(pm->capacity, sizeof(uint32_t));
+    pm->masks = (uint64_t *)calloc(pm->capacity * pm->words, sizeof(uint64_t));
+    if (!pm->latin || !pm->keys || !pm->masks) {
+        pm_free(pm);
+        return -1;
+    }
+    for (size_t i = 0; i < len; ++i)
+        pm_find(pm, s[i], 1)[i / 64] |= 1ull << (i % 64);
+    return 0;
+}
+
+// Najdłuższy wspólny podciąg (Hyyrö): jedno dodawanie i dwie operacje
+// bitowe na znak tekstu dla każdego słowa wzorca
+static long lcs_length(const PatternMasks *pm, size_t lp, const uint32_t *t, size_t lt) {
+    size_t words = pm->words;
+    uint64_t single = ~0ull;
+    uint64_t *S = &single;
+    if (words > 1) {
+        S = (uint64_t *)malloc(words * sizeof(uint64_t));
+        if (!S)
+            return -1;
+        memset(S, 0xff, words * sizeof(uint64_t));
+    }
+    for (size_t j = 0; j < lt; ++j) {
+        const uint64_t *M = pm_find(pm, t[j], 0);
+        if (!M)
+            continue;
+        uint64_t carry = 0;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t sv = S[w];
+            uint64_t u = sv & M[w];
+            uint64_t x = sv + u;
+            uint64_t c1 = x < sv;
+            x += carry;
+            carry = c1 | (x < carry);
+            S[w] = x | (sv - u);
+        }
+    }
+    long lcs = 0;
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t v = ~S[w];
+        size_t bits = lp - w * 64;
+        if (bits < 64)
+            v &= (1ull << bits) - 1;
+        lcs += __builtin_popcountll(v);
+    }
+    if (S != &single)
+        free(S);
+    return lcs;
+}
+
+static double ratio_masks(const PatternMasks *pm, size_t lp, const uint32_t *t, size_t lt) {
+    if (lp + lt == 0)
+        return 1.0;
+    long lcs = lcs_length(pm, lp, t, lt);
+    if (lcs < 0)
+        return -1.0;
+    return 2.0 * (double)lcs / (double)(lp + lt);
+}
+
+// Jaro: każdy znak tekstu łączy się z pierwszym jeszcze wolnym takim samym
+// znakiem wzorca w oknie max(lp, lt) / 2 - 1, wyszukanym maską bitową
+static double jaro_winkler_masks(const PatternMasks *pm, const uint32_t *p, size_t lp,
+                                 const uint32_t *t, size_t lt, double prefix_weight) {
+    if (lp == 0 && lt == 0)
+        return 1.0;
+    if (lp == 0 || lt == 0)
+        return 0.0;
+    size_t longer = lp > lt ? lp : lt;
+    size_t bound = longer / 2 > 0 ? longer / 2 - 1 : 0;
+    size_t pwords = pm->words, twords = (lt + 63) / 64;
+    uint64_t local[2] = {0, 0};
+    uint64_t *pflag = local, *tflag = local + 1;
+    if (pwords > 1 || twords > 1) {
+        pflag = (uint64_t *)calloc(pwords + twords, sizeof(uint64_t));
+        if (!pflag)
+            return -1.0;
+        tflag = pflag + pwords;
+    }
+
+    size_t matches = 0;
+    for (size_t j = 0; j < lt; ++j) {
+        size_t lo = j > bound ? j - bound : 0;
+        size_t hi = j + bound < lp - 1 ? j + bound : lp - 1;
+        if (lo > hi)
+            break;
+        const uint64_t *M = pm_find(pm, t[j], 0);
+        if (!M)
+            continue;
+        for (size_t w = lo / 64; w <= hi / 64; ++w) {
+            uint64_t window = ~0ull;
+            if (w == lo / 64)
+                window &= ~0ull << (lo % 64);
+            if (w == hi / 64 && hi % 64 != 63)
+                window &= (1ull << (hi % 64 + 1)) - 1;
+            uint64_t cand = M[w] & ~pflag[w] & window;
+            if (cand) {
+                pflag[w] |= cand & (~cand + 1);
+                tflag[j / 64] |= 1ull << (j % 64);
+                ++matches;
+                break;
+            }
+        }
+    }
+
+    double sim = 0.0;
+    if (matches) {
+        // Transpozycje: k-ty dopasowany znak tekstu wobec k-tego znaku wzorca
+        size_t trans = 0, pw = 0;
+        uint64_t pbits = pflag[0];
+        for (size_t tw = 0; tw < twords; ++tw) {
+            uint64_t tbits = tflag[tw];
+            while (tbits) {
+                size_t j = tw * 64 + (size_t)__builtin_ctzll(tbits);
+                tbits &= tbits - 1;
+                while (!pbits)
+                    pbits = pflag[++pw];
+                size_t i = pw * 64 + (size_t)__builtin_ctzll(pbits);
+                pbits &= pbits - 1;
+                trans += p[i] != t[j];
+            }
+        }
+        double m = (double)matches;
+        sim = (m / (double)lp + m / (double)lt + (m - (double)(trans / 2)) / m) / 3.0;
+    }
+    if (pflag != local)
+        free(pflag);
+
+    if (sim > 0.7) {
+        size_t prefix = 0, limit = lp < lt ? lp : lt;
+        if (limit > 4)
+            limit = 4;
+        while (prefix < limit && p[prefix] == t[prefix])
+            ++prefix;
+        sim += (double)prefix * prefix_weight * (1.0 - sim);
+    }
+    return sim;
+}
+
+// Jaro-Winkler similarity of a and b with the given prefix weight (0.1 is
+// Winkler's); the boost applies above a Jaro similarity of 0.7.
+// Returns -1 on allocation failure.
+double jaro_winkler_similarity(const uint32_t *a, size_t la, const uint32_t *b, size_t lb,
+                               double prefix_weight) {
+    PatternMasks pm;
+    if (pm_init(&pm, a, la) != 0)
+        return -1.0;
+    double sim = jaro_winkler_masks(&pm, a, la, b, lb, prefix_weight);
+    pm_free(&pm);
+    return sim;
+}
+
+// 1 - InDel distance / (la + lb), i.e. 2 * LCS / (la + lb); the ratio of
+// python-Levenshtein and rapidfuzz. Returns -1 on allocation failure.
+double levenshtein_ratio(const uint32_t *a, size_t la, const uint32_t *b, size_t lb) {
+    // Krótszy napis jako wzorzec: mniej słów maski
+    if (la > lb) {
+        const uint32_t *tmp = a;
+        a = b;
+        b = tmp;
+        size_t tl = la;
+        la = lb;
+        lb = tl;
+    }
+    PatternMasks pm;
+    if (pm_init(&pm, a, la) != 0)
+        return -1.0;
+    double ratio = ratio_masks(&pm, la, b, lb);
+    pm_free(&pm);
+    return ratio;
+}
+
+// Score query against n strings stored back to back in texts; string k spans
+// texts[offsets[k]] .. texts[offsets[k + 1]]. Writes n scores to out and
+// returns 0, or -1 on allocation failure.
+int similarity_batch(int metric, const uint32_t *query, size_t lq, const uint32_t *texts,
+                     const size_t *offsets, size_t n, double prefix_weight, double *out) {
+    PatternMasks pm;
+    if (pm_init(&pm, query, lq) != 0)
+        return -1;
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic, 16) reduction(|:failed)
+    for (long k = 0; k < (long)n; ++k) {
+        const uint32_t *t = texts + offsets[k];
+        size_t lt = offsets[k + 1] - offsets[k];
+        double score = metric == METRIC_JARO_WINKLER
+                           ? jaro_winkler_masks(&pm, query, lq, t, lt, prefix_weight)
+                           : ratio_masks(&pm, lq, t, lt);
+        failed |= score < 0.0;
+        out[k] = score;
+    }
+    pm_free(&pm);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,752 @@
+// Native CPU inference backend for quantized GGUF models (llama.cpp).
+//
+// Exposes a small C API loaded from Python via ctypes (see native_llm.py).
+// Requests are queued and served by one scheduler thread per engine that
+// decodes up to ``n_parallel`` sequences in a single llama_batch
+// (continuous batching): a finished sequence frees its slot and the next
+// queued request joins the following decode step.
+//
+// Sequence 0 holds the KV cache of the static prompt prefix set with
+// llm_engine_set_prefix() (optionally restored from / saved to a file);
+// slots copy it instead of evaluating it again. Each slot also keeps the
+// tokens of its last request, so a prompt sharing a longer prefix with them
+// only prefills the remainder.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llama.h"
+
+#ifdef _WIN32
+#define LLM_API extern "C" __declspec(dllexport)
+#else
+#define LLM_API extern "C" __attribute__((visibility("default")))
+#endif
+
+// Completion callback: ``status`` is 0 and ``text`` the completion on
+// success, or -1 and ``text`` the error message. Called from the scheduler
+// thread.
+typedef void (*llm_callback)(void *user, int status, const char *text,
+                             size_t len);
+
+namespace {
+
+thread_local std::string g_last_error;
+
+void set_error(const std::string &msg) { g_last_error = msg; }
+
+std::once_flag g_backend_once;
+
+struct llm_request {
+  std::vector<llama_token> tokens;
+  int max_tokens = 0;
+  float temperature = 0.0f;
+  float top_p = 1.0f;
+  uint32_t seed = 0;
+  std::string grammar;
+  std::string stop;
+  llm_callback cb = nullptr;
+  void *user = nullptr;
+};
+
+struct llm_slot {
+  llama_seq_id seq = 0;
+  // Tokens whose KV entries are stored for ``seq``; the first ``n_shared``
+  // of them are cells shared with the prefix in sequence 0.
+  std::vector<llama_token> cached;
+  size_t n_shared = 0;
+  // Active request state.
+  std::unique_ptr<llm_request> req;
+  llama_sampler *smpl = nullptr;
+  llama_token next = -1; // sampled token waiting to be decoded
+  int n_generated = 0;
+  std::string result;
+  uint64_t order = 0; // admission order, the newest is preempted first
+  // Per-step bookkeeping.
+  size_t n_pending = 0; // prompt tokens placed in the current batch
+  int i_batch = -1;     // batch index whose logits are sampled
+};
+
+struct completion {
+  llm_callback cb;
+  void *user;
+  int status;
+  std::string text;
+};
+
+} // namespace
+
+struct llm_engine {
+  llama_model *model = nullptr;
+  llama_context *ctx = nullptr;
+  const llama_vocab *vocab = nullptr;
+  int n_ctx = 0;
+  int n_batch = 0;
+  llama_batch batch = {};
+
+  // Guards ctx, slots and the prefix; held by the scheduler for a step.
+  std::mutex ctx_mutex;
+  std::vector<llm_slot> slots;
+  std::vector<llama_token> prefix_tokens;
+  uint64_t n_admitted = 0;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_cv;
+  std::deque<std::unique_ptr<llm_request>> queue;
+  std::atomic<int> n_active{0};
+  bool stopping = false;
+  // llm_engine_free() was called from a completion callback; the scheduler
+  // frees the engine once it is back in its loop.
+  bool free_on_exit = false;
+  // ``user`` values of requests to cancel (nullptr cancels all), applied by
+  // the scheduler to queued and running requests.
+  std::vector<void *> cancelled;
+  std::thread worker;
+};
+
+namespace {
+
+bool tokenize(const llm_engine *engine, const std::string &text,
+              bool add_special, std::vector<llama_token> &out) {
+  int n = -llama_tokenize(engine->vocab, text.c_str(), (int32_t)text.size(),
+                          nullptr, 0, add_special, true);
+  out.resize(n);
+  if (n == 0)
+    return true;
+  if (llama_tokenize(engine->vocab, text.c_str(), (int32_t)text.size(),
+                     out.data(), n, add_special, true) < 0) {
+    set_error("Tokenizacja promptu nie powiodła się");
+    return false;
+  }
+  return true;
+}
+
+std::string token_to_piece(const llm_engine *engine, llama_token token) {
+  char buf[256];
+  int n = llama_token_to_piece(engine->vocab, token, buf, sizeof(buf), 0, false);
+  if (n < 0) {
+    std::string big(-n, '\0');
+    n = llama_token_to_piece(engine->vocab, token, &big[0], -n, 0, false);
+    return n > 0 ? big.substr(0, n) : std::string();
+  }
+  return std::string(buf, n);
+}
+
+// Build the sampler chain; returns nullptr when the grammar does not parse.
+llama_sampler *make_sampler(const llm_engine *engine, const llm_request &req) {
+  llama_sampler *chain =
+      llama_sampler_chain_init(llama_sampler_chain_default_params());
+  if (!req.grammar.empty()) {
+    llama_sampler *g =
+        llama_sampler_init_grammar(engine->vocab, req.grammar.c_str(), "root");
+    if (!g) {
+      llama_sampler_free(chain);
+      return nullptr;
+    }
+    llama_sampler_chain_add(chain, g);
+  }
+  if (req.temperature <= 0.0f) {
+    llama_sampler_chain_add(chain, llama_sampler_init_greedy());
+    return chain;
+  }
+  if (req.top_p > 0.0f && req.top_p < 1.0f)
+    llama_sampler_chain_add(chain, llama_sampler_init_top_p(req.top_p, 1));
+  llama_sampler_chain_add(chain, llama_sampler_init_temp(req.temperature));
+  llama_sampler_chain_add(chain, llama_sampler_init_dist(req.seed));
+  return chain;
+}
+
+size_t common_prefix(const std::vector<llama_token> &a,
+                     const std::vector<llama_token> &b) {
+  size_t n = std::min(a.size(), b.size());
+  size_t i = 0;
+  while (i < n && a[i] == b[i])
+    ++i;
+  return i;
+}
+
+void batch_add(llama_batch &batch, llama_token token, llama_pos pos,
+               llama_seq_id seq, bool logits) {
+  int i = batch.n_tokens++;
+  batch.token[i] = token;
+  batch.pos[i] = pos;
+  batch.n_seq_id[i] = 1;
+  batch.seq_id[i][0] = seq;
+  batch.logits[i] = logits;
+}
+
+// Number of KV cells in use, counting cells shared with the prefix once.
+size_t kv_used(const llm_engine *engine) {
+  size_t used = engine->prefix_tokens.size();
+  for (const llm_slot &slot : engine->slots)
+    used += slot.cached.size() - slot.n_shared;
+  return used;
+}
+
+void clear_slot(llm_engine *engine, llm_slot &slot) {
+  llama_memory_seq_rm(llama_get_memory(engine->ctx), slot.seq, -1, -1);
+  slot.cached.clear();
+  slot.n_shared = 0;
+}
+
+// Drop the cached tokens of ``slot`` after position ``n_keep``. Memories that
+// cannot remove a suffix (recurrent models) start again from the prefix.
+void truncate_slot(llm_engine *engine, llm_slot &slot, size_t n_keep) {
+  if (n_keep >= slot.cached.size())
+    return;
+  llama_memory_t mem = llama_get_memory(engine->ctx);
+  if (n_keep > 0 && llama_memory_seq_rm(mem, slot.seq, (llama_pos)n_keep, -1)) {
+    slot.cached.resize(n_keep);
+    slot.n_shared = std::min(slot.n_shared, n_keep);
+    return;
+  }
+  clear_slot(engine, slot);
+  if (!engine->prefix_tokens.empty() && n_keep >= engine->prefix_tokens.size()) {
+    llama_memory_seq_cp(mem, 0, slot.seq, -1, -1);
+    slot.cached = engine->prefix_tokens;
+    slot.n_shared = slot.cached.size();
+  }
+}
+
+void release_slot(llm_slot &slot) {
+  if (slot.smpl)
+    llama_sampler_free(slot.smpl);
+  slot.smpl = nullptr;
+  slot.req.reset();
+  slot.next = -1;
+  slot.n_pending = 0;
+  slot.i_batch = -1;
+}
+
+void finish_slot(llm_engine *engine, llm_slot &slot, int status,
+                 const std::string &text, std::vector<completion> &done) {
+  done.push_back({slot.req->cb, slot.req->user, status, text});
+  release_slot(slot);
+  --engine->n_active;
+}
+
+// Return the newest active request to the front of the queue and free its
+// KV cells.
+void preempt_newest(llm_engine *engine) {
+  llm_slot *victim = nullptr;
+  for (llm_slot &slot : engine->slots)
+    if (slot.req && (!victim || slot.order > victim->order))
+      victim = &slot;
+  if (!victim)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(engine->queue_mutex);
+    engine->queue.push_front(std::move(victim->req));
+  }
+  release_slot(*victim);
+  clear_slot(engine, *victim);
+  --engine->n_active;
+}
+
+// Drop the caches kept by idle slots until ``needed`` more cells fit.
+bool make_room(llm_engine *engine, size_t needed) {
+  for (llm_slot &slot : engine->slots) {
+    if (kv_used(engine) + needed <= (size_t)engine->n_ctx)
+      return true;
+    if (!slot.req)
+      clear_slot(engine, slot);
+  }
+  return kv_used(engine) + needed <= (size_t)engine->n_ctx;
+}
+
+// Move queued requests into free slots while the KV cache has room.
+void admit(llm_engine *engine, std::vector<completion> &done) {
+  for (;;) {
+    llm_slot *slot = nullptr;
+    for (llm_slot &s : engine->slots)
+      if (!s.req) {
+        slot = &s;
+        break;
+      }
+    if (!slot)
+      return;
+
+    std::unique_ptr<llm_request> req;
+    {
+      std::lock_guard<std::mutex> lock(engine->queue_mutex);
+      if (engine->queue.empty())
+        return;
+      req = std::move(engine->queue.front());
+      engine->queue.pop_front();
+    }
+
+    // Prefer the idle slot whose cache shares the longest prefix.
+    size_t n_keep = 0;
+    for (llm_slot &s : engine->slots) {
+      if (s.req)
+        continue;
+      size_t n = common_prefix(s.cached, req->tokens);
+      if (n > n_keep) {
+        n_keep = n;
+        slot = &s;
+      }
+    }
+    size_t n_prefix = common_prefix(engine->prefix_tokens, req->tokens);
+    if (n_prefix > n_keep) {
+      clear_slot(engine, *slot);
+      llama_memory_seq_cp(llama_get_memory(engine->ctx), 0, slot->seq, -1, -1);
+      slot->cached = engine->prefix_tokens;
+      slot->n_shared = slot->cached.size();
+      n_keep = n_prefix;
+    }
+    // At least the last prompt token is decoded again to obtain its logits.
+    truncate_slot(engine, *slot, std::min(n_keep, req->tokens.size() - 1));
+
+    if (!make_room(engine, req->tokens.size() - slot->cached.size() + 1)) {
+      if (engine->n_active > 0) {
+        std::lock_guard<std::mutex> lock(engine->queue_mutex);
+        engine->queue.push_front(std::move(req));
+        return;
+      }
+      done.push_back({req->cb, req->user, -1,
+                      "Prompt nie mieści się w pamięci KV modelu"});
+      continue;
+    }
+
+    slot->smpl = make_sampler(engine, *req);
+    if (!slot->smpl) {
+      done.push_back({req->cb, req->user, -1, "Nieprawidłowa gramatyka GBNF"});
+      continue;
+    }
+    slot->req = std::move(req);
+    slot->next = -1;
+    slot->n_generated = 0;
+    slot->result.clear();
+    slot->order = ++engine->n_admitted;
+    ++engine->n_active;
+  }
+}
+
+// Fill the batch with one pending token per generating slot followed by as
+// many prompt tokens of prefilling slots as fit. Returns the token count.
+int plan_batch(llm_engine *engine) {
+  llama_batch &batch = engine->batch;
+  batch.n_tokens = 0;
+  for (llm_slot &slot : engine->slots) {
+    slot.n_pending = 0;
+    slot.i_batch = -1;
+    if (slot.req && slot.next >= 0) {
+      slot.i_batch = batch.n_tokens;
+      batch_add(batch, slot.next, (llama_pos)slot.cached.size(), slot.seq, true);
+    }
+  }
+  for (llm_slot &slot : engine->slots) {
+    if (!slot.req || slot.next >= 0)
+      continue;
+    const std::vector<llama_token> &tokens = slot.req->tokens;
+    size_t from = slot.cached.size();
+    size_t n = std::min(tokens.size() - from,
+                        (size_t)(engine->n_batch - batch.n_tokens));
+    for (size_t k = 0; k < n; ++k) {
+      bool last = from + k == tokens.size() - 1;
+      if (last)
+        slot.i_batch = batch.n_tokens;
+      batch_add(batch, tokens[from + k], (llama_pos)(from + k), slot.seq, last);
+    }
+    slot.n_pending = n;
+  }
+  return batch.n_tokens;
+}
+
+// Run one decode step over all active slots.
+void step(llm_engine *engine, std::vector<completion> &done) {
+  int n_tokens = plan_batch(engine);
+  while (n_tokens > 0 && !make_room(engine, n_tokens) && engine->n_active > 1) {
+    preempt_newest(engine);
+    n_tokens = plan_batch(engine);
+  }
+  if (n_tokens == 0)
+    return;
+
+  int ret = llama_decode(engine->ctx, engine->batch);
+  if (ret == 1 && engine->n_active > 1) {
+    // No free KV cells: retry the others next step.
+    preempt_newest(engine);
+    return;
+  }
+  if (ret != 0) {
+    for (llm_slot &slot : engine->slots) {
+      if (slot.req)
+        finish_slot(engine, slot, -1,
+                    "llama_decode nie powiodło się podczas generowania", done);
+      clear_slot(engine, slot);
+    }
+    return;
+  }
+
+  for (llm_slot &slot : engine->slots) {
+    if (!slot.req)
+      continue;
+    if (slot.next >= 0) {
+      slot.cached.push_back(slot.next);
+      slot.next = -1;
+    } else {
+      const std::vector<llama_token> &tokens = slot.req->tokens;
+      size_t from = slot.cached.size();
+      slot.cached.insert(slot.cached.end(), tokens.begin() + from,
+                         tokens.begin() + from + slot.n_pending);
+    }
+    if (slot.i_batch < 0)
+      continue; // prompt not fully evaluated yet
+
+    llama_token tok = llama_sampler_sample(slot.smpl, engine->ctx, slot.i_batch);
+    if (llama_vocab_is_eog(engine->vocab, tok)) {
+      finish_slot(engine, slot, 0, slot.result, done);
+      continue;
+    }
+    std::string piece = token_to_piece(engine, tok);
+    slot.result += piece;
+    ++slot.n_generated;
+    const std::string &stop = slot.req->stop;
+    if (!stop.empty()) {
+      // The stop string may span the previous piece and this one.
+      size_t from = slot.result.size() - piece.size();
+      from = from >= stop.size() ? from - stop.size() + 1 : 0;
+      size_t pos = slot.result.find(stop, from);
+      if (pos != std::string::npos) {
+        slot.result.resize(pos + stop.size());
+        finish_slot(engine, slot, 0, slot.result, done);
+        continue;
+      }
+    }
+    if (slot.n_generated >= slot.req->max_tokens) {
+      finish_slot(engine, slot, 0, slot.result, done);
+      continue;
+    }
+    slot.next = tok;
+  }
+}
+
+const char *const k_cancelled = "Żądanie zostało anulowane";
+
+bool matches(const std::vector<void *> &users, void *user) {
+  for (void *u : users)
+    if (!u || u == user)
+      return true;
+  return false;
+}
+
+// Complete the queued and running requests named in engine->cancelled.
+void apply_cancels(llm_engine *engine, std::vector<completion> &done) {
+  std::vector<void *> users;
+  {
+    std::lock_guard<std::mutex> lock(engine->queue_mutex);
+    users.swap(engine->cancelled);
+    if (users.empty())
+      return;
+    // Requests preempted back into the queue since llm_engine_cancel().
+    auto &queue = engine->queue;
+    for (auto it = queue.begin(); it != queue.end();) {
+      if (matches(users, (*it)->user)) {
+        done.push_back({(*it)->cb, (*it)->user, -1, k_cancelled});
+        it = queue.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (llm_slot &slot : engine->slots)
+    if (slot.req && matches(users, slot.req->user))
+      finish_slot(engine, slot, -1, k_cancelled, done);
+}
+
+void destroy_engine(llm_engine *engine) {
+  const char *msg = "Silnik LLM został zamknięty";
+  for (llm_slot &slot : engine->slots) {
+    if (slot.req)
+      slot.req->cb(slot.req->user, -1, msg, std::strlen(msg));
+    release_slot(slot);
+  }
+  for (std::unique_ptr<llm_request> &req : engine->queue)
+    req->cb(req->user, -1, msg, std::strlen(msg));
+  llama_batch_free(engine->batch);
+  llama_free(engine->ctx);
+  llama_model_free(engine->model);
+  delete engine;
+}
+
+void scheduler_loop(llm_engine *engine) {
+  std::vector<completion> done;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(engine->queue_mutex);
+      engine->queue_cv.wait(lock, [engine] {
+        return engine->stopping || !engine->queue.empty() ||
+               engine->n_active > 0 || !engine->cancelled.empty();
+      });
+      if (engine->stopping)
+        break;
+    }
+    {
+      std::lock_guard<std::mutex> lock(engine->ctx_mutex);
+      apply_cancels(engine, done);
+      admit(engine, done);
+      step(engine, done);
+    }
+    // Callbacks run without locks so they may submit new requests or free
+    // the engine; the engine stays valid until the loop checks ``stopping``.
+    for (const completion &c : done)
+      c.cb(c.user, c.status, c.text.data(), c.text.size());
+    done.clear();
+  }
+  // Only this thread sets free_on_exit, so it is read without the lock.
+  if (engine->free_on_exit) {
+    engine->worker.detach();
+    destroy_engine(engine);
+  }
+}
+
+// Decode ``tokens`` into sequence ``seq`` from position 0 without logits.
+bool decode_sequence(llm_engine *engine, const std::vector<llama_token> &tokens,
+                     llama_seq_id seq) {
+  llama_batch &batch = engine->batch;
+  for (size_t i = 0; i < tokens.size(); i += engine->n_batch) {
+    batch.n_tokens = 0;
+    size_t n = std::min<size_t>(engine->n_batch, tokens.size() - i);
+    for (size_t k = 0; k < n; ++k)
+      batch_add(batch, tokens[i + k], (llama_pos)(i + k), seq, false);
+    if (llama_decode(engine->ctx, batch) != 0) {
+      set_error("llama_decode nie powiodło się podczas przetwarzania promptu");
+      return false;
+    }
+  }
+  return true;
+}
+
+struct sync_result {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  int status = 0;
+  std::string text;
+};
+
+void sync_callback(void *user, int status, const char *text, size_t len) {
+  sync_result *r = static_cast<sync_result *>(user);
+  std::lock_guard<std::mutex> lock(r->mutex);
+  r->status = status;
+  r->text.assign(text, len);
+  r->done = true;
+  r->cv.notify_one();
+}
+
+} // namespace
+
+LLM_API const char *llm_last_error(void) { return g_last_error.c_str(); }
+
+// Load a GGUF model from ``model_path``. ``n_ctx`` is the KV cache size
+// shared by all sequences, ``n_threads`` <= 0 uses all cores and
+// ``n_parallel`` is the number of sequences decoded together.
+LLM_API llm_engine *llm_engine_create(const char *model_path, int n_ctx,
+                                      int n_threads, int n_parallel) {
+  std::call_once(g_backend_once, [] { llama_backend_init(); });
+
+  llama_model_params mparams = llama_model_default_params();
+  mparams.n_gpu_layers = 0;
+  llama_model *model = llama_model_load_from_file(model_path, mparams);
+  if (!model) {
+    set_error(std::string("Nie można wczytać modelu GGUF: ") + model_path);
+    return nullptr;
+  }
+
+  if (n_threads <= 0)
+    n_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  n_parallel = std::max(1, n_parallel);
+
+  llama_context_params cparams = llama_context_default_params();
+  cparams.n_ctx = n_ctx > 0 ? (uint32_t)n_ctx : 4096;
+  cparams.n_batch = std::min<uint32_t>(cparams.n_ctx, 512);
+  cparams.n_seq_max = (uint32_t)n_parallel + 1; // + prefix sequence
+  cparams.kv_unified = true;
+  cparams.n_threads = n_threads;
+  cparams.n_threads_batch = n_threads;
+  cparams.no_perf = true;
+  llama_context *ctx = llama_init_from_model(model, cparams);
+  if (!ctx) {
+    llama_model_free(model);
+    set_error("Nie można utworzyć kontekstu llama.cpp");
+    return nullptr;
+  }
+
+  llm_engine *engine = new llm_engine();
+  engine->model = model;
+  engine->ctx = ctx;
+  engine->vocab = llama_model_get_vocab(model);
+  engine->n_ctx = (int)llama_n_ctx(ctx);
+  engine->n_batch = (int)cparams.n_batch;
+  engine->batch = llama_batch_init(engine->n_batch, 0, 1);
+  engine->slots.resize(n_parallel);
+  for (int i = 0; i < n_parallel; ++i)
+    engine->slots[i].seq = i + 1;
+  engine->worker = std::thread(scheduler_loop, engine);
+  return engine;
+}
+
+// Stop the scheduler and release the model. Requests still queued or
+// running complete with an error. Called from a completion callback, it
+// only marks the engine; the scheduler thread frees it after the callback
+// returns.
+LLM_API void llm_engine_free(llm_engine *engine) {
+  if (!engine)
+    return;
+  bool from_worker = engine->worker.get_id() == std::this_thread::get_id();
+  {
+    std::lock_guard<std::mutex> lock(engine->queue_mutex);
+    engine->stopping = true;
+    engine->free_on_exit = from_worker;
+  }
+  engine->queue_cv.notify_all();
+  if (from_worker)
+    return;
+  if (engine->worker.joinable())
+    engine->worker.join();
+  destroy_engine(engine);
+}
+
+// Cancel the requests submitted with ``user``, or all requests when
+// ``user`` is NULL. Queued requests complete with an error on the next
+// scheduler pass, running ones after the current decode step; the callbacks
+// run on the scheduler thread.
+LLM_API void llm_engine_cancel(llm_engine *engine, void *user) {
+  if (!engine)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(engine->queue_mutex);
+    engine->cancelled.push_back(user);
+  }
+  engine->queue_cv.notify_one();
+}
+
+// Queue a completion request for ``prompt``; ``cb`` is called once with the
+// result. ``temperature`` <= 0 selects greedy decoding. An optional GBNF
+// ``grammar`` (start rule "root") constrains the output and generation ends
+// right after the first occurrence of ``stop``; both may be NULL. Returns 0,
+// or -1 without calling ``cb`` when the request is rejected.
+LLM_API int llm_engine_submit(llm_engine *engine, const char *prompt,
+                              int max_tokens, float temperature, float top_p,
+                              unsigned int seed, const char *grammar,
+                              const char *stop, llm_callback cb, void *user) {
+  if (!engine || !prompt || !cb || max_tokens <= 0) {
+    set_error("Nieprawidłowe argumenty");
+    return -1;
+  }
+  std::unique_ptr<llm_request> req(new llm_request());
+  if (!tokenize(engine, prompt, true, req->tokens))
+    return -1;
+  if (req->tokens.empty() ||
+      (int)req->tokens.size() + max_tokens > engine->n_ctx) {
+    set_error("Prompt nie mieści się w oknie kontekstu modelu");
+    return -1;
+  }
+  req->max_tokens = max_tokens;
+  req->temperature = temperature;
+  req->top_p = top_p;
+  req->seed = seed;
+  req->grammar = grammar ? grammar : "";
+  req->stop = stop ? stop : "";
+  req->cb = cb;
+  req->user = user;
+  {
+    std::lock_guard<std::mutex> lock(engine->queue_mutex);
+    if (engine->stopping) {
+      set_error("Silnik LLM został zamknięty");
+      return -1;
+    }
+    engine->queue.push_back(std::move(req));
+  }
+  engine->queue_cv.notify_one();
+  return 0;
+}
+
+// Generate a completion for ``prompt`` and wait for it (see
+// llm_engine_submit). Writes at most ``out_size - 1`` bytes of UTF-8 to
+// ``out`` and returns the full length of the completion, or -1 on error
+// (see llm_last_error).
+LLM_API int llm_engine_generate(llm_engine *engine, const char *prompt,
+                                int max_tokens, float temperature, float top_p,
+                                unsigned int seed, const char *grammar,
+                                const char *stop, char *out, size_t out_size) {
+  sync_result r;
+  if (llm_engine_submit(engine, prompt, max_tokens, temperature, top_p, seed,
+                        grammar, stop, sync_callback, &r) != 0)
+    return -1;
+  std::unique_lock<std::mutex> lock(r.mutex);
+  r.cv.wait(lock, [&r] { return r.done; });
+  if (r.status != 0) {
+    set_error(r.text);
+    return -1;
+  }
+  if (out && out_size > 0) {
+    size_t n = std::min(r.text.size(), out_size - 1);
+    std::memcpy(out, r.text.data(), n);
+    out[n] = '\0';
+  }
+  return (int)r.text.size();
+}
+
+// Evaluate the static prompt ``prefix`` into sequence 0. When ``cache_path``
+// is given the state is loaded from that file if it matches the prefix
+// tokens, and written there otherwise. Returns the number of prefix tokens
+// or -1 on error.
+LLM_API int llm_engine_set_prefix(llm_engine *engine, const char *prefix,
+                                  const char *cache_path) {
+  if (!engine || !prefix) {
+    set_error("Nieprawidłowe argumenty");
+    return -1;
+  }
+  std::vector<llama_token> tokens;
+  if (!tokenize(engine, prefix, true, tokens))
+    return -1;
+  if (tokens.empty() || (int)tokens.size() >= engine->n_ctx) {
+    set_error("Nieprawidłowa długość prefiksu promptu");
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lock(engine->ctx_mutex);
+  llama_memory_t mem = llama_get_memory(engine->ctx);
+  // Slots keep the cells they copied, but they are no longer shared.
+  llama_memory_seq_rm(mem, 0, -1, -1);
+  engine->prefix_tokens.clear();
+  for (llm_slot &slot : engine->slots) {
+    slot.n_shared = 0;
+    if (!slot.req)
+      clear_slot(engine, slot);
+  }
+
+  bool restored = false;
+  if (cache_path && *cache_path) {
+    std::vector<llama_token> stored(tokens.size());
+    size_t n_stored = 0;
+    restored = llama_state_seq_load_file(engine->ctx, cache_path, 0,
+                                         stored.data(), stored.size(),
+                                         &n_stored) > 0 &&
+               n_stored == tokens.size() && stored == tokens;
+    if (!restored)
+      llama_memory_seq_rm(mem, 0, -1, -1);
+  }
+  if (!restored) {
+    if (!decode_sequence(engine, tokens, 0)) {
+      llama_memory_seq_rm(mem, 0, -1, -1);
+      return -1;
+    }
+    if (cache_path && *cache_path)
+      llama_state_seq_save_file(engine->ctx, cache_path, 0, tokens.data(),
+                                tokens.size());
+  }
+  engine->prefix_tokens = tokens;
+  return (int)tokens.size();
+}
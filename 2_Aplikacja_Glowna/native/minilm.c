@@ -0,0 +1,605 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Int8 sentence-embedding encoder for MiniLM/BERT-class models.
+//
+// Weights come from a single file written by native_embedder.py and are
+// memory-mapped, so loading is instant and pages are shared between
+// processes. Linear layers use int8 weights with one scale per output row
+// and activations quantized per row on the fly (int32 accumulation).
+// Texts are encoded as one padded batch; the output is a row-major
+// float matrix of L2-normalized mean-pooled embeddings that can be passed
+// directly to cosine_top_kf() from fast_similarity.c.
+//
+// Input texts must already be normalized by the caller (lowercased, accents
+// stripped, punctuation separated by spaces); this file only performs the
+// WordPiece split.
+
+#define MINILM_MAGIC "MINILM8"
+#define MINILM_VERSION 1
+#define MINILM_ALIGN 32
+#define MINILM_MAX_WORD 100
+
+typedef struct {
+    int in;
+    int out;
+    const int8_t *weight; // [out * in]
+    const float *scale;   // [out]
+    const float *bias;    // [out]
+} qlinear;
+
+typedef struct {
+    qlinear q, k, v, o;
+    const float *attn_ln_w, *attn_ln_b;
+    qlinear ffn_in, ffn_out;
+    const float *out_ln_w, *out_ln_b;
+} encoder_layer;
+
+typedef struct {
+    const char *text;
+    int len;
+    int id;
+} vocab_entry;
+
+typedef struct minilm_model {
+    int vocab_size, hidden, n_layers, n_heads, intermediate, max_pos;
+    float ln_eps;
+    const int8_t *word_emb;
+    const float *word_scale;
+    const float *pos_emb;
+    const float *type_emb;
+    const float *emb_ln_w, *emb_ln_b;
+    encoder_layer *layers;
+    // Open-addressing hash table over the vocabulary.
+    vocab_entry *table;
+    size_t table_size;
+    int cls_id, sep_id, unk_id;
+    // Backing storage of the weights.
+    const unsigned char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+} minilm_model;
+
+static char g_error[256];
+
+static void set_error(const char *msg) {
+    snprintf(g_error, sizeof(g_error), "%s", msg);
+}
+
+const char *minilm_last_error(void) {
+    return g_error;
+}
+
+// Model file reading ---------------------------------------------------------
+
+typedef struct {
+    const unsigned char *base;
+    size_t pos, size;
+    int ok;
+} reader;
+
+static const void *take(reader *r, size_t n, int align) {
+    if (align) {
+        r->pos = (r->pos + MINILM_ALIGN - 1) & ~(size_t)(MINILM_ALIGN - 1);
+    }
+    if (!r->ok || r->pos > r->size || n > r->size - r->pos) {
+        r->ok = 0;
+        return NULL;
+    }
+    const void *p = r->base + r->pos;
+    r->pos += n;
+    return p;
+}
+
+static uint32_t take_u32(reader *r) {
+    uint32_t v = 0;
+    const void *p = take(r, 4, 0);
+    if (p) {
+        memcpy(&v, p, 4);
+    }
+    return v;
+}
+
+static const float *take_floats(reader *r, size_t n) {
+    return (const float *)take(r, n * sizeof(float), 1);
+}
+
+static void take_linear(reader *r, qlinear *l, int in, int out) {
+    l->in = in;
+    l->out = out;
+    l->weight = (const int8_t *)take(r, (size_t)in * out, 1);
+    l->scale = take_floats(r, out);
+    l->bias = take_floats(r, out);
+}
+
+static uint64_t hash_bytes(const char *s, int n) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (int i = 0; i < n; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int vocab_lookup(const minilm_model *m, const char *s, int n) {
+    size_t mask = m->table_size - 1;
+    for (size_t i = hash_bytes(s, n) & mask;; i = (i + 1) & mask) {
+        const vocab_entry *e = &m->table[i];
+        if (!e->text) {
+            return -1;
+        }
+        if (e->len == n && memcmp(e->text, s, n) == 0) {
+            return e->id;
+        }
+    }
+}
+
+static int map_file(minilm_model *m, const char *path) {
+#ifdef _WIN32
+    m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(m->file, &size);
+    m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) {
+        CloseHandle(m->file);
+        return 0;
+    }
+    m->data = (const unsigned char *)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    m->size = (size_t)size.QuadPart;
+    return m->data != NULL;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return 0;
+    }
+    m->data = (const unsigned char *)p;
+    m->size = (size_t)st.st_size;
+    return 1;
+#endif
+}
+
+static void unmap_file(minilm_model *m) {
+    if (!m->data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+    CloseHandle(m->file);
+#else
+    munmap((void *)m->data, m->size);
+#endif
+}
+
+void minilm_free(minilm_model *m) {
+    if (!m) {
+        return;
+    }
+    unmap_file(m);
+    free(m->layers);
+    free(m->table);
+    free(m);
+}
+
+// Load a model written by native_embedder.py. Returns NULL on error.
+minilm_model *minilm_load(const char *path) {
+    minilm_model *m = (minilm_model *)calloc(1, sizeof(minilm_model));
+    if (!m) {
+        set_error("Brak pamięci");
+        return NULL;
+    }
+    if (!map_file(m, path)) {
+        set_error("Nie można otworzyć pliku modelu embeddingów");
+        free(m);
+        return NULL;
+    }
+
+    reader r = {m->data, 0, m->size, 1};
+    const char *magic = (const char *)take(&r, 8, 0);
+    if (!magic || memcmp(magic, MINILM_MAGIC, 8) != 0 || take_u32(&r) != MINILM_VERSION) {
+        set_error("Nieprawidłowy format pliku modelu embeddingów");
+        minilm_free(m);
+        return NULL;
+    }
+    m->vocab_size = (int)take_u32(&r);
+    m->hidden = (int)take_u32(&r);
+    m->n_layers = (int)take_u32(&r);
+    m->n_heads = (int)take_u32(&r);
+    m->intermediate = (int)take_u32(&r);
+    m->max_pos = (int)take_u32(&r);
+    const void *eps = take(&r, 4, 0);
+    if (eps) {
+        memcpy(&m->ln_eps, eps, 4);
+    }
+    if (!r.ok || m->vocab_size <= 0 || m->hidden <= 0 || m->n_heads <= 0 ||
+        m->hidden % m->n_heads != 0 || m->max_pos < 3) {
+        set_error("Nieprawidłowy nagłówek modelu embeddingów");
+        minilm_free(m);
+        return NULL;
+    }
+
+    m->table_size = 1;
+    while (m->table_size < (size_t)m->vocab_size * 2) {
+        m->table_size <<= 1;
+    }
+    m->table = (vocab_entry *)calloc(m->table_size, sizeof(vocab_entry));
+    m->layers = (encoder_layer *)calloc(m->n_layers, sizeof(encoder_layer));
+    if (!m->table || !m->layers) {
+        set_error("Brak pamięci");
+        minilm_free(m);
+        return NULL;
+    }
+    for (int id = 0; id < m->vocab_size && r.ok; ++id) {
+        const unsigned char *lp = (const unsigned char *)take(&r, 2, 0);
+        int len = lp ? lp[0] | (lp[1] << 8) : 0;
+        const char *text = (const char *)take(&r, len, 0);
+        if (!text) {
+            break;
+        }
+        size_t mask = m->table_size - 1;
+        size_t i = hash_bytes(text, len) & mask;
+        while (m->table[i].text) {
+            i = (i + 1) & mask;
+        }
+        m->table[i].text = text;
+        m->table[i].len = len;
+        m->table[i].id = id;
+    }
+
+    int h = m->hidden;
+    m->word_emb = (const int8_t *)take(&r, (size_t)m->vocab_size * h, 1);
+    m->word_scale = take_floats(&r, m->vocab_size);
+    m->pos_emb = take_floats(&r, (size_t)m->max_pos * h);
+    m->type_emb = take_floats(&r, h);
+    m->emb_ln_w = take_floats(&r, h);
+    m->emb_ln_b = take_floats(&r, h);
+    for (int l = 0; l < m->n_layers; ++l) {
+        encoder_layer *layer = &m->layers[l];
+        take_linear(&r, &layer->q, h, h);
+        take_linear(&r, &layer->k, h, h);
+        take_linear(&r, &layer->v, h, h);
+        take_linear(&r, &layer->o, h, h);
+        layer->attn_ln_w = take_floats(&r, h);
+        layer->attn_ln_b = take_floats(&r, h);
+        take_linear(&r, &layer->ffn_in, h, m->intermediate);
+        take_linear(&r, &layer->ffn_out, m->intermediate, h);
+        layer->out_ln_w = take_floats(&r, h);
+        layer->out_ln_b = take_floats(&r, h);
+    }
+    if (!r.ok) {
+        set_error("Plik modelu embeddingów jest niekompletny");
+        minilm_free(m);
+        return NULL;
+    }
+
+    m->cls_id = vocab_lookup(m, "[CLS]", 5);
+    m->sep_id = vocab_lookup(m, "[SEP]", 5);
+    m->unk_id = vocab_lookup(m, "[UNK]", 5);
+    if (m->cls_id < 0 || m->sep_id < 0 || m->unk_id < 0) {
+        set_error("Słownik modelu nie zawiera tokenów specjalnych");
+        minilm_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+int minilm_dim(const minilm_model *m) {
+    return m ? m->hidden : 0;
+}
+
+// Tokenization ---------------------------------------------------------------
+
+// Greedy longest-match WordPiece split of one whitespace-delimited word.
+static int wordpiece(const minilm_model *m, const char *word, int n, int *out, int cap) {
+    if (n > MINILM_MAX_WORD) {
+        if (cap > 0) {
+            out[0] = m->unk_id;
+        }
+        return 1;
+    }
+    char buf[MINILM_MAX_WORD + 3] = "##";
+    int count = 0;
+    int start = 0;
+    while (start < n) {
+        int id = -1;
+        int end = n;
+        for (; end > start; --end) {
+            if (start == 0) {
+                id = vocab_lookup(m, word, end);
+            } else {
+                memcpy(buf + 2, word + start, end - start);
+                id = vocab_lookup(m, buf, end - start + 2);
+            }
+            if (id >= 0) {
+                break;
+            }
+        }
+        if (id < 0) {
+            if (cap > 0) {
+                out[0] = m->unk_id;
+            }
+            return 1;
+        }
+        if (count < cap) {
+            out[count] = id;
+        }
+        ++count;
+        start = end;
+    }
+    return count < cap ? count : cap;
+}
+
+// Tokenize ``text`` into [CLS] ... [SEP], truncated to ``max_len`` ids.
+static int tokenize(const minilm_model *m, const char *text, int max_len, int *ids) {
+    int n = 0;
+    ids[n++] = m->cls_id;
+    const char *p = text;
+    while (*p && n < max_len - 1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            ++p;
+        }
+        const char *w = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+            ++p;
+        }
+        if (p > w) {
+            n += wordpiece(m, w, (int)(p - w), ids + n, max_len - 1 - n);
+        }
+    }
+    ids[n++] = m->sep_id;
+    return n;
+}
+
+// Kernels ----------------------------------------------------------------------
+
+static inline int32_t dot_q8(const int8_t *restrict a, const int8_t *restrict b, int n) {
+    int32_t acc = 0;
+    #pragma omp simd reduction(+:acc)
+    for (int i = 0; i < n; ++i) {
+        acc += (int16_t)a[i] * (int16_t)b[i];
+    }
+    return acc;
+}
+
+// y[rows x out] = x[rows x in] * W^T + b with x quantized per row to int8.
+static void linear_q8(const qlinear *l, const float *x, int rows, float *y, int8_t *xq) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; ++i) {
+        const float *xi = x + (size_t)i * l->in;
+        int8_t *qi = xq + (size_t)i * l->in;
+        float amax = 0.0f;
+        for (int k = 0; k < l->in; ++k) {
+            float a = fabsf(xi[k]);
+            amax = a > amax ? a : amax;
+        }
+        float xs = amax > 0.0f ? amax / 127.0f : 1.0f;
+        float inv = 1.0f / xs;
+        for (int k = 0; k < l->in; ++k) {
+            qi[k] = (int8_t)lrintf(xi[k] * inv);
+        }
+        float *yi = y + (size_t)i * l->out;
+        for (int j = 0; j < l->out; ++j) {
+            int32_t acc = dot_q8(qi, l->weight + (size_t)j * l->in, l->in);
+            yi[j] = (float)acc * xs * l->scale[j] + l->bias[j];
+        }
+    }
+}
+
+// x = LayerNorm(x + residual), row by row.
+static void add_layer_norm(float *x, const float *residual, int rows, int n,
+                           const float *w, const float *b, float eps) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; ++i) {
+        float *xi = x + (size_t)i * n;
+        if (residual) {
+            const float *ri = residual + (size_t)i * n;
+            for (int k = 0; k < n; ++k) {
+                xi[k] += ri[k];
+            }
+        }
+        float mean = 0.0f;
+        for (int k = 0; k < n; ++k) {
+            mean += xi[k];
+        }
+        mean /= n;
+        float var = 0.0f;
+        for (int k = 0; k < n; ++k) {
+            float d = xi[k] - mean;
+            var += d * d;
+        }
+        float inv = 1.0f / sqrtf(var / n + eps);
+        for (int k = 0; k < n; ++k) {
+            xi[k] = (xi[k] - mean) * inv * w[k] + b[k];
+        }
+    }
+}
+
+// Multi-head self-attention over ``batch`` sequences padded to ``seq``.
+static void attention(const minilm_model *m, const float *q, const float *k,
+                      const float *v, const int *lens, int batch, int seq, float *out) {
+    int h = m->hidden;
+    int d = h / m->n_heads;
+    float scale = 1.0f / sqrtf((float)d);
+    #pragma omp parallel
+    {
+        float *scores = (float *)malloc(sizeof(float) * seq);
+        #pragma omp for collapse(2) schedule(static)
+        for (int b = 0; b < batch; ++b) {
+            for (int head = 0; head < m->n_heads; ++head) {
+                int len = lens[b];
+                size_t base = (size_t)b * seq * h + (size_t)head * d;
+                for (int i = 0; i < len; ++i) {
+                    const float *qi = q + base + (size_t)i * h;
+                    float mx = -INFINITY;
+                    for (int j = 0; j < len; ++j) {
+                        const float *kj = k + base + (size_t)j * h;
+                        float s = 0.0f;
+                        #pragma omp simd reduction(+:s)
+                        for (int t = 0; t < d; ++t) {
+                            s += qi[t] * kj[t];
+                        }
+                        scores[j] = s * scale;
+                        mx = scores[j] > mx ? scores[j] : mx;
+                    }
+                    float sum = 0.0f;
+                    for (int j = 0; j < len; ++j) {
+                        scores[j] = expf(scores[j] - mx);
+                        sum += scores[j];
+                    }
+                    float *oi = out + base + (size_t)i * h;
+                    memset(oi, 0, sizeof(float) * d);
+                    for (int j = 0; j < len; ++j) {
+                        const float *vj = v + base + (size_t)j * h;
+                        float p = scores[j] / sum;
+                        #pragma omp simd
+                        for (int t = 0; t < d; ++t) {
+                            oi[t] += p * vj[t];
+                        }
+                    }
+                }
+            }
+        }
+        free(scores);
+    }
+}
+
+static void gelu(float *x, size_t n) {
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = 0.5f * x[i] * (1.0f + erff(x[i] * 0.70710678f));
+    }
+}
+
+// Encoding -----------------------------------------------------------------------
+
+// Embed ``n`` texts in one batch. Each text is truncated to ``max_len``
+// tokens (including [CLS]/[SEP]; <= 0 uses the model limit). Writes
+// ``n * minilm_dim()`` floats to ``out``. Returns 0 or -1 on error.
+int minilm_encode(const minilm_model *m, const char *const *texts, int n, int max_len,
+                  float *out) {
+    if (!m || !texts || !out || n < 0) {
+        set_error("Nieprawidłowe argumenty");
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (max_len <= 0 || max_len > m->max_pos) {
+        max_len = m->max_pos;
+    }
+    int h = m->hidden;
+    int *ids = (int *)malloc(sizeof(int) * (size_t)n * max_len);
+    int *lens = (int *)malloc(sizeof(int) * n);
+    if (!ids || !lens) {
+        free(ids);
+        free(lens);
+        set_error("Brak pamięci");
+        return -1;
+    }
+    int seq = 0;
+    for (int b = 0; b < n; ++b) {
+        lens[b] = tokenize(m, texts[b] ? texts[b] : "", max_len, ids + (size_t)b * max_len);
+        seq = lens[b] > seq ? lens[b] : seq;
+    }
+
+    size_t rows = (size_t)n * seq;
+    size_t widest = (size_t)(h > m->intermediate ? h : m->intermediate);
+    float *x = (float *)calloc(rows * h, sizeof(float));
+    float *q = (float *)malloc(sizeof(float) * rows * h);
+    float *k = (float *)malloc(sizeof(float) * rows * h);
+    float *v = (float *)malloc(sizeof(float) * rows * h);
+    float *ctx = (float *)calloc(rows * h, sizeof(float));
+    float *ffn = (float *)malloc(sizeof(float) * rows * m->intermediate);
+    int8_t *xq = (int8_t *)malloc(rows * widest);
+    if (!x || !q || !k || !v || !ctx || !ffn || !xq) {
+        set_error("Brak pamięci");
+        free(x); free(q); free(k); free(v); free(ctx); free(ffn); free(xq);
+        free(ids);
+        free(lens);
+        return -1;
+    }
+
+    // Padded rows stay zero and are ignored by attention and pooling.
+    for (int b = 0; b < n; ++b) {
+        for (int i = 0; i < lens[b]; ++i) {
+            int id = ids[(size_t)b * max_len + i];
+            const int8_t *we = m->word_emb + (size_t)id * h;
+            float ws = m->word_scale[id];
+            const float *pe = m->pos_emb + (size_t)i * h;
+            float *xi = x + ((size_t)b * seq + i) * h;
+            for (int t = 0; t < h; ++t) {
+                xi[t] = we[t] * ws + pe[t] + m->type_emb[t];
+            }
+        }
+    }
+    add_layer_norm(x, NULL, (int)rows, h, m->emb_ln_w, m->emb_ln_b, m->ln_eps);
+
+    for (int l = 0; l < m->n_layers; ++l) {
+        const encoder_layer *layer = &m->layers[l];
+        linear_q8(&layer->q, x, (int)rows, q, xq);
+        linear_q8(&layer->k, x, (int)rows, k, xq);
+        linear_q8(&layer->v, x, (int)rows, v, xq);
+        attention(m, q, k, v, lens, n, seq, ctx);
+        linear_q8(&layer->o, ctx, (int)rows, q, xq);
+        add_layer_norm(x, q, (int)rows, h, layer->attn_ln_w, layer->attn_ln_b, m->ln_eps);
+        linear_q8(&layer->ffn_in, x, (int)rows, ffn, xq);
+        gelu(ffn, rows * m->intermediate);
+        linear_q8(&layer->ffn_out, ffn, (int)rows, q, xq);
+        add_layer_norm(x, q, (int)rows, h, layer->out_ln_w, layer->out_ln_b, m->ln_eps);
+    }
+
+    // Mean pooling over real tokens followed by L2 normalization.
+    for (int b = 0; b < n; ++b) {
+        float *o = out + (size_t)b * h;
+        memset(o, 0, sizeof(float) * h);
+        for (int i = 0; i < lens[b]; ++i) {
+            const float *xi = x + ((size_t)b * seq + i) * h;
+            for (int t = 0; t < h; ++t) {
+                o[t] += xi[t];
+            }
+        }
+        float norm = 0.0f;
+        for (int t = 0; t < h; ++t) {
+            o[t] /= lens[b];
+            norm += o[t] * o[t];
+        }
+        norm = sqrtf(norm);
+        if (norm > 0.0f) {
+            for (int t = 0; t < h; ++t) {
+                o[t] /= norm;
+            }
+        }
+    }
+
+    free(x); free(q); free(k); free(v); free(ctx); free(ffn); free(xq);
+    free(ids);
+    free(lens);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Perceptual hashes of rasterized pages for the page-level OCR cache
+// (page_cache.py).
+//
+// The grayscale page is reduced to a 32x32 thumbnail by averaging equal
+// integer blocks of pixels. From the thumbnail two 64-bit hashes are taken:
+// dHash compares neighbouring cells of a 9x8 grid and pHash thresholds the
+// 8x8 lowest frequencies of a DCT at their median. Everything is computed in
+// integers so the Python fallback gives bit-identical results.
+
+#define THUMB 32
+#define LOW 8
+#define COS_SCALE 4096.0
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Cosines of the 8 lowest DCT-II frequencies, scaled to integers. Filled per
+// call: 256 values are cheap next to the thumbnail and need no locking.
+static void cos_table(int64_t tab[LOW][THUMB]) {
+    for (int u = 0; u < LOW; ++u)
+        for (int x = 0; x < THUMB; ++x)
+            tab[u][x] = (int64_t)floor(COS_SCALE * cos((2 * x + 1) * u * M_PI / (2 * THUMB)) + 0.5);
+}
+
+// Average gray value, rounded, of each of the 32x32 blocks the page is split
+// into.
+// Block (by, bx) covers rows [by*h/32, (by+1)*h/32) and likewise columns.
+static void thumbnail(const uint8_t *gray, int width, int height, int stride,
+                      uint8_t *thumb) {
+    for (int by = 0; by < THUMB; ++by) {
+        int y0 = (int)((int64_t)by * height / THUMB);
+        int y1 = (int)((int64_t)(by + 1) * height / THUMB);
+        uint64_t sums[THUMB] = {0};
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t *row = gray + (size_t)y * stride;
+            for (int bx = 0; bx < THUMB; ++bx) {
+                int x0 = (int)((int64_t)bx * width / THUMB);
+                int x1 = (int)((int64_t)(bx + 1) * width / THUMB);
+                uint64_t s = 0;
+                for (int x = x0; x < x1; ++x)
+                    s += row[x];
+                sums[bx] += s;
+            }
+        }
+        for (int bx = 0; bx < THUMB; ++bx) {
+            int x0 = (int)((int64_t)bx * width / THUMB);
+            int x1 = (int)((int64_t)(bx + 1) * width / THUMB);
+            uint64_t n = (uint64_t)(y1 - y0) * (x1 - x0);
+            thumb[by * THUMB + bx] = (uint8_t)((sums[bx] + n / 2) / n);
+        }
+    }
+}
+
+// Bit r*8+c is set when cell c+1 of row r of a 9x8 grid is brighter than
+// cell c. Cells have unequal widths, so means are compared cross-multiplied.
+static uint64_t dhash(const uint8_t *thumb) {
+    uint64_t h = 0;
+    for (int r = 0; r < 8; ++r) {
+        int64_t sums[9] = {0};
+        int64_t widths[9];
+        for (int c = 0; c < 9; ++c) {
+            int x0 = c * THUMB / 9, x1 = (c + 1) * THUMB / 9;
+            widths[c] = x1 - x0;
+            for (int y = r * 4; y < r * 4 + 4; ++y)
+                for (int x = x0; x < x1; ++x)
+                    sums[c] += thumb[y * THUMB + x];
+        }
+        for (int c = 0; c < 8; ++c)
+            if (sums[c + 1] * widths[c] > sums[c] * widths[c + 1])
+                h |= (uint64_t)1 << (r * 8 + c);
+    }
+    return h;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Bit u*8+v is set when DCT coefficient (u, v) exceeds the median of the 63
+// non-DC coefficients; the DC bit is always clear.
+static uint64_t phash(const uint8_t *thumb) {
+    int64_t rows[THUMB][LOW];
+    int64_t coeffs[LOW * LOW];
+    int64_t sorted[LOW * LOW - 1];
+    int64_t cos_tab[LOW][THUMB];
+    cos_table(cos_tab);
+    for (int y = 0; y < THUMB; ++y)
+        for (int v = 0; v < LOW; ++v) {
+            int64_t s = 0;
+            for (int x = 0; x < THUMB; ++x)
+                s += thumb[y * THUMB + x] * cos_tab[v][x];
+            rows[y][v] = s;
+        }
+    for (int u = 0; u < LOW; ++u)
+        for (int v = 0; v < LOW; ++v) {
+            int64_t s = 0;
+            for (int y = 0; y < THUMB; ++y)
+                s += cos_tab[u][y] * rows[y][v];
+            coeffs[u * LOW + v] = s;
+        }
+    for (int k = 1; k < LOW * LOW; ++k)
+        sorted[k - 1] = coeffs[k];
+    qsort(sorted, LOW * LOW - 1, sizeof(int64_t), cmp_i64);
+    int64_t median = sorted[(LOW * LOW - 1) / 2];
+    uint64_t h = 0;
+    for (int k = 1; k < LOW * LOW; ++k)
+        if (coeffs[k] > median)
+            h |= (uint64_t)1 << k;
+    return h;
+}
+
+// Hash a grayscale page of width x height pixels whose rows start stride
+// bytes apart. Writes dHash to out[0] and pHash to out[1]; returns -1 for
+// pages smaller than the thumbnail.
+int page_hash(const uint8_t *gray, int width, int height, int stride, uint64_t *out) {
+    uint8_t thumb[THUMB * THUMB];
+    if (width < THUMB || height < THUMB || stride < width)
+        return -1;
+    thumbnail(gray, width, height, stride, thumb);
+    out[0] = dhash(thumb);
+    out[1] = phash(thumb);
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SimHash fingerprints and a multi-index Hamming table for near-duplicate
+// detection of incoming scans (near_duplicates.py).
+//
+// A fingerprint is the 64-bit Charikar SimHash of the word shingles of a
+// document. Fingerprints within Hamming distance k are found with the
+// pigeonhole principle: the 64 bits are split into k + 1 blocks and two
+// fingerprints within distance k agree exactly on at least one block, so
+// every block has a hash table from block value to fingerprints and only
+// those candidates are compared.
+
+#define MAX_BLOCKS 8
+
+// FNV-1a over the shingle bytes followed by the MurmurHash3 finalizer, which
+// spreads FNV's weak high bits over the whole word.
+static uint64_t hash_bytes(const unsigned char *s, int len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < len; ++i) {
+        h ^= s[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// SimHash of the shingles of n_tokens words. Words are stored in text
+// separated by single spaces; word i starts at offsets[i] and offsets[n_tokens]
+// is the text length plus one. Shingles are `shingle` consecutive words
+// including the spaces between them; with fewer words the whole text is one
+// feature.
+uint64_t simhash_tokens(const char *text, const int *offsets, int n_tokens, int shingle) {
+    int counts[64] = {0};
+    if (n_tokens <= 0)
+        return 0;
+    if (shingle < 1)
+        shingle = 1;
+    if (shingle > n_tokens)
+        shingle = n_tokens;
+    for (int i = 0; i + shingle <= n_tokens; ++i) {
+        int start = offsets[i], end = offsets[i + shingle] - 1;
+        uint64_t h = hash_bytes((const unsigned char *)text + start, end - start);
+        for (int b = 0; b < 64; ++b)
+            counts[b] += (h >> b) & 1 ? 1 : -1;
+    }
+    uint64_t fp = 0;
+    for (int b = 0; b < 64; ++b)
+        if (counts[b] > 0)
+            fp |= (uint64_t)1 << b;
+    return fp;
+}
+
+// ---------------------------------------------------------------------------
+// Multi-index Hamming table
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint64_t *keys;  // block value per slot
+    int32_t *heads;  // newest entry with that block value, -1 for empty slot
+    uint32_t mask;
+    uint32_t used;
+} Table;
+
+typedef struct {
+    int max_distance;
+    int n_blocks;
+    int shift[MAX_BLOCKS];
+    uint64_t block_mask[MAX_BLOCKS];
+    Table tables[MAX_BLOCKS];
+    int32_t *next;   // n_blocks links per entry
+    uint64_t *fps;
+    int len;
+    int cap;
+} SimIndex;
+
+static inline uint64_t block_of(const SimIndex *idx, uint64_t fp, int b) {
+    return (fp >> idx->shift[b]) & idx->block_mask[b];
+}
+
+static inline uint32_t slot_hash(uint64_t key) {
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(key >> 32);
+}
+
+static int table_init(Table *t, uint32_t size) {
+    t->keys = (uint64_t *)malloc((size_t)size * sizeof(uint64_t));
+    t->heads = (int32_t *)malloc((size_t)size * sizeof(int32_t));
+    if (!t->keys || !t->heads)
+        return -1;
+    memset(t->heads, 0xFF, (size_t)size * sizeof(int32_t));
+    t->mask = size - 1;
+    t->used = 0;
+    return 0;
+}
+
+static uint32_t table_find(const Table *t, uint64_t key) {
+    uint32_t i = slot_hash(key) & t->mask;
+    while (t->heads[i] >= 0 && t->keys[i] != key)
+        i = (i + 1) & t->mask;
+    return i;
+}
+
+static int table_grow(Table *t) {
+    Table bigger;
+    if (table_init(&bigger, (t->mask + 1) * 2) < 0) {
+        free(bigger.keys);
+        free(bigger.heads);
+        return -1;
+    }
+    for (uint32_t i = 0; i <= t->mask; ++i) {
+        if (t->heads[i] < 0)
+            continue;
+        uint32_t j = table_find(&bigger, t->keys[i]);
+        bigger.keys[j] = t->keys[i];
+        bigger.heads[j] = t->heads[i];
+    }
+    bigger.used = t->used;
+    free(t->keys);
+    free(t->heads);
+    *t = bigger;
+    return 0;
+}
+
+void simindex_free(SimIndex *idx) {
+    if (!idx)
+        return;
+    for (int b = 0; b < idx->n_blocks; ++b) {
+        free(idx->tables[b].keys);
+        free(idx->tables[b].heads);
+    }
+    free(idx->next);
+    free(idx->fps);
+    free(idx);
+}
+
+// Create a table answering queries up to max_distance (0..7) bits.
+SimIndex *simindex_new(int max_distance) {
+    if (max_distance < 0 || max_distance >= MAX_BLOCKS)
+        return NULL;
+    SimIndex *idx = (SimIndex *)calloc(1, sizeof(SimIndex));
+    if (!idx)
+        return NULL;
+    idx->max_distance = max_distance;
+    idx->n_blocks = max_distance + 1;
+    int shift = 0;
+    for (int b = 0; b < idx->n_blocks; ++b) {
+        // Bloki różnią się długością najwyżej o jeden bit
+        int width = 64 / idx->n_blocks + (b < 64 % idx->n_blocks);
+        idx->shift[b] = shift;
+        idx->block_mask[b] = width == 64 ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
+        shift += width;
+        if (table_init(&idx->tables[b], 1024) < 0) {
+            idx->n_blocks = b + 1;
+            simindex_free(idx);
+            return NULL;
+        }
+    }
+    return idx;
+}
+
+// Add a fingerprint; returns its id (0, 1, 2, ... in insertion order) or -1.
+int simindex_add(SimIndex *idx, uint64_t fp) {
+    if (idx->len == idx->cap) {
+        int cap = idx->cap ? idx->cap * 2 : 1024;
+        uint64_t *fps = (uint64_t *)realloc(idx->fps, (size_t)cap * sizeof(uint64_t));
+        if (!fps)
+            return -1;
+        idx->fps = fps;
+        int32_t *next =
+            (int32_t *)realloc(idx->next, (size_t)cap * idx->n_blocks * sizeof(int32_t));
+        if (!next)
+            return -1;
+        idx->next = next;
+        idx->cap = cap;
+    }
+    int id = idx->len;
+    for (int b = 0; b < idx->n_blocks; ++b) {
+        Table *t = &idx->tables[b];
+        if ((t->used + 1) * 4 > (t->mask + 1) * 3 && table_grow(t) < 0)
+            return -1;
+        uint64_t key = block_of(idx, fp, b);
+        uint32_t slot = table_find(t, key);
+        if (t->heads[slot] < 0) {
+            t->keys[slot] = key;
+            t->used++;
+        }
+        idx->next[(size_t)id * idx->n_blocks + b] = t->heads[slot];
+        t->heads[slot] = id;
+    }
+    idx->fps[id] = fp;
+    idx->len++;
+    return id;
+}
+
+// Add n fingerprints; returns the number added.
+int simindex_add_many(SimIndex *idx, const uint64_t *fps, int n) {
+    for (int i = 0; i < n; ++i)
+        if (simindex_add(idx, fps[i]) < 0)
+            return i;
+    return n;
+}
+
+// Find fingerprints within max_distance (at most the table's distance) of fp.
+// Writes up to cap (id, distance) pairs to out_ids/out_dists and returns the
+// total number found.
+int simindex_query(const SimIndex *idx, uint64_t fp, int max_distance, int *out_ids,
+                   int *out_dists, int cap) {
+    if (max_distance > idx->max_distance)
+        max_distance = idx->max_distance;
+    int found = 0;
+    for (int b = 0; b < idx->n_blocks; ++b) {
+        const Table *t = &idx->tables[b];
+        uint64_t key = block_of(idx, fp, b);
+        uint32_t slot = table_find(t, key);
+        for (int32_t e = t->heads[slot]; e >= 0; e = idx->next[(size_t)e * idx->n_blocks + b]) {
+            uint64_t other = idx->fps[e];
+            // Kandydat zgodny także na wcześniejszym bloku został już zgłoszony
+            int seen = 0;
+            for (int p = 0; p < b && !seen; ++p)
+                seen = block_of(idx, other, p) == block_of(idx, fp, p);
+            if (seen)
+                continue;
+            int dist = __builtin_popcountll(other ^ fp);
+            if (dist > max_distance)
+                continue;
+            if (found < cap) {
+                out_ids[found] = e;
+                out_dists[found] = dist;
+            }
+            ++found;
+        }
+    }
+    return found;
+}
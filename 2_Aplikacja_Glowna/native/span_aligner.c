@@ -0,0 +1,348 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Multi-pattern entity span aligner for NER training data.
+//
+// All entity values of one document are located in a single call: exact
+// occurrences with an Aho-Corasick automaton over every pattern, then
+// approximate occurrences within a per-pattern edit distance using Myers'
+// bit-parallel search (patterns up to 64 code points). Candidates are chosen
+// greedily by pattern length minus errors, so a long value read with a few
+// OCR errors still wins over a short exact value inside it; the returned
+// spans never overlap and can be assigned to spaCy's doc.ents directly.
+//
+// Text and patterns are UTF-32 code points, so offsets equal Python str
+// indices. See native_aligner.py for the ctypes wrapper.
+
+typedef struct {
+    int start;
+    int end;
+    int pattern;
+    int cost;
+    int weight; // pattern length - cost
+} Candidate;
+
+typedef struct {
+    Candidate *items;
+    size_t len;
+    size_t cap;
+} CandidateList;
+
+static int push_candidate(CandidateList *list, int start, int end, int pattern, int m,
+                          int cost) {
+    if (list->len == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        Candidate *items = (Candidate *)realloc(list->items, cap * sizeof(Candidate));
+        if (!items)
+            return -1;
+        list->items = items;
+        list->cap = cap;
+    }
+    Candidate c = {start, end, pattern, cost, m - cost};
+    list->items[list->len++] = c;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Aho-Corasick (exact matches)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint32_t ch;
+    int child;   // first child
+    int sibling; // next child of the same parent
+    int fail;
+    int out;     // pattern ending at this node or -1
+    int dict;    // nearest node on the fail chain with out >= 0, or -1
+} Node;
+
+typedef struct {
+    Node *nodes;
+    int len;
+    int cap;
+} Trie;
+
+static int trie_new_node(Trie *t, uint32_t ch) {
+    if (t->len == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 256;
+        Node *nodes = (Node *)realloc(t->nodes, (size_t)cap * sizeof(Node));
+        if (!nodes)
+            return -1;
+        t->nodes = nodes;
+        t->cap = cap;
+    }
+    Node n = {ch, -1, -1, 0, -1, -1};
+    t->nodes[t->len] = n;
+    return t->len++;
+}
+
+static int trie_child(const Trie *t, int node, uint32_t ch) {
+    for (int c = t->nodes[node].child; c >= 0; c = t->nodes[c].sibling)
+        if (t->nodes[c].ch == ch)
+            return c;
+    return -1;
+}
+
+static int trie_build(Trie *t, const uint32_t *patterns, const int *offsets, int n_patterns) {
+    if (trie_new_node(t, 0) < 0)
+        return -1;
+    for (int p = 0; p < n_patterns; ++p) {
+        int node = 0;
+        for (int i = offsets[p]; i < offsets[p + 1]; ++i) {
+            int next = trie_child(t, node, patterns[i]);
+            if (next < 0) {
+                next = trie_new_node(t, patterns[i]);
+                if (next < 0)
+                    return -1;
+                t->nodes[next].sibling = t->nodes[node].child;
+                t->nodes[node].child = next;
+            }
+            node = next;
+        }
+        if (node > 0 && t->nodes[node].out < 0)
+            t->nodes[node].out = p;
+    }
+
+    // Failure links in breadth-first order
+    int *queue = (int *)malloc((size_t)t->len * sizeof(int));
+    if (!queue)
+        return -1;
+    int head = 0, tail = 0;
+    for (int c = t->nodes[0].child; c >= 0; c = t->nodes[c].sibling)
+        queue[tail++] = c;
+    while (head < tail) {
+        int u = queue[head++];
+        for (int v = t->nodes[u].child; v >= 0; v = t->nodes[v].sibling) {
+            uint32_t ch = t->nodes[v].ch;
+            int f = t->nodes[u].fail;
+            int target = trie_child(t, f, ch);
+            while (f > 0 && target < 0) {
+                f = t->nodes[f].fail;
+                target = trie_child(t, f, ch);
+            }
+            int fail = target >= 0 ? target : 0;
+            t->nodes[v].fail = fail;
+            t->nodes[v].dict = t->nodes[fail].out >= 0 ? fail : t->nodes[fail].dict;
+            queue[tail++] = v;
+        }
+    }
+    free(queue);
+    return 0;
+}
+
+static int exact_matches(const Trie *t, const uint32_t *text, int text_len, const int *offsets,
+                         CandidateList *out) {
+    int state = 0;
+    for (int i = 0; i < text_len; ++i) {
+        int next = trie_child(t, state, text[i]);
+        while (state > 0 && next < 0) {
+            state = t->nodes[state].fail;
+            next = trie_child(t, state, text[i]);
+        }
+        state = next >= 0 ? next : 0;
+        int hit = t->nodes[state].out >= 0 ? state : t->nodes[state].dict;
+        for (; hit >= 0; hit = t->nodes[hit].dict) {
+            int p = t->nodes[hit].out;
+            int len = offsets[p + 1] - offsets[p];
+            if (push_candidate(out, i + 1 - len, i + 1, p, len, 0) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Myers bit-parallel approximate search
+// ---------------------------------------------------------------------------
+
+static int is_space(uint32_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v' || c == 0xA0;
+}
+
+// Start of the best alignment of pattern that ends exactly at text[end - 1].
+// Computes the edit distance of the reversed pattern against every reversed
+// text suffix of length up to m + k and prefers the length closest to m.
+static int match_start(const uint32_t *text, int end, const uint32_t *pat, int m, int k,
+                       int *row, int *prev) {
+    int width = m + k < end ? m + k : end;
+    for (int l = 0; l <= width; ++l)
+        prev[l] = l;
+    for (int i = 1; i <= m; ++i) {
+        uint32_t pc = pat[m - i];
+        row[0] = i;
+        for (int l = 1; l <= width; ++l) {
+            int cost = prev[l - 1] + (text[end - l] != pc);
+            int del = prev[l] + 1;
+            int ins = row[l - 1] + 1;
+            int best = cost < del ? cost : del;
+            row[l] = best < ins ? best : ins;
+        }
+        int *tmp = prev;
+        prev = row;
+        row = tmp;
+    }
+    int best_len = 0;
+    for (int l = 1; l <= width; ++l) {
+        int d = abs(l - m), best_d = abs(best_len - m);
+        if (prev[l] < prev[best_len] || (prev[l] == prev[best_len] && d < best_d))
+            best_len = l;
+    }
+    return end - best_len;
+}
+
+static int fuzzy_matches(const uint32_t *text, int text_len, const uint32_t *pat, int m, int k,
+                         int pattern, CandidateList *out) {
+    // Pattern alphabet with one match mask per distinct code point
+    uint32_t chars[64];
+    uint64_t masks[64];
+    int n_chars = 0;
+    for (int i = 0; i < m; ++i) {
+        int c = 0;
+        while (c < n_chars && chars[c] != pat[i])
+            ++c;
+        if (c == n_chars) {
+            chars[n_chars] = pat[i];
+            masks[n_chars++] = 0;
+        }
+        masks[c] |= (uint64_t)1 << i;
+    }
+
+    int *rows = (int *)malloc((size_t)(m + k + 1) * 2 * sizeof(int));
+    if (!rows)
+        return -1;
+
+    uint64_t high = (uint64_t)1 << (m - 1);
+    uint64_t pv = ~(uint64_t)0, mv = 0;
+    int score = m;
+    int run_best = -1, run_score = 0;
+    for (int j = 0; j <= text_len; ++j) {
+        if (j < text_len) {
+            uint64_t eq = 0;
+            for (int c = 0; c < n_chars; ++c) {
+                if (chars[c] == text[j]) {
+                    eq = masks[c];
+                    break;
+                }
+            }
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & high)
+                ++score;
+            else if (mh & high)
+                --score;
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        if (j < text_len && score <= k) {
+            // Keep the end with the fewest errors within a run of hits
+            if (run_best < 0 || score < run_score) {
+                run_best = j;
+                run_score = score;
+            }
+            continue;
+        }
+        if (run_best >= 0) {
+            int end = run_best + 1;
+            int start = match_start(text, end, pat, m, k, rows, rows + m + k + 1);
+            while (start < end && is_space(text[start]))
+                ++start;
+            while (end > start && is_space(text[end - 1]))
+                --end;
+            if (end > start && push_candidate(out, start, end, pattern, m, run_score) < 0) {
+                free(rows);
+                return -1;
+            }
+            run_best = -1;
+        }
+    }
+    free(rows);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Selection
+// ---------------------------------------------------------------------------
+
+static int by_priority(const void *a, const void *b) {
+    const Candidate *x = (const Candidate *)a, *y = (const Candidate *)b;
+    if (x->weight != y->weight)
+        return y->weight - x->weight;
+    if (x->cost != y->cost)
+        return x->cost - y->cost;
+    int lx = x->end - x->start, ly = y->end - y->start;
+    if (lx != ly)
+        return ly - lx;
+    if (x->start != y->start)
+        return x->start - y->start;
+    return x->pattern - y->pattern;
+}
+
+static int by_start(const void *a, const void *b) {
+    const Candidate *x = (const Candidate *)a, *y = (const Candidate *)b;
+    return x->start - y->start;
+}
+
+// Find non-overlapping spans of the patterns in text.
+//   patterns/offsets: pattern p is patterns[offsets[p] .. offsets[p + 1])
+//   max_errors:       allowed edit distance per pattern (0 = exact only);
+//                     fuzzy search applies to patterns of at most 64 chars
+//   out:              receives (start, end, pattern) triples, at most
+//                     out_capacity of them, ordered by start
+// Returns the number of spans found (may exceed out_capacity) or -1 on
+// allocation failure.
+int align_spans(const uint32_t *text, int text_len, const uint32_t *patterns, const int *offsets,
+                int n_patterns, const int *max_errors, int *out, int out_capacity) {
+    CandidateList cands = {NULL, 0, 0};
+    Trie trie = {NULL, 0, 0};
+    int result = -1;
+
+    if (trie_build(&trie, patterns, offsets, n_patterns) < 0)
+        goto done;
+    if (exact_matches(&trie, text, text_len, offsets, &cands) < 0)
+        goto done;
+    for (int p = 0; p < n_patterns; ++p) {
+        int m = offsets[p + 1] - offsets[p];
+        int k = max_errors ? max_errors[p] : 0;
+        if (k >= m)
+            k = m - 1;
+        if (k <= 0 || m > 64)
+            continue;
+        if (fuzzy_matches(text, text_len, patterns + offsets[p], m, k, p, &cands) < 0)
+            goto done;
+    }
+
+    qsort(cands.items, cands.len, sizeof(Candidate), by_priority);
+    unsigned char *taken = (unsigned char *)calloc((size_t)text_len + 1, 1);
+    if (!taken)
+        goto done;
+    size_t kept = 0;
+    for (size_t i = 0; i < cands.len; ++i) {
+        Candidate c = cands.items[i];
+        int free_span = 1;
+        for (int j = c.start; j < c.end && free_span; ++j)
+            free_span = !taken[j];
+        if (!free_span)
+            continue;
+        memset(taken + c.start, 1, (size_t)(c.end - c.start));
+        cands.items[kept++] = c;
+    }
+    free(taken);
+
+    qsort(cands.items, kept, sizeof(Candidate), by_start);
+    for (size_t i = 0; i < kept && (int)i < out_capacity; ++i) {
+        out[3 * i] = cands.items[i].start;
+        out[3 * i + 1] = cands.items[i].end;
+        out[3 * i + 2] = cands.items[i].pattern;
+    }
+    result = (int)kept;
+
+done:
+    free(cands.items);
+    free(trie.nodes);
+    return result;
+}
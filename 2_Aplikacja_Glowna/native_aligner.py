@@ -0,0 +1,154 @@
+"""Entity span alignment for NER training data (``native/span_aligner.c``).
+
+All spreadsheet values of a document are located in one call: exact matches
+with Aho-Corasick and, for values long enough, approximate matches within a
+small edit distance so that OCR noise ("Kowa1ski", "ACME  Sp.") does not hide
+the entity.  The returned character spans never overlap and can be passed to
+``Doc.char_span`` directly.
+
+Without the compiled library only exact matches are found, with the same
+longest-first, non-overlapping selection.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import logging
+import re
+from array import array
+from typing import List, Sequence, Tuple, Union
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Dopuszczalna liczba błędów OCR: jeden na każde 5 znaków, najwyżej 3
+CHARS_PER_ERROR = 5
+MAX_ERRORS = 3
+
+_IntPtr = ctypes.POINTER(ctypes.c_int)
+_UIntPtr = ctypes.POINTER(ctypes.c_uint32)
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.align_spans.argtypes = [
+        _UIntPtr,
+        ctypes.c_int,
+        _UIntPtr,
+        _IntPtr,
+        ctypes.c_int,
+        _IntPtr,
+        _IntPtr,
+        ctypes.c_int,
+    ]
+    lib.align_spans.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("span_aligner", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native aligner can be used."""
+    return _library.is_available()
+
+
+def default_max_errors(pattern: str) -> int:
+    """Edit distance allowed for ``pattern``; short values must match exactly."""
+    return min(MAX_ERRORS, len(pattern) // CHARS_PER_ERROR)
+
+
+def _fold(text: str) -> str:
+    """Lowercase ``text`` when that keeps character offsets unchanged."""
+    lowered = text.lower()
+    return lowered if len(lowered) == len(text) else text
+
+
+def _code_points(text: str) -> array:
+    buf = array("I")
+    buf.frombytes(text.encode("utf-32-le"))
+    return buf
+
+
+def _pointer(buf: array, ctype):
+    address, _ = buf.buffer_info()
+    return ctypes.cast(address, ctypes.POINTER(ctype))
+
+
+def _exact_spans(text: str, patterns: Sequence[str]) -> List[Tuple[int, int, int]]:
+    """Fallback: non-overlapping exact matches, longest pattern first."""
+    index = {}
+    for i, pattern in enumerate(patterns):
+        if pattern:
+            index.setdefault(pattern, i)
+    if not index:
+        return []
+    regex = re.compile(
+        "|".join(re.escape(p) for p in sorted(index, key=len, reverse=True))
+    )
+    return [(m.start(), m.end(), index[m.group()]) for m in regex.finditer(text)]
+
+
+def align_spans(
+    text: str,
+    patterns: Sequence[str],
+    max_errors: Union[None, int, Sequence[int]] = None,
+    ignore_case: bool = True,
+) -> List[Tuple[int, int, int]]:
+    """Locate ``patterns`` in ``text``.
+
+    Args:
+        text: OCR text of the document.
+        patterns: Entity values to find.
+        max_errors: Allowed edit distance, either one value for all patterns
+            or one per pattern; ``None`` uses :func:`default_max_errors`.
+        ignore_case: Compare case-insensitively.
+
+    Returns:
+        ``(start, end, pattern_index)`` spans ordered by ``start``.  Where
+        matches overlap, the one with the highest pattern length minus
+        errors is kept (exact matches first on ties).
+    """
+    if not text or not patterns:
+        return []
+    if ignore_case:
+        text = _fold(text)
+        patterns = [_fold(p) for p in patterns]
+
+    lib = _library.load()
+    if lib is None:
+        return _exact_spans(text, patterns)
+
+    if max_errors is None:
+        errors = [default_max_errors(p) for p in patterns]
+    elif isinstance(max_errors, int):
+        errors = [max_errors] * len(patterns)
+    else:
+        errors = list(max_errors)
+
+    text_buf = _code_points(text)
+    pattern_buf = array("I")
+    offsets = array("i", [0])
+    for pattern in patterns:
+        pattern_buf.extend(_code_points(pattern))
+        offsets.append(len(pattern_buf))
+    if not pattern_buf:
+        return []
+    errors_buf = array("i", errors)
+    # Zakresy nie nakładają się, więc jest ich najwyżej tyle, ile znaków tekstu
+    capacity = len(text_buf)
+    out = array("i", [0]) * (3 * capacity)
+
+    count = lib.align_spans(
+        _pointer(text_buf, ctypes.c_uint32),
+        len(text_buf),
+        _pointer(pattern_buf, ctypes.c_uint32),
+        _pointer(offsets, ctypes.c_int),
+        len(patterns),
+        _pointer(errors_buf, ctypes.c_int),
+        _pointer(out, ctypes.c_int),
+        capacity,
+    )
+    if count < 0:
+        logger.warning("Natywne dopasowanie encji nie powiodło się, tylko dokładne dopasowania")
+        return _exact_spans(text, patterns)
+    return [(out[3 * i], out[3 * i + 1], out[3 * i + 2]) for i in range(count)]
@@ -0,0 +1,367 @@
+"""Native int8 sentence-embedding engine (``native/minilm.c``).
+
+Replaces the torch ``SentenceTransformer`` for MiniLM/BERT-class models: the
+weights are stored as int8 in one memory-mapped file, a whole batch of texts
+is embedded in a single call and the resulting float matrix is passed
+unchanged to the top-k kernel of ``native/fast_similarity.c``.
+
+The model file is produced once from a sentence-transformers directory::
+
+    python native_embedder.py convert all-MiniLM-L6-v2/ minilm-l6-int8.bin
+"""
+
+from __future__ import annotations
+
+import ctypes
+import logging
+import os
+import struct
+import sys
+import unicodedata
+from typing import Iterable, List, Optional, Sequence, Tuple
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Domyślne położenie skonwertowanego modelu
+DEFAULT_MODEL_PATH = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "embedding_model", "minilm-l6-int8.bin"
+)
+
+_MAGIC = b"MINILM8\0"
+_VERSION = 1
+_ALIGN = 32
+
+_FloatPtr = ctypes.POINTER(ctypes.c_float)
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.minilm_last_error.argtypes = []
+    lib.minilm_last_error.restype = ctypes.c_char_p
+    lib.minilm_load.argtypes = [ctypes.c_char_p]
+    lib.minilm_load.restype = ctypes.c_void_p
+    lib.minilm_free.argtypes = [ctypes.c_void_p]
+    lib.minilm_free.restype = None
+    lib.minilm_dim.argtypes = [ctypes.c_void_p]
+    lib.minilm_dim.restype = ctypes.c_int
+    lib.minilm_encode.argtypes = [
+        ctypes.c_void_p,
+        ctypes.POINTER(ctypes.c_char_p),
+        ctypes.c_int,
+        ctypes.c_int,
+        _FloatPtr,
+    ]
+    lib.minilm_encode.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("minilm", _configure)
+
+
+def _configure_similarity(lib: ctypes.CDLL) -> None:
+    # Starsza kompilacja bez jąder wsadowych nie jest używana
+    lib.cosine_top_kf.argtypes = [
+        _FloatPtr,
+        _FloatPtr,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_int),
+        _FloatPtr,
+    ]
+    lib.cosine_top_kf.restype = ctypes.c_int
+
+
+_similarity = native_lib.NativeLibrary("fast_similarity", _configure_similarity)
+
+
+def is_available(model_path: str = DEFAULT_MODEL_PATH) -> bool:
+    """Return ``True`` when the library is built and ``model_path`` exists."""
+    return os.path.exists(model_path) and _library.is_available()
+
+
+def normalize_text(text: str) -> str:
+    """Apply BERT's uncased basic tokenization.
+
+    Lowercases, strips accents, drops control characters and separates
+    punctuation with spaces, so the native side only needs WordPiece.
+    """
+    text = unicodedata.normalize("NFD", text.lower())
+    out: List[str] = []
+    for ch in text:
+        cat = unicodedata.category(ch)
+        if cat == "Mn" or ch in "\x00�":
+            continue
+        if ch in " \t\n\r" or cat == "Zs":
+            out.append(" ")
+        elif cat.startswith("C"):
+            continue
+        elif cat.startswith("P") or (ch.isascii() and not ch.isalnum()):
+            out.append(f" {ch} ")
+        elif 0x4E00 <= ord(ch) <= 0x9FFF:
+            out.append(f" {ch} ")
+        else:
+            out.append(ch)
+    return "".join(out)
+
+
+class EmbeddingMatrix:
+    """Row-major float32 embeddings kept in a ctypes buffer."""
+
+    def __init__(self, buffer: ctypes.Array, rows: int, dim: int) -> None:
+        self.buffer = buffer
+        self.rows = rows
+        self.dim = dim
+
+    def __len__(self) -> int:
+        return self.rows
+
+    def __getitem__(self, index: int) -> List[float]:
+        if index < 0:
+            index += self.rows
+        if not 0 <= index < self.rows:
+            raise IndexError(index)
+        return self.buffer[index * self.dim : (index + 1) * self.dim]
+
+    def row_pointer(self, index: int):
+        """Return a ``float *`` to row ``index`` without copying."""
+        offset = index * self.dim * ctypes.sizeof(ctypes.c_float)
+        return ctypes.cast(ctypes.addressof(self.buffer) + offset, _FloatPtr)
+
+    def tolist(self) -> List[List[float]]:
+        return [self[i] for i in range(self.rows)]
+
+
+class NativeSentenceEncoder:
+    """Drop-in replacement for ``SentenceTransformer`` backed by ``minilm.c``."""
+
+    def __init__(self, model_path: str = DEFAULT_MODEL_PATH, max_length: int = 256) -> None:
+        """Map the int8 model file.
+
+        Args:
+            model_path: File produced by :func:`convert_sentence_transformer`.
+            max_length: Maximum number of tokens per text (MiniLM default 256).
+
+        Raises:
+            OSError: If the native library is not built.
+            RuntimeError: If the model file cannot be loaded.
+        """
+        lib = _library.load()
+        if lib is None:
+            raise OSError(f"Brak biblioteki {_library.path}")
+        self._lib = lib
+        self.max_length = max_length
+        self._handle = lib.minilm_load(model_path.encode("utf-8"))
+        if not self._handle:
+            raise RuntimeError(lib.minilm_last_error().decode("utf-8", errors="replace"))
+        self._dim = lib.minilm_dim(self._handle)
+
+    def get_sentence_embedding_dimension(self) -> int:
+        return self._dim
+
+    def encode_buffer(self, texts: Sequence[str]) -> EmbeddingMatrix:
+        """Embed ``texts`` in one native call and keep the result native."""
+        if isinstance(texts, str):
+            texts = [texts]
+        n = len(texts)
+        encoded = (ctypes.c_char_p * max(n, 1))(
+            *[normalize_text(t).encode("utf-8") for t in texts]
+        )
+        out = (ctypes.c_float * (max(n, 1) * self._dim))()
+        if self._lib.minilm_encode(self._handle, encoded, n, self.max_length, out) != 0:
+            raise RuntimeError(self._lib.minilm_last_error().decode("utf-8", errors="replace"))
+        return EmbeddingMatrix(out, n, self._dim)
+
+    def encode(self, texts, convert_to_numpy: bool = False):
+        """Return L2-normalized embeddings, mirroring ``SentenceTransformer.encode``."""
+        vectors = self.encode_buffer(texts).tolist()
+        if convert_to_numpy:
+            import numpy as np
+
+            return np.asarray(vectors, dtype=np.float32)
+        return vectors
+
+    def close(self) -> None:
+        if self._handle:
+            self._lib.minilm_free(self._handle)
+            self._handle = None
+
+    def __del__(self) -> None:  # pragma: no cover - depends on GC timing
+        try:
+            self.close()
+        except Exception:
+            pass
+
+
+def top_k_similar(
+    matrix: EmbeddingMatrix, query_index: int, k: int, rows: Optional[int] = None
+) -> List[Tuple[int, float]]:
+    """Return ``(row, cosine)`` for the ``k`` rows closest to row ``query_index``.
+
+    Only the first ``rows`` rows (default: all) are searched.  Uses the
+    native top-k kernel when ``fast_similarity`` is built.
+    """
+    rows = matrix.rows if rows is None else rows
+    query = matrix.row_pointer(query_index)
+    lib = _similarity.load()
+    if lib is not None and rows > 0:
+        indices = (ctypes.c_int * k)()
+        scores = (ctypes.c_float * k)()
+        count = lib.cosine_top_kf(
+            query, matrix.row_pointer(0), rows, matrix.dim, k, indices, scores
+        )
+        if count >= 0:
+            return [(indices[i], float(scores[i])) for i in range(count)]
+    q = matrix[query_index]
+    scored = []
+    for i in range(rows):
+        row = matrix[i]
+        dot = sum(a * b for a, b in zip(q, row))
+        norm = (sum(a * a for a in q) * sum(b * b for b in row)) ** 0.5
+        scored.append((i, dot / norm if norm else 0.0))
+    scored.sort(key=lambda item: item[1], reverse=True)
+    return scored[:k]
+
+
+def top_k_vectors(
+    query: Sequence[float], vectors: Sequence[Sequence[float]], k: int
+) -> List[Tuple[int, float]]:
+    """Like :func:`top_k_similar` for embeddings held in Python lists."""
+    if not vectors:
+        return []
+    dim = len(query)
+    rows = len(vectors)
+    buffer = (ctypes.c_float * ((rows + 1) * dim))()
+    for i, vec in enumerate(vectors):
+        buffer[i * dim : (i + 1) * dim] = [float(x) for x in vec]
+    buffer[rows * dim :] = [float(x) for x in query]
+    return top_k_similar(EmbeddingMatrix(buffer, rows + 1, dim), rows, k, rows=rows)
+
+
+# Model conversion ---------------------------------------------------------------
+
+
+def _quantize_rows(rows: Iterable[Sequence[float]]) -> Tuple[bytes, List[float]]:
+    """Symmetric per-row int8 quantization."""
+    data = bytearray()
+    scales = []
+    for row in rows:
+        amax = max((abs(x) for x in row), default=0.0)
+        scale = amax / 127.0 if amax > 0 else 1.0
+        data.extend(struct.pack(f"{len(row)}b", *(max(-127, min(127, round(x / scale))) for x in row)))
+        scales.append(scale)
+    return bytes(data), scales
+
+
+def write_model(path: str, config: dict, vocab: Sequence[str], tensors: dict) -> None:
+    """Write the int8 model file read by ``minilm_load``.
+
+    Args:
+        path: Output file.
+        config: ``hidden``, ``layers``, ``heads``, ``intermediate``,
+            ``max_position`` and ``layer_norm_eps``.
+        vocab: WordPiece vocabulary ordered by token id.
+        tensors: Nested lists keyed like the Hugging Face BERT state dict
+            (``embeddings.word_embeddings.weight``, ``encoder.layer.0...``).
+    """
+    out = bytearray()
+
+    def align() -> None:
+        out.extend(b"\0" * (-len(out) % _ALIGN))
+
+    def floats(values: Iterable[float]) -> None:
+        align()
+        values = list(values)
+        out.extend(struct.pack(f"<{len(values)}f", *values))
+
+    def flat(matrix) -> List[float]:
+        return [x for row in matrix for x in row]
+
+    def linear(prefix: str) -> None:
+        q, scales = _quantize_rows(tensors[prefix + ".weight"])
+        align()
+        out.extend(q)
+        floats(scales)
+        floats(tensors[prefix + ".bias"])
+
+    hidden = config["hidden"]
+    out.extend(_MAGIC)
+    out.extend(
+        struct.pack(
+            "<7If",
+            _VERSION,
+            len(vocab),
+            hidden,
+            config["layers"],
+            config["heads"],
+            config["intermediate"],
+            config["max_position"],
+            config.get("layer_norm_eps", 1e-12),
+        )
+    )
+    for token in vocab:
+        raw = token.encode("utf-8")
+        out.extend(struct.pack("<H", len(raw)))
+        out.extend(raw)
+
+    q, scales = _quantize_rows(tensors["embeddings.word_embeddings.weight"])
+    align()
+    out.extend(q)
+    floats(scales)
+    floats(flat(tensors["embeddings.position_embeddings.weight"][: config["max_position"]]))
+    floats(tensors["embeddings.token_type_embeddings.weight"][0])
+    floats(tensors["embeddings.LayerNorm.weight"])
+    floats(tensors["embeddings.LayerNorm.bias"])
+    for i in range(config["layers"]):
+        p = f"encoder.layer.{i}."
+        for name in ("query", "key", "value"):
+            linear(p + "attention.self." + name)
+        linear(p + "attention.output.dense")
+        floats(tensors[p + "attention.output.LayerNorm.weight"])
+        floats(tensors[p + "attention.output.LayerNorm.bias"])
+        linear(p + "intermediate.dense")
+        linear(p + "output.dense")
+        floats(tensors[p + "output.LayerNorm.weight"])
+        floats(tensors[p + "output.LayerNorm.bias"])
+
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+def convert_sentence_transformer(model_dir: str, out_path: str) -> None:
+    """Convert a local sentence-transformers MiniLM directory to int8."""
+    import json
+
+    from transformers import AutoModel  # type: ignore
+
+    model = AutoModel.from_pretrained(model_dir)
+    with open(os.path.join(model_dir, "config.json"), encoding="utf-8") as f:
+        cfg = json.load(f)
+    with open(os.path.join(model_dir, "vocab.txt"), encoding="utf-8") as f:
+        vocab = [line.rstrip("\n") for line in f]
+    tensors = {
+        name.removeprefix("bert."): value.detach().float().tolist()
+        for name, value in model.state_dict().items()
+    }
+    write_model(
+        out_path,
+        {
+            "hidden": cfg["hidden_size"],
+            "layers": cfg["num_hidden_layers"],
+            "heads": cfg["num_attention_heads"],
+            "intermediate": cfg["intermediate_size"],
+            "max_position": cfg["max_position_embeddings"],
+            "layer_norm_eps": cfg.get("layer_norm_eps", 1e-12),
+        },
+        vocab,
+        tensors,
+    )
+    logger.info(f"Zapisano model embeddingów int8: {out_path}")
+
+
+if __name__ == "__main__":  # pragma: no cover - manual conversion tool
+    if len(sys.argv) != 4 or sys.argv[1] != "convert":
+        print("Użycie: python native_embedder.py convert <katalog_modelu> <plik_wyjściowy>")
+        sys.exit(1)
+    logging.basicConfig(level=logging.INFO)
+    convert_sentence_transformer(sys.argv[2], sys.argv[3])
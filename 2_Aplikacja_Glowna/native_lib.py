@@ -0,0 +1,69 @@
+"""Optional native libraries in ``native/``, loaded through ctypes.
+
+Every accelerated module declares its library once as a
+:class:`NativeLibrary` with a function that sets the argument and result
+types of the symbols it uses.  The library is opened on first use and
+shared by all threads.  When it is not built, or is an older build without
+one of those symbols, :meth:`NativeLibrary.load` returns ``None`` and the
+module runs its Python implementation, which gives the same results
+unless the module's docstring says otherwise.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import os
+import threading
+from typing import Callable, Optional
+
+NATIVE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "native")
+
+
+def library_filename(name: str) -> str:
+    """Platform file name of library ``name``, e.g. ``libpage_hash.so``."""
+    return f"{name}.dll" if os.name == "nt" else f"lib{name}.so"
+
+
+class NativeLibrary:
+    """A shared library from :data:`NATIVE_DIR`, loaded once on first use.
+
+    Args:
+        name: library name without prefix and extension, see
+            :func:`library_filename`.
+        configure: called with the loaded library to declare its symbols;
+            an ``AttributeError`` (missing symbol) makes it unavailable.
+        filename: file name overriding the one derived from ``name``.
+    """
+
+    def __init__(
+        self,
+        name: str,
+        configure: Callable[[ctypes.CDLL], None],
+        filename: str = "",
+    ) -> None:
+        self.filename = filename or library_filename(name)
+        self.directory = NATIVE_DIR
+        self._configure = configure
+        self._lib: Optional[ctypes.CDLL] = None
+        self._lock = threading.Lock()
+
+    @property
+    def path(self) -> str:
+        """Full path of the library file."""
+        return os.path.join(self.directory, self.filename)
+
+    def load(self) -> Optional[ctypes.CDLL]:
+        """Return the configured library, or ``None`` when it is unavailable."""
+        with self._lock:
+            if self._lib is None:
+                try:
+                    lib = ctypes.CDLL(self.path)
+                    self._configure(lib)
+                except (OSError, AttributeError):
+                    return None
+                self._lib = lib
+            return self._lib
+
+    def is_available(self) -> bool:
+        """Return ``True`` when :meth:`load` finds the library."""
+        return self.load() is not None
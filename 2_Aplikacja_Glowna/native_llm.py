@@ -0,0 +1,271 @@
+"""ctypes wrapper for the native GGUF inference backend (``native/llm_backend.cpp``).
+
+The backend runs quantized llama.cpp models on the CPU without torch.  The
+shared library is built with ``native/build_llm_backend.sh``; when it is
+missing :func:`is_available` returns ``False`` and callers fall back to the
+transformers path.
+
+Requests submitted with :meth:`NativeLLM.submit` are decoded together by the
+backend's scheduler thread (continuous batching) and resolve
+:class:`concurrent.futures.Future` objects.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import itertools
+import logging
+import threading
+from concurrent.futures import Future
+from typing import Dict, Optional
+
+import native_lib
+
+logger = logging.getLogger(__name__)
+
+# Rozmiar bufora na odpowiedź; ~500 tokenów mieści się z dużym zapasem
+_OUTPUT_BUFFER = 16 * 1024
+
+# void (*)(void *user, int status, const char *text, size_t len)
+_CALLBACK = ctypes.CFUNCTYPE(
+    None, ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_char), ctypes.c_size_t
+)
+
+# Oczekujące żądania: identyfikator przekazany jako ``user`` -> Future
+_pending: Dict[int, Future] = {}
+_pending_lock = threading.Lock()
+_request_ids = itertools.count(1)
+
+
+def _complete(user, status, text, length) -> None:
+    """Resolve the future of a finished request (runs on the scheduler thread)."""
+    with _pending_lock:
+        future = _pending.pop(user or 0, None)
+    if future is None:
+        return
+    data = ctypes.string_at(text, length).decode("utf-8", errors="replace")
+    if status == 0:
+        future.set_result(data)
+    else:
+        future.set_exception(RuntimeError(data))
+
+
+# Referencja utrzymuje wskaźnik funkcji przy życiu przez cały czas działania
+_on_complete = _CALLBACK(_complete)
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.llm_last_error.argtypes = []
+    lib.llm_last_error.restype = ctypes.c_char_p
+    lib.llm_engine_create.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+    lib.llm_engine_create.restype = ctypes.c_void_p
+    lib.llm_engine_free.argtypes = [ctypes.c_void_p]
+    lib.llm_engine_free.restype = None
+    lib.llm_engine_generate.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_float,
+        ctypes.c_float,
+        ctypes.c_uint,
+        ctypes.c_char_p,
+        ctypes.c_char_p,
+        ctypes.c_char_p,
+        ctypes.c_size_t,
+    ]
+    lib.llm_engine_generate.restype = ctypes.c_int
+    lib.llm_engine_submit.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_float,
+        ctypes.c_float,
+        ctypes.c_uint,
+        ctypes.c_char_p,
+        ctypes.c_char_p,
+        _CALLBACK,
+        ctypes.c_void_p,
+    ]
+    lib.llm_engine_submit.restype = ctypes.c_int
+    lib.llm_engine_set_prefix.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+    lib.llm_engine_set_prefix.restype = ctypes.c_int
+    try:
+        lib.llm_engine_cancel.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        lib.llm_engine_cancel.restype = None
+    except AttributeError:
+        # Starsza kompilacja bez anulowania: żądania kończą się normalnie
+        pass
+
+
+_library = native_lib.NativeLibrary("llm_backend", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native backend library can be loaded."""
+    return _library.is_available()
+
+
+def _last_error(lib: ctypes.CDLL) -> str:
+    msg = lib.llm_last_error()
+    return msg.decode("utf-8", errors="replace") if msg else "nieznany błąd"
+
+
+class NativeLLM:
+    """Quantized GGUF model executed by the native llama.cpp backend."""
+
+    def __init__(
+        self, model_path: str, n_ctx: int = 4096, n_threads: int = 0, n_parallel: int = 1
+    ) -> None:
+        """Load ``model_path`` into memory.
+
+        Args:
+            model_path: Path to a local ``.gguf`` file.
+            n_ctx: KV cache size in tokens, shared by all parallel sequences.
+            n_threads: Number of CPU threads; ``0`` uses all cores.
+            n_parallel: Number of requests decoded together in one batch.
+
+        Raises:
+            OSError: If the native library is not built.
+            RuntimeError: If the model cannot be loaded.
+        """
+        lib = _library.load()
+        if lib is None:
+            raise OSError(f"Brak biblioteki {_library.path}")
+        self._lib = lib
+        self.model_path = model_path
+        self._handle = lib.llm_engine_create(
+            model_path.encode("utf-8"), int(n_ctx), int(n_threads), int(n_parallel)
+        )
+        if not self._handle:
+            raise RuntimeError(_last_error(lib))
+
+    def set_prompt_prefix(self, prefix: str, cache_path: Optional[str] = None) -> int:
+        """Precompute the KV cache for a prompt prefix shared by all requests.
+
+        Later :meth:`generate` calls whose prompt starts with ``prefix`` only
+        evaluate the remaining tokens.
+
+        Args:
+            prefix: Constant leading part of the prompts.
+            cache_path: Optional file used to persist the computed state
+                between runs; it is reused when it matches ``prefix``.
+
+        Returns:
+            Number of tokens in the prefix.
+        """
+        if not self._handle:
+            raise RuntimeError("Model został już zwolniony")
+        n = self._lib.llm_engine_set_prefix(
+            self._handle,
+            prefix.encode("utf-8"),
+            cache_path.encode("utf-8") if cache_path else None,
+        )
+        if n < 0:
+            raise RuntimeError(_last_error(self._lib))
+        return n
+
+    def submit(
+        self,
+        prompt: str,
+        max_tokens: int = 500,
+        temperature: float = 0.0,
+        top_p: float = 1.0,
+        seed: int = 0,
+        grammar: Optional[str] = None,
+        stop: Optional[str] = None,
+    ) -> Future:
+        """Queue ``prompt`` for batched generation.
+
+        Takes the same arguments as :meth:`generate`.
+
+        Returns:
+            Future resolved with the completion text, or with ``RuntimeError``
+            when generation fails.
+        """
+        if not self._handle:
+            raise RuntimeError("Model został już zwolniony")
+        future: Future = Future()
+        request_id = next(_request_ids)
+        with _pending_lock:
+            _pending[request_id] = future
+        rc = self._lib.llm_engine_submit(
+            self._handle,
+            prompt.encode("utf-8"),
+            int(max_tokens),
+            float(temperature),
+            float(top_p),
+            int(seed),
+            grammar.encode("utf-8") if grammar else None,
+            stop.encode("utf-8") if stop else None,
+            _on_complete,
+            request_id,
+        )
+        if rc != 0:
+            with _pending_lock:
+                _pending.pop(request_id, None)
+            raise RuntimeError(_last_error(self._lib))
+        return future
+
+    def generate(
+        self,
+        prompt: str,
+        max_tokens: int = 500,
+        temperature: float = 0.0,
+        top_p: float = 1.0,
+        seed: int = 0,
+        grammar: Optional[str] = None,
+        stop: Optional[str] = None,
+    ) -> str:
+        """Return the completion generated for ``prompt``.
+
+        Args:
+            grammar: Optional GBNF grammar (start rule ``root``) restricting
+                the tokens that may be sampled.
+            stop: Optional string ending the generation; it is kept as the
+                last part of the completion.
+        """
+        if not self._handle:
+            raise RuntimeError("Model został już zwolniony")
+        buf = ctypes.create_string_buffer(_OUTPUT_BUFFER)
+        n = self._lib.llm_engine_generate(
+            self._handle,
+            prompt.encode("utf-8"),
+            int(max_tokens),
+            float(temperature),
+            float(top_p),
+            int(seed),
+            grammar.encode("utf-8") if grammar else None,
+            stop.encode("utf-8") if stop else None,
+            buf,
+            len(buf),
+        )
+        if n < 0:
+            raise RuntimeError(_last_error(self._lib))
+        if n >= len(buf):
+            logger.warning("Odpowiedź modelu została obcięta do %d bajtów", len(buf) - 1)
+        return buf.value.decode("utf-8", errors="replace")
+
+    def cancel_pending(self) -> None:
+        """Cancel all queued and running requests of this engine.
+
+        Their futures fail with ``RuntimeError`` shortly afterwards; running
+        sequences stop after the current decode step.
+        """
+        if self._handle and hasattr(self._lib, "llm_engine_cancel"):
+            self._lib.llm_engine_cancel(self._handle, None)
+
+    def close(self) -> None:
+        """Release the model and its context.
+
+        May be called from a future's callback; the backend then frees the
+        engine once the callback has returned.
+        """
+        if self._handle:
+            self._lib.llm_engine_free(self._handle)
+            self._handle = None
+
+    def __del__(self) -> None:  # pragma: no cover - depends on GC timing
+        try:
+            self.close()
+        except Exception:
+            pass
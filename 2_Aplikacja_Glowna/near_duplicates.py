@@ -0,0 +1,354 @@
+"""Near-duplicate detection of incoming scans (``native/simhash.c``).
+
+Every archived document gets a 64-bit SimHash fingerprint of its OCR text:
+the text is normalized like the full-text index (see
+:func:`fulltext_index.analyze`) and the fingerprint is built from two-word
+shingles, so a fax and a rescan of the same letter differ only by the few
+bits their OCR errors flip.  Fingerprints are kept in a multi-index Hamming
+table: the 64 bits are split into ``max_distance + 1`` blocks and only
+fingerprints equal on one of the blocks are compared, which makes a lookup
+take microseconds regardless of the archive size.
+
+The store is two append-only files in the index directory:
+``simhash.bin`` with 16-byte records (fingerprint, offset into
+``simhash.jsonl``) loaded in one read at startup, and ``simhash.jsonl`` with
+the archived path and extracted metadata, read only for matches.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import json
+import logging
+import os
+import struct
+import sys
+import threading
+from array import array
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional
+
+import native_lib
+from fulltext_index import analyze, default_index_dir
+
+logger = logging.getLogger(__name__)
+
+# Liczba słów w cesze (shingle) odcisku
+SHINGLE = 2
+# Krótsze teksty (puste strony, same nagłówki) nie są porównywane
+MIN_TOKENS = 20
+MAX_DISTANCE = 7
+
+FINGERPRINTS = "simhash.bin"
+RECORDS = "simhash.jsonl"
+_RECORD = struct.Struct("<QQ")
+
+_MASK64 = (1 << 64) - 1
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.simhash_tokens.argtypes = [
+        ctypes.c_char_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int, ctypes.c_int
+    ]
+    lib.simhash_tokens.restype = ctypes.c_uint64
+    lib.simindex_new.argtypes = [ctypes.c_int]
+    lib.simindex_new.restype = ctypes.c_void_p
+    lib.simindex_free.argtypes = [ctypes.c_void_p]
+    lib.simindex_free.restype = None
+    lib.simindex_add.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.simindex_add.restype = ctypes.c_int
+    lib.simindex_add_many.argtypes = [
+        ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint64), ctypes.c_int
+    ]
+    lib.simindex_add_many.restype = ctypes.c_int
+    lib.simindex_query.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_uint64,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_int),
+        ctypes.POINTER(ctypes.c_int),
+        ctypes.c_int,
+    ]
+    lib.simindex_query.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("simhash", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native SimHash library can be used."""
+    return _library.is_available()
+
+
+def _hash_bytes(data: bytes) -> int:
+    h = 0xCBF29CE484222325
+    for byte in data:
+        h = ((h ^ byte) * 0x100000001B3) & _MASK64
+    h ^= h >> 33
+    h = (h * 0xFF51AFD7ED558CCD) & _MASK64
+    h ^= h >> 33
+    h = (h * 0xC4CEB9FE1A85EC53) & _MASK64
+    return h ^ (h >> 33)
+
+
+def fingerprint(text: str, shingle: int = SHINGLE) -> Optional[int]:
+    """Return the SimHash of ``text`` or ``None`` when it is too short."""
+    tokens = analyze(text)
+    if len(tokens) < MIN_TOKENS:
+        return None
+    data = " ".join(tokens).encode("utf-8")
+    offsets = array("i", [0])
+    for token in tokens:
+        offsets.append(offsets[-1] + len(token.encode("utf-8")) + 1)
+    lib = _library.load()
+    if lib is not None:
+        address, _ = offsets.buffer_info()
+        return lib.simhash_tokens(
+            data, ctypes.cast(address, ctypes.POINTER(ctypes.c_int)), len(tokens), shingle
+        )
+    shingle = max(1, min(shingle, len(tokens)))
+    counts = [0] * 64
+    for i in range(len(tokens) - shingle + 1):
+        h = _hash_bytes(data[offsets[i]:offsets[i + shingle] - 1])
+        for b in range(64):
+            counts[b] += 1 if (h >> b) & 1 else -1
+    return sum(1 << b for b in range(64) if counts[b] > 0)
+
+
+def hamming(a: int, b: int) -> int:
+    """Number of differing bits of two fingerprints."""
+    return (a ^ b).bit_count()
+
+
+class _PyTable:
+    """Python multi-index table, used without the compiled library."""
+
+    def __init__(self, max_distance: int) -> None:
+        self.max_distance = max_distance
+        n_blocks = max_distance + 1
+        self.blocks = []
+        shift = 0
+        for b in range(n_blocks):
+            width = 64 // n_blocks + (b < 64 % n_blocks)
+            self.blocks.append((shift, (1 << width) - 1))
+            shift += width
+        self.tables: List[Dict[int, List[int]]] = [{} for _ in range(n_blocks)]
+        self.fps: List[int] = []
+
+    def add(self, fp: int) -> int:
+        idx = len(self.fps)
+        self.fps.append(fp)
+        for (shift, mask), table in zip(self.blocks, self.tables):
+            table.setdefault((fp >> shift) & mask, []).append(idx)
+        return idx
+
+    def query(self, fp: int, max_distance: int) -> Dict[int, int]:
+        found = {}
+        for (shift, mask), table in zip(self.blocks, self.tables):
+            for idx in table.get((fp >> shift) & mask, ()):
+                if idx not in found:
+                    dist = hamming(fp, self.fps[idx])
+                    if dist <= max_distance:
+                        found[idx] = dist
+        return found
+
+
+@dataclass
+class DuplicateMatch:
+    """An archived document similar to the checked one.
+
+    ``reserved`` is set when the match is a document of the current batch
+    that is not archived yet; its ``path`` is then the input file and
+    ``info`` is empty until :meth:`DuplicateIndex.store` is called for ``id``.
+    """
+
+    path: str
+    distance: int
+    info: dict = field(default_factory=dict)
+    id: int = -1
+    reserved: bool = False
+
+
+class DuplicateIndex:
+    """Fingerprints of archived documents stored in ``directory``."""
+
+    def __init__(self, directory: str, max_distance: int = 3) -> None:
+        """Open or create the store.
+
+        Args:
+            directory: Directory of ``simhash.bin`` and ``simhash.jsonl``.
+            max_distance: Largest Hamming distance reported as a duplicate
+                (0..7).  At 3 only copies with a few OCR differences match;
+                larger values also catch noisier rescans but may match
+                letters filled in from the same template.
+        """
+        if not 0 <= max_distance <= MAX_DISTANCE:
+            raise ValueError(f"max_distance poza zakresem 0..{MAX_DISTANCE}")
+        self.directory = directory
+        self.max_distance = max_distance
+        self._lock = threading.Lock()
+        self._lib = _library.load()
+        self._native = None
+        self._table = None
+        if self._lib is not None:
+            self._native = self._lib.simindex_new(max_distance)
+            if not self._native:
+                raise MemoryError("simindex_new")
+        else:
+            self._table = _PyTable(max_distance)
+        # Dla każdego odcisku: przesunięcie rekordu w simhash.jsonl lub, dla
+        # dokumentów jeszcze nie zarchiwizowanych, słownik z rekordem w pamięci
+        # (None po zwolnieniu rezerwacji)
+        self._records: List[object] = []
+        os.makedirs(directory, exist_ok=True)
+        self._load()
+
+    def _load(self) -> None:
+        fps_path = os.path.join(self.directory, FINGERPRINTS)
+        if not os.path.exists(fps_path):
+            return
+        with open(fps_path, "rb") as f:
+            data = f.read()
+        # Niepełny ostatni rekord po przerwanym zapisie jest obcinany, aby
+        # kolejne dopisane rekordy zaczynały się na granicy 16 bajtów
+        if len(data) % _RECORD.size:
+            data = data[: len(data) - len(data) % _RECORD.size]
+            with open(fps_path, "r+b") as f:
+                f.truncate(len(data))
+        pairs = array("Q", data)
+        if sys.byteorder != "little":
+            pairs.byteswap()
+        fps = pairs[0::2]
+        self._records.extend(pairs[1::2])
+        if self._native is not None:
+            address, _ = fps.buffer_info()
+            added = self._lib.simindex_add_many(
+                self._native, ctypes.cast(address, ctypes.POINTER(ctypes.c_uint64)), len(fps)
+            )
+            if added != len(fps):
+                raise MemoryError("simindex_add_many")
+        else:
+            for fp in fps:
+                self._table.add(fp)
+
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._records)
+
+    def _add_locked(self, fp: int, record: object) -> int:
+        if self._native is not None:
+            idx = self._lib.simindex_add(self._native, fp)
+            if idx < 0:
+                raise MemoryError("simindex_add")
+        else:
+            idx = self._table.add(fp)
+        self._records.append(record)
+        return idx
+
+    def _query_locked(self, fp: int, max_distance: int) -> Dict[int, int]:
+        if self._native is None:
+            return self._table.query(fp, max_distance)
+        cap = 64
+        while True:
+            ids = (ctypes.c_int * cap)()
+            dists = (ctypes.c_int * cap)()
+            found = self._lib.simindex_query(self._native, fp, max_distance, ids, dists, cap)
+            if found <= cap:
+                return dict(zip(ids[:found], dists[:found]))
+            cap = found
+
+    def _read_record(self, record: object) -> dict:
+        if isinstance(record, dict):
+            return record
+        with open(os.path.join(self.directory, RECORDS), "rb") as f:
+            f.seek(record)
+            return json.loads(f.readline())
+
+    def find(
+        self, fp: Optional[int], max_distance: Optional[int] = None
+    ) -> Optional[DuplicateMatch]:
+        """Return the closest stored document within ``max_distance`` bits."""
+        if fp is None:
+            return None
+        if max_distance is None:
+            max_distance = self.max_distance
+        with self._lock:
+            found = self._query_locked(fp, min(max_distance, self.max_distance))
+            # Zwolnione rezerwacje zostają w tablicy, ale nie są dopasowaniem
+            found = {i: d for i, d in found.items() if self._records[i] is not None}
+            if not found:
+                return None
+            # Najbliższy odcisk, przy remisie najnowszy dokument
+            idx = min(found, key=lambda i: (found[i], -i))
+            record = self._records[idx]
+        data = self._read_record(record)
+        return DuplicateMatch(
+            data.get("path", ""),
+            found[idx],
+            data.get("info") or {},
+            idx,
+            isinstance(record, dict),
+        )
+
+    def reserve(self, fp: int, path: str) -> int:
+        """Register a document still being processed; returns its id.
+
+        Later documents of the same batch are then recognised as its
+        duplicates before it is archived.  :meth:`store` makes it permanent.
+        """
+        with self._lock:
+            return self._add_locked(fp, {"fp": fp, "path": path, "info": {}})
+
+    def release(self, idx: int) -> None:
+        """Forget reserved document ``idx``, e.g. when it was not archived."""
+        with self._lock:
+            if isinstance(self._records[idx], dict):
+                self._records[idx] = None
+
+    def store(self, idx: int, path: str, info: Optional[dict] = None) -> None:
+        """Persist reserved document ``idx`` under its archived ``path``."""
+        line = json.dumps({"path": path, "info": info or {}}, ensure_ascii=False)
+        with self._lock:
+            record = self._records[idx]
+            if not isinstance(record, dict):
+                return
+            records = os.path.join(self.directory, RECORDS)
+            with open(records, "ab") as f:
+                offset = f.tell()
+                f.write(line.encode("utf-8") + b"\n")
+            with open(os.path.join(self.directory, FINGERPRINTS), "ab") as f:
+                f.write(_RECORD.pack(record["fp"], offset))
+            self._records[idx] = offset
+
+    def add(self, fp: int, path: str, info: Optional[dict] = None) -> int:
+        """Store an archived document at once; returns its id."""
+        idx = self.reserve(fp, path)
+        self.store(idx, path, info)
+        return idx
+
+    def close(self) -> None:
+        """Free the native table."""
+        with self._lock:
+            if self._native is not None:
+                self._lib.simindex_free(self._native)
+                self._native = None
+
+
+_shared: Dict[str, DuplicateIndex] = {}
+_shared_lock = threading.Lock()
+
+
+def open_duplicate_index(settings=None) -> DuplicateIndex:
+    """Return the fingerprint store shared by the whole application.
+
+    It is kept in the full-text index directory next to the segments.
+    """
+    directory = getattr(settings, "fulltext_index_dir", "") or default_index_dir()
+    directory = os.path.abspath(directory)
+    max_distance = getattr(settings, "duplicate_max_distance", 3)
+    with _shared_lock:
+        index = _shared.get(directory)
+        if index is None or index.max_distance != max_distance:
+            index = DuplicateIndex(directory, max_distance)
+            _shared[directory] = index
+        return index
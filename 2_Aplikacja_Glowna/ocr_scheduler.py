@@ -0,0 +1,95 @@
+"""Priority lanes for the OCR engines shared by all recognitions.
+
+Every page recognized by :mod:`processing.ocr` runs on one of a fixed
+number of engines (``ocr_workers``, by default all cores).  A page takes
+an engine with :meth:`EngineScheduler.engine` and gives it back when done,
+so a batch yields at every page boundary.  Waiting pages are served by
+priority class first and in arrival order within a class: a document
+re-recognized interactively gets the next free engine even while a batch
+of thousands of pages keeps all of them busy, and waits for at most one
+page of the batch.
+"""
+
+from __future__ import annotations
+
+import heapq
+import itertools
+import os
+import threading
+from contextlib import contextmanager
+from typing import Iterator, List, Optional, Tuple
+
+# Klasy priorytetu: mniejsza wartość jest obsługiwana wcześniej
+INTERACTIVE = 0
+BATCH = 1
+
+
+class EngineScheduler:
+    """Hand out ``engines`` OCR engines to waiting pages by priority."""
+
+    def __init__(self, engines: int) -> None:
+        self._engines = max(1, engines)
+        self._free = self._engines
+        self._waiting: List[Tuple[int, int]] = []
+        self._order = itertools.count()
+        self._cond = threading.Condition()
+
+    @property
+    def engines(self) -> int:
+        return self._engines
+
+    def resize(self, engines: int) -> None:
+        """Change the number of engines; busy pages finish undisturbed."""
+        with self._cond:
+            engines = max(1, engines)
+            self._free += engines - self._engines
+            self._engines = engines
+            self._cond.notify_all()
+
+    def acquire(self, priority: int = BATCH) -> None:
+        """Wait for an engine; higher-priority pages are served first."""
+        with self._cond:
+            ticket = (priority, next(self._order))
+            heapq.heappush(self._waiting, ticket)
+            while self._free <= 0 or self._waiting[0] != ticket:
+                self._cond.wait()
+            heapq.heappop(self._waiting)
+            self._free -= 1
+            if self._free > 0 and self._waiting:
+                # Wolny silnik dla kolejnego oczekującego
+                self._cond.notify_all()
+
+    def release(self) -> None:
+        with self._cond:
+            self._free += 1
+            self._cond.notify_all()
+
+    @contextmanager
+    def engine(self, priority: int = BATCH) -> Iterator[None]:
+        """Hold an engine for the duration of one page."""
+        self.acquire(priority)
+        try:
+            yield
+        finally:
+            self.release()
+
+
+_shared: Optional[EngineScheduler] = None
+_shared_lock = threading.Lock()
+
+
+def shared(engines: int = 0) -> EngineScheduler:
+    """Return the process-wide scheduler with ``engines`` engines.
+
+    ``0`` means one engine per core.  A different count than before resizes
+    the scheduler, so a changed ``ocr_workers`` setting applies to the next
+    page.
+    """
+    global _shared
+    engines = engines or os.cpu_count() or 1
+    with _shared_lock:
+        if _shared is None:
+            _shared = EngineScheduler(engines)
+        elif _shared.engines != engines:
+            _shared.resize(engines)
+        return _shared
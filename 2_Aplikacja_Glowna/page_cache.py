@@ -0,0 +1,290 @@
+"""Page-level OCR cache keyed by perceptual hashes (``native/page_hash.c``).
+
+Cover sheets, standard forms and attachments repeated across letters are
+rasterized again for every document that contains them.  Right after
+rasterization every page gets two 64-bit perceptual hashes (dHash and
+pHash of a 32x32 thumbnail) and pages whose hashes match an already
+recognised page are candidates for reusing its stored text instead of
+running Tesseract.  The thumbnail cannot see a filled-in field of a form,
+so a candidate is only taken when a digest of the whole binarized page at
+full resolution matches as well.
+
+Text depends on the OCR settings as well, so every entry carries a profile
+key of the language, Tesseract options, DPI and preprocessing parameters;
+pages are only reused under the same profile.
+
+The store is two append-only files in the index directory:
+``ocr_pages.bin`` with 32-byte records (profile, dHash, pHash, offset into
+``ocr_pages.jsonl``) loaded in one read at startup, and ``ocr_pages.jsonl``
+with the page text and its bilevel digest, read only for candidates.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import hashlib
+import json
+import logging
+import math
+import os
+import struct
+import threading
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Tuple
+
+import native_lib
+from fulltext_index import default_index_dir
+
+logger = logging.getLogger(__name__)
+
+THUMB = 32
+_LOW = 8
+# Najwyższa dopuszczalna odległość Hamminga każdego z dwóch skrótów
+MAX_DISTANCE = 8
+
+HASHES = "ocr_pages.bin"
+TEXTS = "ocr_pages.jsonl"
+_RECORD = struct.Struct("<QQQQ")
+# Próg binaryzacji skrótu weryfikującego: ciemne piksele 0, jasne 1
+_BILEVEL = bytes(0 if v < 128 else 1 for v in range(256))
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.page_hash.argtypes = [
+        ctypes.c_char_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_uint64),
+    ]
+    lib.page_hash.restype = ctypes.c_int
+
+
+_library = native_lib.NativeLibrary("page_hash", _configure)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native page hashing library can be used."""
+    return _library.is_available()
+
+
+@dataclass(frozen=True)
+class PageHash:
+    """Perceptual hashes of one rasterized page.
+
+    ``bilevel`` is a digest of the page thresholded at full resolution; two
+    pages share it only when every pixel falls on the same side of the
+    threshold, so a form with another case number in one field differs.
+    """
+
+    dhash: int
+    phash: int
+    bilevel: bytes = b""
+
+
+def _bilevel_digest(data: bytes) -> bytes:
+    return hashlib.blake2b(data.translate(_BILEVEL), digest_size=16).digest()
+
+
+def _thumbnail(data: bytes, width: int, height: int) -> List[int]:
+    thumb = []
+    cols = [(bx * width // THUMB, (bx + 1) * width // THUMB) for bx in range(THUMB)]
+    for by in range(THUMB):
+        y0, y1 = by * height // THUMB, (by + 1) * height // THUMB
+        sums = [0] * THUMB
+        for y in range(y0, y1):
+            row = y * width
+            for bx, (x0, x1) in enumerate(cols):
+                sums[bx] += sum(data[row + x0:row + x1])
+        counts = [(y1 - y0) * (x1 - x0) for x0, x1 in cols]
+        thumb.extend((s + n // 2) // n for s, n in zip(sums, counts))
+    return thumb
+
+
+def _dhash(thumb: List[int]) -> int:
+    h = 0
+    cells = [(c * THUMB // 9, (c + 1) * THUMB // 9) for c in range(9)]
+    for r in range(8):
+        sums = [
+            sum(thumb[y * THUMB + x] for y in range(r * 4, r * 4 + 4) for x in range(x0, x1))
+            for x0, x1 in cells
+        ]
+        widths = [x1 - x0 for x0, x1 in cells]
+        for c in range(8):
+            if sums[c + 1] * widths[c] > sums[c] * widths[c + 1]:
+                h |= 1 << (r * 8 + c)
+    return h
+
+
+def _phash(thumb: List[int]) -> int:
+    cos_tab = [
+        [
+            math.floor(4096.0 * math.cos((2 * x + 1) * u * math.pi / (2 * THUMB)) + 0.5)
+            for x in range(THUMB)
+        ]
+        for u in range(_LOW)
+    ]
+    rows = [
+        [sum(thumb[y * THUMB + x] * cos_tab[v][x] for x in range(THUMB)) for v in range(_LOW)]
+        for y in range(THUMB)
+    ]
+    coeffs = [
+        sum(cos_tab[u][y] * rows[y][v] for y in range(THUMB))
+        for u in range(_LOW)
+        for v in range(_LOW)
+    ]
+    median = sorted(coeffs[1:])[(_LOW * _LOW - 1) // 2]
+    return sum(1 << k for k in range(1, _LOW * _LOW) if coeffs[k] > median)
+
+
+def hash_gray(data: bytes, width: int, height: int) -> Optional[PageHash]:
+    """Hash an 8-bit grayscale page stored row by row without padding.
+
+    Returns ``None`` for pages smaller than the 32x32 thumbnail.
+    """
+    if width < THUMB or height < THUMB or len(data) < width * height:
+        return None
+    bilevel = _bilevel_digest(bytes(data[: width * height]))
+    lib = _library.load()
+    if lib is not None:
+        out = (ctypes.c_uint64 * 2)()
+        if lib.page_hash(data, width, height, width, out) < 0:
+            return None
+        return PageHash(out[0], out[1], bilevel)
+    thumb = _thumbnail(data, width, height)
+    return PageHash(_dhash(thumb), _phash(thumb), bilevel)
+
+
+def hash_image(image) -> Optional[PageHash]:
+    """Hash a rasterized PIL page."""
+    gray = image.convert("L")
+    width, height = gray.size
+    return hash_gray(gray.tobytes(), width, height)
+
+
+def profile_key(*settings) -> int:
+    """Return a 64-bit key of the OCR settings the cached text depends on."""
+    digest = hashlib.blake2b(repr(settings).encode("utf-8"), digest_size=8).digest()
+    return int.from_bytes(digest, "little")
+
+
+class PageCache:
+    """OCR text of already recognised pages stored in ``directory``."""
+
+    def __init__(self, directory: str, max_distance: int = 0) -> None:
+        """Open or create the cache.
+
+        Args:
+            directory: Directory of ``ocr_pages.bin`` and ``ocr_pages.jsonl``.
+            max_distance: Largest Hamming distance (0..8) of both the dHash
+                and the pHash of a page still considered a candidate.  At 0
+                only pages identical at thumbnail scale are candidates.  Every
+                candidate must also have the same bilevel digest, so larger
+                values only help pages whose thumbnails shift slightly while
+                the binarized page stays the same.
+        """
+        if not 0 <= max_distance <= MAX_DISTANCE:
+            raise ValueError(f"max_distance poza zakresem 0..{MAX_DISTANCE}")
+        self.directory = directory
+        self.max_distance = max_distance
+        self._lock = threading.Lock()
+        # Kilka stron (np. formularze z innym wpisem) może mieć te same skróty
+        self._exact: Dict[Tuple[int, int, int], List[int]] = {}
+        # Dla wyszukiwania przybliżonego: skróty stron każdego profilu
+        self._by_profile: Dict[int, List[Tuple[int, int, int]]] = {}
+        os.makedirs(directory, exist_ok=True)
+        self._load()
+
+    def _load(self) -> None:
+        path = os.path.join(self.directory, HASHES)
+        if not os.path.exists(path):
+            return
+        with open(path, "rb") as f:
+            data = f.read()
+        # Niepełny ostatni rekord po przerwanym zapisie jest obcinany
+        if len(data) % _RECORD.size:
+            data = data[: len(data) - len(data) % _RECORD.size]
+            with open(path, "r+b") as f:
+                f.truncate(len(data))
+        for profile, dhash, phash, offset in _RECORD.iter_unpack(data):
+            self._remember(profile, PageHash(dhash, phash), offset)
+
+    def _remember(self, profile: int, page: PageHash, offset: int) -> None:
+        self._exact.setdefault((profile, page.dhash, page.phash), []).append(offset)
+        self._by_profile.setdefault(profile, []).append((page.dhash, page.phash, offset))
+
+    def __len__(self) -> int:
+        with self._lock:
+            return sum(len(offsets) for offsets in self._exact.values())
+
+    def _candidates_locked(self, profile: int, page: PageHash) -> List[int]:
+        """Return offsets of pages with matching hashes, closest and newest first."""
+        # Nowszy wpis tej samej strony zastępuje starszy (ponowne rozpoznanie)
+        exact = self._exact.get((profile, page.dhash, page.phash), [])[::-1]
+        if not self.max_distance:
+            return exact
+        near = []
+        for dhash, phash, offset in self._by_profile.get(profile, ()):
+            ddist = (dhash ^ page.dhash).bit_count()
+            pdist = (phash ^ page.phash).bit_count()
+            if ddist <= self.max_distance and pdist <= self.max_distance:
+                near.append((ddist + pdist, -offset))
+        return [-offset for _, offset in sorted(near)]
+
+    def _find_locked(self, profile: int, page: PageHash) -> Optional[str]:
+        candidates = self._candidates_locked(profile, page)
+        if not candidates:
+            return None
+        with open(os.path.join(self.directory, TEXTS), "rb") as f:
+            for offset in candidates:
+                f.seek(offset)
+                entry = json.loads(f.readline())
+                # Wpisy bez skrótu binarnego (starsze) nigdy nie są potwierdzone
+                if entry.get("bilevel", "") == page.bilevel.hex():
+                    return entry["text"]
+        return None
+
+    def get(self, profile: int, page: PageHash) -> Optional[str]:
+        """Return the cached text of ``page`` or ``None`` for an unseen page."""
+        with self._lock:
+            return self._find_locked(profile, page)
+
+    def put(self, profile: int, page: PageHash, text: str, replace: bool = False) -> None:
+        """Store the recognised ``text`` of ``page``.
+
+        A page already stored keeps its text unless ``replace`` is set, as
+        after a page was recognised again on request.
+        """
+        line = json.dumps(
+            {"text": text, "bilevel": page.bilevel.hex()}, ensure_ascii=False
+        ).encode("utf-8") + b"\n"
+        with self._lock:
+            stored = self._find_locked(profile, page)
+            if stored is not None and (not replace or stored == text):
+                return
+            with open(os.path.join(self.directory, TEXTS), "ab") as f:
+                offset = f.tell()
+                f.write(line)
+            with open(os.path.join(self.directory, HASHES), "ab") as f:
+                f.write(_RECORD.pack(profile, page.dhash, page.phash, offset))
+            self._remember(profile, page, offset)
+
+
+_shared: Dict[str, PageCache] = {}
+_shared_lock = threading.Lock()
+
+
+def open_page_cache(settings=None) -> PageCache:
+    """Return the page cache shared by all OCR workers.
+
+    It is kept in the full-text index directory next to the segments.
+    """
+    directory = getattr(settings, "fulltext_index_dir", "") or default_index_dir()
+    directory = os.path.abspath(directory)
+    max_distance = getattr(settings, "ocr_page_cache_max_distance", 0)
+    with _shared_lock:
+        cache = _shared.get(directory)
+        if cache is None or cache.max_distance != max_distance:
+            cache = PageCache(directory, max_distance)
+            _shared[directory] = cache
+        return cache
@@ -0,0 +1,87 @@
+"""Batch named-entity recognition over streams of OCR texts.
+
+Documents are fed to ``nlp.pipe`` as they arrive instead of calling the
+model once per document.  With ``n_process > 1`` spaCy shards the stream
+across worker processes; the pipeline is sent to each worker once when it
+starts, so the model is loaded once per process rather than per document.
+"""
+
+from __future__ import annotations
+
+import logging
+import os
+import time
+from typing import Any, Dict, Iterable, Iterator, List, Sequence, Tuple
+
+logger = logging.getLogger(__name__)
+
+# Mniejsze partie skracają czas oczekiwania pierwszych dokumentów w potoku
+DEFAULT_BATCH_SIZE = 4
+
+
+def resolve_processes(n_process: int) -> int:
+    """Map the ``0`` = all cores convention to a process count."""
+    return n_process if n_process > 0 else (os.cpu_count() or 1)
+
+
+def entities_from_doc(doc: Any) -> Dict[str, List[str]]:
+    """Group entity texts of ``doc`` by upper-cased label."""
+    entities: Dict[str, List[str]] = {}
+    for ent in doc.ents:
+        entities.setdefault(ent.label_.upper(), []).append(
+            ent.text.replace("\n", " ").strip()
+        )
+    return entities
+
+
+def pipe_documents(
+    nlp: Any,
+    items: Iterable[Tuple[str, Any]],
+    n_process: int = 1,
+    batch_size: int = DEFAULT_BATCH_SIZE,
+) -> Iterator[Tuple[Any, Any]]:
+    """Run ``nlp`` over a stream of ``(text, context)`` pairs.
+
+    Args:
+        nlp: Loaded spaCy pipeline.
+        items: Iterable (possibly a generator fed by OCR) of texts with an
+            arbitrary context object passed through unchanged.
+        n_process: Number of worker processes; ``0`` uses all cores.
+        batch_size: Documents per batch sent to a worker.
+
+    Yields:
+        ``(doc, context)`` pairs in input order.
+    """
+    n_process = resolve_processes(n_process)
+    yield from nlp.pipe(items, as_tuples=True, n_process=n_process, batch_size=batch_size)
+
+
+def benchmark(
+    nlp: Any,
+    texts: Sequence[str],
+    process_counts: Iterable[int],
+    batch_size: int = 16,
+) -> List[Tuple[int, float]]:
+    """Measure NER throughput for different numbers of processes.
+
+    Args:
+        nlp: Loaded spaCy pipeline.
+        texts: Sample documents; each run processes all of them.
+        process_counts: Process counts to measure.
+        batch_size: Documents per batch.
+
+    Returns:
+        ``(n_process, docs_per_second)`` for every requested count.
+    """
+    results = []
+    for n_process in process_counts:
+        n_process = resolve_processes(n_process)
+        start = time.perf_counter()
+        count = sum(
+            1 for _ in nlp.pipe(texts, n_process=n_process, batch_size=batch_size)
+        )
+        elapsed = time.perf_counter() - start
+        rate = count / elapsed if elapsed > 0 else float("inf")
+        logger.info("NER: %d proces(y), %.1f dok./s", n_process, rate)
+        results.append((n_process, rate))
+    return results
@@ -3,7 +3,8 @@ import os
 import sys
 import logging
 import traceback
-from typing import List, Optional, Sequence, Tuple
+from dataclasses import dataclass, field
+from typing import Iterator, List, Optional, Sequence, Tuple
 from queue import Queue
 import threading
 
@@ -43,17 +44,21 @@ except Exception:  # pragma: no cover - fallback if module missing
     _base = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
     _native = os.path.join(_base, "native")
     _libname = "levenshtein.dll" if os.name == "nt" else "liblevenshtein.so"
-    try:  # pragma: no cover - depends on library presence
-        _lib = ctypes.CDLL(os.path.join(_native, _libname))
-        _lib.levenshtein_distance.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
-        _lib.levenshtein_distance.restype = ctypes.c_int
-
-        def _levenshtein_distance(a: str, b: str) -> int:
-            return _lib.levenshtein_distance(a.encode("utf-8"), b.encode("utf-8"))
-
-    except OSError:  # pragma: no cover - fallback to pure python
-        def _levenshtein_distance(a: str, b: str) -> int:
-            return _levenshtein_distance_py(a, b)
+    try:  # pragma: no cover - depends on the built extension
+        # Moduł rozszerzenia z native_c/CMakeLists.txt: odległość w znakach
+        from native_kernels import levenshtein_distance as _levenshtein_distance
+    except ImportError:
+        try:  # pragma: no cover - depends on library presence
+            _lib = ctypes.CDLL(os.path.join(_native, _libname))
+            _lib.levenshtein_distance.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+            _lib.levenshtein_distance.restype = ctypes.c_int
+
+            def _levenshtein_distance(a: str, b: str) -> int:
+                return _lib.levenshtein_distance(a.encode("utf-8"), b.encode("utf-8"))
+
+        except OSError:  # pragma: no cover - fallback to pure python
+            def _levenshtein_distance(a: str, b: str) -> int:
+                return _levenshtein_distance_py(a, b)
 
     class _LevenshteinModule:
         @staticmethod
@@ -69,7 +74,7 @@ except Exception:  # pragma: no cover - simple heuristic fallback
         polish_chars = set("ąćęłńóśżź")
         return "pl" if any(ch in polish_chars for ch in text.lower()) else "en"
 from pdf2image import convert_from_path, pdfinfo_from_path
-from concurrent.futures import ThreadPoolExecutor, as_completed
+from concurrent.futures import FIRST_COMPLETED, ThreadPoolExecutor, as_completed, wait
 
 try:
     import config as app_config
@@ -85,6 +90,21 @@ except ModuleNotFoundError:  # pragma: no cover - fallback for tests
     spec.loader.exec_module(app_config)  # type: ignore
     _sys.modules["config"] = app_config
 
+try:
+    import barcodes
+    import bilevel
+    import ocr_scheduler
+    import page_cache
+except ModuleNotFoundError:  # pragma: no cover - fallback for tests
+    import pathlib
+    import sys as _sys
+
+    _sys.path.insert(0, str(pathlib.Path(__file__).resolve().parent.parent))
+    import barcodes
+    import bilevel
+    import ocr_scheduler
+    import page_cache
+
 logger = logging.getLogger(__name__)
 
 
@@ -143,6 +163,138 @@ def _build_config(config: str, psm: int, oem: int) -> str:
     return " ".join(parts)
 
 
+def _open_page_cache():
+    """Return the shared page cache or ``None`` when it is disabled."""
+    if not getattr(app_config.SETTINGS, "ocr_page_cache", False):
+        return None
+    try:
+        return page_cache.open_page_cache(app_config.SETTINGS)
+    except Exception as exc:
+        logger.warning("Pamięć podręczna stron OCR niedostępna: %s", exc)
+        return None
+
+
+def _lookup_page(cache, profile: int, pil_image, lookup: bool = True):
+    """Hash a rasterized page and look it up in the page cache.
+
+    Returns:
+        ``(page, text)`` where ``page`` is ``None`` when the page could not be
+        hashed and ``text`` is ``None`` for a page not seen before or when
+        ``lookup`` is false.
+    """
+    try:
+        page = page_cache.hash_image(pil_image)
+        if page is None or not lookup:
+            return page, None
+        return page, cache.get(profile, page)
+    except Exception as exc:
+        logger.debug("Pominięto pamięć podręczną dla strony: %s", exc)
+        return None, None
+
+
+def _store_page(cache, profile: int, page, text: str, replace: bool = False) -> None:
+    """Remember recognised page text; cache errors never fail the OCR."""
+    try:
+        cache.put(profile, page, text, replace=replace)
+    except Exception as exc:
+        logger.warning("Nie zapisano strony w pamięci podręcznej OCR: %s", exc)
+
+
+def _popen_kwargs() -> dict:
+    if os.name == "nt":
+        return {
+            "popen_kwargs": {"creationflags": getattr(subprocess, "CREATE_NO_WINDOW", 0)}
+        }
+    return {}
+
+
+def _rasterize(pdf_path: str, **pages) -> list:
+    """Rasterize ``pdf_path`` (or the page range in ``pages``) for OCR."""
+    try:
+        return convert_from_path(
+            pdf_path,
+            app_config.SETTINGS.ocr_dpi,
+            poppler_path=app_config.SETTINGS.poppler_folder or None,
+            fmt="jpeg",
+            **pages,
+            **_popen_kwargs(),
+        )
+    except TypeError:
+        return convert_from_path(
+            pdf_path,
+            app_config.SETTINGS.ocr_dpi,
+            poppler_path=app_config.SETTINGS.poppler_folder or None,
+            fmt="jpeg",
+            **pages,
+        )
+
+
+def _count_pages(path: str) -> int:
+    try:
+        try:
+            info = pdfinfo_from_path(
+                path,
+                poppler_path=app_config.SETTINGS.poppler_folder or None,
+                **_popen_kwargs(),
+            )
+        except TypeError:
+            info = pdfinfo_from_path(
+                path,
+                poppler_path=app_config.SETTINGS.poppler_folder or None,
+            )
+        return int(info.get("Pages", 0))
+    except Exception as e:  # pragma: no cover - log and continue
+        logger.error("Błąd odczytu liczby stron dla %s: %s", path, e)
+        return 0
+
+
+def _read_codes(pil_image) -> list:
+    """Return barcodes and QR codes of a page; decoding errors give none."""
+    # Linie skanu co ok. 8 pikseli przy 300 dpi
+    step = max(1, barcodes.SCAN_STEP * app_config.SETTINGS.ocr_dpi // 300)
+    try:
+        return barcodes.read_codes(pil_image, step)
+    except Exception as exc:
+        logger.debug("Pominięto odczyt kodów kreskowych: %s", exc)
+        return []
+
+
+def _binarize(pil_image):
+    """Preprocess a rasterized page for Tesseract: grey, median blur, threshold."""
+    open_cv_image = np.array(pil_image)
+    gray = cv2.cvtColor(open_cv_image, cv2.COLOR_BGR2GRAY)
+    blurred = cv2.medianBlur(gray, app_config.SETTINGS.blur_kernel_size)
+    return cv2.adaptiveThreshold(
+        blurred,
+        255,
+        cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
+        cv2.THRESH_BINARY,
+        app_config.SETTINGS.adaptive_threshold_block_size,
+        app_config.SETTINGS.adaptive_threshold_c,
+    )
+
+
+def _add_bilevel_page(pages: list, pil_image, binary=None) -> None:
+    """Append the G4-encoded page to ``pages`` for archive recompression.
+
+    ``None`` is appended for a page with colour content, after which the
+    rest of the document is not encoded since it keeps its original file.
+    """
+    if pages and pages[-1] is None:
+        return
+    try:
+        max_colour = getattr(app_config.SETTINGS, "archive_bilevel_max_colour", 0.001)
+        if bilevel.is_colour(pil_image, max_colour):
+            pages.append(None)
+            return
+        if binary is None:
+            binary = _binarize(pil_image)
+        pages.append(bilevel.encode_page(binary, app_config.SETTINGS.ocr_dpi))
+    except Exception as exc:
+        logger.debug("Pominięto rekompresję strony: %s", exc)
+        pages.append(None)
+
+
 def extract_text_with_ocr(
     pdf_path: str,
     progress_queue: Optional[Queue] = None,
@@ -150,6 +302,12 @@ def extract_text_with_ocr(
     config: str = "",
     psm: int = 3,
     oem: int = 3,
+    codes: Optional[list] = None,
+    skip_routed: bool = False,
+    bilevel_pages: Optional[list] = None,
+    priority: int = ocr_scheduler.BATCH,
+    cancel_event: Optional[threading.Event] = None,
+    use_page_cache: bool = True,
 ) -> Tuple[str, str]:
     """Perform OCR on a single PDF file.
 
@@ -160,71 +318,113 @@ def extract_text_with_ocr(
         config: Additional Tesseract configuration string.
         psm: Page segmentation mode for Tesseract.
         oem: OCR engine mode for Tesseract.
+        codes: Optional list receiving the barcodes and QR codes of the
+            first page (see ``barcodes.py``).
+        skip_routed: With ``codes``, rasterize the first page alone and
+            skip OCR of the document when its codes carry the case
+            signature; the text is then empty and the status
+            ``"Kod kreskowy"``.
+        bilevel_pages: Optional list receiving every page binarized and
+            encoded with CCITT G4 (see ``bilevel.py``).
+        priority: Priority lane of the pages; ``ocr_scheduler.INTERACTIVE``
+            for a single document a user waits for, so it takes the next
+            free engine ahead of batch pages.
+        cancel_event: Optional event checked before every page; once set,
+            the remaining pages are skipped and the status is
+            ``"Anulowano"``.
+        use_page_cache: With ``False`` every page is recognised by
+            Tesseract even when cached, and the new text replaces the
+            cached one; used when a user asks for a document to be
+            recognised again.
 
     Returns:
         A tuple ``(text, status)`` containing recognized text and status
         message.
+
+    With ``ocr_page_cache`` enabled, pages identical after binarization to a
+    page already recognised with the same settings take their text from the
+    page cache (see ``page_cache.py``) instead of running Tesseract.
+
+    Each page holds one engine of the shared ``ocr_scheduler`` only while
+    it is recognised, so concurrent recognitions interleave page by page.
     """
 
     try:
         config = _build_config(config, psm, oem)
-        kwargs = {}
-        if os.name == "nt":
-            kwargs["popen_kwargs"] = {
-                "creationflags": getattr(subprocess, "CREATE_NO_WINDOW", 0)
-            }
-        try:
-            images = convert_from_path(
-                pdf_path,
-                app_config.SETTINGS.ocr_dpi,
-                poppler_path=app_config.SETTINGS.poppler_folder or None,
-                fmt="jpeg",
-                **kwargs,
-            )
-        except TypeError:
-            images = convert_from_path(
-                pdf_path,
-                app_config.SETTINGS.ocr_dpi,
-                poppler_path=app_config.SETTINGS.poppler_folder or None,
-                fmt="jpeg",
-            )
+        if codes is not None and skip_routed:
+            # Najpierw sama pierwsza strona: kod z sygnaturą zastępuje OCR
+            images = _rasterize(pdf_path, first_page=1, last_page=1)
+            if images:
+                codes.extend(_read_codes(images[0]))
+                if barcodes.routing_fields(codes).get("sygnatura_sprawy"):
+                    if progress_queue is not None:
+                        progress_queue.put(("page_done", _count_pages(pdf_path)))
+                    return "", "Kod kreskowy"
+                images += _rasterize(pdf_path, first_page=2)
+        else:
+            images = _rasterize(pdf_path)
+            if images and codes is not None:
+                codes.extend(_read_codes(images[0]))
         if not images:
             return "BŁĄD: Plik PDF jest pusty lub uszkodzony.", ""
 
+        cache = _open_page_cache()
+        profile = page_cache.profile_key(
+            language,
+            config,
+            app_config.SETTINGS.ocr_dpi,
+            app_config.SETTINGS.blur_kernel_size,
+            app_config.SETTINGS.adaptive_threshold_block_size,
+            app_config.SETTINGS.adaptive_threshold_c,
+        )
+        engines = ocr_scheduler.shared(app_config.SETTINGS.ocr_workers)
         full_text = ""
         for pil_image in images:
-            open_cv_image = np.array(pil_image)
-            gray = cv2.cvtColor(open_cv_image, cv2.COLOR_BGR2GRAY)
-            blurred = cv2.medianBlur(gray, app_config.SETTINGS.blur_kernel_size)
-            processed_cv_image = cv2.adaptiveThreshold(
-                blurred,
-                255,
-                cv2.ADAPTIVE_THRESH_GAUSSIAN_C,
-                cv2.THRESH_BINARY,
-                app_config.SETTINGS.adaptive_threshold_block_size,
-                app_config.SETTINGS.adaptive_threshold_c,
+            if cancel_event is not None and cancel_event.is_set():
+                return full_text, "Anulowano"
+            page, cached = (
+                _lookup_page(cache, profile, pil_image, use_page_cache)
+                if cache is not None
+                else (None, None)
             )
-
-            lang = language
-            text_page = ""
-            if language == "auto":
-                preliminary = pytesseract.image_to_string(
-                    processed_cv_image, lang="pol+eng", config=config
-                )
-                try:
-                    detected = detect(preliminary)
-                    lang = "pol" if detected == "pl" else "eng"
-                except Exception:  # pragma: no cover - fall back to polish
-                    lang = "pol"
-                text_page = pytesseract.image_to_string(
-                    processed_cv_image, lang=lang, config=config
-                )
-            else:
-                text_page = pytesseract.image_to_string(
-                    processed_cv_image, lang=lang, config=config
-                )
-
-            text_page = correct_text(text_page, lang)
+            if cached is not None:
+                full_text += cached + "\n"
+                if bilevel_pages is not None:
+                    _add_bilevel_page(bilevel_pages, pil_image)
+                if progress_queue is not None:
+                    progress_queue.put(("page_done", 1))
+                continue
+
+            with engines.engine(priority):
+                # Anulowanie mogło nastąpić w czasie oczekiwania na silnik
+                if cancel_event is not None and cancel_event.is_set():
+                    return full_text, "Anulowano"
+                processed_cv_image = _binarize(pil_image)
+                if bilevel_pages is not None:
+                    _add_bilevel_page(bilevel_pages, pil_image, processed_cv_image)
+
+                lang = language
+                text_page = ""
+                if language == "auto":
+                    preliminary = pytesseract.image_to_string(
+                        processed_cv_image, lang="pol+eng", config=config
+                    )
+                    try:
+                        detected = detect(preliminary)
+                        lang = "pol" if detected == "pl" else "eng"
+                    except Exception:  # pragma: no cover - fall back to polish
+                        lang = "pol"
+                    text_page = pytesseract.image_to_string(
+                        processed_cv_image, lang=lang, config=config
+                    )
+                else:
+                    text_page = pytesseract.image_to_string(
+                        processed_cv_image, lang=lang, config=config
+                    )
+
+                text_page = correct_text(text_page, lang)
+            if page is not None:
+                _store_page(cache, profile, page, text_page, replace=not use_page_cache)
             full_text += text_page + "\n"
             if progress_queue is not None:
                 progress_queue.put(("page_done", 1))
@@ -261,29 +461,6 @@ def extract_texts_with_ocr_parallel(
         A tuple with a list of per-file OCR results and total page count.
     """
 
-    def _count_pages(path: str) -> int:
-        try:
-            kwargs = {}
-            if os.name == "nt":
-                kwargs["popen_kwargs"] = {
-                    "creationflags": getattr(subprocess, "CREATE_NO_WINDOW", 0)
-                }
-            try:
-                info = pdfinfo_from_path(
-                    path,
-                    poppler_path=app_config.SETTINGS.poppler_folder or None,
-                    **kwargs,
-                )
-            except TypeError:
-                info = pdfinfo_from_path(
-                    path,
-                    poppler_path=app_config.SETTINGS.poppler_folder or None,
-                )
-            return int(info.get("Pages", 0))
-        except Exception as e:  # pragma: no cover - log and continue
-            logger.error("Błąd odczytu liczby stron dla %s: %s", path, e)
-            return 0
-
     config = _build_config(config, psm, oem)
     total_pages = sum(_count_pages(path) for path in pdf_paths)
 
@@ -302,6 +479,7 @@ def extract_texts_with_ocr_parallel(
             config,
             psm,
             oem,
+            cancel_event=cancel_event,
         ): idx
         for idx, path in enumerate(pdf_paths)
     }
@@ -323,3 +501,109 @@ def extract_texts_with_ocr_parallel(
 
     return results, total_pages
 
+
+@dataclass
+class OcrExtras:
+    """Per-document results of :func:`iter_texts_with_ocr` besides the text."""
+
+    codes: list = field(default_factory=list)
+    bilevel_pages: list = field(default_factory=list)
+
+
+def iter_texts_with_ocr(
+    pdf_paths: Sequence[str],
+    cancel_event: threading.Event,
+    progress_queue: Optional[Queue] = None,
+    language: str = "pol",
+    config: str = "",
+    psm: int = 3,
+    oem: int = 3,
+    max_pending: int = 0,
+    read_codes: bool = False,
+    skip_routed: bool = False,
+    encode_bilevel: bool = False,
+) -> Iterator[Tuple[int, tuple]]:
+    """Perform OCR on multiple PDFs and yield each one as soon as it is done.
+
+    Unlike :func:`extract_texts_with_ocr_parallel` the caller can start
+    working on the first documents while the others are still recognized.
+    At most ``max_pending`` files are submitted ahead of the consumer, so a
+    slow consumer throttles OCR instead of accumulating finished texts.  A
+    file is also never submitted ``max_pending`` or more positions after the
+    oldest one still being recognized, which keeps a consumer restoring the
+    original order from buffering an unbounded number of documents.
+
+    Args:
+        pdf_paths: Iterable of PDF paths to process.
+        cancel_event: Event flag to stop processing early.
+        progress_queue: Optional queue for progress updates.
+        language: OCR language or ``"auto"`` for detection.
+        config: Additional Tesseract configuration string.
+        psm: Page segmentation mode for Tesseract.
+        oem: OCR engine mode for Tesseract.
+        max_pending: Maximum number of files in flight or awaiting the
+            consumer; ``0`` uses twice the number of OCR workers.
+        read_codes: Also read the barcodes and QR codes of each first page.
+        skip_routed: With ``read_codes``, skip OCR of documents whose codes
+            carry the case signature (see :func:`extract_text_with_ocr`).
+        encode_bilevel: Also encode every page with CCITT G4 for archive
+            recompression.
+
+    Once ``cancel_event`` is set nothing more is yielded, so documents cut
+    short with the status ``"Anulowano"`` never reach the consumer.
+
+    Yields:
+        ``(index, (text, status))`` pairs in completion order, or
+        ``(index, (text, status, extras))`` with an :class:`OcrExtras` when
+        ``read_codes`` or ``encode_bilevel`` is set.
+    """
+    config = _build_config(config, psm, oem)
+    workers = app_config.SETTINGS.ocr_workers or os.cpu_count() or 1
+    max_pending = max(max_pending or 2 * workers, workers)
+    pdf_paths = list(pdf_paths)
+    next_idx = 0
+    executor = ThreadPoolExecutor(max_workers=workers)
+    pending = {}
+
+    def _fill() -> None:
+        nonlocal next_idx
+        while (
+            next_idx < len(pdf_paths)
+            and len(pending) < max_pending
+            and not cancel_event.is_set()
+        ):
+            oldest = min((i for i, _ in pending.values()), default=next_idx)
+            if next_idx >= oldest + max_pending:
+                return
+            idx, path = next_idx, pdf_paths[next_idx]
+            next_idx += 1
+            extras = OcrExtras() if read_codes or encode_bilevel else None
+            extra = {"cancel_event": cancel_event}
+            if read_codes:
+                extra.update(codes=extras.codes, skip_routed=skip_routed)
+            if encode_bilevel:
+                extra["bilevel_pages"] = extras.bilevel_pages
+            future = executor.submit(
+                extract_text_with_ocr, path, progress_queue, language, config, psm, oem, **extra
+            )
+            pending[future] = (idx, extras)
+
+    try:
+        _fill()
+        while pending and not cancel_event.is_set():
+            done, _ = wait(pending, timeout=0.1, return_when=FIRST_COMPLETED)
+            for future in done:
+                idx, extras = pending.pop(future)
+                try:
+                    result = future.result()
+                except Exception as e:  # pragma: no cover - defensive programming
+                    logger.error(f"Błąd równoległego OCR: {e}")
+                    result = (f"BŁĄD TECHNICZNY OCR: {e}", traceback.format_exc())
+                # Po anulowaniu dokumenty są niepełne i nie trafiają do konsumenta
+                if cancel_event.is_set() or result[1] == "Anulowano":
+                    break
+                yield idx, result if extras is None else (*result, extras)
+            _fill()
+    finally:
+        cancelled = cancel_event.is_set()
+        executor.shutdown(wait=not cancelled, cancel_futures=cancelled)
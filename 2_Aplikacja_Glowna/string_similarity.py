@@ -0,0 +1,227 @@
+"""Jaro-Winkler and Levenshtein ratio from ``native/levenshtein.c``.
+
+Both metrics work on Python characters, not UTF-8 bytes, and use
+bit-parallel pattern masks: one 64-bit word per text character for strings
+up to 64 characters, a block of words for longer ones.  :func:`batch`
+prepares the masks of the query once and scores it against many strings in
+parallel, which is how past corrections are matched against a 1000-2000
+character OCR fragment.
+
+The kernels are called through the ``native_kernels`` extension module
+built by ``native_c/CMakeLists.txt`` when it is importable, otherwise
+through ctypes.  Without either the same definitions run in Python, giving
+identical scores, so results never depend on optional wheels such as
+rapidfuzz or python-Levenshtein.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import os
+from array import array
+from typing import List, Sequence
+
+import native_lib
+
+try:  # pragma: no cover - depends on the built extension
+    import native_kernels as _ext
+except ImportError:
+    _ext = None
+
+# Metryki similarity_batch() w native/levenshtein.c
+JARO_WINKLER = 0
+LEVENSHTEIN_RATIO = 1
+_METRICS = {"jaro_winkler": JARO_WINKLER, "levenshtein_ratio": LEVENSHTEIN_RATIO}
+
+# Waga wspólnego prefiksu według Winklera
+PREFIX_WEIGHT = 0.1
+
+_UIntPtr = ctypes.POINTER(ctypes.c_uint32)
+
+
+def _configure(lib: ctypes.CDLL) -> None:
+    lib.jaro_winkler_similarity.argtypes = [
+        _UIntPtr, ctypes.c_size_t, _UIntPtr, ctypes.c_size_t, ctypes.c_double
+    ]
+    lib.jaro_winkler_similarity.restype = ctypes.c_double
+    lib.levenshtein_ratio.argtypes = [
+        _UIntPtr, ctypes.c_size_t, _UIntPtr, ctypes.c_size_t
+    ]
+    lib.levenshtein_ratio.restype = ctypes.c_double
+    lib.similarity_batch.argtypes = [
+        ctypes.c_int,
+        _UIntPtr,
+        ctypes.c_size_t,
+        _UIntPtr,
+        ctypes.POINTER(ctypes.c_size_t),
+        ctypes.c_size_t,
+        ctypes.c_double,
+        ctypes.POINTER(ctypes.c_double),
+    ]
+    lib.similarity_batch.restype = ctypes.c_int
+
+
+# Biblioteka z prefiksem "lib" także na Windows
+_library = native_lib.NativeLibrary(
+    "levenshtein", _configure, "liblevenshtein.dll" if os.name == "nt" else ""
+)
+
+
+def is_available() -> bool:
+    """Return ``True`` when the native similarity kernels can be used."""
+    return _ext is not None or _library.is_available()
+
+
+def _code_points(text: str) -> array:
+    buf = array("I")
+    buf.frombytes(text.encode("utf-32-le"))
+    return buf
+
+
+def _pointer(buf: array, ctype):
+    address, _ = buf.buffer_info()
+    return ctypes.cast(address, ctypes.POINTER(ctype))
+
+
+def _jaro_winkler_python(p: str, t: str, prefix_weight: float) -> float:
+    lp, lt = len(p), len(t)
+    if not lp and not lt:
+        return 1.0
+    if not lp or not lt:
+        return 0.0
+    bound = max(max(lp, lt) // 2 - 1, 0)
+    pflag = [False] * lp
+    matched = []
+    for j, ch in enumerate(t):
+        lo, hi = max(j - bound, 0), min(j + bound, lp - 1)
+        if lo > hi:
+            break
+        for i in range(lo, hi + 1):
+            if not pflag[i] and p[i] == ch:
+                pflag[i] = True
+                matched.append(ch)
+                break
+    sim = 0.0
+    if matched:
+        ordered = [p[i] for i in range(lp) if pflag[i]]
+        trans = sum(a != b for a, b in zip(matched, ordered))
+        m = len(matched)
+        sim = (m / lp + m / lt + (m - trans // 2) / m) / 3.0
+    if sim > 0.7:
+        prefix = 0
+        for a, b in zip(p[:4], t[:4]):
+            if a != b:
+                break
+            prefix += 1
+        sim += prefix * prefix_weight * (1.0 - sim)
+    return sim
+
+
+def _ratio_python(a: str, b: str) -> float:
+    if not a and not b:
+        return 1.0
+    if len(a) > len(b):
+        a, b = b, a
+    # Najdłuższy wspólny podciąg tym samym algorytmem bitowym na liczbach Pythona
+    masks = {}
+    for i, ch in enumerate(a):
+        masks[ch] = masks.get(ch, 0) | (1 << i)
+    full = (1 << len(a)) - 1
+    s = full
+    for ch in b:
+        m = masks.get(ch)
+        if m:
+            u = s & m
+            s = ((s + u) | (s - u)) & full
+    lcs = bin(~s & full).count("1")
+    return 2.0 * lcs / (len(a) + len(b))
+
+
+def jaro_winkler(a: str, b: str, prefix_weight: float = PREFIX_WEIGHT) -> float:
+    """Jaro-Winkler similarity of ``a`` and ``b`` in ``[0, 1]``.
+
+    Characters of ``b`` are matched to the first free equal character of
+    ``a`` within the Jaro window; the common prefix (up to 4 characters)
+    boosts scores above 0.7.
+    """
+    if _ext is not None:
+        return _ext.jaro_winkler(a, b, prefix_weight)
+    lib = _library.load()
+    if lib is not None:
+        pa, pb = _code_points(a), _code_points(b)
+        sim = lib.jaro_winkler_similarity(
+            _pointer(pa, ctypes.c_uint32), len(a), _pointer(pb, ctypes.c_uint32), len(b),
+            prefix_weight,
+        )
+        if sim >= 0:
+            return sim
+    return _jaro_winkler_python(a, b, prefix_weight)
+
+
+def levenshtein_ratio(a: str, b: str) -> float:
+    """Normalized InDel similarity ``2 * LCS / (len(a) + len(b))``.
+
+    This is the ``ratio`` of python-Levenshtein and rapidfuzz.
+    """
+    if _ext is not None:
+        return _ext.levenshtein_ratio(a, b)
+    lib = _library.load()
+    if lib is not None:
+        pa, pb = _code_points(a), _code_points(b)
+        ratio = lib.levenshtein_ratio(
+            _pointer(pa, ctypes.c_uint32), len(a), _pointer(pb, ctypes.c_uint32), len(b)
+        )
+        if ratio >= 0:
+            return ratio
+    return _ratio_python(a, b)
+
+
+def batch(
+    query: str,
+    choices: Sequence[str],
+    metric: str = "jaro_winkler",
+    prefix_weight: float = PREFIX_WEIGHT,
+) -> List[float]:
+    """Score ``query`` against every string of ``choices``.
+
+    Args:
+        query: String compared with all choices; for Jaro-Winkler it is the
+            first argument of :func:`jaro_winkler`.
+        choices: Strings to score.
+        metric: ``"jaro_winkler"`` or ``"levenshtein_ratio"``.
+        prefix_weight: Winkler prefix weight.
+
+    Returns:
+        One score per choice, in order.
+    """
+    code = _METRICS[metric]
+    if not choices:
+        return []
+    if _ext is not None:
+        return _ext.similarity_batch(query, choices, code, prefix_weight)
+    lib = _library.load()
+    if lib is not None:
+        q = _code_points(query)
+        texts = _code_points("".join(choices))
+        offsets = (ctypes.c_size_t * (len(choices) + 1))()
+        pos = 0
+        for k, choice in enumerate(choices):
+            offsets[k] = pos
+            pos += len(choice)
+        offsets[len(choices)] = pos
+        out = (ctypes.c_double * len(choices))()
+        status = lib.similarity_batch(
+            code,
+            _pointer(q, ctypes.c_uint32),
+            len(query),
+            _pointer(texts, ctypes.c_uint32),
+            offsets,
+            len(choices),
+            prefix_weight,
+            out,
+        )
+        if status == 0:
+            return list(out)
+    if code == JARO_WINKLER:
+        return [_jaro_winkler_python(query, c, prefix_weight) for c in choices]
+    return [_ratio_python(query, c) for c in choices]
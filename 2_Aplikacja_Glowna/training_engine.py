@@ -11,12 +11,18 @@ from spacy.tokens import DocBin
 from spacy.cli.train import train
 import random
 import subprocess
-from concurrent.futures import ThreadPoolExecutor
 import logging
 import shutil
+import threading
+
+from native_aligner import align_spans
+from processing.ner import resolve_processes
 
 # Konfiguracja logowania
 logger = logging.getLogger(__name__)
+
+# Czas na posprzątanie po poleceniu cancel, zanim proces OCR zostanie zabity
+STOP_GRACE_SECONDS = 5.0
 
 # --- Konfiguracja Ścieżek ---
 if getattr(sys, 'frozen', False):
@@ -44,6 +50,13 @@ TYPY_DOKUMENTOW = {
     "UMOWA": ["umowa", "umowy"], "POROZUMIENIE": ["porozumienie"],
     "PROTOKÓŁ": ["protokół", "protokołu"], "ODBIÓR": ["odbiór", "odbioru"]
 }
+# Dokumenty w jednym pliku .spacy zapisywanym w trakcie OCR
+DOC_BIN_CHUNK = 256
+
+
+class OcrEngineError(RuntimeError):
+    """The ``training_ocr`` process could not be run or did not finish."""
+
 
 def find_all_occurrences(text: str, sub: str) -> Iterator[int]:
     """Yield indices of all occurrences of ``sub`` in ``text``."""
@@ -66,45 +79,183 @@ def detect_document_type(text: str) -> Tuple[Optional[str], Optional[int], Optio
     return None, None, None
 
 
-def run_cpp_ocr(pdf_paths: List[str]) -> List[str]:
-    """Wywołuje moduł C++ do równoległego OCR."""
-    exe_path = os.path.join(base_path, "training_ocr")
+def align_entities(text: str, patterns: List[Tuple[str, str]]) -> List[List]:
+    """Znajduje wszystkie wartości z rozpiski w tekście jednym wywołaniem.
+
+    Dokładne i przybliżone (błędy OCR) wystąpienia wyszukuje
+    :func:`native_aligner.align_spans`; zwrócone zakresy
+    ``[start, end, etykieta]`` nie nakładają się na siebie.
+    """
+    labels = {}
+    for value, label in patterns:
+        value = value.strip()
+        if value:
+            labels.setdefault(value, label)
+    values = list(labels)
+    return [
+        [start, end, labels[values[index]]]
+        for start, end, index in align_spans(text, values)
+    ]
 
-    def _worker(paths):
-        cmd = [exe_path] + paths
-        creationflags = subprocess.CREATE_NO_WINDOW if os.name == "nt" else 0
-        result = subprocess.run(
-            cmd,
-            capture_output=True,
+
+def run_cpp_ocr_stream(
+    pdf_paths: List[str],
+    pdf_dir: Optional[str] = None,
+    bilevel: bool = False,
+    cancel_event: Optional[threading.Event] = None,
+    progress: Optional[Callable[[int, str, int, int, int], None]] = None,
+) -> Iterator[tuple]:
+    """Uruchamia jeden proces C++ OCR dla wszystkich plików.
+
+    Ścieżki trafiają na stdin, a wyniki są zwracane jako ``(indeks, tekst)``
+    w kolejności ukończenia, zanim OCR pozostałych plików się zakończy.
+    Pliki, których nie udało się przetworzyć, dają pusty tekst.
+
+    Gdy podano ``pdf_dir``, w tym samym przebiegu OCR powstają tam
+    przeszukiwalne PDF-y (obraz strony z niewidoczną warstwą tekstu), a
+    wyniki mają postać ``(indeks, tekst, ścieżka_pdf)``; ścieżka jest pusta,
+    gdy pliku nie udało się zapisać.  ``bilevel`` osadza strony
+    zbinaryzowane (CCITT G4) zamiast JPEG, co zmniejsza pliki skanów tekstu.
+
+    Ustawienie ``cancel_event`` przerywa OCR w ciągu milisekund: proces
+    dostaje polecenie ``cancel`` na stdin (pusta linia kończy listę plików),
+    przerywa rozpoznawanie bieżących stron i rasteryzację ``pdftoppm``,
+    usuwa pliki tymczasowe i kończy się, zwalniając rdzenie.  Polecenie
+    działa także na Windows, gdzie ``terminate()`` zabija proces bez
+    sprzątania; proces, który nie zakończy się w ciągu
+    ``STOP_GRACE_SECONDS``, jest zabijany.  ``progress`` jest
+    wywoływane jako ``progress(indeks, etap, strona, stron, procent)``
+    w trakcie rozpoznawania każdej strony (etapy ``"rasterize"`` i ``"ocr"``).
+
+    Raises:
+        OcrEngineError: procesu nie można uruchomić, zwrócił nieczytelny
+            wynik albo zakończył się bez wyników części plików (np. po
+            awarii).  Wyniki odebrane wcześniej zostały już zwrócone.
+    """
+    if not pdf_paths:
+        return
+    exe_path = os.path.join(base_path, "training_ocr")
+    creationflags = subprocess.CREATE_NO_WINDOW if os.name == "nt" else 0
+    args = [exe_path, "--stream"]
+    if progress is not None:
+        args.append("--progress")
+    if pdf_dir:
+        args += ["--pdf", pdf_dir]
+        if bilevel:
+            args.append("--pdf-bilevel")
+    try:
+        proc = subprocess.Popen(
+            [*args, "-"],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL,
             text=True,
-            check=True,
+            encoding="utf-8",
             creationflags=creationflags,
         )
-        return json.loads(result.stdout or "[]")
+    except OSError as exc:
+        raise OcrEngineError(f"Nie można uruchomić {exe_path}: {exc}") from exc
+    received = set()
+    stdin_lock = threading.Lock()
+
+    def _stop() -> None:
+        with stdin_lock:
+            try:
+                proc.stdin.write("cancel\n")
+                proc.stdin.flush()
+            except (OSError, ValueError):
+                pass
+        try:
+            proc.wait(timeout=STOP_GRACE_SECONDS)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+
+    def _watch_cancel() -> None:
+        while proc.poll() is None:
+            if cancel_event.wait(0.01):
+                _stop()
+                return
+
+    try:
+        # Stdin zostaje otwarte na polecenia, więc lista kończy się pustą linią
+        with stdin_lock:
+            proc.stdin.write("\n".join(pdf_paths) + "\n\n")
+            proc.stdin.flush()
+        if cancel_event is not None:
+            threading.Thread(target=_watch_cancel, daemon=True).start()
+        for line in proc.stdout:
+            if not line.strip():
+                continue
+            try:
+                item = json.loads(line)
+            except ValueError as exc:
+                raise OcrEngineError(f"Nieczytelny wynik OCR: {line[:200]!r}") from exc
+            if "stage" in item:
+                if progress is not None:
+                    progress(
+                        item["index"], item["stage"], item["page"], item["pages"], item["percent"]
+                    )
+                continue
+            if cancel_event is not None and cancel_event.is_set():
+                break
+            if item.get("error"):
+                logger.warning("OCR C++: %s: %s", pdf_paths[item["index"]], item["error"])
+            if item.get("pdf_error"):
+                logger.warning("PDF C++: %s: %s", pdf_paths[item["index"]], item["pdf_error"])
+            received.add(item["index"])
+            if pdf_dir:
+                yield item["index"], item.get("text", ""), item.get("pdf", "")
+            else:
+                yield item["index"], item.get("text", "")
+        else:
+            # Kod 1 oznacza błędy pojedynczych plików, zgłoszone już w wynikach
+            returncode = proc.wait()
+            missing = len(pdf_paths) - len(received)
+            cancelled = cancel_event is not None and cancel_event.is_set()
+            if not cancelled and (missing or returncode not in (0, 1)):
+                raise OcrEngineError(
+                    f"training_ocr zakończył się kodem {returncode}, "
+                    f"brak wyników dla {missing} z {len(pdf_paths)} plików"
+                )
+    finally:
+        proc.stdout.close()
+        if proc.poll() is None:
+            # Polecenie cancel pozwala usunąć strony tymczasowe i niedokończone PDF-y
+            _stop()
+        proc.wait()
+        with stdin_lock:
+            try:
+                proc.stdin.close()
+            except OSError:
+                pass
+
+
+def run_cpp_ocr(pdf_paths: List[str]) -> List[str]:
+    """Wywołuje moduł C++ do równoległego OCR."""
+    texts = ["" for _ in pdf_paths]
+    for index, text in run_cpp_ocr_stream(pdf_paths):
+        texts[index] = text
+    return texts
+
+
+def _collect_sheet_entries(
+    input_dir: str, log_callback: Callable[[str], None]
+) -> List[Tuple[str, str, List[Tuple[str, str]]]]:
+    """Zbiera z rozpisek wszystkich folderów ``(plik, ścieżka, wzorce)``."""
+    entries = []
+    for root, _, files in os.walk(input_dir):
+        xlsx_files = [f for f in files if f.lower().endswith('.xlsx')]
+        if not xlsx_files:
+            continue
+
+        xlsx_path = os.path.join(root, xlsx_files[0])
+        log_callback(f"\n--- Przetwarzanie rozpiski: {os.path.basename(xlsx_path)} ---")
+        try:
+            df = pd.read_excel(xlsx_path)
+        except Exception as e:
+            log_callback(f"!! Błąd odczytu pliku Excel: {e}")
+            continue
 
-    with ThreadPoolExecutor(max_workers=1) as executor:
-        future = executor.submit(_worker, pdf_paths)
-        return future.result()
-
-def create_training_data_from_sheets(input_dir: str, log_callback: Callable[[str], None]) -> Optional[str]:
-    """Krok 1: Przetwarza foldery z rozpiskami i PDF-ami na plik JSONL."""
-    log_callback("Rozpoczynanie przygotowania danych treningowych...")
-    training_data = []
-
-    for root, _, files in os.walk(input_dir):
-        xlsx_files = [f for f in files if f.lower().endswith('.xlsx')]
-        if not xlsx_files:
-            continue
-
-        xlsx_path = os.path.join(root, xlsx_files[0])
-        log_callback(f"\n--- Przetwarzanie rozpiski: {os.path.basename(xlsx_path)} ---")
-        try:
-            df = pd.read_excel(xlsx_path)
-        except Exception as e:
-            log_callback(f"!! Błąd odczytu pliku Excel: {e}")
-            continue
-
-        pdf_entries = []
         for index, row in df.iterrows():
             pdf_filename = row.get(KOLUMNA_Z_NAZWA_PLIKU)
             if not pdf_filename or not isinstance(pdf_filename, str):
@@ -115,55 +266,157 @@ def create_training_data_from_sheets(input_dir: str, log_callback: Callable[[str
                 log_callback(f"!! Ostrzeżenie: Plik PDF '{pdf_filename}' nie został znaleziony.")
                 continue
 
-            pdf_entries.append((row, pdf_filename, pdf_path))
+            patterns = [
+                (str(row[col_name]), label)
+                for col_name, label in KOLUMNY_MAPOWANIE.items()
+                if col_name in row and pd.notna(row[col_name])
+            ]
+            entries.append((pdf_filename, pdf_path, patterns))
+    return entries
 
-        pdf_paths = [p for (_, _, p) in pdf_entries]
-        texts = []
-        if pdf_paths:
-            try:
-                texts = run_cpp_ocr(pdf_paths)
-            except Exception as e:
-                log_callback(f"  !! Błąd OCR w module C++: {e}")
-                texts = ["" for _ in pdf_paths]
-
-        for (row, pdf_filename, pdf_path), full_text in zip(pdf_entries, texts):
-            log_callback(f"  -> Przetwarzanie pliku: {pdf_filename}")
-
-            entities = []
-            # Wyszukiwanie na podstawie Excela
-            for col_name, label in KOLUMNY_MAPOWANIE.items():
-                if col_name in row and pd.notna(row[col_name]):
-                    metadata_text = str(row[col_name])
-                    if not metadata_text:
-                        continue
-                    for start_index in find_all_occurrences(full_text, metadata_text):
-                        entities.append([start_index, start_index + len(metadata_text), label])
-
-            # Automatyczne wykrywanie typu dokumentu
-            doc_type, start, end = detect_document_type(full_text)
-            if doc_type:
-                entities.append([start, end, "TYP_DOKUMENTU"])
-
-            if entities:
-                training_data.append({"text": full_text, "label": entities})
-
-    if not training_data:
-        log_callback("Nie znaleziono żadnych danych do treningu.")
-        return None
-
-    # Zapisz do tymczasowego pliku JSONL
-    output_jsonl_file = os.path.join(os.path.dirname(base_path), "temp_training_data.jsonl")
-    with open(output_jsonl_file, 'w', encoding='utf-8') as f:
-        for entry in training_data:
-            json.dump(entry, f, ensure_ascii=False)
-            f.write('\n')
-    
-    log_callback(f"\n>>> Zakończono! Zapisano {len(training_data)} rekordów treningowych.")
-    return output_jsonl_file
-
-def convert_to_spacy_format(jsonl_path: str, train_path: str, dev_path: str) -> None:
-    """Krok 2: Konwertuje plik JSONL na format .spacy."""
-    nlp = spacy.blank("pl")
+
+def _goes_to_dev(count: int, dev: int) -> bool:
+    """Czy ``count``-ty dokument (od 1) trafia do korpusu dev.
+
+    Po każdym dokumencie dev ma ``count - int(count * 0.8)`` dokumentów,
+    dokładnie jak przy podziale 80/20 całego pliku, więc od drugiego
+    dokumentu dev nie jest pusty.  Pierwszy trafia do train, aby pojedynczy
+    dokument nie zostawił pustego korpusu treningowego.
+    """
+    return count >= 2 and dev < count - count * 4 // 5
+
+
+def create_training_data_from_sheets(
+    input_dir: str,
+    log_callback: Callable[[str], None],
+    spacy_paths: Optional[Tuple[str, str]] = None,
+    cancel_event: Optional[threading.Event] = None,
+) -> Optional[str]:
+    """Krok 1: Przetwarza foldery z rozpiskami i PDF-ami na plik JSONL.
+
+    Wszystkie PDF-y ze wszystkich folderów trafiają do jednego zadania OCR,
+    a każdy rekord jest zapisywany do JSONL zaraz po rozpoznaniu pliku.
+    Gdy podano ``spacy_paths`` (katalogi train, dev), dokumenty są od razu
+    dodawane do korpusów ``.spacy`` w proporcji 80/20 (deterministycznie,
+    zob. :func:`_goes_to_dev`), co zastępuje Krok 2.
+    Co ``DOC_BIN_CHUNK`` dokumentów powstaje w katalogu kolejny plik
+    ``.spacy``, więc pamięć nie rośnie z liczbą dokumentów.
+
+    Każda rozpoznana strona jest odnotowywana w logu.  Ustawienie
+    ``cancel_event`` przerywa OCR w ciągu milisekund; funkcja zwraca wtedy
+    ``None`` bez pliku JSONL.
+    """
+    log_callback("Rozpoczynanie przygotowania danych treningowych...")
+    entries = _collect_sheet_entries(input_dir, log_callback)
+
+    output_jsonl_file = os.path.join(os.path.dirname(base_path), "temp_training_data.jsonl")
+    nlp = spacy.blank("pl") if spacy_paths else None
+    doc_bins = [DocBin(), DocBin()] if spacy_paths else None
+    chunks = [0, 0]
+    count = 0
+    dev = 0
+    if spacy_paths:
+        for directory in spacy_paths:
+            # Fragmenty z poprzedniego przebiegu trafiłyby do korpusu
+            shutil.rmtree(directory, ignore_errors=True)
+            os.makedirs(directory)
+
+    def _flush(which: int) -> None:
+        if not len(doc_bins[which]):
+            return
+        chunks[which] += 1
+        doc_bins[which].to_disk(
+            os.path.join(spacy_paths[which], f"{chunks[which]:05d}.spacy")
+        )
+        doc_bins[which] = DocBin()
+
+    def _progress(index: int, stage: str, page: int, pages: int, percent: int) -> None:
+        if stage == "ocr" and percent == 100:
+            log_callback(f"     {entries[index][0]}: strona {page}/{pages}")
+
+    received = set()
+    texts = run_cpp_ocr_stream(
+        [path for (_, path, _) in entries], cancel_event=cancel_event, progress=_progress
+    )
+    with open(output_jsonl_file, 'w', encoding='utf-8') as f:
+        try:
+            for index, full_text in texts:
+                received.add(index)
+                pdf_filename, _, patterns = entries[index]
+                log_callback(f"  -> Przetwarzanie pliku: {pdf_filename}")
+
+                # Wyszukiwanie na podstawie Excela
+                entities = align_entities(full_text, patterns)
+
+                # Automatyczne wykrywanie typu dokumentu
+                doc_type, start, end = detect_document_type(full_text)
+                if doc_type and not any(s < end and start < e for s, e, _ in entities):
+                    entities.append([start, end, "TYP_DOKUMENTU"])
+
+                if not entities:
+                    continue
+                json.dump({"text": full_text, "label": entities}, f, ensure_ascii=False)
+                f.write('\n')
+                count += 1
+                if doc_bins is not None:
+                    which = 1 if _goes_to_dev(count, dev) else 0
+                    dev += which
+                    _add_to_doc_bin(doc_bins[which], nlp.make_doc(full_text), entities)
+                    if len(doc_bins[which]) >= DOC_BIN_CHUNK:
+                        _flush(which)
+        except OcrEngineError as e:
+            log_callback(f"  !! Błąd OCR w module C++: {e}")
+
+    if cancel_event is not None and cancel_event.is_set():
+        log_callback("Przerwano przygotowanie danych treningowych.")
+        os.remove(output_jsonl_file)
+        return None
+    for index, (pdf_filename, _, _) in enumerate(entries):
+        if index not in received:
+            log_callback(f"  !! Brak wyniku OCR dla pliku: {pdf_filename}")
+
+    if not count:
+        log_callback("Nie znaleziono żadnych danych do treningu.")
+        os.remove(output_jsonl_file)
+        return None
+
+    if doc_bins is not None:
+        _flush(0)
+        _flush(1)
+
+    log_callback(f"\n>>> Zakończono! Zapisano {count} rekordów treningowych.")
+    return output_jsonl_file
+
+
+def _add_to_doc_bin(db, doc, labels) -> None:
+    """Dodaje dokument z encjami do ``DocBin``.
+
+    Zakres, który nie pokrywa się z granicami tokenów (np. dopasowanie
+    przybliżone), jest rozszerzany do całych tokenów.
+    """
+    ents = []
+    for start, end, label in labels:
+        span = doc.char_span(start, end, label=label)
+        if span is None:
+            span = doc.char_span(start, end, label=label, alignment_mode="expand")
+        if span is not None:
+            ents.append(span)
+    try:
+        doc.ents = ents
+        db.add(doc)
+    except ValueError:
+        pass # Ignoruj błędy, jeśli encje się nakładają
+
+def convert_to_spacy_format(
+    jsonl_path: str, train_path: str, dev_path: str, n_process: int = 1
+) -> None:
+    """Krok 2: Konwertuje plik JSONL na format .spacy.
+
+    Tokenizacja dokumentów przez ``nlp.pipe`` jest rozdzielana między
+    ``n_process`` procesów (``0`` oznacza wszystkie rdzenie).
+    """
+    nlp = spacy.blank("pl")
+    n_process = resolve_processes(n_process)
     
     with open(jsonl_path, 'r', encoding='utf-8') as f:
         lines = f.readlines()
@@ -172,41 +425,40 @@ def convert_to_spacy_format(jsonl_path: str, train_path: str, dev_path: str) ->
     
     for dataset_type, dataset_lines in [("train", lines[:split_point]), ("dev", lines[split_point:])]:
         db = DocBin()
-        for line in dataset_lines:
-            item = json.loads(line)
-            text = item['text']
-            doc = nlp.make_doc(text)
-            ents = []
-            for start, end, label in item['label']:
-                span = doc.char_span(start, end, label=label)
-                if span is not None:
-                    ents.append(span)
-            try:
-                doc.ents = ents
-                db.add(doc)
-            except ValueError:
-                pass # Ignoruj błędy, jeśli encje się nakładają
+        items = ((item['text'], item['label']) for item in map(json.loads, dataset_lines))
+        for doc, labels in nlp.pipe(items, as_tuples=True, n_process=n_process, batch_size=64):
+            _add_to_doc_bin(db, doc, labels)
         
         output_path = train_path if dataset_type == "train" else dev_path
         db.to_disk(output_path)
 
-def run_training_pipeline(data_folder_path: str, output_model_path: str, log_callback: Callable[[str], None]) -> bool:
-    """Główna funkcja uruchamiająca cały proces treningu."""
+def run_training_pipeline(
+    data_folder_path: str,
+    output_model_path: str,
+    log_callback: Callable[[str], None],
+    cancel_event: Optional[threading.Event] = None,
+) -> bool:
+    """Główna funkcja uruchamiająca cały proces treningu.
+
+    ``cancel_event`` przerywa OCR danych treningowych; po jego ustawieniu
+    trening spaCy nie jest uruchamiany.
+    """
     try:
-        # Krok 1: Przygotuj dane
-        jsonl_file = create_training_data_from_sheets(data_folder_path, log_callback)
-        if not jsonl_file:
-            return False
-
-        # Krok 2: Przygotuj pliki .spacy
+        # Krok 1 i 2: Przygotuj dane i pliki .spacy w jednym przebiegu
         temp_dir = os.path.join(os.path.dirname(base_path), "temp_spacy_data")
         os.makedirs(temp_dir, exist_ok=True)
-        train_spacy_path = os.path.join(temp_dir, "train.spacy")
-        dev_spacy_path = os.path.join(temp_dir, "dev.spacy")
-        
-        log_callback("\nKonwertowanie danych do formatu spaCy...")
-        convert_to_spacy_format(jsonl_file, train_spacy_path, dev_spacy_path)
-        log_callback("Konwersja zakończona.")
+        # Korpusy jako katalogi plików .spacy zapisywanych w trakcie OCR
+        train_spacy_path = os.path.join(temp_dir, "train")
+        dev_spacy_path = os.path.join(temp_dir, "dev")
+        jsonl_file = create_training_data_from_sheets(
+            data_folder_path, log_callback, (train_spacy_path, dev_spacy_path), cancel_event
+        )
+        if not jsonl_file:
+            return False
+        if cancel_event is not None and cancel_event.is_set():
+            os.remove(jsonl_file)
+            log_callback("Przerwano trening.")
+            return False
 
         # Krok 3: Przygotuj plik konfiguracyjny
         config_path = os.path.join(temp_dir, "config.cfg")
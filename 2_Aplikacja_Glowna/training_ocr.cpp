@@ -5,11 +5,15 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <random>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -18,16 +22,26 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 
 #include "tesseract/baseapi.h"
+#include "tesseract/ocrclass.h"
+#include "tesseract/renderer.h"
 #include "tesseract/include/leptonica/allheaders.h"
 
 namespace fs = std::filesystem;
 
+// Ustawiane przez SIGINT/SIGTERM (SIGBREAK na Windows) albo polecenie cancel
+// na stdin; sprawdzane między
+// stronami, w trakcie rasteryzacji i przez monitor rozpoznawania Tesseracta
+std::atomic<bool> g_cancelled{false};
+
+extern "C" void on_cancel_signal(int) { g_cancelled = true; }
+
 std::string get_env(const char *name, const std::string &def = "") {
 #ifdef _WIN32
   // Use secure _dupenv_s on Windows to avoid deprecated getenv
@@ -140,7 +154,10 @@ CommandResult run_command(const std::vector<std::string> &args,
     CloseHandle(read_pipe);
   }
 
-  WaitForSingleObject(pi.hProcess, INFINITE);
+  while (WaitForSingleObject(pi.hProcess, 10) == WAIT_TIMEOUT) {
+    if (g_cancelled)
+      TerminateProcess(pi.hProcess, 1);
+  }
   DWORD exit_code = 0;
   GetExitCodeProcess(pi.hProcess, &exit_code);
   CloseHandle(pi.hProcess);
@@ -199,8 +216,16 @@ CommandResult run_command(const std::vector<std::string> &args,
     }
     return res;
   } else {
+    // Anulowanie nie czeka na rasteryzację całego dokumentu
     int status = 0;
-    waitpid(pid, &status, 0);
+    bool killed = false;
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+      if (g_cancelled && !killed) {
+        kill(pid, SIGTERM);
+        killed = true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
     if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
       res.ok = false;
       res.error = "Command failed: " + args[0];
@@ -230,56 +255,227 @@ std::string escape_json(const std::string &in) {
       out += "\\t";
       break;
     default:
-      out += c;
+      if (static_cast<unsigned char>(c) < 0x20) {
+        // Pozostałe znaki sterujące (np. \f od Tesseracta) jako \u00XX
+        static const char hex[] = "0123456789abcdef";
+        out += "\\u00";
+        out += hex[(c >> 4) & 0xF];
+        out += hex[c & 0xF];
+      } else {
+        out += c;
+      }
       break;
     }
   }
   return out;
 }
 
-std::string ocr_pdf(const std::string &pdf_path,
+// Silnik Tesseract inicjowany raz na wątek i używany dla kolejnych plików
+struct OcrEngine {
+  tesseract::TessBaseAPI api;
+  bool ready = false;
+
+  bool init(const std::string &tessdata_prefix) {
+    if (!ready)
+      ready = api.Init(tessdata_prefix.empty() ? nullptr
+                                               : tessdata_prefix.c_str(),
+                       "pol") == 0;
+    return ready;
+  }
+
+  ~OcrEngine() {
+    if (ready)
+      api.End();
+  }
+};
+
+// Progress of one file, reported from Tesseract's recognition monitor as
+// stream records {"index": N, "stage": "...", "page": P, "pages": T,
+// "percent": X}. Without an output mutex nothing is reported.
+struct Progress {
+  std::mutex *out = nullptr;
+  size_t index = 0;
+  size_t page = 0;
+  size_t pages = 0;
+  int reported = -1;
+
+  void report(const char *stage, int percent) {
+    if (!out)
+      return;
+    std::lock_guard<std::mutex> lock(*out);
+    std::cout << "{\"index\":" << index << ",\"stage\":\"" << stage
+              << "\",\"page\":" << page << ",\"pages\":" << pages
+              << ",\"percent\":" << percent << "}\n"
+              << std::flush;
+    reported = percent;
+  }
+};
+
+bool cancel_requested(void *, int) { return g_cancelled; }
+
+bool on_recognition_progress(tesseract::ETEXT_DESC *monitor, int, int, int,
+                             int) {
+  auto *progress = static_cast<Progress *>(monitor->cancel_this);
+  // Co 10%, aby nie zalewać strumienia wyników
+  if (monitor->progress >= progress->reported + 10)
+    progress->report("ocr", monitor->progress);
+  return true;
+}
+
+// Recognize pages first..last of pdf_path (every page when last is 0). When
+// pdf_out is set, the same recognition also writes a searchable PDF there: the
+// page image with an invisible text layer. Page images are JPEG-compressed, or with bilevel Tesseract's own
+// binarization is embedded instead and compressed with CCITT G4. A failure to
+// write the PDF goes to pdf_error and does not discard the recognized text.
+std::string ocr_pdf(const std::string &pdf_path, OcrEngine &engine,
                     const std::string &tessdata_prefix,
-                    const std::string &pdftoppm, std::string &error) {
+                    const std::string &pdftoppm, int first, int last,
+                    const std::string &pdf_out, bool bilevel,
+                    Progress &progress, std::string &error,
+                    std::string &pdf_error) {
   TempDir tmp;
   std::string prefix = (tmp.path / "page").string();
 
   // Konwersja PDF -> obrazy
-  auto conv =
-      run_command({pdftoppm, "-png", "-r", "300", pdf_path, prefix}, false);
+  std::vector<std::string> args = {pdftoppm, "-png", "-r", "300"};
+  if (last > 0) {
+    args.insert(args.end(),
+                {"-f", std::to_string(first), "-l", std::to_string(last)});
+  }
+  args.push_back(pdf_path);
+  args.push_back(prefix);
+  progress.report("rasterize", 0);
+  auto conv = run_command(args, false);
+  if (g_cancelled) {
+    error = "Anulowano";
+    return "";
+  }
   if (!conv.ok) {
     error = conv.error;
     return "";
   }
-
-  tesseract::TessBaseAPI api;
-  if (api.Init(tessdata_prefix.empty() ? nullptr : tessdata_prefix.c_str(),
-               "pol")) {
+  // pdftoppm dopełnia numery stron zerami do długości numeru ostatniej strony
+  // (page-01.png), więc kolejność wyznacza posortowana lista plików
+  std::vector<std::string> images;
+  for (const auto &entry : fs::directory_iterator(tmp.path))
+    images.push_back(entry.path().string());
+  std::sort(images.begin(), images.end());
+
+  if (!engine.init(tessdata_prefix)) {
     error = "Nie można zainicjować Tesseract";
     return "";
   }
+  tesseract::TessBaseAPI &api = engine.api;
+
+  std::unique_ptr<tesseract::TessPDFRenderer> renderer;
+  if (!pdf_out.empty()) {
+    // Renderer sam dopisuje rozszerzenie ".pdf" do podanej nazwy
+    std::string base = pdf_out.substr(0, pdf_out.size() - 4);
+    renderer.reset(
+        new tesseract::TessPDFRenderer(base.c_str(), api.GetDatapath(), false));
+    if (!renderer->BeginDocument(fs::path(pdf_path).stem().string().c_str())) {
+      pdf_error = "Nie można utworzyć pliku " + pdf_out;
+      renderer.reset();
+    }
+  }
 
   std::string text;
-  for (int i = 1;; ++i) {
-    std::string image = prefix + "-" + std::to_string(i) + ".png";
-    if (!fs::exists(image))
-      break;
+  progress.pages = images.size();
+  for (size_t i = 0; i < images.size(); ++i) {
+    const std::string &image = images[i];
     Pix *pix = pixRead(image.c_str());
     if (!pix)
       break;
     api.SetImage(pix);
+    progress.page = i + 1;
+    progress.reported = -1;
+    tesseract::ETEXT_DESC monitor;
+    monitor.cancel = cancel_requested;
+    monitor.cancel_this = &progress;
+    monitor.progress_callback2 = on_recognition_progress;
+    api.Recognize(&monitor);
+    if (g_cancelled) {
+      // Przerwane rozpoznanie: pliki stron usuwa TempDir, PDF - kod niżej
+      error = "Anulowano";
+      pixDestroy(&pix);
+      break;
+    }
+    if (progress.reported < 100)
+      progress.report("ocr", 100);
     char *out = api.GetUTF8Text();
     if (out) {
       text += out;
       delete[] out;
     }
+    if (renderer) {
+      // Warstwa tekstowa z rozpoznania wykonanego wyżej przez Recognize
+      if (bilevel)
+        api.SetInputImage(api.GetThresholdedImage());
+      if (!renderer->AddImage(&api)) {
+        pdf_error =
+            "Błąd zapisu strony " + std::to_string(i + 1) + " do " + pdf_out;
+        renderer.reset();
+      }
+    }
     pixDestroy(&pix);
     fs::remove(image);
   }
-  api.End();
+  api.Clear();
 
+  if (renderer && !renderer->EndDocument())
+    pdf_error = "Błąd zapisu pliku " + pdf_out;
+  // Niepełny PDF (błąd zapisu, przerwany lub nieudany OCR) nie zostaje na dysku
+  if (!pdf_out.empty() && (!error.empty() || !pdf_error.empty())) {
+    std::error_code ec;
+    fs::remove(pdf_out, ec);
+  }
   return text;
 }
 
+// Searchable PDF names in out_dir: the input file name, with the first free
+// "-N" suffix appended when several inputs share it. A suffixed name is never
+// one already given to another input, so a real "scan-1.pdf" keeps its name.
+std::vector<std::string> pdf_outputs(const std::vector<std::string> &paths,
+                                     const std::string &out_dir) {
+  std::vector<std::string> out(paths.size());
+  std::set<std::string> stems;
+  for (const auto &path : paths)
+    stems.insert(fs::path(path).stem().string());
+  std::set<std::string> used;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    std::string stem = fs::path(paths[i]).stem().string();
+    std::string name = stem;
+    if (!used.insert(name).second) {
+      // Pomijamy nazwy innych plików wejściowych i już nadane
+      int n = 1;
+      do
+        name = stem + "-" + std::to_string(n++);
+      while (stems.count(name) || used.count(name));
+      used.insert(name);
+    }
+    out[i] = (fs::path(out_dir) / (name + ".pdf")).string();
+  }
+  return out;
+}
+
+// Usage: training_ocr [--stream [--progress]] [--pages F-L]
+//                     [--pdf DIR [--pdf-bilevel]] (PDF... | -)
+//   -              read PDF paths from stdin, one per line; an empty line
+//                  ends the list and keeps stdin open for commands: the
+//                  line "cancel" stops OCR like SIGTERM, also on Windows
+//                  where the parent cannot signal a windowless process
+//   --stream       print one JSON object per line as soon as a file is done:
+//                  {"index": N, "text": "...", "error": "..."}
+//                  instead of a single JSON array at the end
+//   --progress     also stream progress records while a file is recognized:
+//                  {"index": N, "stage": "rasterize" | "ocr", "page": P,
+//                   "pages": T, "percent": X}
+//   --pages F-L    recognize only pages F to L of every file (a shard of a
+//                  distributed OCR job, see distributed_ocr.py)
+//   --pdf DIR      also write a searchable PDF of every file to DIR in the
+//                  same OCR pass; stream records gain "pdf": "path", empty
+//                  with the reason in "pdf_error" when writing failed
+//   --pdf-bilevel  embed binarized pages (CCITT G4) instead of JPEG
 int main(int argc, char *argv[]) {
   if (argc <= 1)
     return 0;
@@ -289,30 +485,122 @@ int main(int argc, char *argv[]) {
   std::string pdftoppm_cmd =
       poppler_path.empty() ? "pdftoppm" : poppler_path + "/pdftoppm";
 
+  std::signal(SIGINT, on_cancel_signal);
+  std::signal(SIGTERM, on_cancel_signal);
+#ifdef SIGBREAK
+  std::signal(SIGBREAK, on_cancel_signal);
+#endif
+
+  bool stream = false;
+  bool report_progress = false;
+  bool bilevel = false;
+  bool commands = false;
+  int first = 1, last = 0;
+  std::string pdf_dir;
   std::vector<std::string> paths;
-  for (int i = 1; i < argc; ++i)
-    paths.emplace_back(argv[i]);
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--progress") {
+      report_progress = true;
+    } else if (arg == "--pdf" && i + 1 < argc) {
+      pdf_dir = argv[++i];
+    } else if (arg == "--pdf-bilevel") {
+      bilevel = true;
+    } else if (arg == "--pages" && i + 1 < argc) {
+      std::string range = argv[++i];
+      size_t dash = range.find('-');
+      first = std::atoi(range.substr(0, dash).c_str());
+      last = dash == std::string::npos ? first
+                                       : std::atoi(range.c_str() + dash + 1);
+      if (first < 1 || last < first) {
+        std::cerr << "Nieprawidłowy zakres stron: " << range << std::endl;
+        return 2;
+      }
+    } else if (arg == "-") {
+      // Lista z stdin omija limit długości linii poleceń przy tysiącach plików
+      std::string line;
+      while (std::getline(std::cin, line)) {
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        if (line.empty()) {
+          commands = true;
+          break;
+        }
+        paths.push_back(line);
+      }
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (commands) {
+    // Wątek nie blokuje zakończenia: exit() kończy go razem z procesem
+    std::thread([] {
+      std::string command;
+      while (std::getline(std::cin, command)) {
+        if (!command.empty() && command.back() == '\r')
+          command.pop_back();
+        if (command == "cancel")
+          g_cancelled = true;
+      }
+    }).detach();
+  }
+  if (paths.empty()) {
+    if (!stream)
+      std::cout << "[]";
+    return 0;
+  }
+
+  std::vector<std::string> pdf_out(paths.size());
+  if (!pdf_dir.empty()) {
+    std::error_code ec;
+    fs::create_directories(pdf_dir, ec);
+    pdf_out = pdf_outputs(paths, pdf_dir);
+  }
 
-  std::vector<std::string> results(paths.size());
+  std::vector<std::string> results(stream ? 0 : paths.size());
   std::vector<std::thread> workers;
   std::atomic<size_t> next{0};
   std::mutex error_mutex;
+  std::mutex output_mutex;
   std::vector<std::string> errors;
   size_t max_threads = std::min<size_t>(
       std::max<unsigned>(1, std::thread::hardware_concurrency()), paths.size());
 
   for (size_t t = 0; t < max_threads; ++t) {
-    workers.emplace_back([&, t]() {
+    workers.emplace_back([&]() {
+      OcrEngine engine;
       while (true) {
         size_t i = next.fetch_add(1);
-        if (i >= paths.size())
+        if (i >= paths.size() || g_cancelled)
           break;
-        std::string err;
-        std::string res = ocr_pdf(paths[i], tessdata_prefix, pdftoppm_cmd, err);
-        if (!err.empty()) {
+        Progress progress;
+        progress.index = i;
+        if (stream && report_progress)
+          progress.out = &output_mutex;
+        std::string err, pdf_err;
+        std::string res =
+            ocr_pdf(paths[i], engine, tessdata_prefix, pdftoppm_cmd, first,
+                    last, pdf_out[i], bilevel, progress, err, pdf_err);
+        if (!err.empty() || !pdf_err.empty()) {
           std::lock_guard<std::mutex> lock(error_mutex);
-          errors.push_back("Failed to process " + paths[i] + ": " + err);
-        } else {
+          errors.push_back("Failed to process " + paths[i] + ": " +
+                           (err.empty() ? pdf_err : err));
+        }
+        if (stream) {
+          std::lock_guard<std::mutex> lock(output_mutex);
+          std::cout << "{\"index\":" << i << ",\"text\":\"" << escape_json(res)
+                    << "\",\"error\":\"" << escape_json(err) << '"';
+          if (!pdf_dir.empty()) {
+            bool written = err.empty() && pdf_err.empty();
+            std::cout << ",\"pdf\":\""
+                      << (written ? escape_json(pdf_out[i]) : "") << '"';
+            if (!pdf_err.empty())
+              std::cout << ",\"pdf_error\":\"" << escape_json(pdf_err) << '"';
+          }
+          std::cout << "}\n" << std::flush;
+        } else if (err.empty()) {
           results[i] = std::move(res);
         }
       }
@@ -321,11 +609,16 @@ int main(int argc, char *argv[]) {
 
   for (auto &t : workers)
     t.join();
+  if (g_cancelled)
+    return 130;
 
   for (const auto &err : errors) {
     std::cerr << err << std::endl;
   }
 
+  if (stream)
+    return errors.empty() ? 0 : 1;
+
   // Output JSON array
   std::cout << "[";
   for (size_t i = 0; i < results.size(); ++i) {
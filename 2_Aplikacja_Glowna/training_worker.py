@@ -1,5 +1,7 @@
+import multiprocessing
 import sys
 import os
+import threading
 
 # Ensure local imports work
 if getattr(sys, 'frozen', False):
@@ -16,6 +18,14 @@ def log(message: str) -> None:
     print(message, flush=True)
 
 
+def watch_cancel(cancel_event: threading.Event) -> None:
+    """Set ``cancel_event`` when the parent writes ``cancel`` to stdin."""
+    for line in sys.stdin:
+        if line.strip() == "cancel":
+            cancel_event.set()
+            return
+
+
 def main() -> int:
     """Entry point for launching the training pipeline as a subprocess."""
     if len(sys.argv) < 3:
@@ -23,11 +33,15 @@ def main() -> int:
         return 1
     data_folder = sys.argv[1]
     output_model_dir = sys.argv[2]
-    success = run_training_pipeline(data_folder, output_model_dir, log)
+    cancel_event = threading.Event()
+    threading.Thread(target=watch_cancel, args=(cancel_event,), daemon=True).start()
+    success = run_training_pipeline(data_folder, output_model_dir, log, cancel_event)
     print("RESULT:SUCCESS" if success else "RESULT:FAIL", flush=True)
     return 0 if success else 1
 
 
 if __name__ == "__main__":
+    # Wymagane przez procesy robocze nlp.pipe w wersji .exe
+    multiprocessing.freeze_support()
     raise SystemExit(main())
 
@@ -0,0 +1,356 @@
+"""Streaming XLSX writer used by the register export.
+
+Rows are serialized to worksheet XML as they are written, so memory use does
+not grow with the number of rows apart from the shared-string table (one
+copy of every distinct text) and the set of distinct cell styles.  The
+worksheet body is spooled to a temporary file because the column widths,
+which Excel expects before the data, are only known after the last row; the
+package is then assembled once with ``zipfile``/zlib.
+
+Example::
+
+    with XlsxWriter(path) as xlsx:
+        xlsx.write_row(["Lp.", "Nazwa"], CellStyle(bold=True))
+        xlsx.write_row(["1", "umowa.pdf"])
+"""
+
+from __future__ import annotations
+
+import os
+import re
+import tempfile
+import zipfile
+from typing import Dict, Iterable, List, NamedTuple, Optional, Sequence, Union
+from xml.sax.saxutils import escape
+
+# Znaki niedozwolone w XML 1.0 (poza tabulatorem i końcami linii)
+_ILLEGAL_XML = re.compile("[\x00-\x08\x0b\x0c\x0e-\x1f]")
+# Zapis do pliku tymczasowego porcjami zamiast pojedynczymi wierszami
+_BUFFER_ROWS = 512
+
+
+class CellStyle(NamedTuple):
+    """Formatting of one cell; equal styles share one ``cellXfs`` entry."""
+
+    bold: bool = False
+    fill: str = ""  # kolor RGB, np. "D9D9D9"; pusty = brak wypełnienia
+    border: bool = False  # cienka czarna ramka z każdej strony
+    wrap: bool = False  # zawijanie tekstu z wyrównaniem do góry
+
+
+def column_letter(index: int) -> str:
+    """Return the column name for a 1-based ``index`` (1 -> A, 27 -> AA)."""
+    letters = ""
+    while index:
+        index, rem = divmod(index - 1, 26)
+        letters = chr(65 + rem) + letters
+    return letters
+
+
+class XlsxWriter:
+    """Write a single-sheet workbook row by row."""
+
+    def __init__(
+        self,
+        path: Union[str, os.PathLike],
+        sheet_name: str = "Sheet1",
+        freeze_header: bool = False,
+        auto_filter: bool = False,
+        column_padding: int = 2,
+    ) -> None:
+        """Create the writer.
+
+        Args:
+            path: Output ``.xlsx`` file.
+            sheet_name: Name of the worksheet.
+            freeze_header: Keep the first row visible while scrolling.
+            auto_filter: Add filter buttons over the written range.
+            column_padding: Added to the longest text of each column to get
+                its width; ``None`` disables automatic widths.
+        """
+        self.path = os.fspath(path)
+        self.sheet_name = sheet_name
+        self.freeze_header = freeze_header
+        self.auto_filter = auto_filter
+        self.column_padding = column_padding
+        self.rows = 0
+        self.columns = 0
+        self._widths: List[int] = []
+        self._strings: Dict[str, int] = {}
+        self._string_refs = 0
+        self._styles: Dict[CellStyle, int] = {CellStyle(): 0}
+        self._pending: List[str] = []
+        self._body = tempfile.TemporaryFile(mode="w+", encoding="utf-8")
+
+    # -- writing -----------------------------------------------------------
+    def write_row(
+        self,
+        values: Iterable[object],
+        styles: Union[None, CellStyle, Sequence[Optional[CellStyle]]] = None,
+    ) -> None:
+        """Append one row.
+
+        Args:
+            values: Cell texts; ``None`` and ``""`` leave the cell empty but
+                still styled.
+            styles: One style for the whole row or one per cell.
+        """
+        self.rows += 1
+        r = self.rows
+        cells = []
+        for c, value in enumerate(values, start=1):
+            if styles is None or isinstance(styles, CellStyle):
+                style = styles
+            else:
+                style = styles[c - 1] if c - 1 < len(styles) else None
+            s = self._style_index(style) if style else 0
+            attr = f' s="{s}"' if s else ""
+            ref = f"{column_letter(c)}{r}"
+            text = "" if value is None else str(value)
+            if c > len(self._widths):
+                self._widths.append(0)
+            if text:
+                self._widths[c - 1] = max(self._widths[c - 1], len(text))
+                cells.append(f'<c r="{ref}"{attr} t="s"><v>{self._string_index(text)}</v></c>')
+            elif s:
+                cells.append(f'<c r="{ref}"{attr}/>')
+        self.columns = max(self.columns, len(self._widths))
+        self._pending.append(f'<row r="{r}">{"".join(cells)}</row>')
+        if len(self._pending) >= _BUFFER_ROWS:
+            self._flush()
+
+    def _string_index(self, text: str) -> int:
+        self._string_refs += 1
+        index = self._strings.get(text)
+        if index is None:
+            index = self._strings[text] = len(self._strings)
+        return index
+
+    def _style_index(self, style: CellStyle) -> int:
+        index = self._styles.get(style)
+        if index is None:
+            index = self._styles[style] = len(self._styles)
+        return index
+
+    def _flush(self) -> None:
+        self._body.write("".join(self._pending))
+        self._pending.clear()
+
+    # -- package -----------------------------------------------------------
+    def close(self) -> None:
+        """Assemble the ``.xlsx`` package and release the temporary file."""
+        if self._body.closed:
+            return
+        try:
+            self._flush()
+            self._body.seek(0)
+            with zipfile.ZipFile(self.path, "w", zipfile.ZIP_DEFLATED) as zf:
+                zf.writestr("[Content_Types].xml", _CONTENT_TYPES)
+                zf.writestr("_rels/.rels", _ROOT_RELS)
+                zf.writestr("xl/workbook.xml", _workbook_xml(self.sheet_name))
+                zf.writestr("xl/_rels/workbook.xml.rels", _WORKBOOK_RELS)
+                zf.writestr("xl/styles.xml", _styles_xml(list(self._styles)))
+                with zf.open("xl/worksheets/sheet1.xml", "w", force_zip64=True) as out:
+                    out.write(self._sheet_head().encode("utf-8"))
+                    while True:
+                        chunk = self._body.read(1 << 20)
+                        if not chunk:
+                            break
+                        out.write(chunk.encode("utf-8"))
+                    out.write(self._sheet_tail().encode("utf-8"))
+                with zf.open("xl/sharedStrings.xml", "w", force_zip64=True) as out:
+                    self._write_shared_strings(out)
+        finally:
+            self._body.close()
+
+    def __enter__(self) -> "XlsxWriter":
+        return self
+
+    def __exit__(self, exc_type, exc, tb) -> None:
+        if exc_type is None:
+            self.close()
+        else:
+            self._body.close()
+
+    def _sheet_head(self) -> str:
+        parts = [
+            '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+            f'<worksheet xmlns="{_NS_MAIN}" xmlns:r="{_NS_REL}">'
+        ]
+        if self.columns:
+            parts.append(f"<dimension ref=\"A1:{column_letter(self.columns)}{max(self.rows, 1)}\"/>")
+        if self.freeze_header:
+            parts.append(
+                '<sheetViews><sheetView workbookViewId="0">'
+                '<pane ySplit="1" topLeftCell="A2" activePane="bottomLeft" state="frozen"/>'
+                '<selection pane="bottomLeft" activeCell="A2" sqref="A2"/>'
+                "</sheetView></sheetViews>"
+            )
+        if self.column_padding is not None and self._widths:
+            parts.append("<cols>")
+            for idx, width in enumerate(self._widths, start=1):
+                parts.append(
+                    f'<col min="{idx}" max="{idx}" width="{width + self.column_padding}" customWidth="1"/>'
+                )
+            parts.append("</cols>")
+        parts.append("<sheetData>")
+        return "".join(parts)
+
+    def _sheet_tail(self) -> str:
+        tail = "</sheetData>"
+        if self.auto_filter and self.rows and self.columns:
+            tail += f'<autoFilter ref="A1:{column_letter(self.columns)}{self.rows}"/>'
+        return tail + "</worksheet>"
+
+    def _write_shared_strings(self, out) -> None:
+        out.write(
+            (
+                '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+                f'<sst xmlns="{_NS_MAIN}" count="{self._string_refs}" '
+                f'uniqueCount="{len(self._strings)}">'
+            ).encode("utf-8")
+        )
+        batch = []
+        # Słownik zachowuje kolejność wstawiania, czyli kolejność indeksów
+        for text in self._strings:
+            text = escape(_ILLEGAL_XML.sub("", text))
+            if text != text.strip():
+                batch.append(f'<si><t xml:space="preserve">{text}</t></si>')
+            else:
+                batch.append(f"<si><t>{text}</t></si>")
+            if len(batch) >= 4096:
+                out.write("".join(batch).encode("utf-8"))
+                batch.clear()
+        out.write(("".join(batch) + "</sst>").encode("utf-8"))
+
+
+def write_xlsx(
+    path: Union[str, os.PathLike],
+    rows: Iterable[Sequence[object]],
+    styles: Optional[Iterable[Union[None, CellStyle, Sequence[Optional[CellStyle]]]]] = None,
+    **options,
+) -> int:
+    """Write ``rows`` (optionally paired with ``styles``) and return the row count."""
+    with XlsxWriter(path, **options) as xlsx:
+        if styles is None:
+            for row in rows:
+                xlsx.write_row(row)
+        else:
+            for row, style in zip(rows, styles):
+                xlsx.write_row(row, style)
+        return xlsx.rows
+
+
+# -- static package parts ----------------------------------------------------
+
+_NS_MAIN = "http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+_NS_REL = "http://schemas.openxmlformats.org/officeDocument/2006/relationships"
+_NS_PKG_REL = "http://schemas.openxmlformats.org/package/2006/relationships"
+
+_CONTENT_TYPES = (
+    '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+    '<Types xmlns="http://schemas.openxmlformats.org/package/2006/content-types">'
+    '<Default Extension="rels" ContentType="application/vnd.openxmlformats-package.relationships+xml"/>'
+    '<Default Extension="xml" ContentType="application/xml"/>'
+    '<Override PartName="/xl/workbook.xml" '
+    'ContentType="application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml"/>'
+    '<Override PartName="/xl/worksheets/sheet1.xml" '
+    'ContentType="application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml"/>'
+    '<Override PartName="/xl/styles.xml" '
+    'ContentType="application/vnd.openxmlformats-officedocument.spreadsheetml.styles+xml"/>'
+    '<Override PartName="/xl/sharedStrings.xml" '
+    'ContentType="application/vnd.openxmlformats-officedocument.spreadsheetml.sharedStrings+xml"/>'
+    "</Types>"
+)
+
+_ROOT_RELS = (
+    '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+    f'<Relationships xmlns="{_NS_PKG_REL}">'
+    '<Relationship Id="rId1" '
+    'Type="http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument" '
+    'Target="xl/workbook.xml"/>'
+    "</Relationships>"
+)
+
+_WORKBOOK_RELS = (
+    '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+    f'<Relationships xmlns="{_NS_PKG_REL}">'
+    '<Relationship Id="rId1" '
+    'Type="http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet" '
+    'Target="worksheets/sheet1.xml"/>'
+    '<Relationship Id="rId2" '
+    'Type="http://schemas.openxmlformats.org/officeDocument/2006/relationships/styles" '
+    'Target="styles.xml"/>'
+    '<Relationship Id="rId3" '
+    'Type="http://schemas.openxmlformats.org/officeDocument/2006/relationships/sharedStrings" '
+    'Target="sharedStrings.xml"/>'
+    "</Relationships>"
+)
+
+
+def _workbook_xml(sheet_name: str) -> str:
+    # Nazwa arkusza: maks. 31 znaków, bez []:*?/\
+    name = re.sub(r"[\[\]:*?/\\]", "_", sheet_name)[:31] or "Sheet1"
+    return (
+        '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+        f'<workbook xmlns="{_NS_MAIN}" xmlns:r="{_NS_REL}">'
+        f'<sheets><sheet name="{escape(name, {chr(34): "&quot;"})}" sheetId="1" r:id="rId1"/></sheets>'
+        "</workbook>"
+    )
+
+
+def _styles_xml(styles: List[CellStyle]) -> str:
+    """Build ``styles.xml`` with deduplicated fonts, fills and borders."""
+    fills = ["", "gray125"]  # dwa pierwsze wypełnienia są zarezerwowane
+    fill_index: Dict[str, int] = {}
+    for style in styles:
+        if style.fill and style.fill not in fill_index:
+            fill_index[style.fill] = len(fills)
+            fills.append(style.fill)
+
+    fill_xml = ['<fill><patternFill patternType="none"/></fill>',
+                '<fill><patternFill patternType="gray125"/></fill>']
+    for color in fills[2:]:
+        fill_xml.append(
+            f'<fill><patternFill patternType="solid"><fgColor rgb="FF{color}"/>'
+            f'<bgColor rgb="FF{color}"/></patternFill></fill>'
+        )
+
+    xfs = []
+    for style in styles:
+        attrs = [
+            'numFmtId="0"',
+            f'fontId="{1 if style.bold else 0}"',
+            f'fillId="{fill_index.get(style.fill, 0)}"',
+            f'borderId="{1 if style.border else 0}"',
+            'xfId="0"',
+        ]
+        if style.bold:
+            attrs.append('applyFont="1"')
+        if style.fill:
+            attrs.append('applyFill="1"')
+        if style.border:
+            attrs.append('applyBorder="1"')
+        if style.wrap:
+            attrs.append('applyAlignment="1"')
+            xfs.append(f'<xf {" ".join(attrs)}><alignment vertical="top" wrapText="1"/></xf>')
+        else:
+            xfs.append(f'<xf {" ".join(attrs)}/>')
+
+    side = '<{0} style="thin"><color rgb="FF000000"/></{0}>'
+    thin_border = "".join(side.format(s) for s in ("left", "right", "top", "bottom"))
+    return (
+        '<?xml version="1.0" encoding="UTF-8" standalone="yes"?>\n'
+        f'<styleSheet xmlns="{_NS_MAIN}">'
+        '<fonts count="2">'
+        '<font><sz val="11"/><name val="Calibri"/><family val="2"/></font>'
+        '<font><b/><sz val="11"/><name val="Calibri"/><family val="2"/></font>'
+        "</fonts>"
+        f'<fills count="{len(fill_xml)}">{"".join(fill_xml)}</fills>'
+        '<borders count="2"><border><left/><right/><top/><bottom/><diagonal/></border>'
+        f"<border>{thin_border}<diagonal/></border></borders>"
+        '<cellStyleXfs count="1"><xf numFmtId="0" fontId="0" fillId="0" borderId="0"/></cellStyleXfs>'
+        f'<cellXfs count="{len(xfs)}">{"".join(xfs)}</cellXfs>'
+        '<cellStyles count="1"><cellStyle name="Normal" xfId="0" builtinId="0"/></cellStyles>'
+        "</styleSheet>"
+    )
@@ -1,8 +1,16 @@
 import argparse
+import os
 import threading
+import time
 from typing import List
 
-from archiwizator_core.processing.ocr import extract_texts_with_ocr_parallel
+from archiwizator_core import config
+from archiwizator_core.fulltext_index import FullTextIndex, default_index_dir
+from archiwizator_core.processing.ner import benchmark
+from archiwizator_core.processing.ocr import (
+    extract_texts_with_ocr_parallel,
+    iter_texts_with_ocr,
+)
 
 
 def run_process_command(pdf_paths: List[str], language: str) -> None:
@@ -28,6 +36,149 @@ def run_process_command(pdf_paths: List[str], language: str) -> None:
     print(f"Przetworzono stron: {total_pages}")
 
 
+def run_ner_benchmark_command(
+    model: str, text_paths: List[str], processes: List[int], repeat: int
+) -> None:
+    """Print NER throughput (documents per second) for each process count.
+
+    Args:
+        model: Name or path of the spaCy model.
+        text_paths: Text files used as sample documents (e.g. OCR output).
+        processes: Process counts to measure; ``0`` means all cores.
+        repeat: How many times the sample set is repeated per run.
+    """
+    import spacy
+
+    nlp = spacy.load(model)
+    texts = []
+    for path in text_paths:
+        with open(path, encoding="utf-8", errors="ignore") as f:
+            texts.append(f.read())
+    texts *= repeat
+    print(f"Dokumentów na przebieg: {len(texts)}")
+    baseline = None
+    for n_process, rate in benchmark(nlp, texts, processes):
+        baseline = baseline or rate
+        print(f"{n_process:>3} proc.: {rate:8.1f} dok./s  (x{rate / baseline:.2f})")
+
+
+def _index_dir(directory: str) -> str:
+    return directory or config.SETTINGS.fulltext_index_dir or default_index_dir()
+
+
+def run_index_command(pdf_paths: List[str], language: str, index_dir: str) -> None:
+    """OCR the PDFs and add their text to the full-text index.
+
+    Documents are indexed as soon as their OCR finishes.
+
+    Args:
+        pdf_paths: PDF files to index, stored under their absolute paths.
+        language: language code for OCR (``pol``, ``eng`` or ``auto``).
+        index_dir: Index directory; empty uses the configured one.
+    """
+    cancel_event = threading.Event()
+    indexed = 0
+    with FullTextIndex(
+        _index_dir(index_dir),
+        flush_docs=config.SETTINGS.fulltext_flush_docs,
+        merge_factor=config.SETTINGS.fulltext_merge_factor,
+    ) as index:
+        for idx, (text, status) in iter_texts_with_ocr(
+            pdf_paths, cancel_event, language=language
+        ):
+            if not text or text.startswith("BŁĄD TECHNICZNY OCR"):
+                print(f"{pdf_paths[idx]}: pominięto ({status})")
+                continue
+            index.add_document(pdf_paths[idx], text)
+            indexed += 1
+        print(f"Zaindeksowano dokumentów: {indexed} (w indeksie: {len(index)})")
+
+
+def run_search_command(query: str, limit: int, index_dir: str) -> None:
+    """Print documents matching ``query``, best first.
+
+    Args:
+        query: Words ranked with BM25; text in double quotes is a phrase.
+        limit: Maximum number of results.
+        index_dir: Index directory; empty uses the configured one.
+    """
+    index = FullTextIndex(_index_dir(index_dir), readonly=True)
+    try:
+        start = time.perf_counter()
+        hits = index.search(query, limit)
+        elapsed = (time.perf_counter() - start) * 1000
+        for hit in hits:
+            print(f"{hit.score:8.3f}  {hit.path}")
+        print(f"Wyników: {len(hits)} ({elapsed:.1f} ms)")
+    finally:
+        index.close()
+
+
+def run_searchable_command(pdf_paths: List[str], out_dir: str, bilevel: bool) -> None:
+    """Write searchable copies of ``pdf_paths`` to ``out_dir`` with ``training_ocr``.
+
+    Text and text layer come from the same OCR pass, so the copies can be
+    searched and processed again without running OCR.
+    """
+    from archiwizator_core.training_engine import run_cpp_ocr_stream
+
+    written = 0
+    for index, _, pdf in run_cpp_ocr_stream(pdf_paths, pdf_dir=out_dir, bilevel=bilevel):
+        if pdf:
+            written += 1
+            print(f"{pdf_paths[index]} -> {pdf}")
+        else:
+            print(f"{pdf_paths[index]}: błąd zapisu")
+    print(f"Zapisano plików: {written}/{len(pdf_paths)}")
+
+
+def run_ocr_coordinator_command(
+    pdf_paths: List[str],
+    listen: str,
+    pages_per_task: int,
+    ship_input: bool,
+    out_dir: str,
+    token: str,
+) -> None:
+    """Serve OCR of ``pdf_paths`` to ``ocr-worker`` processes on other nodes.
+
+    Texts are written to ``out_dir`` as ``<name>.txt`` when it is given.
+    Workers must present ``token``; a random one is printed when it is empty.
+    """
+    from archiwizator_core.distributed_ocr import Coordinator, parse_address
+
+    host, port = parse_address(listen)
+    coordinator = Coordinator(
+        pdf_paths,
+        pages_per_task=pages_per_task,
+        ship_input=ship_input,
+        host=host,
+        port=port,
+        token=token,
+    )
+    start = time.perf_counter()
+    with coordinator:
+        print("Koordynator nasłuchuje na %s:%d" % coordinator.address, flush=True)
+        if not token:
+            print(f"Token pracowników: {coordinator.token}", flush=True)
+        for result in coordinator.results():
+            if out_dir:
+                name = os.path.splitext(os.path.basename(result.path))[0]
+                with open(os.path.join(out_dir, f"{name}.txt"), "w", encoding="utf-8") as fh:
+                    fh.write(result.text)
+            status = f"błąd: {result.error}" if result.error else "OK"
+            print(f"{result.path}: {len(result.text)} znaków, {status}", flush=True)
+    print(f"Zakończono {len(pdf_paths)} plików w {time.perf_counter() - start:.1f} s")
+
+
+def run_ocr_worker_command(address: str, token: str, heartbeat: float) -> None:
+    """Recognize page ranges leased by the coordinator at ``address``."""
+    from archiwizator_core.distributed_ocr import parse_address, run_worker
+
+    done = run_worker(parse_address(address), token, heartbeat=heartbeat)
+    print(f"Przetworzono zakresów stron: {done}")
+
+
 def main() -> None:
     parser = argparse.ArgumentParser(description="Archiwizator CLI")
     subparsers = parser.add_subparsers(dest="command")
@@ -46,9 +197,125 @@ def main() -> None:
         help="Język OCR (pol, eng, auto)",
     )
 
+    bench_parser = subparsers.add_parser(
+        "ner-benchmark", help="Zmierz przepustowość NER (dok./s) dla liczby procesów"
+    )
+    bench_parser.add_argument("model", help="Nazwa lub ścieżka modelu spaCy")
+    bench_parser.add_argument(
+        "text_paths", nargs="+", help="Pliki tekstowe z przykładowymi dokumentami"
+    )
+    bench_parser.add_argument(
+        "-p",
+        "--processes",
+        type=int,
+        nargs="+",
+        default=[1, 2, 4, 0],
+        help="Liczby procesów do porównania (0 = wszystkie rdzenie)",
+    )
+    bench_parser.add_argument(
+        "-r", "--repeat", type=int, default=1, help="Powtórzenia zestawu dokumentów"
+    )
+
+    index_parser = subparsers.add_parser(
+        "index", help="Dodaj tekst OCR plików PDF do indeksu pełnotekstowego"
+    )
+    index_parser.add_argument("pdf_paths", nargs="+", help="Pliki PDF do zaindeksowania")
+    index_parser.add_argument(
+        "-l",
+        "--language",
+        default="pol",
+        choices=["pol", "eng", "auto"],
+        help="Język OCR (pol, eng, auto)",
+    )
+    index_parser.add_argument("-d", "--index-dir", default="", help="Katalog indeksu")
+
+    search_parser = subparsers.add_parser(
+        "search", help="Szukaj dokumentów w indeksie pełnotekstowym"
+    )
+    search_parser.add_argument(
+        "query", help='Zapytanie; tekst w cudzysłowie to fraza, np. \'"umowa najmu"\''
+    )
+    search_parser.add_argument(
+        "-n", "--limit", type=int, default=20, help="Maksymalna liczba wyników"
+    )
+    search_parser.add_argument("-d", "--index-dir", default="", help="Katalog indeksu")
+
+    searchable_parser = subparsers.add_parser(
+        "searchable", help="Zapisz przeszukiwalne kopie PDF (obraz z warstwą tekstu)"
+    )
+    searchable_parser.add_argument("pdf_paths", nargs="+", help="Pliki PDF")
+    searchable_parser.add_argument(
+        "-o", "--out-dir", required=True, help="Katalog przeszukiwalnych PDF-ów"
+    )
+    searchable_parser.add_argument(
+        "--bilevel",
+        action="store_true",
+        help="Strony czarno-białe (CCITT G4) zamiast JPEG; mniejsze pliki skanów tekstu",
+    )
+
+    coordinator_parser = subparsers.add_parser(
+        "ocr-coordinator", help="Rozdziel OCR plików PDF między pracowników ocr-worker"
+    )
+    coordinator_parser.add_argument("pdf_paths", nargs="+", help="Pliki PDF")
+    coordinator_parser.add_argument(
+        "--listen",
+        default="127.0.0.1:7461",
+        help="Adres nasłuchu HOST:PORT; 0.0.0.0:PORT udostępnia go w sieci",
+    )
+    coordinator_parser.add_argument(
+        "--token",
+        default=os.environ.get("ARCHIWIZATOR_OCR_TOKEN", ""),
+        help="Wspólny token pracowników (domyślnie ARCHIWIZATOR_OCR_TOKEN lub losowy)",
+    )
+    coordinator_parser.add_argument(
+        "-p", "--pages-per-task", type=int, default=16, help="Stron w jednym zadaniu"
+    )
+    coordinator_parser.add_argument(
+        "--ship",
+        action="store_true",
+        help="Przesyłaj pliki pracownikom zamiast wspólnej ścieżki sieciowej",
+    )
+    coordinator_parser.add_argument("-o", "--out-dir", default="", help="Katalog plików .txt")
+
+    worker_parser = subparsers.add_parser(
+        "ocr-worker", help="Wykonuj OCR zadań przydzielanych przez ocr-coordinator"
+    )
+    worker_parser.add_argument("address", help="Adres koordynatora HOST:PORT")
+    worker_parser.add_argument(
+        "--token",
+        default=os.environ.get("ARCHIWIZATOR_OCR_TOKEN", ""),
+        help="Token koordynatora (domyślnie ARCHIWIZATOR_OCR_TOKEN)",
+    )
+    worker_parser.add_argument(
+        "--heartbeat", type=float, default=5.0, help="Odstęp sygnałów życia (s)"
+    )
+
     args = parser.parse_args()
     if args.command == "process":
         run_process_command(args.pdf_paths, args.language)
+    elif args.command == "ner-benchmark":
+        run_ner_benchmark_command(args.model, args.text_paths, args.processes, args.repeat)
+    elif args.command == "index":
+        run_index_command(
+            [os.path.abspath(p) for p in args.pdf_paths], args.language, args.index_dir
+        )
+    elif args.command == "search":
+        run_search_command(args.query, args.limit, args.index_dir)
+    elif args.command == "searchable":
+        run_searchable_command(
+            [os.path.abspath(p) for p in args.pdf_paths], args.out_dir, args.bilevel
+        )
+    elif args.command == "ocr-coordinator":
+        run_ocr_coordinator_command(
+            [os.path.abspath(p) for p in args.pdf_paths],
+            args.listen,
+            args.pages_per_task,
+            args.ship,
+            args.out_dir,
+            args.token,
+        )
+    elif args.command == "ocr-worker":
+        run_ocr_worker_command(args.address, args.token, args.heartbeat)
     else:
         parser.print_help()
 
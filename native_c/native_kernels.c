@@ -0,0 +1,556 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Archiwizator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * CPython extension module exposing the native similarity kernels without
+ * ctypes. Functions use the METH_FASTCALL (vectorcall) convention and read
+ * str arguments in place: UCS4 strings are passed to the kernels without a
+ * copy, narrower ones are widened into a stack buffer. Vectors are taken
+ * through the buffer protocol (numpy arrays, array.array, memoryview), and
+ * batch calls release the GIL while the kernels run.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "token_similarity.h"
+
+/* Kernels from 2_Aplikacja_Glowna/native compiled into this module */
+long levenshtein_distance_utf32(const uint32_t *a, size_t la, const uint32_t *b, size_t lb);
+double jaro_winkler_similarity(const uint32_t *a, size_t la, const uint32_t *b, size_t lb,
+                               double prefix_weight);
+double levenshtein_ratio(const uint32_t *a, size_t la, const uint32_t *b, size_t lb);
+int similarity_batch(int metric, const uint32_t *query, size_t lq, const uint32_t *texts,
+                     const size_t *offsets, size_t n, double prefix_weight, double *out);
+double cosine_similarity(const double *a, const double *b, int n);
+float cosine_similarityf(const float *a, const float *b, int n);
+void cosine_batchf(const float *query, const float *matrix, int rows, int n, float *out);
+int cosine_top_kf(const float *query, const float *matrix, int rows, int n, int k,
+                  int *indices, float *scores);
+
+/* Powyżej tylu znaków pojedyncze porównanie zwalnia GIL */
+#define GIL_RELEASE_CHARS 4096
+#define LOCAL_CHARS 256
+
+typedef struct {
+    const uint32_t *data;
+    uint32_t *owned;
+    Py_ssize_t len;
+    uint32_t local[LOCAL_CHARS];
+} CodePoints;
+
+static void code_points_free(CodePoints *cp) {
+    PyMem_Free(cp->owned);
+    cp->owned = NULL;
+}
+
+static int code_points(PyObject *obj, CodePoints *cp) {
+    cp->owned = NULL;
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "expected str, got %.200s", Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+#if PY_VERSION_HEX < 0x030C0000
+    if (PyUnicode_READY(obj) < 0)
+        return -1;
+#endif
+    Py_ssize_t len = PyUnicode_GET_LENGTH(obj);
+    int kind = PyUnicode_KIND(obj);
+    const void *data = PyUnicode_DATA(obj);
+    cp->len = len;
+    if (kind == PyUnicode_4BYTE_KIND) {
+        /* Dane str są już w UTF-32: bez kopiowania */
+        cp->data = (const uint32_t *)data;
+        return 0;
+    }
+    uint32_t *out = cp->local;
+    if (len > LOCAL_CHARS) {
+        out = cp->owned = (uint32_t *)PyMem_Malloc((size_t)len * sizeof(uint32_t));
+        if (!out) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    if (kind == PyUnicode_1BYTE_KIND) {
+        const Py_UCS1 *src = (const Py_UCS1 *)data;
+        for (Py_ssize_t i = 0; i < len; ++i)
+            out[i] = src[i];
+    } else {
+        const Py_UCS2 *src = (const Py_UCS2 *)data;
+        for (Py_ssize_t i = 0; i < len; ++i)
+            out[i] = src[i];
+    }
+    cp->data = out;
+    return 0;
+}
+
+static int check_nargs(const char *name, Py_ssize_t nargs, Py_ssize_t min, Py_ssize_t max) {
+    if (nargs < min || nargs > max) {
+        if (min == max)
+            PyErr_Format(PyExc_TypeError, "%s() takes %zd arguments (%zd given)", name, min,
+                         nargs);
+        else
+            PyErr_Format(PyExc_TypeError, "%s() takes %zd to %zd arguments (%zd given)", name,
+                         min, max, nargs);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- Napisy ---- */
+
+static PyObject *nk_token_similarity(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    if (check_nargs("token_similarity", nargs, 2, 2) < 0)
+        return NULL;
+    /* Widok UTF-8 przechowywany w obiekcie str, bez ponownego kodowania */
+    const char *a = PyUnicode_AsUTF8AndSize(args[0], NULL);
+    if (!a)
+        return NULL;
+    const char *b = PyUnicode_AsUTF8AndSize(args[1], NULL);
+    if (!b)
+        return NULL;
+    return PyFloat_FromDouble(token_similarity(a, b));
+}
+
+typedef enum { PAIR_DISTANCE, PAIR_JARO_WINKLER, PAIR_RATIO } PairMetric;
+
+static PyObject *pair_metric(const char *name, PairMetric metric, PyObject *const *args,
+                             Py_ssize_t nargs) {
+    Py_ssize_t max = metric == PAIR_JARO_WINKLER ? 3 : 2;
+    if (check_nargs(name, nargs, 2, max) < 0)
+        return NULL;
+    double prefix_weight = 0.1;
+    if (nargs == 3) {
+        prefix_weight = PyFloat_AsDouble(args[2]);
+        if (prefix_weight == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+    CodePoints a, b;
+    if (code_points(args[0], &a) < 0)
+        return NULL;
+    if (code_points(args[1], &b) < 0) {
+        code_points_free(&a);
+        return NULL;
+    }
+    double score = 0.0;
+    long distance = 0;
+    int release = a.len + b.len > GIL_RELEASE_CHARS;
+    PyThreadState *state = release ? PyEval_SaveThread() : NULL;
+    if (metric == PAIR_DISTANCE)
+        distance = levenshtein_distance_utf32(a.data, (size_t)a.len, b.data, (size_t)b.len);
+    else if (metric == PAIR_JARO_WINKLER)
+        score = jaro_winkler_similarity(a.data, (size_t)a.len, b.data, (size_t)b.len,
+                                        prefix_weight);
+    else
+        score = levenshtein_ratio(a.data, (size_t)a.len, b.data, (size_t)b.len);
+    if (release)
+        PyEval_RestoreThread(state);
+    code_points_free(&a);
+    code_points_free(&b);
+    if (score < 0.0 || distance < 0)
+        return PyErr_NoMemory();
+    if (metric == PAIR_DISTANCE)
+        return PyLong_FromLong(distance);
+    return PyFloat_FromDouble(score);
+}
+
+static PyObject *nk_levenshtein_distance(PyObject *self, PyObject *const *args,
+                                         Py_ssize_t nargs) {
+    (void)self;
+    return pair_metric("levenshtein_distance", PAIR_DISTANCE, args, nargs);
+}
+
+static PyObject *nk_jaro_winkler(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    return pair_metric("jaro_winkler", PAIR_JARO_WINKLER, args, nargs);
+}
+
+static PyObject *nk_levenshtein_ratio(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    return pair_metric("levenshtein_ratio", PAIR_RATIO, args, nargs);
+}
+
+static PyObject *nk_similarity_batch(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    if (check_nargs("similarity_batch", nargs, 2, 4) < 0)
+        return NULL;
+    int metric = 0;
+    double prefix_weight = 0.1;
+    if (nargs >= 3) {
+        metric = PyLong_AsLong(args[2]) != 0;
+        if (PyErr_Occurred())
+            return NULL;
+    }
+    if (nargs == 4) {
+        prefix_weight = PyFloat_AsDouble(args[3]);
+        if (prefix_weight == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+    PyObject *seq = PySequence_Fast(args[1], "choices must be a sequence of str");
+    if (!seq)
+        return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    PyObject *result = NULL;
+    uint32_t *texts = NULL;
+    size_t *offsets = NULL;
+    double *scores = NULL;
+    CodePoints query;
+    if (code_points(args[0], &query) < 0) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    /* Wszystkie napisy w jednym buforze UTF-32, podział według offsets */
+    size_t total = 0;
+    for (Py_ssize_t k = 0; k < n; ++k) {
+        if (!PyUnicode_Check(items[k])) {
+            PyErr_Format(PyExc_TypeError, "choices[%zd] must be str, not %.200s", k,
+                         Py_TYPE(items[k])->tp_name);
+            goto done;
+        }
+        total += (size_t)PyUnicode_GET_LENGTH(items[k]);
+    }
+    texts = (uint32_t *)PyMem_Malloc((total ? total : 1) * sizeof(uint32_t));
+    offsets = (size_t *)PyMem_Malloc(((size_t)n + 1) * sizeof(size_t));
+    scores = (double *)PyMem_Malloc((n ? (size_t)n : 1) * sizeof(double));
+    if (!texts || !offsets || !scores) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    size_t pos = 0;
+    for (Py_ssize_t k = 0; k < n; ++k) {
+        offsets[k] = pos;
+        if (!PyUnicode_AsUCS4(items[k], texts + pos, (Py_ssize_t)(total - pos), 0))
+            goto done;
+        pos += (size_t)PyUnicode_GET_LENGTH(items[k]);
+    }
+    offsets[n] = pos;
+
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = similarity_batch(metric, query.data, (size_t)query.len, texts, offsets, (size_t)n,
+                              prefix_weight, scores);
+    Py_END_ALLOW_THREADS
+    if (status != 0) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    result = PyList_New(n);
+    if (!result)
+        goto done;
+    for (Py_ssize_t k = 0; k < n; ++k) {
+        PyObject *value = PyFloat_FromDouble(scores[k]);
+        if (!value) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, k, value);
+    }
+
+done:
+    code_points_free(&query);
+    PyMem_Free(texts);
+    PyMem_Free(offsets);
+    PyMem_Free(scores);
+    Py_DECREF(seq);
+    return result;
+}
+
+/* ---- Wektory ---- */
+
+/* Znak typu bufora bez prefiksu kolejności bajtów ("<f" -> 'f') */
+static char buffer_type(const Py_buffer *view) {
+    const char *fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=' || *fmt == '<')
+        ++fmt;
+    return fmt[1] == '\0' ? fmt[0] : '\0';
+}
+
+static int float_buffer(PyObject *obj, Py_buffer *view, const char *name) {
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+        return -1;
+    if (buffer_type(view) != 'f') {
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous float32 buffer", name);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+/* Listy i inne sekwencje liczb: kopia do tablicy double */
+static double *sequence_doubles(PyObject *obj, Py_ssize_t *len) {
+    PyObject *seq = PySequence_Fast(obj, "expected a buffer or a sequence of numbers");
+    if (!seq)
+        return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    double *out = (double *)PyMem_Malloc((n ? (size_t)n : 1) * sizeof(double));
+    if (!out) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        out[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+        if (out[i] == -1.0 && PyErr_Occurred()) {
+            PyMem_Free(out);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    *len = n;
+    return out;
+}
+
+static double *vector_doubles(PyObject *obj, Py_ssize_t *len) {
+    Py_buffer view;
+    if (!PyObject_CheckBuffer(obj) ||
+        PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        PyErr_Clear();
+        return sequence_doubles(obj, len);
+    }
+    char type = buffer_type(&view);
+    if (type != 'f' && type != 'd') {
+        PyBuffer_Release(&view);
+        return sequence_doubles(obj, len);
+    }
+    Py_ssize_t n = view.len / view.itemsize;
+    double *out = (double *)PyMem_Malloc((n ? (size_t)n : 1) * sizeof(double));
+    if (!out) {
+        PyBuffer_Release(&view);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i)
+        out[i] = type == 'f' ? ((const float *)view.buf)[i] : ((const double *)view.buf)[i];
+    PyBuffer_Release(&view);
+    *len = n;
+    return out;
+}
+
+static PyObject *nk_cosine_similarity(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    if (check_nargs("cosine_similarity", nargs, 2, 2) < 0)
+        return NULL;
+    /* Dwa bufory float32: jądro float bez kopiowania */
+    Py_buffer va, vb;
+    if (PyObject_CheckBuffer(args[0]) && PyObject_CheckBuffer(args[1]) &&
+        PyObject_GetBuffer(args[0], &va, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+        if (PyObject_GetBuffer(args[1], &vb, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+            if (buffer_type(&va) == 'f' && buffer_type(&vb) == 'f') {
+                Py_ssize_t n = va.len / va.itemsize;
+                double score = 0.0;
+                int same = n == vb.len / vb.itemsize;
+                if (same)
+                    score = cosine_similarityf((const float *)va.buf, (const float *)vb.buf,
+                                               (int)n);
+                PyBuffer_Release(&va);
+                PyBuffer_Release(&vb);
+                if (!same) {
+                    PyErr_SetString(PyExc_ValueError, "vectors differ in length");
+                    return NULL;
+                }
+                return PyFloat_FromDouble(score);
+            }
+            PyBuffer_Release(&vb);
+        }
+        PyBuffer_Release(&va);
+    }
+    PyErr_Clear();
+    Py_ssize_t la = 0, lb = 0;
+    double *a = vector_doubles(args[0], &la);
+    if (!a)
+        return NULL;
+    double *b = vector_doubles(args[1], &lb);
+    if (!b) {
+        PyMem_Free(a);
+        return NULL;
+    }
+    PyObject *result = NULL;
+    if (la != lb)
+        PyErr_SetString(PyExc_ValueError, "vectors differ in length");
+    else
+        result = PyFloat_FromDouble(cosine_similarity(a, b, (int)la));
+    PyMem_Free(a);
+    PyMem_Free(b);
+    return result;
+}
+
+/* Zapytanie [n] i macierz [wiersze x n] float32 dla cosine_batch/cosine_top_k */
+static int query_matrix(PyObject *const *args, Py_buffer *query, Py_buffer *matrix,
+                        int *rows, int *dim) {
+    if (float_buffer(args[0], query, "query") < 0)
+        return -1;
+    if (float_buffer(args[1], matrix, "matrix") < 0) {
+        PyBuffer_Release(query);
+        return -1;
+    }
+    Py_ssize_t n = query->len / (Py_ssize_t)sizeof(float);
+    Py_ssize_t cells = matrix->len / (Py_ssize_t)sizeof(float);
+    if (n == 0 || cells % n != 0 || (matrix->ndim == 2 && matrix->shape[1] != n)) {
+        PyErr_SetString(PyExc_ValueError, "matrix rows must have the length of query");
+        PyBuffer_Release(query);
+        PyBuffer_Release(matrix);
+        return -1;
+    }
+    *dim = (int)n;
+    *rows = (int)(cells / n);
+    return 0;
+}
+
+static PyObject *nk_cosine_batch(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    if (check_nargs("cosine_batch", nargs, 2, 2) < 0)
+        return NULL;
+    Py_buffer query, matrix;
+    int rows, dim;
+    if (query_matrix(args, &query, &matrix, &rows, &dim) < 0)
+        return NULL;
+    PyObject *result = NULL;
+    float *out = (float *)PyMem_Malloc((rows ? (size_t)rows : 1) * sizeof(float));
+    if (!out) {
+        PyErr_NoMemory();
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        cosine_batchf((const float *)query.buf, (const float *)matrix.buf, rows, dim, out);
+        Py_END_ALLOW_THREADS
+        result = PyList_New(rows);
+        for (int r = 0; result && r < rows; ++r) {
+            PyObject *value = PyFloat_FromDouble(out[r]);
+            if (!value) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyList_SET_ITEM(result, r, value);
+        }
+    }
+    PyMem_Free(out);
+    PyBuffer_Release(&query);
+    PyBuffer_Release(&matrix);
+    return result;
+}
+
+static PyObject *nk_cosine_top_k(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    (void)self;
+    if (check_nargs("cosine_top_k", nargs, 3, 3) < 0)
+        return NULL;
+    long k = PyLong_AsLong(args[2]);
+    if (k == -1 && PyErr_Occurred())
+        return NULL;
+    Py_buffer query, matrix;
+    int rows, dim;
+    if (query_matrix(args, &query, &matrix, &rows, &dim) < 0)
+        return NULL;
+    if (k > rows)
+        k = rows;
+    if (k < 0)
+        k = 0;
+    PyObject *result = NULL;
+    int *indices = (int *)PyMem_Malloc((k ? (size_t)k : 1) * sizeof(int));
+    float *scores = (float *)PyMem_Malloc((k ? (size_t)k : 1) * sizeof(float));
+    if (!indices || !scores) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    int count;
+    Py_BEGIN_ALLOW_THREADS
+    count = cosine_top_kf((const float *)query.buf, (const float *)matrix.buf, rows, dim,
+                          (int)k, indices, scores);
+    Py_END_ALLOW_THREADS
+    if (count < 0) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    result = PyList_New(count);
+    for (int i = 0; result && i < count; ++i) {
+        PyObject *pair = Py_BuildValue("(id)", indices[i], (double)scores[i]);
+        if (!pair) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, pair);
+    }
+
+done:
+    PyMem_Free(indices);
+    PyMem_Free(scores);
+    PyBuffer_Release(&query);
+    PyBuffer_Release(&matrix);
+    return result;
+}
+
+static PyMethodDef native_kernels_methods[] = {
+    {"token_similarity", (PyCFunction)(void (*)(void))nk_token_similarity, METH_FASTCALL,
+     "token_similarity(a, b)\n--\n\nJaccard similarity of whitespace-separated tokens."},
+    {"levenshtein_distance", (PyCFunction)(void (*)(void))nk_levenshtein_distance,
+     METH_FASTCALL,
+     "levenshtein_distance(a, b)\n--\n\nEdit distance in characters (code points)."},
+    {"jaro_winkler", (PyCFunction)(void (*)(void))nk_jaro_winkler, METH_FASTCALL,
+     "jaro_winkler(a, b, prefix_weight=0.1)\n--\n\nJaro-Winkler similarity of a and b."},
+    {"levenshtein_ratio", (PyCFunction)(void (*)(void))nk_levenshtein_ratio, METH_FASTCALL,
+     "levenshtein_ratio(a, b)\n--\n\n2 * LCS / (len(a) + len(b)), the InDel ratio."},
+    {"similarity_batch", (PyCFunction)(void (*)(void))nk_similarity_batch, METH_FASTCALL,
+     "similarity_batch(query, choices, metric=0, prefix_weight=0.1)\n--\n\n"
+     "Score query against every str in choices without holding the GIL.\n"
+     "metric 0 is Jaro-Winkler, 1 the Levenshtein ratio."},
+    {"cosine_similarity", (PyCFunction)(void (*)(void))nk_cosine_similarity, METH_FASTCALL,
+     "cosine_similarity(a, b)\n--\n\n"
+     "Cosine similarity of two vectors: float32/float64 buffers or sequences."},
+    {"cosine_batch", (PyCFunction)(void (*)(void))nk_cosine_batch, METH_FASTCALL,
+     "cosine_batch(query, matrix)\n--\n\n"
+     "Cosine similarity of a float32 query with every row of a float32 matrix."},
+    {"cosine_top_k", (PyCFunction)(void (*)(void))nk_cosine_top_k, METH_FASTCALL,
+     "cosine_top_k(query, matrix, k)\n--\n\n"
+     "(row, score) pairs of the k rows most similar to query, best first."},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef native_kernels_module = {
+    PyModuleDef_HEAD_INIT,
+    "native_kernels",
+    "Native similarity kernels of Archiwizator.",
+    -1,
+    native_kernels_methods,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+};
+
+PyMODINIT_FUNC PyInit_native_kernels(void) {
+    PyObject *module = PyModule_Create(&native_kernels_module);
+    if (!module)
+        return NULL;
+    if (PyModule_AddIntConstant(module, "JARO_WINKLER", 0) < 0 ||
+        PyModule_AddIntConstant(module, "LEVENSHTEIN_RATIO", 1) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -1,51 +1,82 @@
-"""Wrapper for the C token similarity library using ctypes."""
+"""Wrapper for the C token similarity kernel.
+
+The kernel is called through the ``native_kernels`` extension module,
+built ahead of time by ``native_c/CMakeLists.txt`` into
+``2_Aplikacja_Glowna``.  A ``token_similarity`` shared library already
+present in ``native_c/build`` is used through ctypes instead, and without
+either the same definition runs in Python.  Nothing is compiled at import.
+"""
 
 from __future__ import annotations
 
 import ctypes
-import subprocess
+import importlib.machinery
+import importlib.util
+import re
 import sys
 from pathlib import Path
 
 
-SRC_DIR = Path(__file__).resolve().parent.parent / "native_c"
+ROOT = Path(__file__).resolve().parent.parent
+SRC_DIR = ROOT / "native_c"
 BUILD_DIR = SRC_DIR / "build"
+EXT_DIR = ROOT / "2_Aplikacja_Glowna"
 if sys.platform.startswith("win"):
     LIB_NAME = "token_similarity.dll"
 else:
     LIB_NAME = "libtoken_similarity.so"
 LIB_PATH = BUILD_DIR / LIB_NAME
 
+# Limit tokenów na napis i separatory, jak w native_c/token_similarity.c
+MAX_TOKENS = 256
+_SEPARATORS = re.compile(r"[ \t\n\r]+")
+
+
+def _load_extension():
+    """Import ``native_kernels`` from the application directory or sys.path."""
+    spec = importlib.machinery.PathFinder.find_spec("native_kernels", [str(EXT_DIR)])
+    if spec is None:
+        spec = importlib.util.find_spec("native_kernels")
+    if spec is None:
+        return None
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
 
-def _build_lib() -> None:
-    """Build the native token similarity library with gcc if missing."""
-    BUILD_DIR.mkdir(parents=True, exist_ok=True)
-    if sys.platform.startswith("win"):
-        cmd = ["gcc", "-O3", "-shared", "token_similarity.c", "-o", str(LIB_PATH)]
-    else:
-        cmd = [
-            "gcc",
-            "-O3",
-            "-fPIC",
-            "-shared",
-            "token_similarity.c",
-            "-o",
-            str(LIB_PATH),
-        ]
-    subprocess.run(cmd, cwd=SRC_DIR, check=True)
 
+def _load_library():
+    if not LIB_PATH.exists():
+        return None
+    lib = ctypes.CDLL(str(LIB_PATH))
+    lib.token_similarity.argtypes = (ctypes.c_char_p, ctypes.c_char_p)
+    lib.token_similarity.restype = ctypes.c_double
+    return lib
 
-if not LIB_PATH.exists():
-    _build_lib()
 
-_lib = ctypes.CDLL(str(LIB_PATH))
+def _tokens(text: str) -> list:
+    return [tok for tok in _SEPARATORS.split(text) if tok][:MAX_TOKENS]
 
-_lib.token_similarity.argtypes = (ctypes.c_char_p, ctypes.c_char_p)
-_lib.token_similarity.restype = ctypes.c_double
+
+def _token_similarity_python(a: str, b: str) -> float:
+    tokens_a = _tokens(a)
+    tokens_b = _tokens(b)
+    set_a, set_b = set(tokens_a), set(tokens_b)
+    # Powtórzenia liczone jak w C: każdy token a, który występuje w b
+    intersection = sum(1 for tok in tokens_a if tok in set_b)
+    union = len(tokens_a) + sum(1 for tok in tokens_b if tok not in set_a)
+    return intersection / union if union else 0.0
+
+
+_ext = _load_extension()
+_lib = None if _ext is not None else _load_library()
 
 
 def token_similarity(a: str, b: str) -> float:
     """Return similarity score between two strings."""
-    return round(
-        _lib.token_similarity(a.encode("utf-8"), b.encode("utf-8")), 6
-    )
+    if _ext is not None:
+        score = _ext.token_similarity(a, b)
+    elif _lib is not None:
+        score = _lib.token_similarity(a.encode("utf-8"), b.encode("utf-8"))
+    else:
+        score = _token_similarity_python(a, b)
+    return round(score, 6)
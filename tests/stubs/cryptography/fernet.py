@@ -10,3 +10,7 @@ class Fernet:
     def decrypt(self, token: bytes) -> bytes:
         return token
 
+
+
+class InvalidToken(Exception):
+    """Raised by the real :meth:`Fernet.decrypt` for a damaged token."""
@@ -23,6 +23,11 @@ class Doc:
         self.text = text
         self.ents: List[Span] = []
 
+    def char_span(
+        self, start: int, end: int, label: str = "", alignment_mode: str = "strict"
+    ) -> Span:
+        return Span(text=self.text[start:end], label_=label)
+
 
 class EntityRuler:
     def __init__(self, nlp: "Language") -> None:
@@ -56,6 +61,18 @@ class Language:
             self._ruler(doc)
         return doc
 
+    def make_doc(self, text: str) -> Doc:
+        return Doc(text)
+
+    def pipe(self, texts, as_tuples=False, n_process=1, batch_size=1000):
+        """Process a stream of texts; ``n_process`` is accepted but ignored."""
+        for item in texts:
+            if as_tuples:
+                text, context = item
+                yield self(text), context
+            else:
+                yield self(item)
+
 
 def blank(lang: str) -> Language:
     return Language(lang)
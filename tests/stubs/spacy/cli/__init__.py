@@ -0,0 +1 @@
+"""Stub of ``spacy.cli``; training itself is never run in the tests."""
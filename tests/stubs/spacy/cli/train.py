@@ -0,0 +1,5 @@
+"""Stub of ``spacy.cli.train``."""
+
+
+def train(config_path, output_path=None, overrides=None):  # pragma: no cover
+    raise NotImplementedError("spaCy training is not available in the stub")
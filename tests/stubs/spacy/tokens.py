@@ -0,0 +1,33 @@
+"""Stub of ``spacy.tokens`` with an in-memory ``DocBin``."""
+
+from __future__ import annotations
+
+import json
+from typing import List
+
+from . import Doc
+
+
+class DocBin:
+    def __init__(self) -> None:
+        self.docs: List[Doc] = []
+
+    def add(self, doc: Doc) -> None:
+        self.docs.append(doc)
+
+    def __len__(self) -> int:
+        return len(self.docs)
+
+    def to_disk(self, path) -> None:
+        with open(path, "w", encoding="utf-8") as f:
+            json.dump(
+                [
+                    {"text": d.text, "ents": [[e.text, e.label_] for e in d.ents]}
+                    for d in self.docs
+                ],
+                f,
+                ensure_ascii=False,
+            )
+
+
+__all__ = ["DocBin", "Doc"]
@@ -0,0 +1,147 @@
+"""Tests for barcode decoding and routing fields from codes."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import barcodes
+from barcodes import Code, routing_fields, scan_barcodes
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(barcodes._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / barcodes._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "barcode.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(barcodes._library, "directory", str(tmp_path))
+        assert barcodes.is_available()
+    else:
+        monkeypatch.setattr(barcodes._library, "load", lambda: None)
+    return request.param
+
+
+def _code128_modules(text):
+    """Module widths of ``text`` encoded in code set B with its check character."""
+    values = [104] + [ord(ch) - 32 for ch in text]
+    values.append((values[0] + sum(i * v for i, v in enumerate(values[1:], 1))) % 103)
+    return "".join(barcodes._C128[v] for v in values) + barcodes._C128_STOP
+
+
+def _code39_modules(text, wide=3):
+    out = []
+    for ch in "*" + text + "*":
+        pattern = barcodes._C39[barcodes._C39_CHARS.index(ch)]
+        out.append("".join(str(wide) if e == "w" else "1" for e in pattern) + "1")
+    return "".join(out)[:-1]
+
+
+def _page(modules, width, height, x0, y0, module=3, bar_height=120, noise=0, seed=0):
+    """Grey page with a barcode of the given module widths, bars first."""
+    data = bytearray(b"\xe0" * (width * height))
+    x = x0
+    for k, m in enumerate(modules):
+        w = int(m) * module
+        if k % 2 == 0:
+            for y in range(y0, y0 + bar_height):
+                data[y * width + x:y * width + x + w] = b"\x30" * w
+        x += w
+    rng = random.Random(seed)
+    for _ in range(noise):
+        data[rng.randrange(len(data))] = rng.randrange(256)
+    return bytes(data)
+
+
+def test_reads_code128_registry_sticker(backend):
+    modules = _code128_modules("KW/2024/00123")
+    page = _page(modules, 600, 400, 60, 200, noise=300)
+    assert scan_barcodes(page, 600, 400) == [Code("CODE128", "KW/2024/00123")]
+    # Kod obrócony o 180 stopni (strona skanowana do góry nogami)
+    assert scan_barcodes(page[::-1], 600, 400) == [Code("CODE128", "KW/2024/00123")]
+
+
+def test_reads_code39_and_rejects_single_line_reads(backend):
+    page = _page(_code39_modules("PZ-1234"), 700, 300, 40, 100)
+    assert scan_barcodes(page, 700, 300) == [Code("CODE39", "PZ-1234")]
+    # Kod 39 nie ma znaku kontrolnego: jeden trafiony wiersz to za mało
+    short = _page(_code39_modules("PZ-1234"), 700, 300, 40, 100, bar_height=4)
+    assert scan_barcodes(short, 700, 300) == []
+
+
+def test_ignores_text_and_corrupted_codes(backend):
+    modules = list(_code128_modules("ABC123"))
+    modules[20] = "1" if modules[20] != "1" else "2"
+    page = _page("".join(modules), 500, 200, 40, 40)
+    assert scan_barcodes(page, 500, 200) == []
+    rng = random.Random(5)
+    text = bytes(rng.choice((0x20, 0xF0)) for _ in range(500 * 200))
+    assert scan_barcodes(text, 500, 200) == []
+
+
+def test_backends_decode_identically(tmp_path, monkeypatch):
+    if shutil.which("gcc") is None:
+        pytest.skip("gcc not available")
+    lib = tmp_path / barcodes._library.filename
+    subprocess.run(
+        ["gcc", "-O3", "-march=native", "-fPIC", "-shared",
+         str(BASE_DIR / "native" / "barcode.c"), "-o", str(lib)],
+        check=True,
+    )
+    monkeypatch.setattr(barcodes._library, "_lib", None)
+    monkeypatch.setattr(barcodes._library, "directory", str(tmp_path))
+    pages = [
+        _page(_code128_modules("I C 105/24"), 500, 160, 30, 20, module=2, noise=2000, seed=1),
+        _page(_code39_modules("AB12"), 400, 160, 30, 20, module=2, noise=3000, seed=2),
+    ]
+    native = [scan_barcodes(p, len(p) // 160, 160, step=4) for p in pages]
+    assert barcodes.is_available()
+    python = [barcodes._scan_python(p, len(p) // 160, 160, 4) for p in pages]
+    assert native == python
+
+
+def test_routing_fields_from_qr_and_barcodes():
+    codes = [
+        Code("CODE128", "KW/2024/00123"),
+        Code("QR", '{"Sygnatura": "I C 105/24", "data": "2024-03-01"}'),
+    ]
+    assert routing_fields(codes) == {
+        "sygnatura_sprawy": "I C 105/24",
+        "data": "2024-03-01",
+        "numer_dokumentu": "KW/2024/00123",
+    }
+    assert routing_fields([Code("QR", "sygn.=II Ca 7/23;nr rej.=12")]) == {
+        "sygnatura_sprawy": "II Ca 7/23",
+        "numer_dokumentu": "12",
+    }
+    assert routing_fields([Code("QR", "https://sad.example/e?sprawa=SA%2012/24")]) == {
+        "sygnatura_sprawy": "SA 12/24",
+    }
+    assert routing_fields([Code("QR", "I  C 105/24")]) == {"sygnatura_sprawy": "I C 105/24"}
+    assert routing_fields([Code("QR", "przypadkowy tekst")]) == {}
+
+
+def test_only_registry_barcodes_give_document_number():
+    # Kod produktu z załącznika i numer przesyłki nie są numerem z dziennika
+    codes = [Code("CODE128", "5901234123457"), Code("CODE128", "PX1234567890")]
+    assert routing_fields(codes) == {}
+    assert routing_fields(codes + [Code("CODE39", "RPW-15-24")]) == {
+        "numer_dokumentu": "RPW-15-24"
+    }
+    assert routing_fields(codes, registry_prefixes=["px"]) == {
+        "numer_dokumentu": "PX1234567890"
+    }
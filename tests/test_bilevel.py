@@ -0,0 +1,260 @@
+"""Tests for CCITT G4 encoding and recompression of archived scans."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import re
+import shutil
+import subprocess
+import sys
+import zlib
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import bilevel
+from bilevel import BilevelPage, Recompressor, encode_g4, write_pdf
+from file_placement import FilePlacer
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(bilevel._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / bilevel._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "bilevel.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(bilevel._library, "directory", str(tmp_path))
+        assert bilevel.is_available()
+    else:
+        monkeypatch.setattr(bilevel._library, "load", lambda: None)
+    return request.param
+
+
+def _decode_g4(data, width, height):
+    """Independent T.6 decoder returning rows of 0 (white) / 1 (black)."""
+    bits = "".join(f"{b:08b}" for b in data)
+    pos = 0
+    tables = []
+    for term, makeup in ((bilevel._WHITE_TERM, bilevel._WHITE_MAKEUP),
+                         (bilevel._BLACK_TERM, bilevel._BLACK_MAKEUP)):
+        table = {code: run for run, code in enumerate(term)}
+        table.update({code: 64 * (k + 1) for k, code in enumerate(makeup)})
+        table.update({code: 1792 + 64 * k for k, code in enumerate(bilevel._EXT_MAKEUP)})
+        tables.append(table)
+    modes = {"1": 0, "011": 1, "000011": 2, "0000011": 3, "010": -1, "000010": -2,
+             "0000010": -3, "0001": "pass", "001": "horizontal"}
+
+    def read(table):
+        nonlocal pos
+        for length in range(1, 14):
+            code = bits[pos:pos + length]
+            if code in table:
+                pos += length
+                return table[code]
+        raise AssertionError(f"nieznany kod na pozycji {pos}")
+
+    def run(color):
+        total = 0
+        while True:
+            length = read(tables[color])
+            total += length
+            if length < 64:
+                return total
+
+    ref = [0] * width
+    rows = []
+    for _ in range(height):
+        line = [0] * width
+        a0, color = -1, 0
+        while a0 < width:
+            start = max(a0, 0)
+            b1 = next(
+                (x for x in range(a0 + 1, width)
+                 if ref[x] != (ref[x - 1] if x else 0) and ref[x] != color),
+                width,
+            )
+            b2 = next((x for x in range(b1 + 1, width) if ref[x] != ref[x - 1]), width)
+            mode = read(modes)
+            if mode == "pass":
+                line[start:b2] = [color] * (b2 - start)
+                a0 = b2
+            elif mode == "horizontal":
+                r1, r2 = run(color), run(1 - color)
+                line[start:start + r1] = [color] * r1
+                line[start + r1:start + r1 + r2] = [1 - color] * r2
+                a0 = start + r1 + r2
+            else:
+                a1 = b1 + mode
+                line[start:a1] = [color] * (a1 - start)
+                a0, color = a1, 1 - color
+        rows.append(line[:width])
+        ref = rows[-1]
+    assert bits[pos:pos + 24] == "000000000001" * 2
+    return rows
+
+
+def _letter(width, height, seed):
+    rng = random.Random(seed)
+    data = bytearray(b"\xf0" * (width * height))
+    for _ in range(width * height // 400):
+        x, y = rng.randrange(width), rng.randrange(height)
+        w, h = rng.randrange(1, 40), rng.randrange(1, 8)
+        for row in range(y, min(height, y + h)):
+            end = min(width, x + w)
+            data[row * width + x:row * width + end] = b"\x20" * (end - x)
+    # Długie serie: czarny pas przez całą szerokość i biała reszta
+    data[width * (height - 3):width * (height - 2)] = b"\x00" * width
+    return bytes(data)
+
+
+def test_g4_round_trip(backend):
+    for width, height, seed in ((200, 60, 1), (3000, 8, 2), (1, 5, 3), (37, 41, 4)):
+        gray = _letter(width, height, seed)
+        rows = _decode_g4(encode_g4(gray, width, height), width, height)
+        expected = [[int(gray[y * width + x] < 128) for x in range(width)] for y in range(height)]
+        assert rows == expected
+
+
+def test_backends_encode_identically(tmp_path, monkeypatch):
+    if shutil.which("gcc") is None:
+        pytest.skip("gcc not available")
+    lib = tmp_path / bilevel._library.filename
+    subprocess.run(
+        ["gcc", "-O3", "-march=native", "-fPIC", "-shared",
+         str(BASE_DIR / "native" / "bilevel.c"), "-o", str(lib)],
+        check=True,
+    )
+    monkeypatch.setattr(bilevel._library, "_lib", None)
+    monkeypatch.setattr(bilevel._library, "directory", str(tmp_path))
+    rng = random.Random(7)
+    pages = [(_letter(600, 300, s), 600, 300) for s in range(3)]
+    noise = bytes(rng.randrange(256) for _ in range(150 * 80))
+    pages.append((noise, 150, 80))
+    rgb = bytes(rng.choice((0, 40, 200, 255)) for _ in range(3 * 97 * 53))
+    native = [encode_g4(*p) for p in pages] + [bilevel.colour_fraction(rgb, 97, 53)]
+    monkeypatch.setattr(bilevel._library, "load", lambda: None)
+    python = [encode_g4(*p) for p in pages] + [bilevel.colour_fraction(rgb, 97, 53)]
+    assert native == python
+    assert 0 < native[-1] < 1
+
+
+def test_colour_detection(backend):
+    grey = bytes(v for _ in range(64 * 64) for v in (90, 95, 92))
+    assert bilevel.colour_fraction(grey, 64, 64) == 0
+    stamp = bytearray(grey)
+    for y in range(0, 16):
+        for x in range(0, 16):
+            stamp[3 * (y * 64 + x):3 * (y * 64 + x) + 3] = b"\x20\x30\xc0"
+    assert bilevel.colour_fraction(bytes(stamp), 64, 64) == pytest.approx(16 / 256)
+
+
+def test_pdf_structure(tmp_path):
+    page = BilevelPage(2480, 3508, 300, b"\x00\x10\x01")
+    path = tmp_path / "out.pdf"
+    write_pdf(str(path), [page, page])
+    data = path.read_bytes()
+    assert data.startswith(b"%PDF-1.4") and data.endswith(b"%%EOF\n")
+    xref = int(re.search(rb"startxref\n(\d+)", data).group(1))
+    assert data[xref:].startswith(b"xref\n0 9\n")
+    offsets = [int(m) for m in re.findall(rb"(\d{10}) 00000 n", data)]
+    for number, offset in enumerate(offsets, 1):
+        assert data[offset:].startswith(b"%d 0 obj" % number)
+    assert b"/MediaBox [0 0 595.20 841.92]" in data
+    assert b"/Filter /CCITTFaxDecode /DecodeParms << /K -1 /Columns 2480 /Rows 3508 >>" in data
+
+
+def _scan(path, pages, size=100_000):
+    """Write an image-only PDF whose pages are large incompressible images."""
+    rng = random.Random(1)
+    write_pdf(str(path), [BilevelPage(2480, 3508, 300, rng.randbytes(size)) for _ in range(pages)])
+
+
+def test_recompressor_replaces_only_smaller_black_and_white_copies(tmp_path):
+    src = tmp_path / "skan.pdf"
+    _scan(src, 2)
+    small = tmp_path / "maly.pdf"
+    _scan(small, 1, size=100)
+    out = tmp_path / "archiwum"
+    out.mkdir()
+    gray = _letter(400, 500, 5)
+    page = BilevelPage(400, 500, 300, encode_g4(gray, 400, 500))
+
+    placer = FilePlacer(max_workers=2)
+    recompressor = Recompressor(max_workers=2)
+    recompressor.submit(placer.submit(str(src), str(out / "a.pdf")), [page, page])
+    recompressor.submit(placer.submit(str(src), str(out / "b.pdf")), [page, None])
+    recompressor.submit(placer.submit(str(small), str(out / "c.pdf")), [page])
+    placer.close()
+    results = recompressor.close()
+
+    assert [(r.replaced, r.reason) for r in results] == [
+        (True, ""), (False, "kolor"), (False, "bez zysku")
+    ]
+    assert (out / "a.pdf").read_bytes().startswith(b"%PDF-1.4")
+    assert (out / "b.pdf").read_bytes() == src.read_bytes()
+    assert (out / "c.pdf").read_bytes() == small.read_bytes()
+    assert sorted(p.name for p in out.iterdir()) == ["a.pdf", "b.pdf", "c.pdf"]
+    files, before, after = bilevel.savings(results)
+    assert (files, before) == (1, src.stat().st_size) and after < before
+
+
+def test_recompressor_keeps_source_when_archive_copy_is_the_source(tmp_path):
+    src = tmp_path / "skan.pdf"
+    _scan(src, 2)
+    original = src.read_bytes()
+    page = BilevelPage(400, 500, 300, encode_g4(_letter(400, 500, 5), 400, 500))
+
+    # Folder wyjściowy równy wejściowemu: FilePlacer nie kopiuje ("same")
+    placer = FilePlacer(max_workers=2)
+    recompressor = Recompressor(max_workers=2)
+    placement = placer.submit(str(src), str(src))
+    recompressor.submit(placement, [page, page])
+    placer.close()
+    (result,) = recompressor.close()
+
+    assert placement.result().method == "same"
+    assert (result.replaced, result.reason) == (False, "brak odrębnej kopii")
+    assert src.read_bytes() == original
+
+
+def test_recompressor_keeps_incomplete_and_non_image_documents(tmp_path):
+    scan = tmp_path / "skan.pdf"
+    _scan(scan, 3)
+    data = scan.read_bytes()
+    searchable = tmp_path / "tekst.pdf"
+    searchable.write_bytes(data.replace(b"/XObject <<", b"/Font << /F1 9 0 R >> /XObject <<", 1))
+    # Formularz ukryty w skompresowanym strumieniu obiektów (PDF 1.5)
+    hidden = zlib.compress(b"10 0 << /AcroForm << /Fields [] >> >>")
+    form = tmp_path / "formularz.pdf"
+    form.write_bytes(
+        data[:-6] + b"10 0 obj\n<< /Type /ObjStm /N 1 /First 5 /Filter /FlateDecode "
+        b"/Length %d >>\nstream\n" % len(hidden) + hidden + b"\nendstream\nendobj\n%%EOF\n"
+    )
+    assert bilevel.scanned_page_count(str(scan)) == 3
+    assert bilevel.scanned_page_count(str(searchable)) is None
+    assert bilevel.scanned_page_count(str(form)) is None
+    out = tmp_path / "archiwum"
+    out.mkdir()
+    page = BilevelPage(400, 500, 300, encode_g4(_letter(400, 500, 5), 400, 500))
+
+    placer = FilePlacer(max_workers=2)
+    recompressor = Recompressor(max_workers=2)
+    for src, pages in ((scan, 2), (searchable, 3), (form, 3)):
+        recompressor.submit(placer.submit(str(src), str(out / src.name)), [page] * pages)
+    placer.close()
+    results = recompressor.close()
+
+    assert [(r.replaced, r.reason) for r in results] == [
+        (False, "niepełny dokument"), (False, "nie tylko obrazy"), (False, "nie tylko obrazy")
+    ]
+    for src in (scan, searchable, form):
+        assert (out / src.name).read_bytes() == src.read_bytes()
@@ -0,0 +1,91 @@
+"""Tests for the known case signature index."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import os
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import case_index
+from case_index import CaseIndex, fold_signature
+
+CASES = ["I C 1/24", "I C 1045/24", "II Ca 310/23", "VIII GC 77/24", "I ACa 1045/24", "XII Ns 5/22"]
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(case_index._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / case_index._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "case_index.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(case_index._library, "directory", str(tmp_path))
+        assert case_index.is_available()
+    else:
+        monkeypatch.setattr(case_index._library, "load", lambda: None)
+    return request.param
+
+
+def test_fold_merges_ocr_lookalikes():
+    assert fold_signature("I C 1O45/24") == fold_signature("l c 1045 / 24")
+    assert fold_signature("VIII GC 77/24") == "VIIIGC77/24"
+    # Numer wydziału nie jest sprowadzany do cyfr
+    assert fold_signature("II C 105/24") == fold_signature("1l C 1O5/24") != fold_signature("I C 105/24")
+
+
+def test_snap_corrects_ocr_errors(backend):
+    index = CaseIndex(CASES)
+    assert index.snap("I C 1O45/24").signature == "I C 1045/24"
+    assert index.snap("II Ca 31O/23").signature == "II Ca 310/23"
+    # Jedna zgubiona cyfra w długiej sygnaturze
+    match = index.snap("VIII GC 7/24")
+    assert (match.signature, match.distance) == ("VIII GC 77/24", 1)
+    # Krótka sygnatura: poprawiane są tylko znaki podobne
+    assert index.snap("I C 7/24") is None
+    assert index.snap("I C l/24").signature == "I C 1/24"
+    assert index.snap("IV K 12/19") is None
+    # Inny wydział to inna sprawa, nawet o jedną edycję dalej
+    assert CaseIndex(["II C 1045/24"]).snap("I C 1045/24") is None
+    assert CaseIndex(["II C 1045/24"]).snap("ll C 1O45/24").signature == "II C 1045/24"
+
+
+def test_search_matches_brute_force(backend):
+    rng = random.Random(7)
+    alphabet = "0123456789/.CAKNS"
+    keys = {"".join(rng.choice(alphabet) for _ in range(rng.randrange(1, 12))) for _ in range(500)}
+    index = CaseIndex(sorted(keys))
+    for _ in range(50):
+        query = "".join(rng.choice(alphabet) for _ in range(rng.randrange(1, 12)))
+        expected = {}
+        for key in keys:
+            dist = case_index._levenshtein_row(
+                fold_signature(key), fold_signature(query), 2
+            )
+            if dist is not None:
+                expected[key] = dist
+        found = {m.signature: m.distance for m in index.search(query, 2)}
+        assert found == expected
+
+
+def test_load_case_index_reloads_changed_file(tmp_path):
+    path = tmp_path / "sygnatury.txt"
+    settings = type("S", (), {"case_signatures_file": str(path)})()
+    assert case_index.load_case_index(settings) is None
+    path.write_text("# komentarz\nI C 1045/24\n", encoding="utf-8")
+    assert len(case_index.load_case_index(settings)) == 1
+    path.write_text("I C 1045/24\nII Ca 310/23\n", encoding="utf-8")
+    os.utime(path, (0, 12345))
+    assert len(case_index.load_case_index(settings)) == 2
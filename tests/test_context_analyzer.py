@@ -1,12 +1,14 @@
 from pathlib import Path
+import sys
 
 import pytest
 import runpy
 
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
 # Load module dynamically since package name starts with a digit
-MODULE = runpy.run_path(
-    str(Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna" / "context_analyzer.py")
-)
+MODULE = runpy.run_path(str(BASE_DIR / "context_analyzer.py"))
 ContextAwareDocumentAnalyzer = MODULE["ContextAwareDocumentAnalyzer"]
 fast_cosine = MODULE["fast_cosine"]
 SentenceTransformer = MODULE["SentenceTransformer"]
@@ -0,0 +1,216 @@
+"""Tests for the distributed OCR coordinator with local worker processes."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import json
+import socket
+import subprocess
+import sys
+import time
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+from distributed_ocr import Coordinator, DocumentResult
+
+# Pracownik testowy: "PDF" to plik tekstowy, jedna linia na stronę
+WORKER = """
+import os, subprocess, sys, time
+sys.path.insert(0, {base!r})
+from distributed_ocr import run_worker
+
+host, port, token = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+mode, marker = sys.argv[4], sys.argv[5]
+seen = set()
+
+def ocr(path, first, last):
+    if mode == "broken":
+        # Węzeł bez silnika OCR: uruchomienie programu się nie udaje
+        subprocess.run([os.path.join(marker, "training_ocr")])
+    seen.add(path)
+    lines = open(path, encoding="utf-8").read().splitlines()
+    last = last or len(lines)
+    if mode in ("crash", "hang") and not os.path.exists(marker):
+        open(marker, "w").close()
+        if mode == "crash":
+            os._exit(1)
+        if mode == "hang":
+            time.sleep(3600)
+    joined = os.path.join(marker, str(os.getpid()))
+    if mode.startswith("barrier") and not os.path.exists(joined):
+        # Pierwszy zakres czeka, aż wszyscy pracownicy dzierżawią swoje naraz
+        os.makedirs(marker, exist_ok=True)
+        open(joined, "w").close()
+        deadline = time.monotonic() + 60
+        while len(os.listdir(marker)) < int(mode[7:]):
+            if time.monotonic() > deadline:
+                raise RuntimeError("pracownicy nie działali równolegle")
+            time.sleep(0.01)
+    if "BŁĄD" in lines[first - 1]:
+        raise ValueError("uszkodzona strona")
+    return "".join(f"<{{line}}>" for line in lines[first - 1:last])
+
+heartbeat = 3600 if mode == "hang" else 0.05
+done = run_worker((host, port), token, ocr, heartbeat=heartbeat)
+print(done, len(seen))
+"""
+
+
+@pytest.fixture
+def spawn(tmp_path):
+    script = tmp_path / "worker.py"
+    script.write_text(WORKER.format(base=str(BASE_DIR)), encoding="utf-8")
+    procs = []
+
+    def start(coordinator, mode="ok", token=None):
+        host, port = coordinator.address
+        token = coordinator.token if token is None else token
+        proc = subprocess.Popen(
+            [sys.executable, str(script), host, str(port), token, mode, str(tmp_path / mode)],
+            stdout=subprocess.PIPE,
+            text=True,
+        )
+        procs.append(proc)
+        return proc
+
+    yield start
+    for proc in procs:
+        proc.kill()
+        proc.wait()
+
+
+def _documents(tmp_path, pages):
+    paths = []
+    for i, count in enumerate(pages):
+        path = tmp_path / f"dok{i}.pdf"
+        path.write_text("\n".join(f"d{i}s{p}" for p in range(1, count + 1)), encoding="utf-8")
+        paths.append(str(path))
+    return paths
+
+
+def _count_pages(path):
+    return len(Path(path).read_text(encoding="utf-8").splitlines())
+
+
+def _expected(paths):
+    return {
+        i: "".join(f"<{line}>" for line in Path(p).read_text(encoding="utf-8").splitlines())
+        for i, p in enumerate(paths)
+    }
+
+
+def test_shards_pages_across_workers(tmp_path, spawn):
+    paths = _documents(tmp_path, [7, 1, 20])
+    with Coordinator(paths, pages_per_task=3, count_pages=_count_pages) as coordinator:
+        workers = [spawn(coordinator) for _ in range(3)]
+        results = list(coordinator.results())
+    assert {r.index: r.text for r in results} == _expected(paths)
+    assert all(r.error == "" for r in results)
+    done = [int(w.communicate(timeout=10)[0].split()[0]) for w in workers]
+    assert sum(done) == 3 + 1 + 7
+
+
+def test_retries_ranges_of_lost_and_stalled_workers(tmp_path, spawn):
+    paths = _documents(tmp_path, [6, 6])
+    with Coordinator(
+        paths, pages_per_task=2, lease_seconds=0.5, count_pages=_count_pages
+    ) as coordinator:
+        crashing = spawn(coordinator, "crash")
+        hanging = spawn(coordinator, "hang")
+        # Drugi pracownik startuje, gdy tamte wzięły już swoje zakresy
+        while not ((tmp_path / "crash").exists() and (tmp_path / "hang").exists()):
+            time.sleep(0.02)
+        spawn(coordinator)
+        results = list(coordinator.results())
+    assert {r.index: r.text for r in results} == _expected(paths)
+    assert crashing.wait(timeout=10) == 1
+    assert hanging.poll() is None
+
+
+def test_reports_failed_ranges_and_ships_input(tmp_path, spawn):
+    paths = _documents(tmp_path, [4, 3])
+    Path(paths[1]).write_text("a\nBŁĄD\nc", encoding="utf-8")
+    with Coordinator(
+        paths, pages_per_task=1, ship_input=True, count_pages=_count_pages
+    ) as coordinator:
+        worker = spawn(coordinator)
+        results = sorted(coordinator.results(), key=lambda r: r.index)
+    # Każdy plik przesłany raz i użyty dla wszystkich jego stron
+    assert worker.communicate(timeout=10)[0].split() == ["7", "2"]
+    assert results == [
+        DocumentResult(0, paths[0], "<d0s1><d0s2><d0s3><d0s4>"),
+        DocumentResult(1, paths[1], "<a><c>", "strony 2-2: uszkodzona strona"),
+    ]
+
+
+def test_broken_worker_gives_its_lease_back_and_stops(tmp_path, spawn):
+    paths = _documents(tmp_path, [4])
+    with Coordinator(
+        paths, pages_per_task=2, max_attempts=2, count_pages=_count_pages
+    ) as coordinator:
+        broken = spawn(coordinator, "broken")
+        assert broken.communicate(timeout=10)[0].split() == ["0", "0"]
+        good = spawn(coordinator)
+        (result,) = coordinator.results()
+    assert result == DocumentResult(0, paths[0], "<d0s1><d0s2><d0s3><d0s4>")
+    assert good.communicate(timeout=10)[0].split() == ["2", "1"]
+
+
+def test_range_fails_after_max_attempts_on_broken_workers(tmp_path, spawn):
+    paths = _documents(tmp_path, [1])
+    with Coordinator(paths, max_attempts=2, count_pages=_count_pages) as coordinator:
+        for _ in range(2):
+            assert spawn(coordinator, "broken").communicate(timeout=10)[0].split() == ["0", "0"]
+        (result,) = coordinator.results()
+    assert result.text == ""
+    assert result.error.startswith("strony 1-1: błąd węzła:")
+    assert result.error.endswith("(2 prób)")
+
+
+def test_workers_recognize_ranges_concurrently(tmp_path, spawn):
+    paths = _documents(tmp_path, [16, 16])
+    with Coordinator(paths, pages_per_task=2, count_pages=_count_pages) as coordinator:
+        # Każdy pracownik kończy pierwszy zakres dopiero, gdy czterech
+        # trzyma dzierżawy jednocześnie, więc przepustowość rośnie z ich liczbą
+        workers = [spawn(coordinator, "barrier4") for _ in range(4)]
+        results = list(coordinator.results())
+    assert {r.index: r.text for r in results} == _expected(paths)
+    assert all(r.error == "" for r in results)
+    done = [int(w.communicate(timeout=10)[0].split()[0]) for w in workers]
+    assert sum(done) == 16 and all(done)
+
+
+def test_rejects_wrong_token_and_results_of_other_workers(tmp_path, spawn):
+    paths = _documents(tmp_path, [2])
+    with Coordinator(paths, pages_per_task=1, count_pages=_count_pages) as coordinator:
+        intruder = spawn(coordinator, token="zły")
+        assert intruder.communicate(timeout=10)[0].split() == ["0", "0"]
+
+        def call(sock, reader, message):
+            sock.sendall(json.dumps(message).encode("utf-8") + b"\n")
+            return json.loads(reader.readline() or "null")
+
+        with socket.create_connection(coordinator.address) as sock:
+            with sock.makefile("rb") as reader:
+                # Bez hello koordynator zamyka połączenie
+                assert call(sock, reader, {"op": "lease"}) is None
+        with socket.create_connection(coordinator.address) as a, socket.create_connection(
+            coordinator.address
+        ) as b:
+            ra, rb = a.makefile("rb"), b.makefile("rb")
+            for sock, reader, name in ((a, ra, "a"), (b, rb, "b")):
+                hello = {"op": "hello", "worker": name, "token": coordinator.token}
+                assert call(sock, reader, hello) == {"ok": True}
+            task = call(a, ra, {"op": "lease"})["task"]
+            forged = {"op": "result", "task": task["id"], "text": "fałsz"}
+            assert call(b, rb, forged) == {"ok": False}
+            real = {"op": "result", "task": task["id"], "text": "<d0s1>"}
+            assert call(a, ra, real) == {"ok": True}
+            ra.close()
+            rb.close()
+        spawn(coordinator)
+        (result,) = coordinator.results()
+    assert result.text == "<d0s1><d0s2>"
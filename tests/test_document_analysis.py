@@ -0,0 +1,77 @@
+from pathlib import Path
+import runpy
+import sys
+
+import spacy
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+from document_analysis import DocumentAnalysis
+from SmartExtractor import SmartExtractor
+from context_analyzer import ContextAwareDocumentAnalyzer
+
+MODULE = runpy.run_path(str(BASE_DIR / "gui" / "processing_worker.py"))
+extract_info_from_text = MODULE["extract_info_from_text"]
+
+
+class CountingNLP:
+    def __init__(self):
+        self.nlp = spacy.blank("pl")
+        self.nlp.add_pipe("entity_ruler").add_patterns(
+            [{"label": "ORGANIZACJA", "pattern": "ACME"}]
+        )
+        self.calls = 0
+
+    def __call__(self, text):
+        self.calls += 1
+        return self.nlp(text)
+
+
+class CountingEncoder:
+    def __init__(self):
+        self.encoded = []
+
+    def encode(self, texts, convert_to_numpy=False):
+        self.encoded.extend(texts)
+        return [[float(len(t)), float(t.count("a")), 1.0] for t in texts]
+
+
+def test_stages_share_one_spacy_parse():
+    nlp = CountingNLP()
+    module_globals = extract_info_from_text.__globals__
+    module_globals["get_nlp_model"] = lambda: nlp
+    module_globals["get_smart_extractor"] = lambda: SmartExtractor(nlp_model=nlp)
+
+    info = extract_info_from_text("Pismo od ACME bez daty", "a.pdf", "KP")
+
+    assert info["nadawca_odbiorca"] == "ACME"
+    assert nlp.calls == 1
+
+
+def test_lazy_views_are_computed_once():
+    nlp = CountingNLP()
+    analysis = DocumentAnalysis("Umowa  ACME\nnr 1", nlp, filename="a.pdf")
+
+    assert nlp.calls == 0
+    assert analysis.entity_text("ORGANIZACJA") == "ACME"
+    assert analysis.entities is analysis.entities
+    assert nlp.calls == 1
+    assert analysis.normalized == "umowa acme nr 1"
+    assert analysis.token_spans[1] == (7, 11)
+
+
+def test_similarity_reuses_document_embedding(tmp_path):
+    encoder = CountingEncoder()
+    analyzer = ContextAwareDocumentAnalyzer(
+        memory_file=str(tmp_path / "memory.json"), embedding_model=encoder
+    )
+    analyzer.add_document_to_memory("faktura za prad", {"id": 1})
+    analyzer.add_document_to_memory("umowa najmu lokalu", {"id": 2})
+    analysis = DocumentAnalysis("faktura za gaz")
+
+    analyzer.generate_enhanced_prompt(analysis.text, "a.pdf", analysis=analysis)
+    analyzer.find_similar_documents(analysis.text, analysis=analysis)
+
+    assert encoder.encoded.count("faktura za gaz") == 1
+    assert encoder.encoded.count("faktura za prad") == 1
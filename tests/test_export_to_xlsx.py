@@ -1,6 +1,8 @@
 from pathlib import Path
+import re
 import sys
 import types
+import zipfile
 
 # Ensure the application package is importable
 BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
@@ -8,6 +10,7 @@ sys.path.insert(0, str(BASE_DIR))
 
 from gui import pdf_processor_app
 from gui.pdf_processor_app import PdfProcessorApp, INFO_FIELDS
+from xlsx_writer import column_letter as get_column_letter
 
 
 def test_export_to_xlsx_applies_styles(tmp_path, monkeypatch):
@@ -68,60 +71,31 @@ def test_export_to_xlsx_applies_styles(tmp_path, monkeypatch):
         types.SimpleNamespace(QFileDialog=DummyFileDialog, QMessageBox=DummyMessageBox),
     )
 
-    # -- stub openpyxl workbook --
-    from openpyxl.utils import get_column_letter
-
-    class DummyCell:
-        def __init__(self):
-            self.font = None
-            self.fill = None
-            self.border = None
-            self.alignment = None
-
-    class DummyWorksheet:
-        def __init__(self, max_col):
-            self.max_col = max_col
-            self.cells = {}
-            self.freeze_panes = None
-            self.auto_filter = types.SimpleNamespace(ref=None)
-            self.dimensions = "A1"
-            import collections
-
-            self.column_dimensions = collections.defaultdict(
-                lambda: types.SimpleNamespace(width=None)
-            )
-
-        def __getitem__(self, idx):
-            return [self.cell(idx, c) for c in range(1, self.max_col + 1)]
-
-        def cell(self, row, column):
-            key = (row, column)
-            if key not in self.cells:
-                self.cells[key] = DummyCell()
-            return self.cells[key]
-
-    class DummyWorkbook:
-        def __init__(self):
-            self.active = DummyWorksheet(len(headers) - 1)
-            self.saved = False
-
-        def save(self, path):
-            self.saved = True
-
-    dummy_wb = DummyWorkbook()
-
-    import openpyxl
-
-    monkeypatch.setattr(openpyxl, "load_workbook", lambda path: dummy_wb, raising=False)
-
     # -- execute --
     app.export_to_xlsx()
 
     # -- assertions --
-    header_cell = dummy_wb.active.cell(1, 1)
-    assert header_cell.fill.start_color == "D9D9D9"
-    assert header_cell.border.left.style == "thin"
-
-    status_col = len(headers) - 1
-    status_cell = dummy_wb.active.cell(2, status_col)
-    assert status_cell.fill.start_color == "C6EFCE"
+    with zipfile.ZipFile(out_path) as zf:
+        sheet = zf.read("xl/worksheets/sheet1.xml").decode("utf-8")
+        styles = zf.read("xl/styles.xml").decode("utf-8")
+        strings = re.findall(r"<t[^>]*>([^<]*)</t>", zf.read("xl/sharedStrings.xml").decode("utf-8"))
+
+    fills = re.findall(r'<fill>.*?</fill>', styles)
+    borders = re.findall(r"<border>.*?</border>", styles)
+    xfs = re.findall(r"<xf [^>]*?fillId=\"(\d+)\" borderId=\"(\d+)\"", styles.split("<cellXfs")[1])
+
+    def cell_style(ref):
+        s = int(re.search(rf'<c r="{ref}" s="(\d+)"', sheet).group(1))
+        fill_id, border_id = map(int, xfs[s])
+        return fills[fill_id], borders[border_id]
+
+    header_fill, header_border = cell_style("A1")
+    assert "D9D9D9" in header_fill
+    assert '<left style="thin">' in header_border
+
+    status_col = get_column_letter(len(headers) - 1)
+    status_fill, _ = cell_style(f"{status_col}2")
+    assert "C6EFCE" in status_fill
+    assert strings[:2] == ["Lp.", "Nowa nazwa"]
+    assert 'state="frozen"' in sheet
+    assert f'<autoFilter ref="A1:{status_col}2"/>' in sheet
@@ -0,0 +1,115 @@
+"""Tests for parallel archive file placement."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import os
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import file_placement
+from file_placement import FilePlacer, place_files
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(file_placement._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / file_placement._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "file_place.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(file_placement._library, "directory", str(tmp_path))
+        assert file_placement.is_available()
+    else:
+        monkeypatch.setattr(file_placement._library, "load", lambda: None)
+    return request.param
+
+
+def _sources(tmp_path, count=40):
+    src_dir = tmp_path / "in"
+    src_dir.mkdir()
+    paths = []
+    for i in range(count):
+        path = src_dir / f"{i}.pdf"
+        path.write_bytes(os.urandom(1000 + i * 5000))
+        os.utime(path, (1_600_000_000, 1_600_000_000 + i))
+        paths.append(path)
+    return paths
+
+
+def test_places_files_in_parallel_with_outcomes(tmp_path, backend):
+    sources = _sources(tmp_path)
+    out = tmp_path / "out"
+    out.mkdir()
+    pairs = [(str(p), str(out / f"a_{p.name}")) for p in sources]
+    pairs.append((str(tmp_path / "brak.pdf"), str(out / "brak.pdf")))
+
+    results = place_files(pairs, max_workers=4, fsync_batch=8, verify=True)
+
+    assert [r.src for r in results] == [src for src, _ in pairs]
+    assert all(r.ok for r in results[:-1])
+    assert not results[-1].ok and results[-1].error
+    for src, result in zip(sources, results):
+        dst = Path(result.dst)
+        assert dst.read_bytes() == src.read_bytes()
+        assert dst.stat().st_mtime == src.stat().st_mtime
+        assert result.checksum == file_placement.file_checksum(str(src))
+        assert result.method in file_placement.METHODS.values()
+
+
+def test_same_destination_keeps_last_submission(tmp_path, backend):
+    sources = _sources(tmp_path, 6)
+    dst = tmp_path / "wspolny.pdf"
+    with FilePlacer(max_workers=4, fsync_batch=0) as placer:
+        for src in sources:
+            placer.submit(str(src), str(dst))
+
+    assert dst.read_bytes() == sources[-1].read_bytes()
+
+
+def test_hardlink_when_allowed(tmp_path, backend):
+    if os.name == "nt":
+        pytest.skip("hard links depend on NTFS")
+    src = _sources(tmp_path, 1)[0]
+    dst = tmp_path / "link.pdf"
+    dst.write_bytes(b"stare")
+
+    [result] = place_files([(str(src), str(dst))], allow_hardlink=True)
+
+    assert result.ok and result.method == "hardlink"
+    assert os.path.samefile(src, dst)
+
+
+@pytest.mark.parametrize("allow_hardlink", [False, True])
+def test_placing_file_onto_itself_keeps_it(tmp_path, backend, allow_hardlink):
+    src = _sources(tmp_path, 1)[0]
+    data = src.read_bytes()
+
+    assert file_placement.place_file(str(src), str(src), allow_hardlink) == "same"
+    [result] = place_files([(str(src), str(src))], allow_hardlink=allow_hardlink)
+
+    assert result.ok and result.method == "same"
+    assert src.read_bytes() == data
+    assert os.listdir(src.parent) == [src.name]
+
+
+def test_failed_copy_keeps_existing_destination(tmp_path, backend):
+    dst = tmp_path / "cel.pdf"
+    dst.write_bytes(b"poprzednia wersja")
+
+    [result] = place_files([(str(tmp_path / "brak.pdf"), str(dst))], allow_hardlink=True)
+
+    assert not result.ok
+    assert dst.read_bytes() == b"poprzednia wersja"
+    assert not list(tmp_path.glob("*.tmp"))
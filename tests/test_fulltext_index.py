@@ -0,0 +1,114 @@
+"""Tests for the archive full-text index."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import json
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import fulltext_index
+from fulltext_index import FullTextIndex, analyze
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(fulltext_index._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / fulltext_index._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "fulltext_index.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(fulltext_index._library, "directory", str(tmp_path))
+        assert fulltext_index.is_available()
+    else:
+        monkeypatch.setattr(fulltext_index._library, "load", lambda: None)
+    return request.param
+
+
+def _paths(hits):
+    return [Path(h.path).name for h in hits]
+
+
+def test_analyze_polish_normalization():
+    assert analyze("W sprawie umowy") == analyze("w SPRAWY umowa")
+    assert analyze("Łódź, Gdańsk") == ["lodz", "gdansk"]
+    # Wyraz przeniesiony przez OCR do następnej linii
+    assert analyze("doku-\nmentu") == analyze("dokumentu")
+
+
+def test_bm25_and_phrase_queries(backend, tmp_path):
+    with FullTextIndex(str(tmp_path / "idx"), flush_docs=2) as index:
+        index.add_document(str(tmp_path / "a.pdf"), "Umowa najmu lokalu w Gdańsku.")
+        index.add_document(str(tmp_path / "b.pdf"), "Lokalu najmu nie dotyczy. Umowa o gaz.")
+        index.add_document(str(tmp_path / "c.pdf"), "Faktura za gaz ziemny, gaz, gaz.")
+        index.commit()
+
+        assert _paths(index.search("gaz")) == ["c.pdf", "b.pdf"]
+        assert set(_paths(index.search("umowy najmu"))) == {"a.pdf", "b.pdf"}
+        assert _paths(index.search('"najmu lokalu"')) == ["a.pdf"]
+        assert _paths(index.search('gaz "umowa o"')) == ["b.pdf"]
+        assert index.search('"gaz najmu"') == []
+
+
+def test_replace_merge_and_reopen(backend, tmp_path):
+    directory = str(tmp_path / "idx")
+    with FullTextIndex(directory, flush_docs=3, merge_factor=3) as index:
+        for i in range(20):
+            index.add_document(str(tmp_path / f"{i}.pdf"), f"pismo numer {i} w sprawie")
+        index.add_document(str(tmp_path / "5.pdf"), "zastąpiona treść")
+        assert index.delete_document(str(tmp_path / "7.pdf"))
+        index.commit()
+        index.wait_for_merges()
+        assert len(index._segments) < 3
+        assert len(index) == 19
+
+    reader = FullTextIndex(directory, readonly=True)
+    try:
+        hits = reader.search("pismo", limit=100)
+        assert len(hits) == 18
+        assert "5.pdf" not in _paths(hits) and "7.pdf" not in _paths(hits)
+        assert _paths(reader.search("zastapiona")) == ["5.pdf"]
+        assert _paths(reader.search('"numer 12"')) == ["12.pdf"]
+    finally:
+        reader.close()
+    # Scalone segmenty zostały usunięte z katalogu
+    manifest = json.loads((Path(directory) / "manifest.json").read_text())
+    files = {p.name for p in Path(directory).iterdir() if p.name.startswith("seg_")}
+    assert files == {s["name"] for s in manifest["segments"]}
+
+
+def test_single_writer_keeps_segments_newer_than_manifest(backend, tmp_path):
+    directory = tmp_path / "idx"
+    writer = FullTextIndex(str(directory), flush_docs=1)
+    writer.add_document("a.pdf", "umowa najmu lokalu")
+    writer.commit()
+    with pytest.raises(fulltext_index.IndexLockedError):
+        FullTextIndex(str(directory))
+    # Odczyt nie wymaga blokady
+    reader = FullTextIndex(str(directory), readonly=True)
+    assert _paths(reader.search("umowa")) == ["a.pdf"]
+    reader.close()
+    writer.close()
+
+    # Segment zapisany po manifeście i pozostałość starszego zapisu
+    (directory / "seg_000009.fts").write_bytes(b"nowszy")
+    (directory / "seg_000001.fts.tmp").write_bytes(b"stary")
+    with FullTextIndex(str(directory), flush_docs=1) as index:
+        index.add_document("b.pdf", "umowa dostawy")
+        index.commit()
+        assert len(index) == 2 and len(index.search("umowa")) == 2
+        names = [s.name for s in index._segments]
+    assert (directory / "seg_000009.fts").read_bytes() == b"nowszy"
+    assert not (directory / "seg_000001.fts.tmp").exists()
+    assert names[-1] == "seg_000010.fts"
@@ -0,0 +1,199 @@
+from pathlib import Path
+from concurrent.futures import Future
+import json
+import sys
+import threading
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import ml_helper
+from ml_helper import DocumentLLMProcessor
+
+
+class FakeNativeLLM:
+    instances = []
+
+    def __init__(self, model_path, n_ctx=4096, n_threads=0, n_parallel=1):
+        self.model_path = model_path
+        self.n_parallel = n_parallel
+        self.calls = []
+        self.prefixes = []
+        self.queued = []
+        FakeNativeLLM.instances.append(self)
+
+    def set_prompt_prefix(self, prefix, cache_path=None):
+        self.prefixes.append((prefix, cache_path))
+        return len(prefix.split())
+
+    def generate(self, prompt, max_tokens=500, temperature=0.0, top_p=1.0, seed=0,
+                 grammar=None, stop=None):
+        self.calls.append((prompt, max_tokens, temperature))
+        self.constraints = (grammar, stop)
+        return json.dumps(
+            {
+                "typ_dokumentu": "UMOWA",
+                "data": "2024-05-12",
+                "nadawca_odbiorca": "ACME",
+                "temat": "dostawa",
+                "numer_dokumentu": "1/2024",
+            }
+        )
+
+
+    def submit(self, prompt, max_tokens=500, temperature=0.0, top_p=1.0, seed=0,
+               grammar=None, stop=None):
+        future = Future()
+        self.queued.append((prompt, future))
+        return future
+
+
+def _processor(tmp_path, monkeypatch, backend):
+    fake_module = type(
+        "native_llm", (), {"NativeLLM": FakeNativeLLM, "is_available": staticmethod(lambda: True)}
+    )
+    monkeypatch.setattr(ml_helper, "native_llm", fake_module)
+    monkeypatch.setattr(ml_helper, "MODEL_CACHE", {})
+    processor = DocumentLLMProcessor(backend=backend)
+    processor.model_dir = str(tmp_path)
+    processor.context_analyzer.memory_file = str(tmp_path / "memory.json")
+    return processor
+
+
+def test_auto_backend_prefers_gguf(tmp_path, monkeypatch):
+    (tmp_path / "phi-2.Q4_K_M.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "auto")
+
+    assert processor.resolve_backend() == "gguf"
+    assert processor.is_model_downloaded()
+    assert processor.load_model()
+    assert processor.native_model.model_path.endswith("phi-2.Q4_K_M.gguf")
+
+
+def test_auto_backend_without_gguf_uses_torch(tmp_path, monkeypatch):
+    processor = _processor(tmp_path, monkeypatch, "auto")
+    assert processor.resolve_backend() == "torch"
+
+
+def test_extract_smart_metadata_native(tmp_path, monkeypatch):
+    (tmp_path / "model.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "gguf")
+
+    metadata = processor.extract_smart_metadata("Umowa nr 1/2024 z dnia 12.05.2024")
+
+    assert metadata["typ_dokumentu"] == "UMOWA"
+    assert metadata["w_sprawie"] == "dostawa"
+    prompt, max_tokens, temperature = processor.native_model.calls[0]
+    assert prompt.endswith("<|assistant|>")
+    assert max_tokens == 500
+    grammar, stop = processor.native_model.constraints
+    assert grammar == ml_helper.METADATA_GRAMMAR
+    assert stop == "}"
+
+
+def test_static_prompt_prefix_is_primed_once(tmp_path, monkeypatch):
+    (tmp_path / "model.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "gguf")
+
+    processor.extract_smart_metadata("Faktura nr 7 z dnia 01.02.2024")
+    processor.extract_smart_metadata("Protokół odbioru z dnia 03.02.2024")
+
+    [(prefix, cache_path)] = processor.native_model.prefixes
+    assert prefix.startswith("<|system|>")
+    assert "w formacie JSON" in prefix and prefix.endswith("dla danego pola.")
+    assert cache_path.startswith(str(tmp_path / "model.prompt-"))
+    for prompt, _, _ in processor.native_model.calls:
+        assert prompt.startswith(prefix)
+
+
+def test_submit_smart_metadata_resolves_batched_futures(tmp_path, monkeypatch):
+    (tmp_path / "model.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "gguf")
+
+    futures = [
+        processor.submit_smart_metadata(f"Pismo nr {i}/2024", f"{i}.pdf") for i in range(3)
+    ]
+    # Zgłaszanie odbywa się w wątku procesora; kolejne zadanie czeka na poprzednie
+    processor._submitter.submit(lambda: None).result()
+    model = processor.native_model
+    assert model.n_parallel == processor.n_parallel
+    assert len(model.queued) == 3 and not any(f.done() for f in futures)
+
+    # Sekwencje kończą się w innej kolejności niż zostały dodane
+    for i in (2, 0, 1):
+        model.queued[i][1].set_result(
+            json.dumps(
+                {
+                    "typ_dokumentu": "PISMO",
+                    "data": "",
+                    "nadawca_odbiorca": "",
+                    "temat": f"sprawa {i}",
+                    "numer_dokumentu": f"{i}/2024",
+                }
+            )
+        )
+    assert [f.result()["numer_dokumentu"] for f in futures] == ["0/2024", "1/2024", "2/2024"]
+
+
+def test_cancel_pending_resolves_queued_and_decoding_requests(tmp_path, monkeypatch):
+    (tmp_path / "model.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "gguf")
+    assert processor.load_model()
+    model = processor.native_model
+    model.cancelled = 0
+
+    def cancel_pending():
+        model.cancelled += 1
+        for _, future in model.queued:
+            future.set_result("")
+
+    model.cancel_pending = cancel_pending
+    gate = threading.Event()
+    first = processor.submit_smart_metadata("Pismo nr 1/2024", "1.pdf")
+    processor._submitter.submit(lambda: None).result()
+    # Wątek zgłaszający jest zajęty, więc drugie żądanie czeka w kolejce
+    processor._submitter.submit(gate.wait)
+    second = processor.submit_smart_metadata("Pismo nr 2/2024", "2.pdf")
+
+    processor.cancel_pending()
+    gate.set()
+    assert model.cancelled == 1
+    assert first.result(timeout=5) is None and second.result(timeout=5) is None
+    processor._submitter.submit(lambda: None).result()
+    assert len(model.queued) == 1
+
+
+def test_native_callback_hands_reply_to_submission_thread(tmp_path, monkeypatch):
+    (tmp_path / "model.gguf").write_bytes(b"")
+    processor = _processor(tmp_path, monkeypatch, "gguf")
+    threads = []
+    real = processor._metadata_from_response
+    monkeypatch.setattr(
+        processor,
+        "_metadata_from_response",
+        lambda text, response: threads.append(threading.current_thread().name)
+        or real(text, response),
+    )
+    first = processor.submit_smart_metadata("Pismo nr 1/2024", "1.pdf")
+    second = processor.submit_smart_metadata("Pismo nr 2/2024", "2.pdf")
+    processor._submitter.submit(lambda: None).result()
+    model = processor.native_model
+    gate = threading.Event()
+    processor._submitter.submit(gate.wait)
+    reply = {"typ_dokumentu": "PISMO", "data": "", "nadawca_odbiorca": "",
+             "temat": "", "numer_dokumentu": "1/2024"}
+    # Callback harmonogramu wraca od razu, choć wątek zgłoszeń jest zajęty
+    model.queued[0][1].set_result(json.dumps(reply))
+    model.queued[1][1].set_result(json.dumps(reply))
+    assert threads == [] and not first.done()
+    # Anulowanie po zdekodowaniu, przed przetworzeniem: wynik None tylko raz
+    processor.cancel_pending()
+    gate.set()
+    assert first.result(timeout=5) is None and second.result(timeout=5) is None
+    assert threads == []
+
+    third = processor.submit_smart_metadata("Pismo nr 3/2024", "3.pdf")
+    processor._submitter.submit(lambda: None).result()
+    model.queued[2][1].set_result(json.dumps(reply))
+    assert third.result(timeout=5)["numer_dokumentu"] == "1/2024"
+    assert threads and threads[0].startswith("llm-submit")
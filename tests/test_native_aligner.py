@@ -0,0 +1,81 @@
+"""Tests for the native multi-pattern entity span aligner."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import native_aligner
+
+TEXT = (
+    "Umowa z ACME Polska, ACME, nr 12/2024. Wykonawca: Przedsiebiorstwo "
+    "Budowlane Kowa1ski  Sp. z o.o., ul. Długa 5"
+)
+PATTERNS = [
+    "ACME",
+    "ACME Polska",
+    "12/2024",
+    "Przedsiębiorstwo Budowlane Kowalski Sp. z o.o.",
+    "Budowlane",
+    "ul. Długa 5",
+]
+
+
+@pytest.fixture
+def native(tmp_path, monkeypatch):
+    if shutil.which("gcc") is None:
+        pytest.skip("gcc not available")
+    lib = tmp_path / native_aligner._library.filename
+    subprocess.run(
+        ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "span_aligner.c"),
+         "-o", str(lib)],
+        check=True,
+    )
+    monkeypatch.setattr(native_aligner._library, "directory", str(tmp_path))
+    monkeypatch.setattr(native_aligner._library, "_lib", None)
+    assert native_aligner.is_available()
+
+
+def _texts(spans):
+    return [(TEXT[s:e], PATTERNS[p]) for s, e, p in spans]
+
+
+def test_exact_and_fuzzy_spans_do_not_overlap(native):
+    spans = native_aligner.align_spans(TEXT, PATTERNS)
+
+    assert _texts(spans) == [
+        ("ACME Polska", "ACME Polska"),
+        ("ACME", "ACME"),
+        ("12/2024", "12/2024"),
+        ("Przedsiebiorstwo Budowlane Kowa1ski  Sp. z o.o.", PATTERNS[3]),
+        ("ul. Długa 5", "ul. Długa 5"),
+    ]
+    for (_, end, _), (start, _, _) in zip(spans, spans[1:]):
+        assert end <= start
+
+
+def test_exact_only_matches_python_fallback(native, monkeypatch):
+    rng = random.Random(3)
+    words = ["acme", "umowa", "nr", "12", "12/2024", "sp.", "kowalski", "z", "o.o."]
+    text = " ".join(rng.choice(words) for _ in range(400))
+    patterns = ["acme", "12/2024", "kowalski sp.", "sp. z o.o.", "12", "brak"]
+
+    native_spans = native_aligner.align_spans(text, patterns, max_errors=0)
+    monkeypatch.setattr(native_aligner._library, "load", lambda: None)
+
+    assert native_spans == native_aligner.align_spans(text, patterns)
+
+
+def test_short_values_need_exact_match(native):
+    assert native_aligner.default_max_errors("12/2024") == 1
+    assert native_aligner.default_max_errors("ACME") == 0
+    assert native_aligner.align_spans("nr ACNE", ["ACME"]) == []
+    assert native_aligner.align_spans("nr ACNE", ["ACME"], max_errors=1) == [(3, 7, 0)]
@@ -0,0 +1,188 @@
+"""Tests for the native int8 MiniLM encoder and the batch top-k kernel.
+
+Both libraries are compiled into a temporary directory and a tiny random
+BERT model is written with ``native_embedder.write_model``.  The native
+embeddings are compared with a float reference forward pass.
+"""
+
+from __future__ import annotations
+
+from pathlib import Path
+import math
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import native_embedder
+
+pytestmark = pytest.mark.skipif(shutil.which("gcc") is None, reason="gcc not available")
+
+VOCAB = ["[PAD]", "[UNK]", "[CLS]", "[SEP]", "umowa", "faktura", "nr", "dostaw", "##y",
+         "##a", "z", "dnia", "/", "1", "2024", "protokol", "odbioru"]
+CONFIG = {"hidden": 8, "layers": 2, "heads": 2, "intermediate": 16, "max_position": 16,
+          "layer_norm_eps": 1e-12}
+
+
+def _random_tensors(seed: int = 7) -> dict:
+    rng = random.Random(seed)
+    h, inter = CONFIG["hidden"], CONFIG["intermediate"]
+
+    def mat(rows, cols):
+        return [[rng.gauss(0.0, 0.5) for _ in range(cols)] for _ in range(rows)]
+
+    def vec(n, mean=0.0):
+        return [mean + rng.gauss(0.0, 0.1) for _ in range(n)]
+
+    t = {
+        "embeddings.word_embeddings.weight": mat(len(VOCAB), h),
+        "embeddings.position_embeddings.weight": mat(CONFIG["max_position"], h),
+        "embeddings.token_type_embeddings.weight": mat(2, h),
+        "embeddings.LayerNorm.weight": vec(h, 1.0),
+        "embeddings.LayerNorm.bias": vec(h),
+    }
+    for i in range(CONFIG["layers"]):
+        p = f"encoder.layer.{i}."
+        for name, (out, inp) in {
+            "attention.self.query": (h, h),
+            "attention.self.key": (h, h),
+            "attention.self.value": (h, h),
+            "attention.output.dense": (h, h),
+            "intermediate.dense": (inter, h),
+            "output.dense": (h, inter),
+        }.items():
+            t[p + name + ".weight"] = mat(out, inp)
+            t[p + name + ".bias"] = vec(out)
+        for name in ("attention.output.LayerNorm", "output.LayerNorm"):
+            t[p + name + ".weight"] = vec(h, 1.0)
+            t[p + name + ".bias"] = vec(h)
+    return t
+
+
+def _reference(tensors: dict, ids: list) -> list:
+    """Float BERT forward pass with mean pooling and L2 normalization."""
+    h, heads = CONFIG["hidden"], CONFIG["heads"]
+    d = h // heads
+
+    def linear(x, name):
+        w, b = tensors[name + ".weight"], tensors[name + ".bias"]
+        return [[sum(wi * xi for wi, xi in zip(row, r)) + bo for row, bo in zip(w, b)] for r in x]
+
+    def layer_norm(x, name):
+        w, b = tensors[name + ".weight"], tensors[name + ".bias"]
+        out = []
+        for r in x:
+            mean = sum(r) / h
+            var = sum((v - mean) ** 2 for v in r) / h
+            out.append([(v - mean) / math.sqrt(var + 1e-12) * wi + bi for v, wi, bi in zip(r, w, b)])
+        return out
+
+    x = [
+        [a + b + c for a, b, c in zip(
+            tensors["embeddings.word_embeddings.weight"][tok],
+            tensors["embeddings.position_embeddings.weight"][pos],
+            tensors["embeddings.token_type_embeddings.weight"][0],
+        )]
+        for pos, tok in enumerate(ids)
+    ]
+    x = layer_norm(x, "embeddings.LayerNorm")
+    for i in range(CONFIG["layers"]):
+        p = f"encoder.layer.{i}."
+        q = linear(x, p + "attention.self.query")
+        k = linear(x, p + "attention.self.key")
+        v = linear(x, p + "attention.self.value")
+        ctx = [[0.0] * h for _ in ids]
+        for hd in range(heads):
+            sl = slice(hd * d, (hd + 1) * d)
+            for a in range(len(ids)):
+                scores = [sum(x1 * x2 for x1, x2 in zip(q[a][sl], k[b][sl])) / math.sqrt(d)
+                          for b in range(len(ids))]
+                top = max(scores)
+                weights = [math.exp(s - top) for s in scores]
+                total = sum(weights)
+                for b, wgt in enumerate(weights):
+                    for j in range(d):
+                        ctx[a][hd * d + j] += wgt / total * v[b][hd * d + j]
+        attn = linear(ctx, p + "attention.output.dense")
+        x = layer_norm([[a + b for a, b in zip(r1, r2)] for r1, r2 in zip(x, attn)],
+                       p + "attention.output.LayerNorm")
+        inter = linear(x, p + "intermediate.dense")
+        inter = [[0.5 * v * (1.0 + math.erf(v / math.sqrt(2.0))) for v in r] for r in inter]
+        out = linear(inter, p + "output.dense")
+        x = layer_norm([[a + b for a, b in zip(r1, r2)] for r1, r2 in zip(x, out)],
+                       p + "output.LayerNorm")
+    pooled = [sum(r[j] for r in x) / len(ids) for j in range(h)]
+    norm = math.sqrt(sum(v * v for v in pooled))
+    return [v / norm for v in pooled]
+
+
+@pytest.fixture()
+def encoder(tmp_path, monkeypatch):
+    native = BASE_DIR / "native"
+    for src, lib in (("minilm.c", "libminilm.so"), ("fast_similarity.c", "libfast_similarity.so")):
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(native / src), "-o", str(tmp_path / lib),
+             "-fopenmp", "-lm"],
+            check=True,
+        )
+    for library in (native_embedder._library, native_embedder._similarity):
+        monkeypatch.setattr(library, "directory", str(tmp_path))
+        monkeypatch.setattr(library, "_lib", None)
+    tensors = _random_tensors()
+    model_path = tmp_path / "minilm-test.bin"
+    native_embedder.write_model(str(model_path), CONFIG, VOCAB, tensors)
+    assert native_embedder.is_available(str(model_path))
+    enc = native_embedder.NativeSentenceEncoder(str(model_path), max_length=16)
+    yield enc, tensors
+    enc.close()
+
+
+def _cosine(a, b):
+    return sum(x * y for x, y in zip(a, b)) / math.sqrt(
+        sum(x * x for x in a) * sum(y * y for y in b)
+    )
+
+
+def test_normalize_text_matches_bert_basic_tokenizer():
+    assert native_embedder.normalize_text("Umowa nr 1/2024, Łódź") == "umowa nr 1 / 2024 ,  łodz"
+
+
+def test_native_embeddings_match_float_reference(encoder):
+    enc, tensors = encoder
+    texts = ["Umowa nr 1/2024", "Faktura z dnia dostawy", "Protokół odbioru", "xyz"]
+    # [CLS]=2, [SEP]=3, [UNK]=1; "dostawy" -> dostaw ##y, "protokół" -> protokol
+    ids = [
+        [2, 4, 6, 13, 12, 14, 3],
+        [2, 5, 10, 11, 7, 8, 3],
+        [2, 15, 16, 3],
+        [2, 1, 3],
+    ]
+
+    vectors = enc.encode(texts)
+
+    assert enc.get_sentence_embedding_dimension() == CONFIG["hidden"]
+    assert len(vectors) == len(texts)
+    for vec, tokens in zip(vectors, ids):
+        assert abs(sum(v * v for v in vec) - 1.0) < 1e-4
+        assert _cosine(vec, _reference(tensors, tokens)) > 0.99
+
+
+def test_top_k_similar_uses_native_kernel(encoder):
+    enc, _ = encoder
+    texts = ["Umowa nr 1/2024", "Faktura z dnia dostawy", "Protokół odbioru", "Umowa nr 1/2024"]
+    matrix = enc.encode_buffer(texts)
+
+    ranked = native_embedder.top_k_similar(matrix, 3, 2, rows=3)
+
+    assert native_embedder._similarity._lib is not None
+    assert ranked[0][0] == 0 and ranked[0][1] == pytest.approx(1.0, abs=1e-5)
+    expected = sorted(
+        ((i, _cosine(matrix[3], matrix[i])) for i in range(3)), key=lambda t: t[1], reverse=True
+    )[:2]
+    assert [i for i, _ in ranked] == [i for i, _ in expected]
+    assert [s for _, s in ranked] == pytest.approx([s for _, s in expected], abs=1e-5)
@@ -0,0 +1,114 @@
+"""Tests for the ``native_kernels`` CPython extension built with CMake."""
+
+from __future__ import annotations
+
+from array import array
+import importlib.machinery
+import importlib.util
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+import sysconfig
+
+import pytest
+
+ROOT = Path(__file__).resolve().parents[1]
+BASE_DIR = ROOT / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+sys.path.append(str(ROOT / "python"))
+
+import string_similarity
+import token_similarity
+
+
+@pytest.fixture(scope="module")
+def nk(tmp_path_factory):
+    if shutil.which("cmake") is None or shutil.which("gcc") is None:
+        pytest.skip("cmake or gcc not available")
+    if not (Path(sysconfig.get_paths()["include"]) / "Python.h").exists():
+        pytest.skip("Python headers not available")
+    out = tmp_path_factory.mktemp("native_kernels")
+    subprocess.run(
+        ["cmake", "-S", str(ROOT / "native_c"), "-B", str(out / "build"),
+         f"-DPython3_EXECUTABLE={sys.executable}", f"-DNATIVE_KERNELS_OUTPUT_DIR={out}"],
+        check=True, stdout=subprocess.DEVNULL,
+    )
+    subprocess.run(
+        ["cmake", "--build", str(out / "build"), "--target", "native_kernels"],
+        check=True, stdout=subprocess.DEVNULL,
+    )
+    spec = importlib.machinery.PathFinder.find_spec("native_kernels", [str(out)])
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def test_string_kernels_match_python_definitions(nk):
+    rng = random.Random(5)
+    words = ["Łódź", "sąd", "umowa", "najmu", "😀", "pismo", "w"]
+    texts = [""] + [
+        " ".join(rng.choice(words) for _ in range(rng.randrange(1, n)))
+        for n in (3, 20, 200)
+        for _ in range(4)
+    ]
+    query = texts[-1]
+    for a in texts:
+        for b in texts[:6]:
+            assert nk.jaro_winkler(a, b) == pytest.approx(
+                string_similarity._jaro_winkler_python(a, b, 0.1), abs=1e-12
+            )
+            assert nk.levenshtein_ratio(a, b) == string_similarity._ratio_python(a, b)
+            assert nk.token_similarity(a, b) == pytest.approx(
+                token_similarity._token_similarity_python(a, b)
+            )
+    assert nk.levenshtein_distance("Łódź", "Lodz") == 3
+    assert nk.levenshtein_distance("kitten", "sitting") == 3
+    assert nk.jaro_winkler("MARTHA", "MARHTA", 0.2) == pytest.approx(0.977778, abs=1e-6)
+    assert nk.similarity_batch(query, texts) == [nk.jaro_winkler(query, t) for t in texts]
+    assert nk.similarity_batch(query, tuple(texts), nk.LEVENSHTEIN_RATIO) == [
+        nk.levenshtein_ratio(query, t) for t in texts
+    ]
+    with pytest.raises(TypeError):
+        nk.similarity_batch(query, ["a", b"b"])
+    with pytest.raises(TypeError):
+        nk.jaro_winkler("a")
+
+
+def _cosine(a, b):
+    dot = sum(x * y for x, y in zip(a, b))
+    na = sum(x * x for x in a) ** 0.5
+    nb = sum(y * y for y in b) ** 0.5
+    return 0.0 if na == 0.0 or nb == 0.0 else dot / (na * nb)
+
+
+def test_vector_kernels_accept_buffers_and_sequences(nk):
+    rng = random.Random(0)
+    rows, dim = 50, 24
+    flat = array("f", (rng.gauss(0, 1) for _ in range(rows * dim)))
+    vectors = [flat[r * dim:(r + 1) * dim] for r in range(rows)]
+    query = array("f", (x + 0.01 for x in vectors[7]))
+    expected = [_cosine(query, v) for v in vectors]
+
+    # Płaska macierz i widok 2D (jak ndarray float32) dają ten sam wynik
+    matrix = memoryview(flat).cast("B").cast("f", [rows, dim])
+    assert nk.cosine_batch(query, flat) == pytest.approx(expected, abs=1e-5)
+    assert nk.cosine_batch(query, matrix) == pytest.approx(expected, abs=1e-5)
+    top = nk.cosine_top_k(query, matrix, 3)
+    assert [i for i, _ in top] == sorted(range(rows), key=lambda r: -expected[r])[:3]
+    assert top[0] == (7, pytest.approx(expected[7], abs=1e-5))
+    assert nk.cosine_top_k(query, flat, 100)[-1][0] == min(range(rows), key=expected.__getitem__)
+    assert nk.cosine_top_k(query, flat, 0) == []
+
+    a, b = array("d", query), array("d", vectors[3])
+    assert nk.cosine_similarity(a, b) == pytest.approx(expected[3], abs=1e-12)
+    assert nk.cosine_similarity(list(a), b) == pytest.approx(expected[3], abs=1e-12)
+    assert nk.cosine_similarity(query, vectors[3]) == pytest.approx(expected[3], abs=1e-5)
+    assert nk.cosine_similarity([0.0, 0.0], [1.0, 2.0]) == 0.0
+    with pytest.raises(ValueError):
+        nk.cosine_similarity([1.0], [1.0, 2.0])
+    with pytest.raises(ValueError):
+        nk.cosine_batch(query, flat[:-1])
+    with pytest.raises(TypeError):
+        nk.cosine_batch(a, flat)
@@ -0,0 +1,112 @@
+"""Tests for SimHash near-duplicate detection."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import near_duplicates
+from near_duplicates import DuplicateIndex, fingerprint, hamming
+
+LETTER = (
+    "Izba Gospodarcza Gazownictwa uprzejmie informuje, że w związku z planowaną "
+    "zmianą taryfy dla odbiorców paliw gazowych w gospodarstwach domowych "
+    "przekazujemy w załączeniu stanowisko w sprawie projektu rozporządzenia "
+    "Ministra Klimatu i Środowiska oraz prosimy o uwzględnienie uwag zgłoszonych "
+    "przez członków Izby na posiedzeniu w dniu 12 marca 2024 roku."
+)
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(near_duplicates._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / near_duplicates._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "simhash.c"),
+             "-o", str(lib)],
+            check=True,
+        )
+        monkeypatch.setattr(near_duplicates._library, "directory", str(tmp_path))
+        assert near_duplicates.is_available()
+    else:
+        monkeypatch.setattr(near_duplicates._library, "load", lambda: None)
+    return request.param
+
+
+def test_fingerprint_tolerates_layout_and_case(backend):
+    fp = fingerprint(LETTER)
+    # Ta sama treść po innym łamaniu wierszy i z przeniesieniem wyrazu
+    rescan = LETTER.replace("gospodarstwach", "gospo-\ndarstwach").replace(" ", "\n", 5)
+    assert fingerprint(rescan.upper()) == fp
+    assert hamming(fp, fingerprint(LETTER.replace("12 marca", "13 marca"))) <= 8
+    assert fingerprint("za krótki tekst") is None
+
+
+def test_query_matches_brute_force(backend, tmp_path):
+    rng = random.Random(5)
+    fps = [rng.getrandbits(64) for _ in range(3000)]
+    # Bliskie warianty kilku odcisków
+    for i in range(0, 300, 3):
+        fps.append(fps[i] ^ (1 << rng.randrange(64)) ^ (1 << rng.randrange(64)))
+    index = DuplicateIndex(str(tmp_path), max_distance=3)
+    for i, fp in enumerate(fps):
+        assert index.reserve(fp, f"{i}.pdf") == i
+    for probe in fps[:50] + [rng.getrandbits(64) for _ in range(50)]:
+        expected = {i: hamming(probe, fp) for i, fp in enumerate(fps) if hamming(probe, fp) <= 3}
+        assert index._query_locked(probe, 3) == expected
+    index.close()
+
+
+def test_store_persists_and_reloads(backend, tmp_path):
+    fp = fingerprint(LETTER)
+    index = DuplicateIndex(str(tmp_path))
+    assert index.find(fp) is None
+    first = index.reserve(fp, "wejscie/skan.pdf")
+    match = index.find(fingerprint(LETTER + " Z poważaniem"))
+    assert match.path == "wejscie/skan.pdf" and match.info == {}
+    assert (match.id, match.reserved) == (first, True)
+    index.store(first, "archiwum/1_pismo.pdf", {"w_sprawie": "taryfa"})
+    assert index.find(fp).reserved is False
+    index.add(fp ^ 0xFFFF_FFFF, "archiwum/2_inne.pdf")
+    index.close()
+
+    # Niepełny rekord po przerwanym zapisie jest ignorowany
+    with open(tmp_path / near_duplicates.FINGERPRINTS, "ab") as f:
+        f.write(b"\x01\x02\x03")
+    reopened = DuplicateIndex(str(tmp_path))
+    assert len(reopened) == 2
+    match = reopened.find(fp)
+    assert (match.path, match.distance, match.info) == (
+        "archiwum/1_pismo.pdf", 0, {"w_sprawie": "taryfa"}
+    )
+    reopened.add(fp, "archiwum/3_kopia.pdf")
+    reopened.close()
+    assert len(DuplicateIndex(str(tmp_path))) == 3
+
+
+def test_released_reservation_is_not_a_match(backend, tmp_path):
+    fp = fingerprint(LETTER)
+    index = DuplicateIndex(str(tmp_path))
+    archived = index.add(fp ^ 0b11, "archiwum/1_pismo.pdf", {"w_sprawie": "taryfa"})
+    failed = index.reserve(fp, "wejscie/skan.pdf")
+    assert index.find(fp).id == failed
+    # Kopia do archiwum się nie powiodła: pasuje już tylko zarchiwizowany dokument
+    index.release(failed)
+    index.store(failed, "archiwum/2_skan.pdf")
+    match = index.find(fp)
+    assert (match.id, match.path, match.distance) == (archived, "archiwum/1_pismo.pdf", 2)
+    index.release(archived)
+    assert index.find(fp).id == archived
+    index.close()
+    assert len(DuplicateIndex(str(tmp_path))) == 1
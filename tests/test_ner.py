@@ -0,0 +1,49 @@
+from pathlib import Path
+import os
+import sys
+
+import spacy
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+from processing import ner
+
+
+def _nlp():
+    nlp = spacy.blank("pl")
+    nlp.add_pipe("entity_ruler").add_patterns(
+        [{"label": "organizacja", "pattern": "ACME"}, {"label": "DATA", "pattern": "12.05.2024"}]
+    )
+    return nlp
+
+
+def test_pipe_documents_keeps_context_and_batches(monkeypatch):
+    nlp = _nlp()
+    calls = []
+    original_pipe = nlp.pipe
+
+    def tracking_pipe(texts, **kwargs):
+        calls.append(kwargs)
+        return original_pipe(texts, **kwargs)
+
+    monkeypatch.setattr(nlp, "pipe", tracking_pipe)
+
+    def ocr_stream():
+        yield "Umowa z ACME", 0
+        yield "Pismo z dnia 12.05.2024", 1
+
+    results = [
+        (ctx, ner.entities_from_doc(doc))
+        for doc, ctx in ner.pipe_documents(nlp, ocr_stream(), n_process=0, batch_size=2)
+    ]
+
+    assert results == [(0, {"ORGANIZACJA": ["ACME"]}), (1, {"DATA": ["12.05.2024"]})]
+    assert calls == [{"as_tuples": True, "n_process": os.cpu_count() or 1, "batch_size": 2}]
+
+
+def test_benchmark_reports_rate_per_process_count():
+    results = ner.benchmark(_nlp(), ["Umowa z ACME"] * 20, [1, 2])
+
+    assert [n for n, _ in results] == [1, 2]
+    assert all(rate > 0 for _, rate in results)
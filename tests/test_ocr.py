@@ -1,11 +1,21 @@
 from pathlib import Path
 import runpy
 import threading
+import time
 import queue
 
+import pytest
+
 MODULE = runpy.run_path(str(Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna" / "processing" / "ocr.py"))
 extract_text_with_ocr = MODULE["extract_text_with_ocr"]
 extract_texts_with_ocr_parallel = MODULE["extract_texts_with_ocr_parallel"]
+iter_texts_with_ocr = MODULE["iter_texts_with_ocr"]
+
+
+@pytest.fixture(autouse=True)
+def _page_cache_dir(tmp_path, monkeypatch):
+    """Keep the page cache of every test in its own directory."""
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "fulltext_index_dir", str(tmp_path))
 
 
 def test_extract_text_with_ocr_basic(monkeypatch):
@@ -62,7 +72,8 @@ def test_extract_text_with_ocr_tesseract_error(monkeypatch):
 
 
 def test_extract_texts_with_ocr_parallel_order_and_cancel(monkeypatch):
-    def fake_extract(path, progress_queue=None, language="pol", config="", psm=3, oem=3):
+    def fake_extract(path, progress_queue=None, language="pol", config="", psm=3, oem=3,
+                     cancel_event=None):
         assert config == "--psm 3 --oem 3"
         if progress_queue:
             progress_queue.put(("page_done", 1))
@@ -147,3 +158,251 @@ def test_psm_and_language_change_output(monkeypatch):
     assert text3.strip() == "pol4"
     assert text1 != text2
     assert text1 != text3
+
+
+def test_iter_texts_with_ocr_streams_with_bounded_backlog(monkeypatch):
+    def fake_extract(path, progress_queue=None, language="pol", config="", psm=3, oem=3,
+                     cancel_event=None):
+        return f"text-{path}", "Sukces"
+
+    iter_texts_with_ocr.__globals__["extract_text_with_ocr"] = fake_extract
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "ocr_workers", 2)
+    submitted = []
+    original_submit = MODULE["ThreadPoolExecutor"].submit
+
+    def counting_submit(self, fn, *args, **kwargs):
+        submitted.append(args[0])
+        return original_submit(self, fn, *args, **kwargs)
+
+    monkeypatch.setattr(MODULE["ThreadPoolExecutor"], "submit", counting_submit)
+    pdfs = [f"{i}.pdf" for i in range(10)]
+
+    stream = iter_texts_with_ocr(pdfs, threading.Event(), max_pending=3)
+    first = next(stream)
+    # Konsument nie odebrał reszty, więc OCR nie wyprzedza go o więcej niż 3 pliki
+    assert len(submitted) <= 4
+    results = dict([first, *stream])
+
+    assert results == {i: (f"text-{p}", "Sukces") for i, p in enumerate(pdfs)}
+    assert len(submitted) == len(pdfs)
+
+
+def test_iter_texts_with_ocr_does_not_run_ahead_of_slow_document(monkeypatch):
+    release = threading.Event()
+    started = []
+
+    def fake_extract(path, progress_queue=None, language="pol", config="", psm=3, oem=3,
+                     cancel_event=None):
+        started.append(path)
+        if path == "0.pdf":
+            release.wait(5)
+        return f"text-{path}", "Sukces"
+
+    iter_texts_with_ocr.__globals__["extract_text_with_ocr"] = fake_extract
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "ocr_workers", 2)
+    pdfs = [f"{i}.pdf" for i in range(10)]
+
+    stream = iter_texts_with_ocr(pdfs, threading.Event(), max_pending=3)
+    # Dokument 0 trwa, więc gotowe są tylko 1 i 2: dalsze pliki czekałyby na
+    # niego u konsumenta przywracającego kolejność
+    assert [next(stream)[0], next(stream)[0]] == [1, 2]
+    assert sorted(started) == ["0.pdf", "1.pdf", "2.pdf"]
+    release.set()
+    assert sorted(idx for idx, _ in stream) == [0, *range(3, 10)]
+
+
+class _Page:
+    """Rasterized page exposing the PIL calls used for hashing."""
+
+    def __init__(self, data: bytes, size=(64, 64)):
+        self.data = data
+        self.size = size
+
+    def convert(self, mode):
+        return self
+
+    def tobytes(self):
+        return self.data
+
+
+def test_page_cache_skips_ocr_of_seen_pages(tmp_path, monkeypatch):
+    form = _Page(bytes(range(256)) * 16)
+    other = _Page(bytes(reversed(range(256))) * 16)
+    pages = {"a.pdf": [form, other], "b.pdf": [form], "c.pdf": [other, form]}
+    calls = []
+
+    def fake_convert_from_path(pdf_path, dpi, poppler_path=None, fmt=None):
+        return pages[pdf_path]
+
+    def fake_image_to_string(image, lang="pol", config=""):
+        calls.append(image)
+        return "formularz" if len(calls) == 1 else "załącznik"
+
+    settings = MODULE["app_config"].SETTINGS
+    monkeypatch.setattr(settings, "ocr_page_cache", True)
+    extract_text_with_ocr.__globals__["convert_from_path"] = fake_convert_from_path
+    monkeypatch.setattr(MODULE["pytesseract"], "image_to_string", fake_image_to_string)
+    extract_text_with_ocr.__globals__["pytesseract"] = MODULE["pytesseract"]
+
+    q = queue.Queue()
+    assert extract_text_with_ocr("a.pdf", q)[0] == "formularz\nzałącznik\n"
+    assert extract_text_with_ocr("b.pdf", q)[0] == "formularz\n"
+    assert extract_text_with_ocr("c.pdf", q)[0] == "załącznik\nformularz\n"
+    assert len(calls) == 2
+    assert q.qsize() == 5
+    # Inne ustawienia OCR dają inny tekst, więc strona jest rozpoznawana ponownie
+    extract_text_with_ocr("b.pdf", q, psm=6)
+    assert len(calls) == 3
+
+
+def test_retry_recognizes_cached_pages_again(monkeypatch):
+    form = _Page(bytes(range(256)) * 16)
+    texts = iter(["formularz", "załącznik"])
+    calls = []
+
+    def fake_image_to_string(image, lang="pol", config=""):
+        calls.append(image)
+        return next(texts)
+
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "ocr_page_cache", True)
+    extract_text_with_ocr.__globals__["convert_from_path"] = (
+        lambda pdf_path, dpi, poppler_path=None, fmt=None: [form]
+    )
+    monkeypatch.setattr(MODULE["pytesseract"], "image_to_string", fake_image_to_string)
+    extract_text_with_ocr.__globals__["pytesseract"] = MODULE["pytesseract"]
+
+    assert extract_text_with_ocr("a.pdf")[0] == "formularz\n"
+    assert extract_text_with_ocr("a.pdf")[0] == "formularz\n"
+    assert len(calls) == 1
+    # Ponowienie na żądanie uruchamia Tesseract i zastępuje wpis w pamięci podręcznej
+    assert extract_text_with_ocr("a.pdf", use_page_cache=False)[0] == "załącznik\n"
+    assert len(calls) == 2
+    assert extract_text_with_ocr("a.pdf")[0] == "załącznik\n"
+    assert len(calls) == 2
+
+
+def test_qr_code_with_case_signature_skips_ocr(monkeypatch):
+    qr, plain, body = _Page(b"q" * 4096), _Page(b"p" * 4096), _Page(b"b" * 4096)
+    pages = {"qr.pdf": [qr, body], "plain.pdf": [plain, body]}
+    rendered = []
+
+    def fake_convert_from_path(pdf_path, dpi, poppler_path=None, fmt=None,
+                               first_page=1, last_page=None):
+        rendered.append((pdf_path, first_page))
+        return pages[pdf_path][first_page - 1:last_page]
+
+    def fake_read_codes(image, step=8):
+        if image is qr:
+            return [MODULE["barcodes"].Code("QR", "sygnatura=I C 105/24")]
+        return [MODULE["barcodes"].Code("CODE128", "KW/2024/00123")] if image is plain else []
+
+    settings = MODULE["app_config"].SETTINGS
+    monkeypatch.setattr(settings, "ocr_page_cache", False)
+    extract_text_with_ocr.__globals__["convert_from_path"] = fake_convert_from_path
+    extract_text_with_ocr.__globals__["pdfinfo_from_path"] = lambda path, **kw: {"Pages": 2}
+    monkeypatch.setattr(MODULE["barcodes"], "read_codes", fake_read_codes)
+    monkeypatch.setattr(
+        MODULE["pytesseract"], "image_to_string", lambda image, lang="pol", config="": "pismo"
+    )
+    extract_text_with_ocr.__globals__["pytesseract"] = MODULE["pytesseract"]
+
+    q = queue.Queue()
+    codes = []
+    assert extract_text_with_ocr("qr.pdf", q, codes=codes, skip_routed=True) == (
+        "", "Kod kreskowy"
+    )
+    assert codes == [MODULE["barcodes"].Code("QR", "sygnatura=I C 105/24")]
+    assert rendered == [("qr.pdf", 1)]
+    assert q.get_nowait() == ("page_done", 2)
+
+    # Sam numer z rejestru nie wskazuje sprawy, więc dokument przechodzi OCR
+    codes = []
+    text, status = extract_text_with_ocr("plain.pdf", q, codes=codes, skip_routed=True)
+    assert (text, status) == ("pismo\npismo\n", "Sukces")
+    assert codes == [MODULE["barcodes"].Code("CODE128", "KW/2024/00123")]
+    assert rendered[1:] == [("plain.pdf", 1), ("plain.pdf", 2)]
+
+
+def test_interactive_document_preempts_batch_at_page_boundary(monkeypatch):
+    batch = [_Page(bytes([i]) * 4096) for i in range(5)]
+    pages = {"a.pdf": batch, "b.pdf": batch, "pilny.pdf": batch[:2]}
+    order = []
+    started = threading.Event()
+
+    def fake_convert_from_path(pdf_path, dpi, poppler_path=None, fmt=None):
+        return pages[pdf_path]
+
+    def fake_image_to_string(image, lang="pol", config=""):
+        main = threading.current_thread() is threading.main_thread()
+        order.append("pilny" if main else "wsad")
+        if len(order) == 2:
+            started.set()
+        time.sleep(0.02)
+        return "pismo"
+
+    settings = MODULE["app_config"].SETTINGS
+    monkeypatch.setattr(settings, "ocr_page_cache", False)
+    monkeypatch.setattr(settings, "ocr_workers", 1)
+    monkeypatch.setitem(
+        iter_texts_with_ocr.__globals__, "extract_text_with_ocr", extract_text_with_ocr
+    )
+    extract_text_with_ocr.__globals__["convert_from_path"] = fake_convert_from_path
+    monkeypatch.setattr(MODULE["pytesseract"], "image_to_string", fake_image_to_string)
+    extract_text_with_ocr.__globals__["pytesseract"] = MODULE["pytesseract"]
+
+    # Wsad zajmuje jedyny silnik strona po stronie
+    consumer = threading.Thread(
+        target=lambda: list(iter_texts_with_ocr(["a.pdf", "b.pdf"], threading.Event()))
+    )
+    consumer.start()
+    started.wait(timeout=5)
+    text, status = extract_text_with_ocr(
+        "pilny.pdf", language="pol", priority=MODULE["ocr_scheduler"].INTERACTIVE
+    )
+    consumer.join(timeout=5)
+
+    assert (text, status) == ("pismo\npismo\n", "Sukces")
+    # Pilny dokument zajmuje następny wolny silnik, przed resztą wsadu
+    first = order.index("pilny")
+    assert first <= 3 and order[first:first + 2] == ["pilny", "pilny"]
+    assert order.count("wsad") == 10
+
+
+def test_cancel_event_stops_document_at_next_page(monkeypatch):
+    pages = [_Page(bytes([i]) * 4096) for i in range(4)]
+    cancel = threading.Event()
+    calls = []
+
+    def fake_convert_from_path(pdf_path, dpi, poppler_path=None, fmt=None):
+        return pages
+
+    def fake_image_to_string(image, lang="pol", config=""):
+        calls.append(image)
+        cancel.set()
+        return "pismo"
+
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "ocr_page_cache", False)
+    extract_text_with_ocr.__globals__["convert_from_path"] = fake_convert_from_path
+    monkeypatch.setattr(MODULE["pytesseract"], "image_to_string", fake_image_to_string)
+    extract_text_with_ocr.__globals__["pytesseract"] = MODULE["pytesseract"]
+
+    q = queue.Queue()
+    assert extract_text_with_ocr("a.pdf", q, cancel_event=cancel) == ("pismo\n", "Anulowano")
+    assert len(calls) == 1 and q.qsize() == 1
+
+
+def test_iter_texts_with_ocr_yields_nothing_after_cancel(monkeypatch):
+    cancel = threading.Event()
+
+    def fake_extract(path, progress_queue=None, language="pol", config="", psm=3, oem=3,
+                     cancel_event=None):
+        if path == "1.pdf":
+            cancel.set()
+            return "część", "Anulowano"
+        return f"text-{path}", "Sukces"
+
+    iter_texts_with_ocr.__globals__["extract_text_with_ocr"] = fake_extract
+    monkeypatch.setattr(MODULE["app_config"].SETTINGS, "ocr_workers", 1)
+
+    results = list(iter_texts_with_ocr(["0.pdf", "1.pdf", "2.pdf"], cancel))
+    assert results == [(0, ("text-0.pdf", "Sukces"))]
@@ -0,0 +1,64 @@
+"""Tests for the priority lanes of OCR engines."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import sys
+import threading
+import time
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import ocr_scheduler
+from ocr_scheduler import BATCH, INTERACTIVE, EngineScheduler
+
+
+def _waiter(scheduler, priority, name, order):
+    def run():
+        with scheduler.engine(priority):
+            order.append(name)
+
+    thread = threading.Thread(target=run)
+    thread.start()
+    return thread
+
+
+def _wait_queued(scheduler, count):
+    while len(scheduler._waiting) < count:
+        time.sleep(0.001)
+
+
+def test_interactive_pages_take_next_free_engine():
+    scheduler = EngineScheduler(2)
+    order = []
+    scheduler.acquire()
+    scheduler.acquire()
+    threads = []
+    for name, priority in (("b1", BATCH), ("b2", BATCH), ("i1", INTERACTIVE),
+                           ("b3", BATCH), ("i2", INTERACTIVE)):
+        threads.append(_waiter(scheduler, priority, name, order))
+        _wait_queued(scheduler, len(threads))
+    scheduler.release()
+    scheduler.release()
+    for thread in threads:
+        thread.join(timeout=5)
+    # Dwa silniki zwolnione naraz: obie strony interaktywne ruszają pierwsze
+    assert sorted(order[:2]) == ["i1", "i2"]
+    assert order[2:] == ["b1", "b2", "b3"]
+
+
+def test_resize_and_shared_instance():
+    scheduler = EngineScheduler(1)
+    scheduler.acquire()
+    order = []
+    thread = _waiter(scheduler, BATCH, "b", order)
+    _wait_queued(scheduler, 1)
+    scheduler.resize(2)
+    thread.join(timeout=5)
+    assert order == ["b"]
+    scheduler.release()
+
+    shared = ocr_scheduler.shared(3)
+    assert ocr_scheduler.shared(3) is shared and shared.engines == 3
+    assert ocr_scheduler.shared(5) is shared and shared.engines == 5
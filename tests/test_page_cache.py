@@ -0,0 +1,128 @@
+"""Tests for perceptual page hashing and the page-level OCR cache."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import page_cache
+from page_cache import PageCache, PageHash, hash_gray
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(page_cache._library, "_lib", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        lib = tmp_path / page_cache._library.filename
+        subprocess.run(
+            ["gcc", "-O2", "-fPIC", "-shared", str(BASE_DIR / "native" / "page_hash.c"),
+             "-o", str(lib), "-lm"],
+            check=True,
+        )
+        monkeypatch.setattr(page_cache._library, "directory", str(tmp_path))
+        assert page_cache.is_available()
+    else:
+        monkeypatch.setattr(page_cache._library, "load", lambda: None)
+    return request.param
+
+
+def _page(width, height, seed, noise=0):
+    """White page with dark "text lines" and optional salt-and-pepper noise."""
+    rng = random.Random(seed)
+    rows = []
+    for y in range(height):
+        line = (y // 6) % 3 == 0 and y > height // 10
+        row = bytearray(b"\xff" * width)
+        if line:
+            start = rng.randrange(width // 8, width // 4)
+            row[start:width - start] = b"\x20" * (width - 2 * start)
+        rows.append(row)
+    data = bytearray(b"".join(rows))
+    for _ in range(noise):
+        data[rng.randrange(len(data))] ^= 0xFF
+    return bytes(data)
+
+
+def test_hash_tolerates_scan_noise(backend):
+    page = _page(1240, 1754, seed=1)
+    h = hash_gray(page, 1240, 1754)
+    assert h == hash_gray(page, 1240, 1754)
+    # Kilkadziesiąt przekłamanych pikseli skanu nie zmienia miniatury 32x32
+    rescan = hash_gray(_page(1240, 1754, seed=1, noise=50), 1240, 1754)
+    assert (h.dhash ^ rescan.dhash).bit_count() <= 2
+    assert (h.phash ^ rescan.phash).bit_count() <= 2
+    other = hash_gray(_page(1240, 1754, seed=2), 1240, 1754)
+    assert (h.dhash ^ other.dhash).bit_count() + (h.phash ^ other.phash).bit_count() > 10
+    assert hash_gray(b"\x00" * 100, 10, 10) is None
+
+
+def test_backends_give_identical_hashes(tmp_path, monkeypatch):
+    if shutil.which("gcc") is None:
+        pytest.skip("gcc not available")
+    lib = tmp_path / page_cache._library.filename
+    subprocess.run(
+        ["gcc", "-O3", "-march=native", "-fPIC", "-shared",
+         str(BASE_DIR / "native" / "page_hash.c"), "-o", str(lib), "-lm"],
+        check=True,
+    )
+    monkeypatch.setattr(page_cache._library, "_lib", None)
+    monkeypatch.setattr(page_cache._library, "directory", str(tmp_path))
+    rng = random.Random(3)
+    pages = [(w, h, bytes(rng.randrange(256) for _ in range(w * h)))
+             for w, h in [(32, 32), (97, 131), (250, 180)]]
+    native = [hash_gray(data, w, h) for w, h, data in pages]
+    monkeypatch.setattr(page_cache._library, "load", lambda: None)
+    assert [hash_gray(data, w, h) for w, h, data in pages] == native
+
+
+def test_cache_persists_per_profile(tmp_path):
+    page = PageHash(0x1234_5678_9ABC_DEF0, 0x0FED_CBA9_8765_4321)
+    near = PageHash(page.dhash ^ 0b11, page.phash ^ 0b1)
+    cache = PageCache(str(tmp_path))
+    cache.put(1, page, "Pismo przewodnie")
+    cache.put(1, page, "pominięte")
+    assert cache.get(1, page) == "Pismo przewodnie"
+    assert cache.get(2, page) is None
+    assert cache.get(1, near) is None
+
+    with open(tmp_path / page_cache.HASHES, "ab") as f:
+        f.write(b"\x01\x02")
+    reopened = PageCache(str(tmp_path), max_distance=2)
+    assert len(reopened) == 1
+    assert reopened.get(1, near) == "Pismo przewodnie"
+    assert reopened.get(1, PageHash(page.dhash ^ 0b111, page.phash)) is None
+    reopened.put(2, page, "Inny profil")
+    assert len(PageCache(str(tmp_path))) == 2
+
+
+def test_form_pages_differing_in_one_field_are_not_reused(tmp_path, backend):
+    width, height = 1240, 1754
+    form = _page(width, height, seed=4)
+    filled = bytearray(form)
+    # Inna sygnatura w polu 200x20 px (400x40 px przy 300 dpi)
+    for y in range(150, 170):
+        for x in range(900, 1100, 3):
+            filled[y * width + x] = 0
+    first, scanned = hash_gray(form, width, height), hash_gray(bytes(filled), width, height)
+    assert first.dhash == scanned.dhash
+    assert first.bilevel != scanned.bilevel
+    # Na prawdziwych formularzach oba skróty miniatury są identyczne
+    second = PageHash(first.dhash, first.phash, scanned.bilevel)
+
+    cache = PageCache(str(tmp_path))
+    cache.put(1, first, "Sygn. akt I C 105/24")
+    assert cache.get(1, second) is None
+    cache.put(1, second, "Sygn. akt I C 106/24")
+    assert cache.get(1, first) == "Sygn. akt I C 105/24"
+    assert cache.get(1, second) == "Sygn. akt I C 106/24"
+    assert len(PageCache(str(tmp_path))) == 2
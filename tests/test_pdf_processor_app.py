@@ -18,7 +18,7 @@ from config import AppSettings
 def _stub_processing(monkeypatch):
     """Patch processing functions to avoid heavy dependencies."""
 
-    def fake_extract(text, filename, mode, case_signature_override="", llm_processor=None):
+    def fake_extract(text, filename, mode, case_signature_override="", llm_processor=None, llm_future=None, analysis=None):
         return {"numer_dokumentu": filename.split(".")[0]}
 
     def fake_generate(info, mode, counters):
@@ -40,11 +40,21 @@ def _stub_processing(monkeypatch):
     def fake_pdfinfo(path, poppler_path=None, **kwargs):
         return {"Pages": 1}
 
+    def fake_iter_ocr(paths, cancel_event, progress_queue=None, **kwargs):
+        results, _ = fake_ocr(paths, cancel_event, progress_queue)
+        yield from enumerate(results)
+
     monkeypatch.setattr(
         pdf_processor_app.processing_worker.ocr,
         "extract_texts_with_ocr_parallel",
         fake_ocr,
     )
+    monkeypatch.setattr(
+        pdf_processor_app.processing_worker.ocr,
+        "iter_texts_with_ocr",
+        fake_iter_ocr,
+        raising=False,
+    )
     monkeypatch.setattr(
         pdf_processor_app.processing_worker, "pdfinfo_from_path", fake_pdfinfo
     )
@@ -59,7 +69,7 @@ def test_process_files_passes_llm(tmp_path, monkeypatch):
     sentinel = object()
     captured = {}
 
-    def tracker(text, filename, mode, case_signature_override="", llm_processor=None):
+    def tracker(text, filename, mode, case_signature_override="", llm_processor=None, llm_future=None, analysis=None):
         captured["llm"] = llm_processor
         return {"numer_dokumentu": filename.split(".")[0]}
 
@@ -83,6 +93,9 @@ def test_processing_worker_emits_results(tmp_path, monkeypatch):
     (tmp_path / "c.pdf").write_bytes(b"")
     out_dir = tmp_path / "out"
     _stub_processing(monkeypatch)
+    monkeypatch.setattr(
+        processing_worker.config.SETTINGS, "fulltext_index_dir", str(tmp_path / "indeks")
+    )
 
     # ensure generate_new_filename returns non-ASCII characters to test sanitisation
     monkeypatch.setattr(
@@ -127,6 +140,38 @@ def test_start_processing_warns_when_llm_missing(tmp_path, monkeypatch):
     assert "called" in warned
 
 
+def test_process_files_submits_llm_requests_up_front(tmp_path, monkeypatch):
+    for name in ("a.pdf", "b.pdf"):
+        (tmp_path / name).write_bytes(b"")
+    out_dir = tmp_path / "out"
+    out_dir.mkdir()
+    _stub_processing(monkeypatch)
+
+    events = []
+
+    class BatchingLLM:
+        def submit_smart_metadata(self, text, filename, analysis=None):
+            events.append(("submit", filename))
+            return filename
+
+    def tracker(text, filename, mode, case_signature_override="", llm_processor=None, llm_future=None, analysis=None):
+        events.append(("extract", llm_future))
+        return {"numer_dokumentu": filename.split(".")[0]}
+
+    monkeypatch.setattr(
+        pdf_processor_app.processing_worker, "extract_info_from_text", tracker
+    )
+
+    PdfProcessorApp.process_files(str(tmp_path), str(out_dir), llm_processor=BatchingLLM())
+
+    assert events == [
+        ("submit", "a.pdf"),
+        ("submit", "b.pdf"),
+        ("extract", "a.pdf"),
+        ("extract", "b.pdf"),
+    ]
+
+
 def test_process_files_generate_and_copy(tmp_path, monkeypatch):
     in_dir = tmp_path / "in"
     out_dir = tmp_path / "out"
@@ -134,7 +179,7 @@ def test_process_files_generate_and_copy(tmp_path, monkeypatch):
     out_dir.mkdir()
     (in_dir / "doc.pdf").write_bytes(b"dummy")
 
-    def fake_extract(text, filename, mode, case_signature_override="", llm_processor=None):
+    def fake_extract(text, filename, mode, case_signature_override="", llm_processor=None, llm_future=None, analysis=None):
         return {"numer_dokumentu": "123"}
 
     def fake_generate(info, mode, counters):
@@ -160,6 +205,157 @@ def test_process_files_generate_and_copy(tmp_path, monkeypatch):
     assert (out_dir / "123_new.pdf").exists()
 
 
+def test_process_stream_overlaps_stages_and_commits_in_order():
+    import queue
+    import threading
+
+    documents = queue.Queue(maxsize=2)
+    started = {idx: threading.Event() for idx in range(4)}
+
+    def producer():
+        # OCR kończy dokumenty w innej kolejności niż na liście; kolejny
+        # dokument przychodzi dopiero, gdy poprzedni jest już w ekstrakcji
+        for idx in (1, 0, 3, 2):
+            documents.put((idx, f"text-{idx}"))
+            if not started[idx].wait(5):
+                break
+        documents.put(None)
+
+    def extract(idx, text):
+        started[idx].set()
+        if idx == 0:
+            # Ekstrakcje trwają równolegle: 0 kończy się dopiero po starcie 2
+            assert started[2].wait(5)
+        return text.upper()
+
+    committed = []
+    thread = threading.Thread(target=producer, daemon=True)
+    thread.start()
+    processing_worker.process_stream(
+        documents, extract, lambda idx, info: committed.append((idx, info)), workers=4
+    )
+    thread.join()
+
+    assert committed == [(i, f"TEXT-{i}") for i in range(4)]
+
+
+def test_process_stream_bounds_uncommitted_documents():
+    import queue
+    import threading
+
+    documents = queue.Queue(maxsize=1)
+    for_later = threading.Event()
+    committed = []
+
+    def producer():
+        for idx in range(10):
+            documents.put((idx, idx))
+        documents.put(None)
+
+    def extract(idx, payload):
+        if idx >= 3:
+            for_later.set()
+        # Dokument jest pobierany, gdy mniej niż 3 czekają na zatwierdzenie
+        assert idx - len(committed) < 3
+        if idx == 0:
+            # Przy braku limitu 3 zostałby pobrany, zanim 0 się skończy
+            for_later.wait(0.3)
+        return payload
+
+    thread = threading.Thread(target=producer, daemon=True)
+    thread.start()
+    processing_worker.process_stream(
+        documents, extract, lambda idx, info: committed.append(idx), workers=4, max_pending=3
+    )
+    thread.join()
+
+    assert committed == list(range(10))
+
+
+def test_fingerprint_is_kept_only_for_archived_copies(tmp_path):
+    from concurrent.futures import Future
+
+    import near_duplicates
+
+    index = near_duplicates.DuplicateIndex(str(tmp_path / "idx"))
+    fps = [0, (1 << 64) - 1]
+    ids = [index.reserve(fp, f"wejscie/{i}.pdf") for i, fp in enumerate(fps)]
+    copies = [Future(), Future()]
+    for i, future in enumerate(copies):
+        processing_worker.store_fingerprint(
+            index, ids[i], tmp_path / f"{i}.pdf", {"w_sprawie": str(i)}, future
+        )
+    # Zapis czeka na wynik kopii
+    assert index.find(fps[0]).reserved
+    copies[0].set_result(types.SimpleNamespace(ok=True))
+    copies[1].set_result(types.SimpleNamespace(ok=False))
+
+    match = index.find(fps[0])
+    assert (match.reserved, match.path, match.info) == (
+        False, str(tmp_path / "0.pdf"), {"w_sprawie": "0"}
+    )
+    assert index.find(fps[1]) is None
+    index.close()
+
+
+def test_duplicate_info_marks_in_batch_original():
+    import near_duplicates
+
+    info = processing_worker.duplicate_info(
+        near_duplicates.DuplicateMatch("archiwum/1.pdf", 1, {"w_sprawie": "taryfa"}), "I C 1/24"
+    )
+    assert (info["w_sprawie"], info["sygnatura_sprawy"], info["duplikat"]) == (
+        "taryfa", "I C 1/24", "archiwum/1.pdf"
+    )
+    own = processing_worker.mark_duplicate({"w_sprawie": "własny"}, Path("archiwum/2.pdf"))
+    assert own == {
+        "w_sprawie": "własny",
+        "status": "DUPLIKAT",
+        "duplikat": str(Path("archiwum/2.pdf")),
+        "colors": {"duplikat": "lightblue"},
+    }
+
+
+def test_template_letter_of_another_case_keeps_own_signature():
+    import near_duplicates
+
+    original = processing_worker.fingerprint_info(
+        {"sygnatura_sprawy": "I C 1/24", "numer_dokumentu": "7"},
+        "Wezwanie do zapłaty\nSygn. akt I C 1/24\n",
+    )
+    assert original[processing_worker.TEXT_SIGNATURE] == "I C 1/24"
+    assert processing_worker.signatures_agree("Sygn. akt i c  1/24\n", original)
+    assert not processing_worker.signatures_agree("Sygn. akt I C 2/24\n", original)
+    # Rekord zapisany bez sygnatury z tekstu: porównanie z wyekstrahowaną
+    assert processing_worker.signatures_agree(
+        "Sygnatura: I C 1/24\n", {"sygnatura_sprawy": "I C 1/24"}
+    )
+    info = processing_worker.duplicate_info(
+        near_duplicates.DuplicateMatch("archiwum/1.pdf", 2, original)
+    )
+    assert processing_worker.TEXT_SIGNATURE not in info
+    assert info["numer_dokumentu"] == "7"
+
+
+def test_process_stream_stops_when_poll_returns_false():
+    import queue
+
+    documents = queue.Queue()
+    for idx in range(3):
+        documents.put((idx, idx))
+    committed = []
+
+    processing_worker.process_stream(
+        documents,
+        lambda idx, payload: payload,
+        lambda idx, info: committed.append(idx),
+        workers=1,
+        poll=lambda: len(committed) < 2,
+    )
+
+    assert committed == [0, 1]
+
+
 def test_input_dir_change_updates_output(tmp_path):
     settings = AppSettings(default_output_subdir="wyniki")
     app = PdfProcessorApp(settings)
@@ -267,3 +463,58 @@ def test_training_window_launches(monkeypatch):
     win.start_training_thread()
 
     assert "args" in called
+
+
+def test_training_worker_stop_cancels_process(tmp_path):
+    script = tmp_path / "trening.py"
+    script.write_text(
+        "import sys\n"
+        "print('OCR', flush=True)\n"
+        "print('przerwano' if sys.stdin.readline().strip() == 'cancel' else 'koniec')\n"
+        "sys.exit(1)\n",
+        encoding="utf-8",
+    )
+    worker = training_window.TrainingWorker([sys.executable, str(script)])
+    worker.progress = training_window._DummySignal()
+    worker.finished = training_window._DummySignal()
+    lines, finished = [], []
+
+    def on_line(line):
+        lines.append(line)
+        if line == "OCR":
+            worker.stop()
+
+    worker.progress.connect(on_line)
+    worker.finished.connect(finished.append)
+    worker.run()
+
+    assert lines == ["OCR", "przerwano"] and finished == [False]
+    assert worker.stop_requested
+
+
+def test_reocr_worker_recognizes_with_interactive_priority(monkeypatch):
+    calls = []
+
+    def fake_extract(path, **kwargs):
+        calls.append((path, kwargs))
+        return "tekst", "Sukces"
+
+    monkeypatch.setattr(processing_worker.ocr, "extract_text_with_ocr", fake_extract, raising=False)
+    monkeypatch.setattr(
+        processing_worker.ocr, "_configure_pytesseract", lambda: None, raising=False
+    )
+    settings = AppSettings(ocr_language="eng", ocr_psm=6)
+    worker = processing_worker.ReocrWorker("pilny.pdf", 4, settings)
+    worker.finished = training_window._DummySignal()
+    worker.error = training_window._DummySignal()
+    emitted = []
+    worker.finished.connect(lambda *args: emitted.append(args))
+
+    worker.run()
+
+    assert emitted == [(4, "tekst", "Sukces")]
+    path, kwargs = calls[0]
+    assert path == "pilny.pdf"
+    assert kwargs["priority"] == processing_worker.ocr_scheduler.INTERACTIVE
+    assert (kwargs["language"], kwargs["psm"]) == ("eng", 6)
+    assert kwargs["use_page_cache"] is False
@@ -1,14 +1,16 @@
 import runpy
+import sys
 from pathlib import Path
 import spacy
 import pytest
 
 BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
 MODULE = runpy.run_path(str(BASE_DIR / "gui" / "processing_worker.py"))
 extract_info_from_text = MODULE["extract_info_from_text"]
 
 class DummyExtractor:
-    def extract_info(self, text):
+    def extract_info(self, text, analysis=None):
         return {
             "data": "",
             "nadawca_odbiorca": "",
@@ -50,3 +52,37 @@ def test_regex_number_and_signature():
     info = extract_info_from_text(text, "test.pdf", "KP")
     assert info["numer_dokumentu"] == "ABC-123/2024"
     assert info["sygnatura_sprawy"] == "VII K 123/20"
+
+
+def test_signature_snapped_to_known_case(tmp_path, monkeypatch):
+    known = tmp_path / "sygnatury.txt"
+    known.write_text("# aktywne sprawy\nVII K 123/20\nI C 1045/24\n", encoding="utf-8")
+    monkeypatch.setattr(MODULE["config"].SETTINGS, "case_signatures_file", str(known))
+
+    info = extract_info_from_text("Sygn. akt: VlI K l23/2O\n", "test.pdf", "KP")
+    assert info["sygnatura_sprawy"] == "VII K 123/20"
+    assert info["colors"]["sygnatura_sprawy"] == "orange"
+    # Poprawiona sygnatura czeka na potwierdzenie także po uzupełnieniu reszty z kodu
+    info["colors"] = {"numer_dokumentu": "yellow", "sygnatura_sprawy": "orange"}
+    routed = MODULE["apply_routing_fields"](info, {"numer_dokumentu": "KW/2024/00123"})
+    assert routed["status"] == "DO UZUPEŁNIENIA"
+
+    info = extract_info_from_text("Sygn. akt: IX Ns 7/21\n", "test.pdf", "KP")
+    assert info["sygnatura_sprawy"] == "IX Ns 7/21"
+    assert "sygnatura_sprawy" not in info["colors"]
+
+
+def test_barcode_fields_override_extracted_metadata():
+    apply_routing_fields = MODULE["apply_routing_fields"]
+    info = extract_info_from_text("Numer dokumentu: ABC-1/2024\n", "test.pdf", "KP")
+    assert info["status"] == "DO UZUPEŁNIENIA"
+    fields = {"numer_dokumentu": "KW/2024/00123", "sygnatura_sprawy": "I C 105/24"}
+
+    routed = apply_routing_fields(dict(info, colors=dict(info["colors"])), fields)
+    assert routed["numer_dokumentu"] == "KW/2024/00123"
+    assert routed["sygnatura_sprawy"] == "I C 105/24"
+    assert routed["colors"]["sygnatura_sprawy"] == "lightcyan"
+
+    # Sygnatura wpisana przez użytkownika ma pierwszeństwo przed kodem QR
+    routed = apply_routing_fields(dict(info, sygnatura_sprawy="II K 1/24"), fields, "II K 1/24")
+    assert routed["sygnatura_sprawy"] == "II K 1/24"
@@ -0,0 +1,165 @@
+from pathlib import Path
+import os
+import sys
+import types
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import gui  # noqa: F401 - importuje app_session_manager w kolejności aplikacji
+import app_session_manager
+from app_session_manager import SESSION_HEADER_V2, SessionManager
+
+
+class Item:
+    def __init__(self, text=""):
+        self._text = text
+        self._data = None
+
+    def text(self):
+        return self._text
+
+    def setText(self, text):
+        self._text = text
+
+    def data(self, role):
+        return self._data
+
+    def setData(self, role, value):
+        self._data = value
+
+
+class Tree:
+    def __init__(self, columns=3):
+        self.rows = []
+        self.columns = columns
+
+    def rowCount(self):
+        return len(self.rows)
+
+    def columnCount(self):
+        return self.columns
+
+    def setRowCount(self, n):
+        del self.rows[n:]
+        while len(self.rows) < n:
+            self.rows.append([None] * self.columns)
+
+    def insertRow(self, row):
+        self.rows.insert(row, [None] * self.columns)
+
+    def item(self, row, col):
+        return self.rows[row][col]
+
+    def setItem(self, row, col, item):
+        self.rows[row][col] = item
+
+    def currentRow(self):
+        return 0
+
+    def setCurrentCell(self, row, col):
+        pass
+
+    def setUpdatesEnabled(self, enabled):
+        pass
+
+    def add(self, *values):
+        self.rows.append([Item(v) for v in values])
+
+
+def _manager(tmp_path, monkeypatch):
+    monkeypatch.setattr(
+        app_session_manager, "QtWidgets", types.SimpleNamespace(QTableWidgetItem=Item)
+    )
+    app = types.SimpleNamespace(
+        tree=Tree(), work_mode="KP", input_dir=str(tmp_path), output_dir="",
+        case_signature="", _load_pdf=lambda p: None,
+    )
+    manager = SessionManager(app)
+    manager.session_folder = str(tmp_path)
+    return manager, app
+
+
+def _record_count(path):
+    with open(path, "rb") as f:
+        f.readline()
+        return sum(1 for _ in SessionManager._read_records(f, app_session_manager.Fernet(b"")))
+
+
+def test_save_appends_only_changed_rows(tmp_path, monkeypatch):
+    manager, app = _manager(tmp_path, monkeypatch)
+    for i in range(10):
+        app.tree.add(f"{i}.pdf", str(i), f"nowa_{i}.pdf")
+    path = manager.save_session(str(tmp_path / "s.arch"))
+    assert open(path, "rb").readline().strip() == SESSION_HEADER_V2
+    assert _record_count(path) == 11
+
+    size = os.path.getsize(path)
+    manager.save_session(path)
+    assert os.path.getsize(path) == size
+
+    app.tree.item(3, 2).setText("zmieniona.pdf")
+    app.tree.add("10.pdf", "10", "nowa_10.pdf")
+    manager.save_session(path)
+    assert _record_count(path) == 13
+
+    app.tree.setRowCount(5)
+    manager.save_session(path)
+
+    other, other_app = _manager(tmp_path, monkeypatch)
+    ok, _ = other.load_session(path)
+    assert ok
+    texts = [[item.text() for item in row] for row in other_app.tree.rows]
+    assert len(texts) == 5
+    assert texts[3] == ["3.pdf", "3", "zmieniona.pdf"]
+    assert other_app.tree.item(0, 0).data(None) == os.path.join(str(tmp_path), "0.pdf")
+
+    # Kolejny zapis po wczytaniu nadal dopisuje tylko zmiany
+    other_app.tree.item(0, 1).setText("X")
+    before = _record_count(path)
+    other.save_session(path)
+    assert _record_count(path) == before + 1
+
+
+def test_compaction_and_truncated_tail(tmp_path, monkeypatch):
+    monkeypatch.setattr(app_session_manager, "COMPACT_MIN_RECORDS", 4)
+    manager, app = _manager(tmp_path, monkeypatch)
+    for i in range(4):
+        app.tree.add(f"{i}.pdf", str(i), "")
+    path = manager.save_session(str(tmp_path / "s.arch"))
+    for n in range(10):
+        app.tree.item(0, 2).setText(f"v{n}")
+        manager.save_session(path)
+    assert _record_count(path) <= 1 + 4 + 4 + 1
+
+    # Przerwany zapis zostawia niepełny rekord, który jest pomijany
+    with open(path, "ab") as f:
+        f.write(b"\x00\x00\x01\x00abc")
+    other, other_app = _manager(tmp_path, monkeypatch)
+    assert other.load_session(path)[0]
+    assert other_app.tree.item(0, 2).text() == "v9"
+    other_app.tree.item(1, 2).setText("po")
+    other.save_session(path)
+    third, third_app = _manager(tmp_path, monkeypatch)
+    assert third.load_session(path)[0]
+    assert third_app.tree.item(1, 2).text() == "po"
+
+
+def test_corrupt_record_is_skipped(tmp_path, monkeypatch):
+    manager, app = _manager(tmp_path, monkeypatch)
+    for i in range(3):
+        app.tree.add(f"{i}.pdf", str(i), f"nowa_{i}.pdf")
+    path = manager.save_session(str(tmp_path / "s.arch"))
+
+    # Rekord wiersza 1 (po nagłówku i meta) uszkodzony w środku pliku
+    data = open(path, "rb").read()
+    start = data.index(b'{"t": "row", "row": 1')
+    end = data.index(b"}", start) + 1
+    with open(path, "wb") as f:
+        f.write(data[:start] + b"#" * (end - start) + data[end:])
+
+    other, other_app = _manager(tmp_path, monkeypatch)
+    ok, message = other.load_session(path)
+    assert ok and "Pominięto uszkodzone rekordy: 1" in message
+    texts = [[item.text() if item else "" for item in row] for row in other_app.tree.rows]
+    assert texts == [["0.pdf", "0", "nowa_0.pdf"], ["", "", ""], ["2.pdf", "2", "nowa_2.pdf"]]
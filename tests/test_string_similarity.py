@@ -0,0 +1,118 @@
+"""Tests for the bit-parallel Jaro-Winkler and Levenshtein ratio kernels."""
+
+from __future__ import annotations
+
+from pathlib import Path
+import random
+import shutil
+import subprocess
+import sys
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import string_similarity
+from string_similarity import batch, jaro_winkler, levenshtein_ratio
+
+
+def _build(tmp_path):
+    lib = tmp_path / string_similarity._library.filename
+    subprocess.run(
+        ["gcc", "-O3", "-march=native", "-fPIC", "-shared",
+         str(BASE_DIR / "native" / "levenshtein.c"), "-o", str(lib), "-fopenmp"],
+        check=True,
+    )
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, tmp_path, monkeypatch):
+    monkeypatch.setattr(string_similarity._library, "_lib", None)
+    monkeypatch.setattr(string_similarity, "_ext", None)
+    if request.param == "native":
+        if shutil.which("gcc") is None:
+            pytest.skip("gcc not available")
+        _build(tmp_path)
+        monkeypatch.setattr(string_similarity._library, "directory", str(tmp_path))
+        assert string_similarity.is_available()
+    else:
+        monkeypatch.setattr(string_similarity._library, "load", lambda: None)
+    return request.param
+
+
+def _ocr_noise(text, rng, rate=0.05):
+    out = []
+    for ch in text:
+        r = rng.random()
+        if r < rate / 3:
+            continue
+        if r < 2 * rate / 3:
+            out.append(rng.choice("ąęółżźćńś01lI"))
+        elif r < rate:
+            out.extend((ch, rng.choice(" .,")))
+        else:
+            out.append(ch)
+    return "".join(out)
+
+
+def test_reference_values(backend):
+    assert jaro_winkler("MARTHA", "MARHTA") == pytest.approx(0.961111, abs=1e-6)
+    assert jaro_winkler("DWAYNE", "DUANE") == pytest.approx(0.84, abs=1e-6)
+    assert jaro_winkler("DIXON", "DICKSONX") == pytest.approx(0.813333, abs=1e-6)
+    assert jaro_winkler("", "") == 1.0 and jaro_winkler("a", "") == 0.0
+    assert levenshtein_ratio("kitten", "sitting") == pytest.approx(8 / 13)
+    assert levenshtein_ratio("", "") == 1.0 and levenshtein_ratio("abc", "") == 0.0
+    # Znaki, nie bajty UTF-8: "ż" i "z" różnią się jednym znakiem
+    assert levenshtein_ratio("Łódź", "Lódź") == pytest.approx(6 / 8)
+    assert jaro_winkler("Łódź", "Łódź") == 1.0
+
+
+def test_long_strings_use_blocked_masks(backend):
+    rng = random.Random(3)
+    words = ["umowa", "najmu", "lokalu", "użytkowego", "pismo", "sąd", "w", "sprawie"]
+    text = " ".join(rng.choice(words) for _ in range(300))
+    noisy = _ocr_noise(text, rng)
+    assert len(text) > 1000
+    assert 0.9 < levenshtein_ratio(text, noisy) < 1.0
+    assert 0.8 < jaro_winkler(text, noisy) < 1.0
+    assert levenshtein_ratio(text, text) == 1.0 and jaro_winkler(text, text) == 1.0
+    # Wynik wsadowy równy pojedynczym wywołaniom, także dla Levenshteina
+    choices = [noisy, text[:64], text[:65], "", "zupełnie inny dokument"]
+    assert batch(text, choices) == [jaro_winkler(text, c) for c in choices]
+    assert batch(text, choices, "levenshtein_ratio") == [
+        levenshtein_ratio(text, c) for c in choices
+    ]
+
+
+def test_backends_score_identically(tmp_path, monkeypatch):
+    if shutil.which("gcc") is None:
+        pytest.skip("gcc not available")
+    _build(tmp_path)
+    monkeypatch.setattr(string_similarity._library, "_lib", None)
+    monkeypatch.setattr(string_similarity, "_ext", None)
+    monkeypatch.setattr(string_similarity._library, "directory", str(tmp_path))
+    rng = random.Random(11)
+    pairs = []
+    for length in (1, 5, 63, 64, 65, 127, 128, 200, 700):
+        a = "".join(rng.choice("abcdeąę ") for _ in range(length))
+        pairs.append((a, _ocr_noise(a, rng, 0.3)))
+        pairs.append((a, "".join(rng.choice("abcde") for _ in range(rng.randrange(1, 300)))))
+    query = pairs[-1][0]
+    choices = [b for _, b in pairs]
+
+    def scores():
+        return (
+            [jaro_winkler(a, b) for a, b in pairs],
+            [levenshtein_ratio(a, b) for a, b in pairs],
+            batch(query, choices),
+            batch(query, choices, "levenshtein_ratio"),
+        )
+
+    native = scores()
+    assert string_similarity.is_available()
+    monkeypatch.setattr(string_similarity._library, "load", lambda: None)
+    python = scores()
+    assert native[1] == python[1] and native[3] == python[3]
+    assert native[0] == pytest.approx(python[0], abs=1e-12)
+    assert native[2] == pytest.approx(python[2], abs=1e-12)
@@ -0,0 +1,265 @@
+from pathlib import Path
+import json
+import logging
+import os
+import stat
+import sys
+import threading
+import time
+
+import pytest
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+import training_engine
+
+FAKE_OCR = """#!{python}
+import json, sys
+assert sys.argv[1:] in (["--stream", "-"], ["--stream", "--progress", "-"])
+paths = [line.strip() for line in iter(sys.stdin.readline, "\\n")]
+# Wyniki w odwrotnej kolejności, jak przy różnych czasach OCR
+for i in reversed(range(len(paths))):
+    text = open(paths[i], encoding="utf-8").read()
+    print(json.dumps({{"index": i, "text": text, "error": ""}}), flush=True)
+"""
+
+FAKE_PDF_OCR = """#!{python}
+import json, os, sys
+args = sys.argv[1:]
+assert args[:2] == ["--stream", "--pdf"] and args[3:] == ["--pdf-bilevel", "-"]
+for i, line in enumerate(iter(sys.stdin.readline, "\\n")):
+    out = os.path.join(args[2], os.path.basename(line.strip()))
+    if out.endswith("c.pdf"):
+        # Błąd zapisu PDF nie odbiera rozpoznanego tekstu
+        print(json.dumps({{"index": i, "text": "tekst", "error": "", "pdf": "",
+                          "pdf_error": "Błąd zapisu pliku " + out}}), flush=True)
+        continue
+    with open(out, "w", encoding="utf-8") as f:
+        f.write("warstwa tekstu")
+    print(json.dumps({{"index": i, "text": "tekst", "error": "", "pdf": out}}), flush=True)
+"""
+
+# Awaria po pierwszym wyniku: pozostałe pliki bez odpowiedzi
+FAKE_CRASH_OCR = """#!{python}
+import json, os, sys
+paths = [line.strip() for line in iter(sys.stdin.readline, "\\n")]
+print(json.dumps({{"index": 0, "text": open(paths[0], encoding="utf-8").read(),
+                  "error": ""}}), flush=True)
+os._exit(3)
+"""
+
+# Pierwszy plik z postępem, drugi "rozpoznawany" aż do polecenia cancel;
+# SIGTERM jest ignorowany jak TerminateProcess bez sprzątania na Windows
+FAKE_CANCEL_OCR = """#!{python}
+import json, os, signal, sys, threading, time
+assert sys.argv[1:] == ["--stream", "--progress", "-"]
+paths = [line.strip() for line in iter(sys.stdin.readline, "\\n")]
+
+def on_cancel():
+    if sys.stdin.readline() == "cancel\\n":
+        open(paths[1] + ".anulowano", "w").close()
+        os._exit(130)
+
+signal.signal(signal.SIGTERM, signal.SIG_IGN)
+threading.Thread(target=on_cancel, daemon=True).start()
+for percent in (0, 50, 100):
+    stage = "rasterize" if percent == 0 else "ocr"
+    print(json.dumps({{"index": 0, "stage": stage, "page": 1, "pages": 1,
+                      "percent": percent}}), flush=True)
+print(json.dumps({{"index": 0, "text": "tekst", "error": ""}}), flush=True)
+while True:
+    time.sleep(0.001)
+"""
+
+
+class FakeRow(dict):
+    pass
+
+
+class FakeFrame:
+    def __init__(self, rows):
+        self.rows = rows
+
+    def iterrows(self):
+        return enumerate(FakeRow(r) for r in self.rows)
+
+
+class FakePandas:
+    def __init__(self, sheets):
+        self.sheets = sheets
+
+    def read_excel(self, path):
+        return FakeFrame(self.sheets[Path(path).parent.name])
+
+    @staticmethod
+    def notna(value):
+        return value is not None
+
+
+def _install_fake_ocr(tmp_path, monkeypatch, script=FAKE_OCR):
+    exe = tmp_path / "bin" / "training_ocr"
+    exe.parent.mkdir()
+    exe.write_text(script.format(python=sys.executable), encoding="utf-8")
+    exe.chmod(exe.stat().st_mode | stat.S_IEXEC)
+    monkeypatch.setattr(training_engine, "base_path", str(exe.parent))
+
+
+def test_align_entities_prefers_longest_non_overlapping_match():
+    text = "Umowa z ACME Polska, ACME, nr 12/2024"
+    spans = training_engine.align_entities(
+        text,
+        [("ACME", "ORGANIZACJA"), ("ACME Polska", "ORGANIZACJA"), ("12/2024", "NR_DOKUMENTU")],
+    )
+
+    assert [text[s:e] for s, e, _ in spans] == ["ACME Polska", "ACME", "12/2024"]
+    assert spans[-1][2] == "NR_DOKUMENTU"
+
+
+def test_stream_results_map_back_to_input_order(tmp_path, monkeypatch):
+    _install_fake_ocr(tmp_path, monkeypatch)
+    pdfs = []
+    for i in range(3):
+        pdf = tmp_path / f"{i}.pdf"
+        pdf.write_text(f"tekst {i}\f", encoding="utf-8")
+        pdfs.append(str(pdf))
+
+    assert [i for i, _ in training_engine.run_cpp_ocr_stream(pdfs)] == [2, 1, 0]
+    assert training_engine.run_cpp_ocr(pdfs) == ["tekst 0\f", "tekst 1\f", "tekst 2\f"]
+
+
+def test_stream_writes_searchable_pdfs_in_same_pass(tmp_path, monkeypatch, caplog):
+    _install_fake_ocr(tmp_path, monkeypatch, FAKE_PDF_OCR)
+    out_dir = tmp_path / "przeszukiwalne"
+    out_dir.mkdir()
+    pdfs = [str(tmp_path / "a.pdf"), str(tmp_path / "b.pdf"), str(tmp_path / "c.pdf")]
+
+    with caplog.at_level(logging.WARNING, logger=training_engine.logger.name):
+        results = list(
+            training_engine.run_cpp_ocr_stream(pdfs, pdf_dir=str(out_dir), bilevel=True)
+        )
+    assert results == [
+        (0, "tekst", str(out_dir / "a.pdf")),
+        (1, "tekst", str(out_dir / "b.pdf")),
+        (2, "tekst", ""),
+    ]
+    assert (out_dir / "b.pdf").read_text(encoding="utf-8") == "warstwa tekstu"
+    assert "Błąd zapisu pliku" in caplog.text
+
+
+def test_stream_reports_progress_and_cancels_within_milliseconds(tmp_path, monkeypatch):
+    _install_fake_ocr(tmp_path, monkeypatch, FAKE_CANCEL_OCR)
+    pdfs = [str(tmp_path / "a.pdf"), str(tmp_path / "b.pdf")]
+    cancel = threading.Event()
+    progress = []
+
+    stream = training_engine.run_cpp_ocr_stream(
+        pdfs, cancel_event=cancel, progress=lambda *p: progress.append(p)
+    )
+    assert next(stream) == (0, "tekst")
+    assert progress == [(0, "rasterize", 1, 1, 0), (0, "ocr", 1, 1, 50), (0, "ocr", 1, 1, 100)]
+    start = time.perf_counter()
+    cancel.set()
+    assert list(stream) == []
+    assert time.perf_counter() - start < 1
+    # Proces zakończył się sam po poleceniu cancel, sprzątając po sobie
+    assert Path(pdfs[1] + ".anulowano").exists()
+
+
+def test_single_ocr_job_writes_jsonl_and_doc_bins(tmp_path, monkeypatch):
+    _install_fake_ocr(tmp_path, monkeypatch)
+    sheets = {}
+    for folder, company in [("a", "ACME"), ("b", "Budex")]:
+        (tmp_path / folder).mkdir()
+        (tmp_path / folder / "rozpiska.xlsx").write_text("", encoding="utf-8")
+        (tmp_path / folder / "1.pdf").write_text(
+            f"Umowa z firmą {company}", encoding="utf-8"
+        )
+        sheets[folder] = [
+            {"Nazwa Pliku": "1.pdf", "Nadawca": company, "Data": None},
+            {"Nazwa Pliku": "brak.pdf", "Nadawca": company},
+        ]
+    monkeypatch.setattr(training_engine, "pd", FakePandas(sheets))
+    calls = []
+    real_stream = training_engine.run_cpp_ocr_stream
+    monkeypatch.setattr(
+        training_engine,
+        "run_cpp_ocr_stream",
+        lambda paths, **kw: calls.append(list(paths)) or real_stream(paths, **kw),
+    )
+    spacy_paths = (str(tmp_path / "train"), str(tmp_path / "dev"))
+    # Każdy dokument w osobnym pliku korpusu, zapisanym od razu
+    monkeypatch.setattr(training_engine, "DOC_BIN_CHUNK", 1)
+
+    jsonl = training_engine.create_training_data_from_sheets(
+        str(tmp_path), lambda msg: None, spacy_paths
+    )
+
+    assert len(calls) == 1 and len(calls[0]) == 2
+    records = [json.loads(l) for l in open(jsonl, encoding="utf-8")]
+    os.remove(jsonl)
+    assert sorted(r["text"] for r in records) == ["Umowa z firmą ACME", "Umowa z firmą Budex"]
+    for record in records:
+        labels = {label for _, _, label in record["label"]}
+        assert labels == {"ORGANIZACJA", "TYP_DOKUMENTU"}
+    chunks = [f for p in spacy_paths for f in Path(p).glob("*.spacy")]
+    docs = [d for f in chunks for d in json.load(open(f, encoding="utf-8"))]
+    assert len(docs) == len(chunks) == 2
+    # Dwa dokumenty: jeden w train, jeden w dev, jak przy podziale całości
+    assert [len(list(Path(p).glob("*.spacy"))) for p in spacy_paths] == [1, 1]
+
+
+def test_streamed_split_keeps_80_20_proportion_of_every_prefix():
+    dev = 0
+    for count in range(1, 101):
+        dev += training_engine._goes_to_dev(count, dev)
+        assert dev == (0 if count == 1 else count - int(count * 0.8))
+
+
+def test_crashed_ocr_is_reported_with_missing_files(tmp_path, monkeypatch):
+    _install_fake_ocr(tmp_path, monkeypatch, FAKE_CRASH_OCR)
+    (tmp_path / "a").mkdir()
+    (tmp_path / "a" / "rozpiska.xlsx").write_text("", encoding="utf-8")
+    for name in ("1.pdf", "2.pdf"):
+        (tmp_path / "a" / name).write_text("Umowa z firmą ACME", encoding="utf-8")
+    sheets = {"a": [{"Nazwa Pliku": n, "Nadawca": "ACME"} for n in ("1.pdf", "2.pdf")]}
+    monkeypatch.setattr(training_engine, "pd", FakePandas(sheets))
+
+    stream = training_engine.run_cpp_ocr_stream([str(tmp_path / "a" / "1.pdf")] * 2)
+    assert next(stream)[0] == 0
+    with pytest.raises(training_engine.OcrEngineError, match="kodem 3, brak wyników dla 1 z 2"):
+        next(stream)
+
+    log = []
+    jsonl = training_engine.create_training_data_from_sheets(str(tmp_path), log.append)
+    os.remove(jsonl)
+    assert any("Błąd OCR w module C++" in msg for msg in log)
+    assert "  !! Brak wyniku OCR dla pliku: 2.pdf" in log
+
+
+def test_training_data_stops_on_cancel_and_logs_pages(tmp_path, monkeypatch):
+    _install_fake_ocr(tmp_path, monkeypatch, FAKE_CANCEL_OCR)
+    (tmp_path / "a").mkdir()
+    (tmp_path / "a" / "rozpiska.xlsx").write_text("", encoding="utf-8")
+    for name in ("1.pdf", "2.pdf"):
+        (tmp_path / "a" / name).write_text("Umowa z firmą ACME", encoding="utf-8")
+    sheets = {"a": [{"Nazwa Pliku": n, "Nadawca": "ACME"} for n in ("1.pdf", "2.pdf")]}
+    monkeypatch.setattr(training_engine, "pd", FakePandas(sheets))
+    cancel = threading.Event()
+    log = []
+
+    def on_log(message):
+        log.append(message)
+        if "Przetwarzanie pliku" in message:
+            # Drugi plik jest wciąż rozpoznawany
+            cancel.set()
+
+    jsonl = training_engine.create_training_data_from_sheets(
+        str(tmp_path), on_log, cancel_event=cancel
+    )
+
+    assert jsonl is None
+    assert "     1.pdf: strona 1/1" in log
+    assert log[-1] == "Przerwano przygotowanie danych treningowych."
+    assert Path(tmp_path / "a" / "2.pdf.anulowano").exists()
+    assert not (tmp_path / "temp_training_data.jsonl").exists()
@@ -0,0 +1,49 @@
+from pathlib import Path
+import sys
+import zipfile
+from xml.etree import ElementTree as ET
+
+BASE_DIR = Path(__file__).resolve().parents[1] / "2_Aplikacja_Glowna"
+sys.path.insert(0, str(BASE_DIR))
+
+from xlsx_writer import CellStyle, XlsxWriter, column_letter
+
+NS = {"m": "http://schemas.openxmlformats.org/spreadsheetml/2006/main"}
+
+
+def test_shared_strings_and_styles_are_deduplicated(tmp_path):
+    path = tmp_path / "out.xlsx"
+    row_style = CellStyle(fill="F0F0F0", border=True, wrap=True)
+    with XlsxWriter(path, freeze_header=True) as xlsx:
+        xlsx.write_row(["Lp.", "Nazwa"], CellStyle(bold=True, fill="D9D9D9", border=True))
+        for i in range(600):
+            xlsx.write_row([str(i % 3), " a & <b>\x01"], row_style)
+
+    with zipfile.ZipFile(path) as zf:
+        parts = {name: ET.fromstring(zf.read(name)) for name in zf.namelist() if name.endswith(".xml")}
+    sst = parts["xl/sharedStrings.xml"]
+    texts = [t.text for t in sst.iterfind("m:si/m:t", NS)]
+    assert texts == ["Lp.", "Nazwa", "0", " a & <b>", "1", "2"]
+    assert sst.get("count") == str(2 + 2 * 600)
+
+    xfs = parts["xl/styles.xml"].find("m:cellXfs", NS)
+    assert xfs.get("count") == "3"
+
+    sheet = parts["xl/worksheets/sheet1.xml"]
+    rows = sheet.findall("m:sheetData/m:row", NS)
+    assert len(rows) == 601
+    assert {c.get("s") for c in rows[-1]} == {"2"}
+    widths = [float(c.get("width")) for c in sheet.iterfind("m:cols/m:col", NS)]
+    assert widths == [5, 11]
+
+
+def test_empty_styled_cells_and_column_letters(tmp_path):
+    path = tmp_path / "out.xlsx"
+    with XlsxWriter(path) as xlsx:
+        xlsx.write_row(["x", "", None], [None, CellStyle(border=True), None])
+
+    with zipfile.ZipFile(path) as zf:
+        sheet = zf.read("xl/worksheets/sheet1.xml").decode("utf-8")
+    assert '<c r="B1" s="1"/>' in sheet
+    assert 'r="C1"' not in sheet
+    assert [column_letter(i) for i in (1, 26, 27, 702, 703)] == ["A", "Z", "AA", "ZZ", "AAA"]